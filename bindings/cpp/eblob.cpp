@@ -18,6 +18,8 @@
 #include <unistd.h>
 #include <string.h>
 
+#include <memory>
+
 #include <eblob/eblob.hpp>
 
 using namespace ioremap::eblob;
@@ -190,6 +192,121 @@ void eblob::remove(const struct eblob_key &key)
 	}
 }
 
+static std::exception_ptr async_error(const char *op, const struct eblob_key *key, int err)
+{
+	std::ostringstream str;
+	str << "EBLOB: " << eblob_dump_id(key->id) << ": eblob " << op << " failed: " << strerror(-err);
+	return std::make_exception_ptr(std::runtime_error(str.str()));
+}
+
+static void read_async_complete(struct eblob_key *key, int err, char *data, uint64_t size, void *priv)
+{
+	std::unique_ptr<std::promise<std::string>> promise(static_cast<std::promise<std::string> *>(priv));
+
+	if (err) {
+		promise->set_exception(async_error("async read", key, err));
+		return;
+	}
+
+	try {
+		std::string ret(data, size);
+		free(data);
+		data = nullptr;
+		promise->set_value(std::move(ret));
+	} catch (...) {
+		free(data);
+		promise->set_exception(std::current_exception());
+	}
+}
+
+std::future<std::string> eblob::read_async(const struct eblob_key &key, const uint64_t offset,
+		const uint64_t size, enum eblob_read_flavour csum)
+{
+	std::unique_ptr<std::promise<std::string>> promise(new std::promise<std::string>());
+	std::future<std::string> ret = promise->get_future();
+
+	int err = eblob_read_async(eblob_, (struct eblob_key *)&key, offset, size, csum,
+			read_async_complete, promise.get());
+	if (err) {
+		std::ostringstream str;
+		str << "EBLOB: " << eblob_dump_id(key.id) << ": eblob async read failed: offset: "
+			<< offset << ", size: " << size << ": " << strerror(-err);
+		throw std::runtime_error(str.str());
+	}
+
+	/* Owned by completion from now on */
+	promise.release();
+	return ret;
+}
+
+/* Keeps written data alive until request is completed */
+struct write_async_context {
+	std::promise<void>	promise;
+	std::string		data;
+};
+
+static void write_async_complete(struct eblob_key *key, int err, struct eblob_write_control *, void *priv)
+{
+	std::unique_ptr<write_async_context> ctx(static_cast<write_async_context *>(priv));
+
+	if (err)
+		ctx->promise.set_exception(async_error("async write", key, err));
+	else
+		ctx->promise.set_value();
+}
+
+std::future<void> eblob::write_async(const struct eblob_key &key, const std::string &data,
+		const uint64_t offset, uint64_t flags)
+{
+	std::unique_ptr<write_async_context> ctx(new write_async_context());
+	ctx->data = data;
+	std::future<void> ret = ctx->promise.get_future();
+
+	struct eblob_iovec iov;
+	iov.base = (void *)ctx->data.data();
+	iov.size = ctx->data.size();
+	iov.offset = offset;
+
+	int err = eblob_writev_async(eblob_, (struct eblob_key *)&key, &iov, 1, flags,
+			write_async_complete, ctx.get());
+	if (err) {
+		std::ostringstream str;
+		str << "EBLOB: " << eblob_dump_id(key.id) << ": eblob async write failed: offset: "
+			<< offset << ", size: " << data.size() << ", flags: " << flags << ": " << strerror(-err);
+		throw std::runtime_error(str.str());
+	}
+
+	ctx.release();
+	return ret;
+}
+
+static void remove_async_complete(struct eblob_key *key, int err, void *priv)
+{
+	std::unique_ptr<std::promise<void>> promise(static_cast<std::promise<void> *>(priv));
+
+	if (err)
+		promise->set_exception(async_error("async remove", key, err));
+	else
+		promise->set_value();
+}
+
+std::future<void> eblob::remove_async(const struct eblob_key &key)
+{
+	std::unique_ptr<std::promise<void>> promise(new std::promise<void>());
+	std::future<void> ret = promise->get_future();
+
+	int err = eblob_remove_async(eblob_, (struct eblob_key *)&key, remove_async_complete, promise.get());
+	if (err) {
+		std::ostringstream str;
+		str << "EBLOB: " << eblob_dump_id(key.id) << ": eblob async remove failed: "
+			<< strerror(-err);
+		throw std::runtime_error(str.str());
+	}
+
+	promise.release();
+	return ret;
+}
+
 unsigned long long eblob::elements(void)
 {
 	return eblob_total_elements(eblob_);
@@ -309,11 +309,44 @@ static inline void eblob_convert_disk_control(struct eblob_disk_control *ctl)
  */
 #define EBLOB_AUTO_INDEXSORT			(1<<11)
 
+/*
+ * Use open-addressing hash table instead of rb-tree for in-memory index.
+ * It is faster on lookup and has no per-entry allocations, but
+ * range requests are not supported with it.
+ * Mutually exclusive with EBLOB_L2HASH.
+ */
+#define EBLOB_FLATHASH				(1<<12)
+
+/*
+ * Use blocked bloom filter for sorted bases: all bits of a key are in one
+ * cache line and filter is sized by @bloom_false_positive_ppm instead of
+ * @index_block_bloom_length.
+ */
+#define EBLOB_BLOCKED_BLOOM			(1<<13)
+
+/*
+ * Keep backend-wide table of live keys of sorted bases, so disk lookup
+ * checks only bases that may hold the key and answers miss without
+ * touching any base.
+ */
+#define EBLOB_KEY_LOCATOR			(1<<14)
+
+/*
+ * Save bloom filter, index blocks and counters of every sorted base to
+ * .index.meta file next to its sorted index and load them from it on
+ * startup instead of reading whole sorted index.
+ */
+#define EBLOB_INDEX_META			(1<<15)
+
 struct eblob_config {
 	/* blob flags above */
 	unsigned int		blob_flags;
 
-	/* sync interval in seconds */
+	/*
+	 * sync interval in seconds
+	 * 0 means every write is synced before it returns, syncs of
+	 * concurrent writers are grouped together by background thread
+	 */
 	int			sync;
 
 	/* logger */
@@ -426,8 +459,42 @@ struct eblob_config {
 	int			bg_ioprio_class;  // one of IOPRIO_CLASS_*
 	int			bg_ioprio_data; // priority level within @bg_ioprio_class
 
+	/*
+	 * Number of partitions of in-memory index, each with its own lock.
+	 * Rounded up to power of two.
+	 * Default: 16
+	 */
+	unsigned int		cache_shards;
+
+	/*
+	 * Number of threads that process asynchronous requests
+	 * (eblob_read_async() etc.) and open and load bases on startup.
+	 * Default: 4
+	 */
+	unsigned int		io_threads;
+
+	/*
+	 * Target false positive rate of blocked bloom filter (EBLOB_BLOCKED_BLOOM)
+	 * in parts per million.
+	 * Default: 1000 (0.1%)
+	 */
+	unsigned int		bloom_false_positive_ppm;
+
+	/*
+	 * Number of chunks sorted concurrently by datasort.
+	 * Default: 2
+	 */
+	unsigned int		datasort_threads;
+
+	/*
+	 * Limit on disk traffic of datasort in bytes per second, shared by
+	 * all its threads. Data copied by split, sort and merge steps is counted.
+	 * Default: 0 (unlimited)
+	 */
+	uint64_t		datasort_io_limit;
+
 	/* for future use */
-	uint64_t		__pad_64[8];
+	uint64_t		__pad_64[5];
 	int			__pad_int[3];
 	char			__pad_char[8];
 	void			*__pad_voidp[7];
@@ -457,7 +524,8 @@ struct eblob_iterate_callbacks {
 						struct eblob_ram_control *ctl,
 						int fd, uint64_t data_offset, void *priv, void *thread_priv);
 
-	/* Initialization callback. This function is called in main thread before iterations.
+	/* Initialization callback. This function is called in main thread before iterations
+	 * once for every iteration thread.
 	 * Main purpose of this callback is @thread_priv initialization.
 	 */
 	int				(* iterator_init)(struct eblob_iterate_control *ctl, void **thread_priv);
@@ -468,14 +536,29 @@ struct eblob_iterate_callbacks {
 	 */
 	int				(* iterator_free)(struct eblob_iterate_control *ctl, void **thread_priv);
 
-	/* for future use */
-	int				reserved;
+	/* Data-order iterator callback. If it is set and EBLOB_ITERATE_FLAGS_DATA_ORDER
+	 * is used, it is called instead of @iterator.
+	 * @data points to @size bytes of the record that follow its header in the blob:
+	 * @dc->data_size bytes of data and the footer. It is a part of iterator's read
+	 * buffer and is valid only during the call.
+	 * Records larger than the read buffer are passed to @iterator, so it has to be set too.
+	 */
+	int				(* iterator_data)(struct eblob_disk_control *dc,
+						struct eblob_ram_control *ctl,
+						const void *data, uint64_t size, void *priv, void *thread_priv);
 };
 
 #define EBLOB_ITERATE_FLAGS_ALL			(1<<0)	/* iterate over all blobs, not only the last one */
 #define EBLOB_ITERATE_FLAGS_READONLY		(1<<1)	/* do not modify entries while iterating a blob */
 #define EBLOB_ITERATE_FLAGS_INITIAL_LOAD	(1<<2)	/* set on initial load */
 #define EBLOB_ITERATE_FLAGS_VERIFY_CHECKSUM	(1<<3)	/* verify checksum for entries while iterating a blob */
+/*
+ * Visit records in order of their data in the blob and read the blob in large sequential windows.
+ * Works only with EBLOB_ITERATE_FLAGS_ALL, base is iterated by one thread then.
+ */
+#define EBLOB_ITERATE_FLAGS_DATA_ORDER		(1<<4)
+/* callback reads record data from @fd, it is prefetched together with index batch */
+#define EBLOB_ITERATE_FLAGS_PREFETCH_DATA	(1<<5)
 
 /**
  * Structure which controls which keys should be iterated over.
@@ -502,8 +585,14 @@ struct eblob_iterate_control {
 
 	struct eblob_base_ctl		*base;
 
-	/* for future use */
-	int				reserved;
+	/*
+	 * Number of threads iterating each base, every thread gets its own part
+	 * of the index and its own @thread_priv. 0 or 1 means that base is
+	 * iterated by the calling thread. Ignored unless EBLOB_ITERATE_FLAGS_ALL
+	 * is set, since otherwise iterator truncates the base after the last
+	 * valid record.
+	 */
+	int				thread_num;
 
 	int				err;
 
@@ -594,6 +683,78 @@ int eblob_plain_write(struct eblob_backend *b, struct eblob_key *key,
 int eblob_plain_writev(struct eblob_backend *b, struct eblob_key *key,
 		const struct eblob_iovec *iov, uint16_t iovcnt, uint64_t flags);
 
+/* One record of eblob_writev_batch() */
+struct eblob_write_batch {
+	struct eblob_key		key;
+	const struct eblob_iovec	*iov;
+	uint16_t			iovcnt;
+	uint64_t			flags;
+};
+
+/*
+ * Batched write: writes @num records as if eblob_writev() was called for each
+ * of them in order, result of i-th record is stored in @errors[i].
+ *
+ * New keys written as a whole (iovecs start at zero and are contiguous, no
+ * BLOB_DISK_CTL_APPEND) are put one after another into the last base and,
+ * once it is full, into new ones. Within one base space for the records is
+ * reserved at once, their index entries are appended with one write, headers,
+ * data and footers are written with one pwritev(2) and synced once, and keys
+ * are put into cache taking each shard lock once. All other records
+ * (overwrites, appends, keys that occur in batch more than once) are written
+ * one by one.
+ *
+ * Returns negative error value if batch could not be processed at all,
+ * zero otherwise.
+ */
+int eblob_writev_batch(struct eblob_backend *b, const struct eblob_write_batch *batch,
+		size_t num, int *errors);
+
+/*
+ * Asynchronous API.
+ *
+ * Requests are queued and taken in FIFO order by a pool of internal I/O
+ * threads (see @io_threads in eblob_config) with the same semantics as their
+ * synchronous counterparts. Requests taken by different threads run
+ * concurrently, so callbacks are called in order of queueing only if there is
+ * one I/O thread. Completion callback is called on one of I/O threads, never
+ * on the caller's one, with result of the request, so it should not block for
+ * long: the thread does not take other requests meanwhile. @key passed to
+ * callback is a copy of the original one.
+ *
+ * Functions return zero if request is queued and negative error otherwise,
+ * callback is not called in that case. The queue is bounded, -EAGAIN is
+ * returned if it is full and the request should be retried after some of
+ * queued ones are completed. If backend is started with EBLOB_DISABLE_THREADS,
+ * request is processed and callback is called by the caller before function
+ * returns. Requests queued before eblob_cleanup() are completed by it.
+ */
+
+/*
+ * @data is allocated by library and must be freed by callback with free(3),
+ * it is NULL on error.
+ */
+typedef void (*eblob_read_completion_t)(struct eblob_key *key, int err,
+		char *data, uint64_t size, void *priv);
+/* @wc is valid only during the call */
+typedef void (*eblob_write_completion_t)(struct eblob_key *key, int err,
+		struct eblob_write_control *wc, void *priv);
+typedef void (*eblob_remove_completion_t)(struct eblob_key *key, int err, void *priv);
+
+/* Reads like eblob_read_data(): at most @size bytes (whole record if zero) from @offset */
+int eblob_read_async(struct eblob_backend *b, struct eblob_key *key,
+		uint64_t offset, uint64_t size, enum eblob_read_flavour csum,
+		eblob_read_completion_t complete, void *priv);
+/*
+ * Writes like eblob_writev_return().
+ * Array @iov is copied, but data it points to must be valid until completion.
+ */
+int eblob_writev_async(struct eblob_backend *b, struct eblob_key *key,
+		const struct eblob_iovec *iov, uint16_t iovcnt, uint64_t flags,
+		eblob_write_completion_t complete, void *priv);
+int eblob_remove_async(struct eblob_backend *b, struct eblob_key *key,
+		eblob_remove_completion_t complete, void *priv);
+
 /*
  * The same as above, but these functions take key/ksize pair to hash using sha512 to
  * generate key ID.
@@ -721,6 +882,7 @@ enum eblob_stat_global_flavour {
 	EBLOB_GST_INDEX_READS,
 	EBLOB_GST_DATASORT_COMPLETION_TIME,
 	EBLOB_GST_DATASORT_COMPLETION_STATUS,
+	EBLOB_GST_LOCATOR_SIZE,
 	EBLOB_GST_MAX,
 };
 
@@ -847,6 +1009,10 @@ static inline const char *eblob_dump_blob_flags(unsigned int flags) {
 		{ EBLOB_SCHEDULED_DATASORT,		"scheduled_datasort"},
 		{ EBLOB_DISABLE_THREADS,		"disabled_threads"},
 		{ EBLOB_AUTO_INDEXSORT,			"auto_indexsort"},
+		{ EBLOB_FLATHASH,			"flathash"},
+		{ EBLOB_BLOCKED_BLOOM,			"blocked_bloom"},
+		{ EBLOB_KEY_LOCATOR,			"key_locator"},
+		{ EBLOB_INDEX_META,			"index_meta"},
 	};
 
 	eblob_dump_flags_raw(buffer, sizeof(buffer), flags, infos, sizeof(infos) / sizeof(infos[0]));
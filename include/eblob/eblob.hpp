@@ -18,6 +18,7 @@
 
 #include <stdio.h>
 
+#include <future>
 #include <iostream>
 #include <string>
 #include <sstream>
@@ -105,6 +106,17 @@ class eblob {
 		void remove(const struct eblob_key &key);
 		void remove_hashed(const std::string &key);
 
+		/*
+		 * Asynchronous variants, requests are processed by I/O threads of the backend.
+		 * They throw if request can not be queued (e.g. queue is full), errors of request itself
+		 * are stored in the returned future.
+		 */
+		std::future<std::string> read_async(const struct eblob_key &key, const uint64_t offset,
+				const uint64_t size, enum eblob_read_flavour csum = EBLOB_READ_CSUM);
+		std::future<void> write_async(const struct eblob_key &key, const std::string &data,
+				const uint64_t offset = 0, uint64_t flags = 0);
+		std::future<void> remove_async(const struct eblob_key &key);
+
 		unsigned long long elements(void);
 
 		void remove_blobs(void);
@@ -0,0 +1,314 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "features.h"
+
+#include "blob.h"
+#include "async.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * eblob_async_thread() - I/O thread.
+ * Takes requests one by one until executor is stopped and queue is drained.
+ */
+static void *eblob_async_thread(void *data)
+{
+	struct eblob_backend *b = data;
+	struct eblob_async *a = &b->async;
+	struct eblob_async_request *req;
+
+	eblob_set_name("io_%u", b->cfg.stat_id);
+
+	pthread_mutex_lock(&a->lock);
+	for (;;) {
+		while (list_empty(&a->requests) && !a->need_exit)
+			pthread_cond_wait(&a->queued, &a->lock);
+
+		if (list_empty(&a->requests))
+			break;
+
+		req = list_first_entry(&a->requests, struct eblob_async_request, list);
+		list_del(&req->list);
+		a->queued_num--;
+		pthread_mutex_unlock(&a->lock);
+
+		req->process(b, req);
+
+		pthread_mutex_lock(&a->lock);
+	}
+	pthread_mutex_unlock(&a->lock);
+
+	return NULL;
+}
+
+static void eblob_async_stop(struct eblob_async *a)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&a->lock);
+	a->need_exit = 1;
+	pthread_cond_broadcast(&a->queued);
+	pthread_mutex_unlock(&a->lock);
+
+	for (i = 0; i < a->num; ++i)
+		pthread_join(a->tids[i], NULL);
+	a->num = 0;
+}
+
+int eblob_async_init(struct eblob_backend *b)
+{
+	struct eblob_async *a = &b->async;
+	unsigned int i, num;
+	int err;
+
+	memset(a, 0, sizeof(*a));
+	INIT_LIST_HEAD(&a->requests);
+
+	err = eblob_mutex_init(&a->lock);
+	if (err != 0)
+		goto err_out_exit;
+
+	err = eblob_cond_init(&a->queued);
+	if (err != 0)
+		goto err_out_mutex_destroy;
+
+	/* Requests are processed by caller if there is nobody to do it in background */
+	if (b->cfg.blob_flags & EBLOB_DISABLE_THREADS)
+		return 0;
+
+	num = b->cfg.io_threads;
+	a->queue_limit = num * EBLOB_ASYNC_QUEUE_PER_THREAD;
+	a->tids = calloc(num, sizeof(pthread_t));
+	if (a->tids == NULL) {
+		err = -ENOMEM;
+		goto err_out_cond_destroy;
+	}
+
+	for (i = 0; i < num; ++i) {
+		err = pthread_create(&a->tids[i], NULL, eblob_async_thread, b);
+		if (err) {
+			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: eblob I/O thread creation failed: %d.\n", err);
+			err = -err;
+			goto err_out_stop;
+		}
+		a->num++;
+	}
+
+	return 0;
+
+err_out_stop:
+	eblob_async_stop(a);
+	free(a->tids);
+err_out_cond_destroy:
+	pthread_cond_destroy(&a->queued);
+err_out_mutex_destroy:
+	pthread_mutex_destroy(&a->lock);
+err_out_exit:
+	return err;
+}
+
+void eblob_async_destroy(struct eblob_backend *b)
+{
+	struct eblob_async *a = &b->async;
+
+	eblob_async_stop(a);
+	free(a->tids);
+	a->tids = NULL;
+
+	pthread_cond_destroy(&a->queued);
+	pthread_mutex_destroy(&a->lock);
+}
+
+int eblob_async_queue(struct eblob_backend *b, struct eblob_async_request *req)
+{
+	struct eblob_async *a = &b->async;
+	int err = 0;
+
+	pthread_mutex_lock(&a->lock);
+	if (a->need_exit) {
+		err = -ESHUTDOWN;
+	} else if (a->num && a->queued_num >= a->queue_limit) {
+		err = -EAGAIN;
+	} else if (a->num) {
+		list_add_tail(&req->list, &a->requests);
+		a->queued_num++;
+		pthread_cond_signal(&a->queued);
+	}
+	pthread_mutex_unlock(&a->lock);
+
+	if (err == 0 && !a->num)
+		req->process(b, req);
+
+	return err;
+}
+
+struct eblob_read_request {
+	struct eblob_async_request	req;
+	struct eblob_key		key;
+	uint64_t			offset;
+	uint64_t			size;
+	enum eblob_read_flavour		csum;
+	eblob_read_completion_t		complete;
+	void				*priv;
+};
+
+static void eblob_read_process(struct eblob_backend *b, struct eblob_async_request *r)
+{
+	struct eblob_read_request *req = container_of(r, struct eblob_read_request, req);
+	char *data = NULL;
+	uint64_t size = req->size;
+	int err;
+
+	if (req->csum == EBLOB_READ_NOCSUM)
+		err = eblob_read_data_nocsum(b, &req->key, req->offset, &data, &size);
+	else
+		err = eblob_read_data(b, &req->key, req->offset, &data, &size);
+
+	if (err)
+		req->complete(&req->key, err, NULL, 0, req->priv);
+	else
+		req->complete(&req->key, 0, data, size, req->priv);
+
+	free(req);
+}
+
+int eblob_read_async(struct eblob_backend *b, struct eblob_key *key,
+		uint64_t offset, uint64_t size, enum eblob_read_flavour csum,
+		eblob_read_completion_t complete, void *priv)
+{
+	struct eblob_read_request *req;
+	int err;
+
+	if (b == NULL || key == NULL || complete == NULL)
+		return -EINVAL;
+
+	req = calloc(1, sizeof(struct eblob_read_request));
+	if (req == NULL)
+		return -ENOMEM;
+
+	req->req.process = eblob_read_process;
+	req->key = *key;
+	req->offset = offset;
+	req->size = size;
+	req->csum = csum;
+	req->complete = complete;
+	req->priv = priv;
+
+	err = eblob_async_queue(b, &req->req);
+	if (err)
+		free(req);
+	return err;
+}
+
+struct eblob_writev_request {
+	struct eblob_async_request	req;
+	struct eblob_key		key;
+	uint64_t			flags;
+	struct eblob_write_control	wc;
+	eblob_write_completion_t	complete;
+	void				*priv;
+	uint16_t			iovcnt;
+	/* Copy of caller's iovecs, data they point to is not copied */
+	struct eblob_iovec		iov[];
+};
+
+static void eblob_writev_process(struct eblob_backend *b, struct eblob_async_request *r)
+{
+	struct eblob_writev_request *req = container_of(r, struct eblob_writev_request, req);
+	int err;
+
+	err = eblob_writev_return(b, &req->key, req->iov, req->iovcnt, req->flags, &req->wc);
+	req->complete(&req->key, err, &req->wc, req->priv);
+
+	free(req);
+}
+
+int eblob_writev_async(struct eblob_backend *b, struct eblob_key *key,
+		const struct eblob_iovec *iov, uint16_t iovcnt, uint64_t flags,
+		eblob_write_completion_t complete, void *priv)
+{
+	struct eblob_writev_request *req;
+	int err;
+
+	if (b == NULL || key == NULL || iov == NULL || complete == NULL)
+		return -EINVAL;
+
+	req = calloc(1, sizeof(struct eblob_writev_request) + iovcnt * sizeof(struct eblob_iovec));
+	if (req == NULL)
+		return -ENOMEM;
+
+	req->req.process = eblob_writev_process;
+	req->key = *key;
+	req->flags = flags;
+	req->complete = complete;
+	req->priv = priv;
+	req->iovcnt = iovcnt;
+	memcpy(req->iov, iov, iovcnt * sizeof(struct eblob_iovec));
+
+	err = eblob_async_queue(b, &req->req);
+	if (err)
+		free(req);
+	return err;
+}
+
+struct eblob_remove_request {
+	struct eblob_async_request	req;
+	struct eblob_key		key;
+	eblob_remove_completion_t	complete;
+	void				*priv;
+};
+
+static void eblob_remove_process(struct eblob_backend *b, struct eblob_async_request *r)
+{
+	struct eblob_remove_request *req = container_of(r, struct eblob_remove_request, req);
+	int err;
+
+	err = eblob_remove(b, &req->key);
+	req->complete(&req->key, err, req->priv);
+
+	free(req);
+}
+
+int eblob_remove_async(struct eblob_backend *b, struct eblob_key *key,
+		eblob_remove_completion_t complete, void *priv)
+{
+	struct eblob_remove_request *req;
+	int err;
+
+	if (b == NULL || key == NULL || complete == NULL)
+		return -EINVAL;
+
+	req = calloc(1, sizeof(struct eblob_remove_request));
+	if (req == NULL)
+		return -ENOMEM;
+
+	req->req.process = eblob_remove_process;
+	req->key = *key;
+	req->complete = complete;
+	req->priv = priv;
+
+	err = eblob_async_queue(b, &req->req);
+	if (err)
+		free(req);
+	return err;
+}
@@ -0,0 +1,89 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Executor of asynchronous requests.
+ *
+ * Requests of eblob_*_async() are queued and processed in FIFO order by a
+ * pool of I/O threads, each request is processed by the ordinary synchronous
+ * call and its completion callback is called from the I/O thread.
+ * Queue is bounded to keep memory of requests and latency of their
+ * processing limited when callers produce them faster than disk serves.
+ */
+
+#ifndef __EBLOB_ASYNC_H
+#define __EBLOB_ASYNC_H
+
+#include <stddef.h>
+
+#include "list.h"
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of queued and not yet taken requests per I/O thread */
+#define EBLOB_ASYNC_QUEUE_PER_THREAD	(256)
+
+struct eblob_backend;
+struct eblob_async_request;
+
+/* Processes request, calls its completion and frees it */
+typedef void (*eblob_async_process_t)(struct eblob_backend *b, struct eblob_async_request *req);
+
+struct eblob_async_request {
+	struct list_head	list;
+	eblob_async_process_t	process;
+};
+
+struct eblob_async {
+	/* Protects @requests, @queued_num and @need_exit */
+	pthread_mutex_t		lock;
+	/* Signalled when request is queued or threads should exit */
+	pthread_cond_t		queued;
+	struct list_head	requests;
+	/* Number of requests in @requests and its limit */
+	unsigned int		queued_num;
+	unsigned int		queue_limit;
+	int			need_exit;
+	/* Number of running I/O threads, requests are processed by caller if zero */
+	unsigned int		num;
+	pthread_t		*tids;
+};
+
+/* Initializes executor and starts I/O threads if threads are allowed */
+int eblob_async_init(struct eblob_backend *b);
+/* Processes all queued requests, stops I/O threads and rejects new requests */
+void eblob_async_destroy(struct eblob_backend *b);
+
+/*
+ * Queues @req to be processed by one of I/O threads.
+ * Returns -EAGAIN if queue is full and -ESHUTDOWN if executor is stopped,
+ * @req is not freed then.
+ */
+int eblob_async_queue(struct eblob_backend *b, struct eblob_async_request *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EBLOB_ASYNC_H */
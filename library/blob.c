@@ -58,6 +58,69 @@
 struct eblob_iterate_priv {
 	struct eblob_iterate_control *ctl;
 	void *thread_priv;
+	/* Part of the index [index_offset, index_end) iterated by the thread */
+	unsigned long long index_offset, index_end;
+	/* Range the thread starts from, see eblob_fill_range_offsets() */
+	int current_range_index;
+	/* Shared by all threads of the base, set when one of them fails */
+	int *stop;
+	/* Checksum verification workers of the thread, all threads share eblob_worker_threads() */
+	unsigned int verify_threads;
+};
+
+/*
+ * Part of blob read by data-order iteration, records that fit into it are
+ * passed to callback straight from the buffer.
+ */
+struct eblob_iterate_window {
+	char				*buf;
+	uint64_t			size;
+	/* Position of @buf in blob and number of bytes read into it */
+	uint64_t			offset, len;
+};
+
+/* Result of record which is not verified yet */
+#define EBLOB_ITERATE_VERIFY_PENDING	1
+
+struct eblob_iterate_verify;
+
+struct eblob_iterate_verify_worker {
+	struct eblob_iterate_verify	*verify;
+	pthread_t			tid;
+	char				*buf;
+};
+
+/*
+ * Verification stage of iteration with EBLOB_ITERATE_FLAGS_VERIFY_CHECKSUM.
+ * Worker threads are started once per iteration thread, which gets its part
+ * of eblob_worker_threads(), and take records of
+ * batches queued by iterator thread. Checksums of records of the batch are
+ * verified by them while iterator thread passes already verified records to
+ * callback, so it waits only for records which are not verified yet.
+ */
+struct eblob_iterate_verify {
+	struct eblob_iterate_control	*ctl;
+	/* Protects everything below */
+	pthread_mutex_t			lock;
+	/* Signaled when result of record is ready or worker is done with the batch */
+	pthread_cond_t			cond;
+	/* Signaled when batch is queued or workers should exit */
+	pthread_cond_t			work;
+	/* Converted copy of the batch, iterator thread converts its one in place */
+	struct eblob_disk_control	*dc;
+	int				*results;
+	long long			index_offset;
+	/* Number of records in the batch and the next one to be taken by worker */
+	int				num, next;
+	/* Number of workers verifying records of the batch right now */
+	int				busy;
+	int				exit;
+	/*
+	 * Number of workers and number of running ones, if none is running,
+	 * records are verified by iterator thread through buffer of the first one.
+	 */
+	unsigned int			threads, started;
+	struct eblob_iterate_verify_worker	*workers;
 };
 
 struct eblob_iterate_local {
@@ -65,6 +128,10 @@ struct eblob_iterate_local {
 	struct eblob_disk_control	*dc, *last_valid_dc;
 	int				num, pos;
 	long long			index_offset, last_valid_offset;
+	/* Set by data-order iteration */
+	struct eblob_iterate_window	*window;
+	/* Set when checksums are verified */
+	struct eblob_iterate_verify	*verify;
 };
 
 /**
@@ -116,6 +183,76 @@ err_out_exit:
 	return err;
 }
 
+struct eblob_parallel_ctl {
+	int		(*func)(void *priv, unsigned int item);
+	void		*priv;
+	unsigned int	num;
+	/* Next item to process */
+	unsigned int	next;
+	/* First error, no new items are taken after it */
+	int		err;
+};
+
+static void *eblob_parallel_thread(void *data)
+{
+	struct eblob_parallel_ctl *p = data;
+	unsigned int item;
+	int err, expected;
+
+	while (__atomic_load_n(&p->err, __ATOMIC_RELAXED) == 0) {
+		item = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED);
+		if (item >= p->num)
+			break;
+
+		err = p->func(p->priv, item);
+		if (err) {
+			expected = 0;
+			__atomic_compare_exchange_n(&p->err, &expected, err, 0,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * eblob_parallel() - calls @func for every item in [0, @num) from up to
+ * @threads threads, calling thread is one of them. Stops taking new items
+ * after the first error and returns it.
+ * If threads can not be created, items are processed by fewer threads.
+ */
+int eblob_parallel(unsigned int threads, unsigned int num,
+		int (*func)(void *priv, unsigned int item), void *priv)
+{
+	struct eblob_parallel_ctl p = {
+		.func = func,
+		.priv = priv,
+		.num = num,
+	};
+	pthread_t *tids = NULL;
+	unsigned int i, started = 0;
+
+	if (threads > num)
+		threads = num;
+
+	if (threads > 1)
+		tids = calloc(threads - 1, sizeof(pthread_t));
+
+	for (i = 0; tids && i < threads - 1; ++i) {
+		if (pthread_create(&tids[i], NULL, eblob_parallel_thread, &p) != 0)
+			break;
+		started++;
+	}
+
+	eblob_parallel_thread(&p);
+
+	for (i = 0; i < started; ++i)
+		pthread_join(tids[i], NULL);
+	free(tids);
+
+	return p.err;
+}
+
 /**
 * eblob_event_init() - Inits the event
 */
@@ -327,7 +464,8 @@ inline static uint64_t eblob_validate_ctl_flags(struct eblob_backend *b, uint64_
 }
 
 /*!
- * Writes all \a iov wrt record position in base
+ * Submits writes of all \a iov wrt record position in base. They are not
+ * waited for, caller must call eblob_write_reap() before \a iov is released.
  */
 static int eblob_writev_raw(struct eblob_key *key, struct eblob_write_control *wc,
 		const struct eblob_iovec *iov, uint16_t iovcnt)
@@ -336,7 +474,9 @@ static int eblob_writev_raw(struct eblob_key *key, struct eblob_write_control *w
 	const uint64_t offset_min = wc->ctl_data_offset + sizeof(struct eblob_disk_control);
 	const uint64_t offset_max = wc->ctl_data_offset + wc->total_size;
 	const struct eblob_iovec *tmp;
-	int err = -EFAULT;
+	struct eblob_io_op ops_buf[EBLOB_URING_ENTRIES], *ops = ops_buf, *op;
+	uint64_t end = 0;
+	int err = -EFAULT, ordered = 0, i;
 
 	assert(wc != NULL);
 	assert(wc->bctl != NULL);
@@ -356,6 +496,12 @@ static int eblob_writev_raw(struct eblob_key *key, struct eblob_write_control *w
 		wc->total_data_size -= iov->size;
 	}
 
+	if (iovcnt > EBLOB_URING_ENTRIES) {
+		ops = malloc(iovcnt * sizeof(struct eblob_io_op));
+		if (ops == NULL)
+			return -ENOMEM;
+	}
+
 	for (tmp = iov; tmp < iov + iovcnt; ++tmp) {
 		uint64_t offset = wc->data_offset + tmp->offset;
 
@@ -374,12 +520,32 @@ static int eblob_writev_raw(struct eblob_key *key, struct eblob_write_control *w
 			goto err_exit;
 		}
 
-		err = __eblob_write_ll(wc->bctl->data_ctl.fd, tmp->base, tmp->size, offset);
-		if (err != 0)
-			goto err_exit;
+		/* Chunk that goes back may overlap earlier ones */
+		if (offset < end)
+			ordered = 1;
+		if (offset + tmp->size > end)
+			end = offset + tmp->size;
+
+		op = &ops[tmp - iov];
+		op->fd = wc->bctl->data_ctl.fd;
+		op->buf = tmp->base;
+		op->size = tmp->size;
+		op->offset = offset;
+	}
+
+	if (ordered) {
+		/* Writes in flight are not ordered, so the last of overlapping chunks must be written last */
+		for (i = 0, err = 0; i < iovcnt && err == 0; ++i)
+			err = eblob_write_chain(&ops[i], 1);
+	} else {
+		/* All chunks of the record are in flight at once */
+		eblob_write_submit(ops, iovcnt);
+		err = 0;
 	}
 
 err_exit:
+	if (ops != ops_buf)
+		free(ops);
 	return err;
 }
 
@@ -557,6 +723,281 @@ int eblob_check_record(const struct eblob_base_ctl *bctl,
 	return 0;
 }
 
+/*
+ * Returns in @data pointer to @size bytes of blob at @position, reads next
+ * window starting at @position if they are not in the current one.
+ * Window is never grown, records larger than it are read by callers from fd.
+ */
+static int eblob_iterate_window_get(struct eblob_iterate_window *w, int fd, uint64_t data_size,
+		uint64_t position, uint64_t size, const char **data)
+{
+	uint64_t len;
+	int err;
+
+	if (size > EBLOB_ITERATE_DATA_WINDOW)
+		return -E2BIG;
+
+	if (position < w->offset || position + size > w->offset + w->len) {
+		len = EBLOB_ITERATE_DATA_WINDOW;
+		if (position + len > data_size)
+			len = (data_size > position) ? data_size - position : 0;
+		if (len < size)
+			len = size;
+
+		if (w->buf == NULL) {
+			w->buf = malloc(EBLOB_ITERATE_DATA_WINDOW);
+			if (w->buf == NULL)
+				return -ENOMEM;
+			w->size = EBLOB_ITERATE_DATA_WINDOW;
+		}
+
+		w->len = 0;
+		err = __eblob_read_ll(fd, w->buf, len, position);
+		if (err)
+			return err;
+		w->offset = position;
+		w->len = len;
+
+		/* Next window is read by kernel while this one is processed */
+		if (position + len < data_size)
+			eblob_pagecache_prefetch(fd, position + len,
+					EBLOB_MIN(EBLOB_ITERATE_DATA_WINDOW, data_size - position - len));
+	}
+
+	*data = w->buf + (position - w->offset);
+	return 0;
+}
+
+/**
+ * eblob_iterate_verify_record() - verifies checksum of record @dc which
+ * index entry is at @index_offset, takes it from @record if it is not NULL,
+ * otherwise reads it through @buf.
+ * Returns zero if record is fine or it can not be verified.
+ */
+static int eblob_iterate_verify_record(struct eblob_base_ctl *bctl, struct eblob_disk_control *dc,
+		long long index_offset, char *buf, size_t size, const char *record)
+{
+	struct eblob_ram_control rc;
+	struct eblob_write_control wc;
+	int err;
+
+	if (dc->flags & (BLOB_DISK_CTL_REMOVE | BLOB_DISK_CTL_UNCOMMITTED))
+		return 0;
+
+	memset(&rc, 0, sizeof(rc));
+	rc.index_offset = index_offset;
+	rc.data_offset = dc->position;
+	rc.size = dc->data_size;
+	rc.bctl = bctl;
+
+	memset(&wc, 0, sizeof(wc));
+	eblob_rctl_to_wc(&rc, &wc);
+	eblob_dc_to_wc(dc, &wc);
+
+	if (record != NULL)
+		err = eblob_verify_checksum_record(bctl->back, &dc->key, &wc, record);
+	else
+		err = eblob_verify_checksum_buffer(bctl->back, &dc->key, &wc, buf, size);
+	if (err)
+		eblob_dump_wc(bctl->back, &dc->key, &wc, "eblob_iterate_verify_record: checksum verification failed", err);
+	return err;
+}
+
+/**
+ * eblob_iterate_verify_one() - verifies @pos record of current batch.
+ */
+static int eblob_iterate_verify_one(struct eblob_iterate_verify *v, int pos, char *buf)
+{
+	struct eblob_base_ctl *bctl = v->ctl->base;
+	struct eblob_disk_control *dc = &v->dc[pos];
+
+	/* Broken records are reported by iterator thread, they can not be verified */
+	if (eblob_check_record(bctl, dc))
+		return 0;
+
+	return eblob_iterate_verify_record(bctl, dc, v->index_offset + pos * sizeof(struct eblob_disk_control),
+			buf, EBLOB_ITERATE_VERIFY_BUFFER, NULL);
+}
+
+static void *eblob_iterate_verify_worker(void *data)
+{
+	struct eblob_iterate_verify_worker *w = data;
+	struct eblob_iterate_verify *v = w->verify;
+	int pos, err;
+
+	eblob_set_name("verify_%u", v->ctl->b->cfg.stat_id);
+
+	pthread_mutex_lock(&v->lock);
+	for (;;) {
+		while (!v->exit && v->next >= v->num)
+			pthread_cond_wait(&v->work, &v->lock);
+		if (v->exit)
+			break;
+
+		pos = v->next++;
+		v->busy++;
+		pthread_mutex_unlock(&v->lock);
+
+		err = eblob_iterate_verify_one(v, pos, w->buf);
+
+		pthread_mutex_lock(&v->lock);
+		v->results[pos] = err;
+		v->busy--;
+		pthread_cond_broadcast(&v->cond);
+	}
+	pthread_mutex_unlock(&v->lock);
+
+	return NULL;
+}
+
+/**
+ * eblob_iterate_verify_init() - allocates verification stage for batches
+ * of at most @batch_size records and starts its @threads workers.
+ * If workers can not be started, records are verified by iterator thread.
+ */
+static int eblob_iterate_verify_init(struct eblob_iterate_verify *v, struct eblob_iterate_control *ctl,
+		int batch_size, unsigned int threads)
+{
+	unsigned int i;
+	int err;
+
+	memset(v, 0, sizeof(*v));
+	v->ctl = ctl;
+	if (!(ctl->b->cfg.blob_flags & EBLOB_DISABLE_THREADS))
+		v->threads = threads;
+
+	err = eblob_mutex_init(&v->lock);
+	if (err)
+		goto err_out_exit;
+
+	err = eblob_cond_init(&v->cond);
+	if (err)
+		goto err_out_mutex_destroy;
+
+	err = eblob_cond_init(&v->work);
+	if (err)
+		goto err_out_cond_destroy;
+
+	v->dc = calloc(batch_size, sizeof(struct eblob_disk_control));
+	v->results = calloc(batch_size, sizeof(int));
+	v->workers = calloc(EBLOB_MAX(v->threads, 1), sizeof(struct eblob_iterate_verify_worker));
+	if (!v->dc || !v->results || !v->workers) {
+		err = -ENOMEM;
+		goto err_out_free;
+	}
+
+	for (i = 0; i < EBLOB_MAX(v->threads, 1); ++i) {
+		v->workers[i].verify = v;
+		v->workers[i].buf = malloc(EBLOB_ITERATE_VERIFY_BUFFER);
+		if (!v->workers[i].buf) {
+			err = -ENOMEM;
+			goto err_out_free;
+		}
+	}
+
+	while (v->started < v->threads) {
+		if (pthread_create(&v->workers[v->started].tid, NULL, eblob_iterate_verify_worker,
+					&v->workers[v->started]) != 0)
+			break;
+		v->started++;
+	}
+
+	return 0;
+
+err_out_free:
+	for (i = 0; v->workers && i < EBLOB_MAX(v->threads, 1); ++i)
+		free(v->workers[i].buf);
+	free(v->workers);
+	free(v->results);
+	free(v->dc);
+	pthread_cond_destroy(&v->work);
+err_out_cond_destroy:
+	pthread_cond_destroy(&v->cond);
+err_out_mutex_destroy:
+	pthread_mutex_destroy(&v->lock);
+err_out_exit:
+	return err;
+}
+
+/**
+ * eblob_iterate_verify_destroy() - stops workers and frees verification stage.
+ */
+static void eblob_iterate_verify_destroy(struct eblob_iterate_verify *v)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&v->lock);
+	v->exit = 1;
+	pthread_cond_broadcast(&v->work);
+	pthread_mutex_unlock(&v->lock);
+
+	for (i = 0; i < v->started; ++i)
+		pthread_join(v->workers[i].tid, NULL);
+
+	for (i = 0; i < EBLOB_MAX(v->threads, 1); ++i)
+		free(v->workers[i].buf);
+	free(v->workers);
+	free(v->results);
+	free(v->dc);
+	pthread_cond_destroy(&v->work);
+	pthread_cond_destroy(&v->cond);
+	pthread_mutex_destroy(&v->lock);
+}
+
+/**
+ * eblob_iterate_verify_start() - queues records of @loc for verification.
+ */
+static void eblob_iterate_verify_start(struct eblob_iterate_verify *v, struct eblob_iterate_local *loc)
+{
+	int i;
+
+	/* Workers are idle since previous batch is stopped */
+	pthread_mutex_lock(&v->lock);
+	for (i = 0; i < loc->num; ++i) {
+		v->dc[i] = loc->dc[i];
+		eblob_convert_disk_control(&v->dc[i]);
+		v->results[i] = EBLOB_ITERATE_VERIFY_PENDING;
+	}
+
+	v->num = loc->num;
+	v->next = 0;
+	v->index_offset = loc->index_offset;
+	pthread_cond_broadcast(&v->work);
+	pthread_mutex_unlock(&v->lock);
+}
+
+/**
+ * eblob_iterate_verify_stop() - waits for workers to finish records of the
+ * batch they have already taken, the rest ones are not verified.
+ */
+static void eblob_iterate_verify_stop(struct eblob_iterate_verify *v)
+{
+	pthread_mutex_lock(&v->lock);
+	v->next = v->num;
+	while (v->busy)
+		pthread_cond_wait(&v->cond, &v->lock);
+	pthread_mutex_unlock(&v->lock);
+}
+
+/**
+ * eblob_iterate_verify_result() - returns result of verification of @pos
+ * record of current batch, waits for it if needed.
+ */
+static int eblob_iterate_verify_result(struct eblob_iterate_verify *v, int pos)
+{
+	int err;
+
+	if (v->started == 0)
+		return eblob_iterate_verify_one(v, pos, v->workers[0].buf);
+
+	pthread_mutex_lock(&v->lock);
+	while ((err = v->results[pos]) == EBLOB_ITERATE_VERIFY_PENDING)
+		pthread_cond_wait(&v->cond, &v->lock);
+	pthread_mutex_unlock(&v->lock);
+
+	return err;
+}
+
 /**
  * eblob_check_disk_one() - checks one entry of a blob and calls iterator
  * callback on it
@@ -569,6 +1010,7 @@ static int eblob_check_disk_one(struct eblob_iterate_local *loc)
 	struct eblob_disk_control *dc = &loc->dc[loc->pos];
 	struct eblob_disk_control dc_data;
 	struct eblob_ram_control rc;
+	struct eblob_iterate_window *window;
 	int err;
 
 	if (bc->data_ctl.size == 0)
@@ -591,6 +1033,9 @@ static int eblob_check_disk_one(struct eblob_iterate_local *loc)
 	loc->last_valid_offset = loc->index_offset;
 	loc->last_valid_dc = dc;
 
+	/* Records that do not fit into read window are verified and passed to callback from fd */
+	window = (dc->disk_size <= EBLOB_ITERATE_DATA_WINDOW) ? loc->window : NULL;
+
 	rc.index_offset = loc->index_offset;
 	rc.data_offset = dc->position;
 	rc.size = dc->data_size;
@@ -618,14 +1063,20 @@ static int eblob_check_disk_one(struct eblob_iterate_local *loc)
 	if ((ctl->flags & EBLOB_ITERATE_FLAGS_VERIFY_CHECKSUM) &&
 	    !(dc->flags & BLOB_DISK_CTL_REMOVE) &&
 	    !(dc->flags & BLOB_DISK_CTL_UNCOMMITTED)) {
-		struct eblob_write_control wc;
-		memset(&wc, 0, sizeof(wc));
-		eblob_rctl_to_wc(&rc, &wc);
-		eblob_dc_to_wc(dc, &wc);
-
-		err = eblob_verify_checksum(bc->back, &dc->key, &wc);
+		if (loc->verify != NULL) {
+			err = eblob_iterate_verify_result(loc->verify, loc->pos);
+		} else if (window != NULL) {
+			/* Record is verified from the window it is passed to callback from */
+			const char *record;
+
+			err = eblob_iterate_window_get(window, bc->data_ctl.fd, ctl->data_size,
+					dc->position, dc->disk_size, &record);
+			if (err == 0)
+				err = eblob_iterate_verify_record(bc, dc, loc->index_offset, NULL, 0, record);
+		} else {
+			err = eblob_iterate_verify_record(bc, dc, loc->index_offset, NULL, 0, NULL);
+		}
 		if (err) {
-			eblob_dump_wc(bc->back, &dc->key, &wc, "eblob_check_disk_one: checksum verification failed", err);
 			/*
 			 * Checksum verification failed - skip the key and continue iteration.
 			 * Set err to 0 to avoid breaking the iteration.
@@ -679,6 +1130,19 @@ static int eblob_check_disk_one(struct eblob_iterate_local *loc)
 		goto err_out_exit;
 	}
 
+	if (window != NULL && ctl->iterator_cb.iterator_data != NULL) {
+		const char *data;
+
+		err = eblob_iterate_window_get(window, bc->data_ctl.fd, ctl->data_size,
+				dc->position, dc->disk_size, &data);
+		if (err)
+			goto err_out_exit;
+
+		err = ctl->iterator_cb.iterator_data(dc, &rc, data + sizeof(struct eblob_disk_control),
+				dc->disk_size - sizeof(struct eblob_disk_control), ctl->priv, iter_priv->thread_priv);
+		goto err_out_exit;
+	}
+
 	err = ctl->iterator_cb.iterator(dc, &rc, bc->data_ctl.fd, dc->position + sizeof(struct eblob_disk_control),
 			ctl->priv, iter_priv->thread_priv);
 
@@ -850,10 +1314,54 @@ err_out_exit:
 	return err;
 }
 
+/**
+ * eblob_iterate_prefetch() - starts reads of blob parts that records
+ * [@loc->pos, @loc->num) are going to read, so they are read by kernel in
+ * parallel and not one by one when records are processed.
+ */
+static void eblob_iterate_prefetch(struct eblob_iterate_control *ctl, struct eblob_iterate_local *loc)
+{
+	static const uint64_t hdr_size = sizeof(struct eblob_disk_control);
+	const int fd = ctl->base->data_ctl.fd;
+	uint64_t start = 0, end = 0, total = 0;
+	int whole, i;
+
+	if (ctl->flags & (EBLOB_ITERATE_FLAGS_VERIFY_CHECKSUM | EBLOB_ITERATE_FLAGS_PREFETCH_DATA))
+		whole = 1;
+	else if ((ctl->flags & EBLOB_ITERATE_FLAGS_ALL) && !(ctl->flags & EBLOB_ITERATE_FLAGS_READONLY))
+		whole = 0;
+	else
+		return;
+
+	for (i = loc->pos; i < loc->num && total < EBLOB_ITERATE_PREFETCH_MAX; ++i) {
+		const struct eblob_disk_control *dc = &loc->dc[i];
+		const uint64_t position = eblob_bswap64(dc->position);
+		const uint64_t size = whole ? eblob_bswap64(dc->disk_size) : hdr_size;
+
+		if (dc->flags & eblob_bswap64(BLOB_DISK_CTL_REMOVE))
+			continue;
+
+		if (end != 0 && position >= start && position <= end + EBLOB_ITERATE_PREFETCH_GAP) {
+			end = EBLOB_MAX(end, position + size);
+			continue;
+		}
+
+		if (end != 0) {
+			eblob_pagecache_prefetch(fd, start, end - start);
+			total += end - start;
+		}
+		start = position;
+		end = position + size;
+	}
+
+	if (end != 0 && total < EBLOB_ITERATE_PREFETCH_MAX)
+		eblob_pagecache_prefetch(fd, start, end - start);
+}
+
 /**
  * eblob_blob_iterator() - one iterator thread.
  *
- * Splits data into `batch_size' chunks and passes them to
+ * Splits its part of the index into `batch_size' chunks and passes them to
  * eblob_check_disk()
  */
 static int eblob_blob_iterator(struct eblob_iterate_priv *iter_priv)
@@ -864,8 +1372,9 @@ static int eblob_blob_iterator(struct eblob_iterate_priv *iter_priv)
 	int batch_size = 1024;
 	struct eblob_disk_control dc[batch_size];
 	struct eblob_iterate_local loc;
+	struct eblob_iterate_verify verify;
 	int err = 0;
-	int current_range_index = -1;
+	int current_range_index = iter_priv->current_range_index;
 
 	/*
 	 * TODO: We should probably use unsorted index because order of records
@@ -877,15 +1386,24 @@ static int eblob_blob_iterator(struct eblob_iterate_priv *iter_priv)
 
 	loc.iter_priv = iter_priv;
 
-	pthread_mutex_lock(&bctl->lock);
-	current_range_index = eblob_fill_range_offsets(bctl, ctl);
-	pthread_mutex_unlock(&bctl->lock);
+	if (ctl->flags & EBLOB_ITERATE_FLAGS_VERIFY_CHECKSUM) {
+		err = eblob_iterate_verify_init(&verify, ctl, batch_size, iter_priv->verify_threads);
+		if (err)
+			goto err_out_check;
+		loc.verify = &verify;
+	}
+
+	while (iter_priv->index_offset < iter_priv->index_end) {
+		/* One of other threads has failed */
+		if (__atomic_load_n(iter_priv->stop, __ATOMIC_RELAXED)) {
+			err = 0;
+			goto err_out_check;
+		}
 
-	while (ctl->index_offset < ctl->index_size) {
 		if (ctl->range_num && current_range_index >= 0) {
 			struct eblob_index_block *range = &ctl->range[current_range_index];
 
-			if (ctl->index_offset > range->end_offset) {
+			if (iter_priv->index_offset > range->end_offset) {
 				while (1) {
 					++current_range_index;
 
@@ -893,7 +1411,7 @@ static int eblob_blob_iterator(struct eblob_iterate_priv *iter_priv)
 						eblob_log(ctl->log, EBLOB_LOG_NOTICE, "blob: index: %d, iterator reached end of the requested range "
 								"[%llu, %llu], index-offset: %llu: switching to the next blob\n",
 								bctl->index, (unsigned long long)range->start_offset, (unsigned long long)range->end_offset,
-								ctl->index_offset);
+								iter_priv->index_offset);
 
 						err = 0;
 						goto err_out_check;
@@ -903,12 +1421,12 @@ static int eblob_blob_iterator(struct eblob_iterate_priv *iter_priv)
 						eblob_log(ctl->log, EBLOB_LOG_NOTICE, "blob: index: %d, iterator reached end of the requested ranges "
 								"(last range: [%llu, %llu]), index-offset: %llu: switching to the next range [%llu, %llu]\n",
 								bctl->index, (unsigned long long)range->start_offset, (unsigned long long)range->end_offset,
-								ctl->index_offset, (unsigned long long)next->start_offset, (unsigned long long)next->end_offset);
+								iter_priv->index_offset, (unsigned long long)next->start_offset, (unsigned long long)next->end_offset);
 
 						/*
 						 * Current index offset has already passed over the whole next range, skip it and check the next one
 						 */
-						if (ctl->index_offset > next->end_offset)
+						if (iter_priv->index_offset > next->end_offset)
 							continue;
 
 
@@ -917,19 +1435,25 @@ static int eblob_blob_iterator(struct eblob_iterate_priv *iter_priv)
 						 * The next range may start before current index_offset, so we should get the max of
 						 * next->start_offset and index_offset here to exclude already processed part of the index.
 						 */
-						ctl->index_offset = EBLOB_MAX(next->start_offset, ctl->index_offset);
+						iter_priv->index_offset = EBLOB_MAX(next->start_offset, iter_priv->index_offset);
 						break;
 					}
 				}
 			}
+
+			/* Next range starts in the part of another thread */
+			if (iter_priv->index_offset >= iter_priv->index_end) {
+				err = 0;
+				goto err_out_check;
+			}
 		}
 
 		/*
 		 * if index after index_offset has less then local_max_num eblob_disk_controls
 		 * then read only available ones.
 		 */
-		if (ctl->index_offset + hdr_size * batch_size > ctl->index_size){
-			batch_size = (ctl->index_size - ctl->index_offset) / hdr_size;
+		if (iter_priv->index_offset + hdr_size * batch_size > iter_priv->index_end){
+			batch_size = (iter_priv->index_end - iter_priv->index_offset) / hdr_size;
 			if (batch_size == 0) {
 				err = 0;
 				goto err_out_check;
@@ -938,30 +1462,36 @@ static int eblob_blob_iterator(struct eblob_iterate_priv *iter_priv)
 
 		/* Wait until all pending writes are finished and lock */
 		pthread_mutex_lock(&bctl->lock);
-		err = __eblob_read_ll(bctl->index_ctl.fd, dc, batch_size * hdr_size, ctl->index_offset);
+		err = __eblob_read_ll(bctl->index_ctl.fd, dc, batch_size * hdr_size, iter_priv->index_offset);
 		if (err) {
 			pthread_mutex_unlock(&bctl->lock);
 			goto err_out_check;
 		}
 		pthread_mutex_unlock(&bctl->lock);
 
-		if (ctl->index_offset + batch_size * hdr_size > ctl->index_size) {
+		/* Next batch of index is read by kernel while this one is processed */
+		if (iter_priv->index_offset + batch_size * hdr_size < iter_priv->index_end)
+			eblob_pagecache_prefetch(bctl->index_ctl.fd, iter_priv->index_offset + batch_size * hdr_size,
+					EBLOB_MIN((unsigned long long)batch_size * hdr_size,
+						iter_priv->index_end - iter_priv->index_offset - batch_size * hdr_size));
+
+		if (iter_priv->index_offset + batch_size * hdr_size > iter_priv->index_end) {
 			eblob_log(ctl->log, EBLOB_LOG_ERROR, "blob: index grew under us, iteration stops: "
 					"index_offset: %llu, index_size: %llu, eblob_data_size: %llu, batch_size: %d, "
 					"index_offset+batch_size: %llu, but wanted less than index_size.\n",
-					ctl->index_offset, ctl->index_size, ctl->data_size, batch_size,
-					ctl->index_offset + batch_size * hdr_size);
+					iter_priv->index_offset, iter_priv->index_end, ctl->data_size, batch_size,
+					iter_priv->index_offset + batch_size * hdr_size);
 			err = 0;
 			goto err_out_check;
 		}
 
 
-		loc.index_offset = ctl->index_offset;
+		loc.index_offset = iter_priv->index_offset;
 		loc.dc = dc;
 		loc.pos = 0;
 		loc.num = batch_size;
 
-		ctl->index_offset += hdr_size * batch_size;
+		iter_priv->index_offset += hdr_size * batch_size;
 
 		err = eblob_local_ranges_check(ctl, current_range_index, &loc);
 		if (err < 0)
@@ -970,32 +1500,43 @@ static int eblob_blob_iterator(struct eblob_iterate_priv *iter_priv)
 		if (err == 0)
 			continue;
 
+		eblob_iterate_prefetch(ctl, &loc);
+
 		/*
 		 * Hold btcl for duration of one batch - thus nobody can
 		 * invalidate bctl->data
 		 */
 		eblob_bctl_hold(bctl);
+		if (loc.verify)
+			eblob_iterate_verify_start(loc.verify, &loc);
 		err = eblob_check_disk(&loc);
+		if (loc.verify)
+			eblob_iterate_verify_stop(loc.verify);
 		eblob_bctl_release(bctl);
 		if (err)
 			goto err_out_check;
 	}
 
 err_out_check:
+	if (err < 0)
+		__atomic_store_n(iter_priv->stop, 1, __ATOMIC_RELAXED);
 
 	eblob_log(ctl->log, err < 0 ? EBLOB_LOG_ERROR : EBLOB_LOG_INFO, "blob-0.%d: iterated: data_fd: %d, index_fd: %d, "
 			"data_size: %llu, index_offset: %llu, err: %d\n",
-			bctl->index, bctl->data_ctl.fd, bctl->index_ctl.fd, ctl->data_size, ctl->index_offset, err);
+			bctl->index, bctl->data_ctl.fd, bctl->index_ctl.fd, ctl->data_size, iter_priv->index_offset, err);
 
 	/*
 	 * On open we are trying to auto-fix broken blobs by truncating them to
 	 * the last parsed entry.
 	 *
 	 * NB! This is questionable behaviour.
+	 *
+	 * Base is iterated by the only thread in this mode.
 	 */
 	if (!(ctl->flags & EBLOB_ITERATE_FLAGS_ALL)) {
 		pthread_mutex_lock(&bctl->lock);
 
+		ctl->index_offset = iter_priv->index_offset;
 		bctl->data_ctl.offset = bctl->data_ctl.size;
 		bctl->index_ctl.size = ctl->index_offset;
 
@@ -1046,6 +1587,9 @@ err_out_check:
 		pthread_mutex_unlock(&bctl->lock);
 	}
 
+	if (loc.verify)
+		eblob_iterate_verify_destroy(loc.verify);
+
 	/*
 	 * Propagate internal error to caller thread if not already set.
 	 * This is racy, but OK since we can't decide which thread's
@@ -1057,14 +1601,185 @@ err_out_check:
 	return err;
 }
 
+/* Position of record in blob and offset of its header in index */
+struct eblob_data_order {
+	uint64_t	position;
+	uint64_t	index_offset;
+};
+
+static int eblob_data_order_cmp(const void *a, const void *b)
+{
+	const struct eblob_data_order *o1 = a;
+	const struct eblob_data_order *o2 = b;
+
+	if (o1->position < o2->position)
+		return -1;
+	if (o1->position > o2->position)
+		return 1;
+	return 0;
+}
+
+/*
+ * Collects positions of records of sorted index from its mapping and sorts
+ * them unless base is already data-sorted.
+ */
+static int eblob_data_order_fill(struct eblob_base_ctl *bctl, struct eblob_data_order *order,
+		uint64_t records)
+{
+	uint64_t i;
+	int ordered = 1;
+	int err = 0;
+
+	pthread_rwlock_rdlock(&bctl->index_blocks_lock);
+	if (bctl->index_map == NULL ||
+			bctl->index_map_size < records * sizeof(struct eblob_disk_control)) {
+		err = -EAGAIN;
+		goto err_out_unlock;
+	}
+
+	for (i = 0; i < records; ++i) {
+		order[i].position = eblob_bswap64(bctl->index_map[i].position);
+		order[i].index_offset = i * sizeof(struct eblob_disk_control);
+		if (i > 0 && order[i].position < order[i - 1].position)
+			ordered = 0;
+	}
+
+err_out_unlock:
+	pthread_rwlock_unlock(&bctl->index_blocks_lock);
+
+	if (err == 0 && !ordered)
+		qsort(order, records, sizeof(struct eblob_data_order), eblob_data_order_cmp);
+	return err;
+}
+
+/**
+ * eblob_blob_iterator_data_order() - iterates base in order of records in blob.
+ *
+ * Unsorted index is written in the same order as data, so it is read as is,
+ * headers of sorted index are taken from its mapping in order of positions.
+ * Blob is read in windows of EBLOB_ITERATE_DATA_WINDOW bytes, larger records
+ * are left to fd-based verification and callback.
+ */
+static int eblob_blob_iterator_data_order(struct eblob_iterate_priv *iter_priv)
+{
+	static const uint64_t hdr_size = sizeof(struct eblob_disk_control);
+	struct eblob_iterate_control *ctl = iter_priv->ctl;
+	struct eblob_base_ctl *bctl = ctl->base;
+	const uint64_t records = ctl->index_size / hdr_size;
+	const uint64_t batch_size = 1024;
+	struct eblob_disk_control dc[batch_size];
+	uint64_t offsets[batch_size];
+	struct eblob_data_order *order = NULL;
+	struct eblob_iterate_window window;
+	struct eblob_iterate_local loc;
+	uint64_t pos = 0, i, num = 0;
+	int err = 0;
+
+	memset(&window, 0, sizeof(window));
+	memset(&loc, 0, sizeof(loc));
+	loc.iter_priv = iter_priv;
+	loc.window = &window;
+
+	if (bctl->index_ctl.sorted && records) {
+		order = malloc(records * sizeof(struct eblob_data_order));
+		if (order == NULL) {
+			err = -ENOMEM;
+			goto err_out_exit;
+		}
+
+		err = eblob_data_order_fill(bctl, order, records);
+		if (err)
+			goto err_out_exit;
+	}
+
+	for (pos = 0; pos < records; pos += num) {
+		num = EBLOB_MIN(records - pos, batch_size);
+
+		if (order != NULL) {
+			pthread_rwlock_rdlock(&bctl->index_blocks_lock);
+			if (bctl->index_map == NULL || bctl->index_map_size < ctl->index_size) {
+				pthread_rwlock_unlock(&bctl->index_blocks_lock);
+				err = -EAGAIN;
+				goto err_out_exit;
+			}
+			for (i = 0; i < num; ++i) {
+				offsets[i] = order[pos + i].index_offset;
+				dc[i] = bctl->index_map[offsets[i] / hdr_size];
+			}
+			pthread_rwlock_unlock(&bctl->index_blocks_lock);
+		} else {
+			pthread_mutex_lock(&bctl->lock);
+			err = __eblob_read_ll(bctl->index_ctl.fd, dc, num * hdr_size, pos * hdr_size);
+			pthread_mutex_unlock(&bctl->lock);
+			if (err)
+				goto err_out_exit;
+			if (pos + num < records)
+				eblob_pagecache_prefetch(bctl->index_ctl.fd, (pos + num) * hdr_size,
+						EBLOB_MIN(records - pos - num, batch_size) * hdr_size);
+			for (i = 0; i < num; ++i)
+				offsets[i] = (pos + i) * hdr_size;
+		}
+
+		/*
+		 * Hold btcl for duration of one batch - thus nobody can
+		 * invalidate bctl->data
+		 */
+		eblob_bctl_hold(bctl);
+		for (i = 0; i < num; ++i) {
+			if (ctl->range_num && bsearch(&dc[i].key, ctl->range, ctl->range_num,
+						sizeof(struct eblob_index_block), eblob_key_range_compare) == NULL)
+				continue;
+
+			loc.dc = &dc[i];
+			loc.pos = 0;
+			loc.num = 1;
+			loc.index_offset = offsets[i];
+
+			err = eblob_check_disk_one(&loc);
+			if (err < 0)
+				break;
+		}
+		eblob_bctl_release(bctl);
+		if (err < 0)
+			goto err_out_exit;
+		err = 0;
+	}
+
+err_out_exit:
+	eblob_log(ctl->log, err < 0 ? EBLOB_LOG_ERROR : EBLOB_LOG_INFO, "blob-0.%d: iterated in data order: "
+			"data_fd: %d, index_fd: %d, data_size: %llu, records: %" PRIu64 ", sorted: %d, err: %d\n",
+			bctl->index, bctl->data_ctl.fd, bctl->index_ctl.fd, ctl->data_size, pos,
+			order != NULL, err);
+
+	free(window.buf);
+	free(order);
+
+	if (ctl->err == 0 && err != 0)
+		ctl->err = err;
+
+	return err;
+}
+
+/* Runs iterator thread on part @item of the index */
+static int eblob_blob_iterator_part(void *priv, unsigned int item)
+{
+	struct eblob_iterate_priv *iter_priv = priv;
+
+	return eblob_blob_iterator(&iter_priv[item]);
+}
+
 /**
  * eblob_blob_iterate() - eblob forward iterator.
- * Creates and initialized iterator threads.
+ * Splits index between iterator threads, initializes and runs them.
  */
 int eblob_blob_iterate(struct eblob_iterate_control *ctl)
 {
+	static const unsigned long long hdr_size = sizeof(struct eblob_disk_control);
+	struct eblob_iterate_priv *iter_priv;
+	unsigned long long start_offset, records;
+	unsigned int i, thread_num = 1, initialized = 0;
+	int current_range_index, stop = 0;
 	int err;
-	struct eblob_iterate_priv iter_priv;
 
 	if (ctl->range_num) {
 		/*
@@ -1073,45 +1788,82 @@ int eblob_blob_iterate(struct eblob_iterate_control *ctl)
 		qsort(ctl->range, ctl->range_num, sizeof(struct eblob_index_block), eblob_index_block_cmp);
 	}
 
+	if ((ctl->flags & EBLOB_ITERATE_FLAGS_ALL) && ctl->thread_num > 1 &&
+			!(ctl->flags & EBLOB_ITERATE_FLAGS_DATA_ORDER))
+		thread_num = ctl->thread_num;
+
+	iter_priv = calloc(thread_num, sizeof(struct eblob_iterate_priv));
+	if (iter_priv == NULL) {
+		ctl->err = -ENOMEM;
+		goto err_out_exit;
+	}
+
 	/* Wait until nobody uses bctl->data */
 	eblob_base_wait_locked(ctl->base);
 	err = eblob_base_setup_data(ctl->base, 0);
 	if (err) {
 		pthread_mutex_unlock(&ctl->base->lock);
 		ctl->err = err;
-		goto err_out_exit;
+		goto err_out_free;
 	}
 
 	ctl->index_offset = 0;
 	ctl->data_size = ctl->base->data_ctl.size;
 	ctl->index_size = ctl->base->index_ctl.size;
+	current_range_index = eblob_fill_range_offsets(ctl->base, ctl);
 	pthread_mutex_unlock(&ctl->base->lock);
 
-	iter_priv.ctl = ctl;
-	iter_priv.thread_priv = NULL;
-
-	if (ctl->iterator_cb.iterator_init) {
-		err = ctl->iterator_cb.iterator_init(ctl, &iter_priv.thread_priv);
-		if (err) {
-			ctl->err = err;
-			eblob_log(ctl->log, EBLOB_LOG_ERROR, "blob: failed to init iterator: %d.\n", err);
-			goto err_out_exit;
+	/* Split index by whole records, iteration starts where the first range starts */
+	start_offset = EBLOB_MIN(ctl->index_offset, ctl->index_size);
+	records = (ctl->index_size - start_offset) / hdr_size;
+	for (i = 0; i < thread_num; ++i) {
+		iter_priv[i].ctl = ctl;
+		iter_priv[i].index_offset = start_offset + records * i / thread_num * hdr_size;
+		iter_priv[i].index_end = (i == thread_num - 1) ? ctl->index_size :
+			start_offset + records * (i + 1) / thread_num * hdr_size;
+		iter_priv[i].current_range_index = current_range_index;
+		iter_priv[i].stop = &stop;
+		/* Workers are split between threads as index is, threads that get none verify records themselves */
+		iter_priv[i].verify_threads = eblob_worker_threads(ctl->b) * (i + 1) / thread_num -
+			eblob_worker_threads(ctl->b) * i / thread_num;
+	}
+
+	for (; initialized < thread_num; ++initialized) {
+		if (ctl->iterator_cb.iterator_init) {
+			err = ctl->iterator_cb.iterator_init(ctl, &iter_priv[initialized].thread_priv);
+			if (err) {
+				ctl->err = err;
+				eblob_log(ctl->log, EBLOB_LOG_ERROR, "blob: failed to init iterator: %d.\n", err);
+				goto err_out_free_thread_priv;
+			}
 		}
 	}
 
-	err = eblob_blob_iterator(&iter_priv);
+	if ((ctl->flags & EBLOB_ITERATE_FLAGS_ALL) && (ctl->flags & EBLOB_ITERATE_FLAGS_DATA_ORDER))
+		err = eblob_blob_iterator_data_order(iter_priv);
+	else
+		err = eblob_parallel(thread_num, thread_num, eblob_blob_iterator_part, iter_priv);
 	if (err) {
 		ctl->err = err;
 		eblob_log(ctl->log, EBLOB_LOG_ERROR, "blob: iterator failed: %d.\n", err);
-		goto err_out_exit;
+		goto err_out_free_thread_priv;
 	}
 
-	if (ctl->iterator_cb.iterator_free)
-		ctl->iterator_cb.iterator_free(ctl, &iter_priv.thread_priv);
-
 	if ((ctl->err == -ENOENT) && eblob_total_elements(ctl->b))
 		ctl->err = 0;
 
+err_out_free_thread_priv:
+	for (i = 0; i < initialized; ++i) {
+		if (ctl->iterator_cb.iterator_free) {
+			err = ctl->iterator_cb.iterator_free(ctl, &iter_priv[i].thread_priv);
+			if (err && !ctl->err) {
+				ctl->err = err;
+				eblob_log(ctl->log, EBLOB_LOG_ERROR, "blob: failed to free iterator: %d.\n", err);
+			}
+		}
+	}
+err_out_free:
+	free(iter_priv);
 err_out_exit:
 	return ctl->err;
 }
@@ -1131,7 +1883,8 @@ int eblob_mark_index_removed(int fd, uint64_t offset)
 /**
  * eblob_mark_entry_removed() - Mark entry as removed in both index and data file.
  *
- * Also updates stats and syncs data.
+ * Also updates stats. Files are not synced here since caller holds base lock,
+ * see eblob_mark_entry_removed_purge().
  *
  * TODO: We can add task to periodic thread to punch holes (do fadvise
  * FALLOC_FL_PUNCH_HOLE) in data files. This will free space utilized by
@@ -1226,11 +1979,6 @@ static int eblob_mark_entry_removed(struct eblob_backend *b,
 	eblob_stat_inc(b->stat_summary, EBLOB_LST_RECORDS_REMOVED);
 	eblob_stat_add(b->stat_summary, EBLOB_LST_REMOVED_SIZE, record_size);
 
-	if (!b->cfg.sync) {
-		eblob_fdatasync(old->bctl->data_ctl.fd);
-		eblob_fdatasync(old->bctl->index_ctl.fd);
-	}
-
 err:
 	EBLOB_WARNX(b->cfg.log, EBLOB_LOG_NOTICE, "%s: finished: %d",
 			eblob_dump_id(key->id), err);
@@ -1272,6 +2020,10 @@ static int eblob_mark_entry_removed_purge(struct eblob_backend *b,
 
 err:
 	pthread_mutex_unlock(&old->bctl->lock);
+
+	/* Sync is waited for without base lock, so other writers to the base are not blocked */
+	if (err == 0 && !b->cfg.sync)
+		err = eblob_group_commit(b, old->bctl, EBLOB_GROUP_COMMIT_DATA | EBLOB_GROUP_COMMIT_INDEX);
 	return err;
 }
 
@@ -1305,6 +2057,7 @@ static int eblob_commit_disk(struct eblob_backend *b, struct eblob_key *key,
 	FORMATTED(HANDY_TIMER_SCOPE, ("eblob.%u.disk.write.commit.ll", b->cfg.stat_id));
 
 	struct eblob_disk_control dc;
+	struct eblob_io_op ops[2];
 	int err;
 
 	if (remove)
@@ -1314,21 +2067,30 @@ static int eblob_commit_disk(struct eblob_backend *b, struct eblob_key *key,
 
 	eblob_wc_to_dc(key, wc, &dc);
 
-	err = __eblob_write_ll(wc->index_fd, &dc, sizeof(dc), wc->ctl_index_offset);
+	/* Header goes to index and to data at once, both writes are waited for */
+	ops[0].fd = wc->index_fd;
+	ops[0].buf = &dc;
+	ops[0].size = sizeof(dc);
+	ops[0].offset = wc->ctl_index_offset;
+	ops[1].fd = wc->data_fd;
+	ops[1].buf = &dc;
+	ops[1].size = sizeof(dc);
+	ops[1].offset = wc->ctl_data_offset;
+
+	err = eblob_write_chain(ops, 2);
 	if (err) {
-		eblob_dump_wc(b, key, wc, "eblob_commit_disk: ERROR-write-index", err);
+		eblob_dump_wc(b, key, wc, "eblob_commit_disk: ERROR-write-header", err);
 		goto err_out_exit;
 	}
 
-	err = __eblob_write_ll(wc->data_fd, &dc, sizeof(dc), wc->ctl_data_offset);
-	if (err) {
-		eblob_dump_wc(b, key, wc, "eblob_commit_disk: ERROR-write-data", err);
-		goto err_out_exit;
+	if (!b->cfg.sync) {
+		err = eblob_group_commit(b, wc->bctl, EBLOB_GROUP_COMMIT_INDEX);
+		if (err) {
+			eblob_dump_wc(b, key, wc, "eblob_commit_disk: ERROR-group-commit", err);
+			goto err_out_exit;
+		}
 	}
 
-	if (!b->cfg.sync)
-		fsync(wc->index_fd);
-
 	eblob_dump_wc(b, key, wc, "eblob_commit_disk", err);
 
 err_out_exit:
@@ -1360,6 +2122,42 @@ err_out_exit:
 	return err;
 }
 
+/**
+ * __eblob_writev_ll() - interruption-safe wrapper for pwritev(2)
+ * Writes all @iovcnt buffers splitting them into chunks of IOV_MAX and
+ * resuming after short writes.
+ * NB! @iov is modified.
+ */
+int __eblob_writev_ll(int fd, struct iovec *iov, int iovcnt, off_t offset)
+{
+	int err = 0;
+	ssize_t bytes;
+
+	while (iovcnt > 0) {
+		bytes = pwritev(fd, iov, iovcnt > IOV_MAX ? IOV_MAX : iovcnt, offset);
+		if (bytes == -1) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			goto err_out_exit;
+		}
+		offset += bytes;
+
+		/* Skip fully written buffers and trim partially written one */
+		while (iovcnt > 0 && (size_t)bytes >= iov->iov_len) {
+			bytes -= iov->iov_len;
+			++iov;
+			--iovcnt;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + bytes;
+			iov->iov_len -= bytes;
+		}
+	}
+err_out_exit:
+	return err;
+}
+
 /**
  * __eblob_read_ll() - interruption-safe wrapper for pread(2)
  */
@@ -1610,6 +2408,49 @@ static void eblob_write_control_cleanup(struct eblob_write_control *wc) {
 	}
 }
 
+/**
+ * eblob_cache_lookup_hold() - looks up @key in cache and holds bctl it points to.
+ *
+ * Does not need "backend" lock. Datasort and indexsort bump
+ * @b->defrag_generation when they lock cache for the swap and again before
+ * they unlock bases they have swapped, so if generation is the same after
+ * bctl is held then found location is valid and stays so until bctl is
+ * released. Otherwise lookup is repeated, as well as a miss that may have
+ * been caused by the swap: keys are flushed from cache before sorted base
+ * can be found on disk.
+ *
+ * Returns -EAGAIN if lookup is interrupted by swaps too many times.
+ *
+ * NB! On success @rctl->bctl must be released by caller.
+ */
+static int eblob_cache_lookup_hold(struct eblob_backend *b, struct eblob_key *key,
+		struct eblob_ram_control *rctl, int *on_disk)
+{
+	static const int max_tries = 16;
+	size_t generation;
+	int err, tries;
+
+	for (tries = 0; tries < max_tries; ++tries) {
+		generation = __atomic_load_n(&b->defrag_generation, __ATOMIC_ACQUIRE);
+
+		err = eblob_cache_lookup(b, key, rctl, on_disk);
+		if (err == -ENOENT &&
+				generation != __atomic_load_n(&b->defrag_generation, __ATOMIC_ACQUIRE))
+			continue;
+		if (err)
+			return err;
+
+		eblob_bctl_hold(rctl->bctl);
+		if (rctl->bctl->index_ctl.fd != -1 &&
+				generation == __atomic_load_n(&b->defrag_generation, __ATOMIC_ACQUIRE))
+			return 0;
+
+		eblob_bctl_release(rctl->bctl);
+	}
+
+	return -EAGAIN;
+}
+
 /**
  * eblob_fill_write_control_from_ram() - looks for data/index fds and offsets
  * in cache and fills write control with them.
@@ -1617,7 +2458,6 @@ static void eblob_write_control_cleanup(struct eblob_write_control *wc) {
  *
  * NB! If this function succeeded, then @wc must be released using
  *  eblob_write_control_cleanup().
- *  This function should only be called when @b->lock is locked by caller thread.
  */
 static int eblob_fill_write_control_from_ram(struct eblob_backend *b, struct eblob_key *key,
 		struct eblob_write_control *wc, int for_write, struct eblob_ram_control *old)
@@ -1630,13 +2470,13 @@ static int eblob_fill_write_control_from_ram(struct eblob_backend *b, struct ebl
 	uint64_t calculated_size;
 	int err;
 
-	err = eblob_cache_lookup(b, key, &ctl, &wc->on_disk);
+	err = eblob_cache_lookup_hold(b, key, &ctl, &wc->on_disk);
 	if (err) {
 		int level = EBLOB_LOG_DEBUG;
 		if (err != -ENOENT)
 			level = EBLOB_LOG_ERROR;
 
-		eblob_log(b->cfg.log, level, "blob: %s: %s: eblob_cache_lookup: %d, on_disk: %d\n",
+		eblob_log(b->cfg.log, level, "blob: %s: %s: eblob_cache_lookup_hold: %d, on_disk: %d\n",
 				eblob_dump_id(key->id), __func__, err, wc->on_disk);
 		goto err_out_exit;
 	} else if(old) {
@@ -1648,10 +2488,9 @@ static int eblob_fill_write_control_from_ram(struct eblob_backend *b, struct ebl
 		wc->offset = orig_offset + ctl.size;
 	}
 
+	/* bctl is already held by eblob_cache_lookup_hold() */
 	eblob_rctl_to_wc(&ctl, wc);
 
-	eblob_bctl_hold(wc->bctl);
-
 	err = __eblob_read_ll(wc->index_fd, &dc, sizeof(dc), ctl.index_offset);
 	if (err) {
 		eblob_dump_wc(b, key, wc, "eblob_fill_write_control_from_ram: ERROR-pread-index", err);
@@ -1741,47 +2580,148 @@ static int eblob_check_free_space(struct eblob_backend *b, uint64_t size)
 	return 0;
 }
 
-/*!
- * Low-level counterpart for \fn eblob_write_prepare_disk()
- * NB! Caller should hold "backend" lock.
+/**
+ * eblob_write_account_disk() - updates stats of base and backend with record
+ * that was just placed at @wc.
  */
-static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key *key,
-		struct eblob_write_control *wc, uint64_t prepare_disk_size,
-		enum eblob_copy_flavour copy, uint64_t copy_offset,
-		struct eblob_ram_control *old)
+static void eblob_write_account_disk(struct eblob_backend *b, struct eblob_write_control *wc)
 {
-	FORMATTED(HANDY_TIMER_SCOPE, ("eblob.%u.disk.write.prepare.disk.ll", b->cfg.stat_id));
+	const uint64_t record_size = wc->total_size + sizeof(struct eblob_disk_control);
 
-	struct eblob_base_ctl *ctl = NULL;
-	ssize_t err = 0;
+	eblob_stat_inc(wc->bctl->stat, EBLOB_LST_RECORDS_TOTAL);
+	eblob_stat_add(wc->bctl->stat, EBLOB_LST_BASE_SIZE, record_size);
+
+	eblob_stat_inc(b->stat_summary, EBLOB_LST_RECORDS_TOTAL);
+	eblob_stat_add(b->stat_summary, EBLOB_LST_BASE_SIZE, record_size);
+
+	if (wc->flags & BLOB_DISK_CTL_UNCOMMITTED) {
+		eblob_stat_inc(wc->bctl->stat, EBLOB_LST_RECORDS_UNCOMMITTED);
+		eblob_stat_add(wc->bctl->stat, EBLOB_LST_UNCOMMITTED_SIZE, record_size);
+
+		eblob_stat_inc(b->stat_summary, EBLOB_LST_RECORDS_UNCOMMITTED);
+		eblob_stat_add(b->stat_summary, EBLOB_LST_UNCOMMITTED_SIZE, record_size);
+	}
+}
+
+/**
+ * eblob_write_abandon_disk() - gives up space reserved for @wc.
+ *
+ * Reservation can not be rolled back once base lock is dropped since other
+ * writers may have already reserved space after it. Instead record is marked
+ * removed, so its space will be reclaimed by defrag.
+ */
+static void eblob_write_abandon_disk(struct eblob_backend *b, struct eblob_key *key,
+		struct eblob_write_control *wc)
+{
+	const uint64_t record_size = wc->total_size + sizeof(struct eblob_disk_control);
+	int err;
+
+	err = eblob_commit_disk(b, key, wc, 1);
+	if (err)
+		eblob_dump_wc(b, key, wc, "eblob_write_abandon_disk: ERROR-commit-disk", err);
+
+	eblob_stat_inc(wc->bctl->stat, EBLOB_LST_RECORDS_TOTAL);
+	eblob_stat_add(wc->bctl->stat, EBLOB_LST_BASE_SIZE, record_size);
+	eblob_stat_inc(wc->bctl->stat, EBLOB_LST_RECORDS_REMOVED);
+	eblob_stat_add(wc->bctl->stat, EBLOB_LST_REMOVED_SIZE, record_size);
+
+	eblob_stat_inc(b->stat_summary, EBLOB_LST_RECORDS_TOTAL);
+	eblob_stat_add(b->stat_summary, EBLOB_LST_BASE_SIZE, record_size);
+	eblob_stat_inc(b->stat_summary, EBLOB_LST_RECORDS_REMOVED);
+	eblob_stat_add(b->stat_summary, EBLOB_LST_REMOVED_SIZE, record_size);
+}
+
+/**
+ * eblob_write_pick_base() - returns the last base that new records go to,
+ * adds new base if the last one is full.
+ * NB! Caller should hold "backend" lock.
+ */
+static int eblob_write_pick_base(struct eblob_backend *b, struct eblob_base_ctl **bctl)
+{
+	struct eblob_base_ctl *ctl;
+	int err;
 
 	if (list_empty(&b->bases)) {
 		err = eblob_add_new_base(b);
 		if (err)
-			goto err_out_exit;
+			return err;
 	}
 
 	ctl = list_last_entry(&b->bases, struct eblob_base_ctl, base_entry);
-	if ((ctl->data_ctl.offset >= b->cfg.blob_size) || ctl->index_ctl.sorted ||
-			(ctl->index_ctl.size / sizeof(struct eblob_disk_control) >= b->cfg.records_in_blob)) {
+	if ((__atomic_load_n(&ctl->data_ctl.offset, __ATOMIC_RELAXED) >= b->cfg.blob_size) ||
+			ctl->index_ctl.sorted ||
+			(__atomic_load_n(&ctl->index_ctl.size, __ATOMIC_RELAXED) / sizeof(struct eblob_disk_control)
+			 >= b->cfg.records_in_blob)) {
 		err = eblob_add_new_base(b);
 		if (err)
-			goto err_out_exit;
+			return err;
+
+		if (!ctl->index_ctl.sorted)
+			datasort_force_sort(b);
+
+		ctl = list_last_entry(&b->bases, struct eblob_base_ctl, base_entry);
+	}
+
+	assert(datasort_base_is_sorted(ctl) != 1);
+
+	*bctl = ctl;
+	return 0;
+}
+
+/*!
+ * Low-level counterpart for \fn eblob_write_prepare_disk()
+ *
+ * "Backend" lock is taken only to pick the last base and to check that @old
+ * is still valid. Lock of the picked base is taken only to reserve space, so
+ * its index stays dense. Header is committed, old record is copied and removed
+ * with no locks held - both bases are held instead, so datasort and indexsort
+ * can not swap them underneath. Since other writers may reserve space right
+ * after the lock is dropped, reservation is never rolled back, it is marked
+ * removed by eblob_write_abandon_disk() instead.
+ */
+static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key *key,
+		struct eblob_write_control *wc, uint64_t prepare_disk_size,
+		enum eblob_copy_flavour copy, uint64_t copy_offset,
+		struct eblob_ram_control *old, size_t defrag_generation)
+{
+	FORMATTED(HANDY_TIMER_SCOPE, ("eblob.%u.disk.write.prepare.disk.ll", b->cfg.stat_id));
+
+	struct eblob_base_ctl *ctl = NULL, *old_bctl = NULL;
+	struct eblob_ram_control upd_old;
+	ssize_t err = 0;
 
-		if (!ctl->index_ctl.sorted)
-			datasort_force_sort(b);
+	pthread_mutex_lock(&b->lock);
 
-		ctl = list_last_entry(&b->bases, struct eblob_base_ctl, base_entry);
+	if (defrag_generation != b->defrag_generation) {
+		int disk;
+		err = eblob_cache_lookup(b, key, &upd_old, &disk);
+		switch (err) {
+		case -ENOENT:
+			old = NULL;
+			break;
+		case 0:
+			old = &upd_old;
+			break;
+		default:
+			goto err_out_unlock;
+		}
 	}
 
+	err = eblob_write_pick_base(b, &ctl);
+	if (err)
+		goto err_out_unlock;
+
 	if (old != NULL) {
 		/* Check that bctl is still valid */
 		if (old->bctl->index_ctl.fd == -1) {
 			err = -EAGAIN;
-			goto err_out_exit;
+			goto err_out_unlock;
 		}
 		if (wc->flags & BLOB_DISK_CTL_APPEND)
 			wc->offset += old->size;
+
+		old_bctl = old->bctl;
+		eblob_bctl_hold(old_bctl);
 	} else {
 		if (wc->flags & BLOB_DISK_CTL_APPEND) {
 			/*
@@ -1798,7 +2738,12 @@ static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key
 		}
 	}
 
-	assert(datasort_base_is_sorted(ctl) != 1);
+	if (wc->bctl)
+		eblob_bctl_release(wc->bctl);
+	eblob_bctl_hold(ctl);
+	wc->bctl = ctl;
+
+	pthread_mutex_unlock(&b->lock);
 
 	wc->data_fd = ctl->data_ctl.fd;
 	wc->index_fd = ctl->index_ctl.fd;
@@ -1806,17 +2751,8 @@ static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key
 	wc->index = ctl->index;
 	wc->on_disk = 0;
 
-	wc->ctl_index_offset = ctl->index_ctl.size;
-	wc->ctl_data_offset = ctl->data_ctl.offset;
-
-	wc->data_offset = wc->ctl_data_offset + sizeof(struct eblob_disk_control) + wc->offset;
 	wc->total_data_size = wc->offset + wc->size;
 
-	if (wc->bctl)
-		eblob_bctl_release(wc->bctl);
-	eblob_bctl_hold(ctl);
-	wc->bctl = ctl;
-
 	if (wc->total_data_size < prepare_disk_size)
 		wc->total_size = eblob_calculate_size(b, key, 0, prepare_disk_size);
 	else
@@ -1830,8 +2766,14 @@ static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key
 	if (wc->flags & BLOB_DISK_CTL_APPEND)
 		wc->total_size *= 2;
 
-	ctl->data_ctl.offset += wc->total_size;
-	ctl->index_ctl.size += sizeof(struct eblob_disk_control);
+	pthread_mutex_lock(&ctl->lock);
+
+	wc->ctl_data_offset = __atomic_fetch_add(&ctl->data_ctl.offset, wc->total_size, __ATOMIC_RELAXED);
+	wc->ctl_index_offset = __atomic_fetch_add(&ctl->index_ctl.size, sizeof(struct eblob_disk_control),
+			__ATOMIC_RELAXED);
+	wc->data_offset = wc->ctl_data_offset + sizeof(struct eblob_disk_control) + wc->offset;
+
+	pthread_mutex_unlock(&ctl->lock);
 
 	/*
 	 * We are doing early index update to prevent situations when system
@@ -1840,7 +2782,7 @@ static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key
 	 */
 	err = eblob_commit_disk(b, key, wc, 0);
 	if (err)
-		goto err_out_rollback;
+		goto err_out_abandon;
 
 	/*
 	 * zero prepare_disk_size means client asked eblob to write data and
@@ -1864,7 +2806,7 @@ static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key
 		          "blob i%d: %s: eblob_preallocate: fd: %d, size: %" PRIu64 ", err: %zu\n",
 		          wc->index, eblob_dump_id(key->id), wc->data_fd, wc->ctl_data_offset + wc->total_size, err);
 		if (err != 0)
-			goto err_out_rollback;
+			goto err_out_abandon;
 	}
 
 	/*
@@ -1902,7 +2844,7 @@ static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key
 				sizeof(struct eblob_disk_control), old->data_offset);
 		if (err) {
 			eblob_dump_wc(b, key, wc, "copy: ERROR-pread-data", err);
-			goto err_out_rollback;
+			goto err_out_abandon;
 		}
 
 		/* Sanity: Check that on-disk and in-memory keys are the same */
@@ -1911,12 +2853,23 @@ static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key
 					"keys mismatch: in-memory: %s, on-disk: %s",
 					eblob_dump_id_len(key->id, EBLOB_ID_SIZE),
 					eblob_dump_id_len(old_dc.key.id, EBLOB_ID_SIZE));
-			goto err_out_rollback;
+			err = -EINVAL;
+			goto err_out_abandon;
 		}
 
 		eblob_convert_disk_control(&old_dc);
 		size = old_dc.disk_size - sizeof(struct eblob_disk_control);
 
+		/*
+		 * Old record can be larger than reserved space (e.g. it is
+		 * committed with smaller size) - never copy past reservation,
+		 * since following record can already be written there.
+		 */
+		if (off_out >= wc->ctl_data_offset + wc->total_size)
+			size = 0;
+		else if (off_out + size > wc->ctl_data_offset + wc->total_size)
+			size = wc->ctl_data_offset + wc->total_size - off_out;
+
 		if (wc->data_fd != old->bctl->data_ctl.fd)
 			err = eblob_splice_data(old->bctl->data_ctl.fd, off_in, wc->data_fd, off_out, size);
 		else
@@ -1933,7 +2886,7 @@ static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key
 				eblob_dump_id(key->id), off_in, off_out,
 				size, old->bctl->data_ctl.fd, wc->data_fd, err);
 		if (err < 0)
-			goto err_out_rollback;
+			goto err_out_abandon;
 	}
 
 	if (old != NULL) {
@@ -1947,35 +2900,26 @@ static int eblob_write_prepare_disk_ll(struct eblob_backend *b, struct eblob_key
 			 * in unknown state.  In that case we should not roll
 			 * back write because it's already committed.
 			 */
-			goto err_out_exit;
+			goto err_out_release;
 		}
-	}
-
-	eblob_stat_inc(ctl->stat, EBLOB_LST_RECORDS_TOTAL);
-	eblob_stat_add(ctl->stat, EBLOB_LST_BASE_SIZE,
-	               wc->total_size + sizeof(struct eblob_disk_control));
 
-	eblob_stat_inc(b->stat_summary, EBLOB_LST_RECORDS_TOTAL);
-	eblob_stat_add(b->stat_summary, EBLOB_LST_BASE_SIZE,
-	               wc->total_size + sizeof(struct eblob_disk_control));
-
-	if (wc->flags & BLOB_DISK_CTL_UNCOMMITTED) {
-		eblob_stat_inc(ctl->stat, EBLOB_LST_RECORDS_UNCOMMITTED);
-		eblob_stat_add(ctl->stat, EBLOB_LST_UNCOMMITTED_SIZE,
-		               wc->total_size + sizeof(struct eblob_disk_control));
-
-		eblob_stat_inc(b->stat_summary, EBLOB_LST_RECORDS_UNCOMMITTED);
-		eblob_stat_add(b->stat_summary, EBLOB_LST_UNCOMMITTED_SIZE,
-		               wc->total_size + sizeof(struct eblob_disk_control));
+		eblob_bctl_release(old_bctl);
 	}
 
+	eblob_write_account_disk(b, wc);
+
 	eblob_dump_wc(b, key, wc, "eblob_write_prepare_disk_ll: complete", 0);
 
 	return 0;
 
-err_out_rollback:
-	ctl->data_ctl.offset -= wc->total_size;
-	ctl->index_ctl.size -= sizeof(struct eblob_disk_control);
+err_out_abandon:
+	eblob_write_abandon_disk(b, key, wc);
+err_out_release:
+	if (old_bctl != NULL)
+		eblob_bctl_release(old_bctl);
+	goto err_out_exit;
+err_out_unlock:
+	pthread_mutex_unlock(&b->lock);
 err_out_exit:
 	eblob_dump_wc(b, key, wc, "eblob_write_prepare_disk_ll: error", err);
 	return err;
@@ -1995,40 +2939,21 @@ static int eblob_write_prepare_disk(struct eblob_backend *b, struct eblob_key *k
 
 	ssize_t err = 0;
 	uint64_t size;
-	struct eblob_ram_control upd_old;
 
 	eblob_log(b->cfg.log, EBLOB_LOG_NOTICE,
 			"blob: %s: eblob_write_prepare_disk: start: "
 			"size: %" PRIu64 ", offset: %" PRIu64 ", prepare: %" PRIu64 "\n",
 			eblob_dump_id(key->id), wc->size, wc->offset, prepare_disk_size);
 
-	pthread_mutex_lock(&b->lock);
-
-	if (defrag_generation != b->defrag_generation) {
-		int disk;
-		err = eblob_cache_lookup(b, key, &upd_old, &disk);
-		switch (err) {
-		case -ENOENT:
-			old = NULL;
-			break;
-		case 0:
-			old = &upd_old;
-			break;
-		default:
-			goto err_out_exit;
-		}
-	}
-
 	size = prepare_disk_size > wc->size + wc->offset ? prepare_disk_size : wc->size + wc->offset;
 	err = eblob_check_free_space(b, eblob_calculate_size(b, key, 0, size));
 	if (err)
 		goto err_out_exit;
 
 	err = eblob_write_prepare_disk_ll(b, key, wc, prepare_disk_size,
-			copy, copy_offset, old);
+			copy, copy_offset, old, defrag_generation);
 
 err_out_exit:
-	pthread_mutex_unlock(&b->lock);
 	eblob_dump_wc(b, key, wc, "eblob_write_prepare_disk", err);
 	return err;
 }
@@ -2059,11 +2984,9 @@ int eblob_write_prepare(struct eblob_backend *b, struct eblob_key *key,
 	 * For eblob_write_prepare() this can fail with -E2BIG if we try to overwrite
 	 * record without footer by record with footer.
 	 */
-	pthread_mutex_lock(&b->lock);
-	defrag_generation = b->defrag_generation;
+	defrag_generation = __atomic_load_n(&b->defrag_generation, __ATOMIC_ACQUIRE);
 
 	err = eblob_fill_write_control_from_ram(b, key, &wc, 1, &old);
-	pthread_mutex_unlock(&b->lock);
 	if (err && err != -ENOENT && err != -E2BIG)
 		goto err_out_exit;
 
@@ -2144,15 +3067,20 @@ int eblob_hash(struct eblob_backend *b, void *dst,
 /**
  * eblob_write_commit_ll() - commit phase - writes to disk, updates on-disk2
  * index and puts entry to hash.
+ * @iov is data just written to the record or NULL, see eblob_commit_footer_iov().
  */
 static int eblob_write_commit_ll(struct eblob_backend *b, struct eblob_key *key,
-		struct eblob_write_control *wc)
+		struct eblob_write_control *wc, const struct eblob_iovec *iov, uint16_t iovcnt)
 {
 	FORMATTED(HANDY_TIMER_SCOPE, ("eblob.%u.disk.write.commit", b->cfg.stat_id));
 
-	int err;
+	int err, reap_err;
 
-	err = eblob_commit_footer(b, key, wc);
+	err = eblob_commit_footer_iov(b, key, wc, iov, iovcnt);
+	/* Data submitted by eblob_writev_raw() is complete before the header is committed */
+	reap_err = eblob_write_reap();
+	if (err == 0)
+		err = reap_err;
 	if (err) {
 		eblob_dump_wc(b, key, wc, "eblob_commit_footer: ERROR", err);
 		goto err_out_exit;
@@ -2174,12 +3102,13 @@ err_out_exit:
 static int eblob_write_commit_prepare(struct eblob_backend *b, struct eblob_key *key, uint64_t size,
 				      uint64_t flags, struct eblob_write_control *wc)
 {
+	size_t defrag_generation;
 	int err;
 
-	pthread_mutex_lock(&b->lock);
+	defrag_generation = __atomic_load_n(&b->defrag_generation, __ATOMIC_ACQUIRE);
 	err = eblob_fill_write_control_from_ram(b, key, wc, 1, NULL);
 	if (err < 0)
-		goto err_out_unlock;
+		goto err_out_exit;
 
 	/*
 	 * write commit is allowed only for uncommitted records
@@ -2214,13 +3143,11 @@ static int eblob_write_commit_prepare(struct eblob_backend *b, struct eblob_key
 			goto err_out_cleanup_wc;
 
 		err = eblob_write_prepare_disk_ll(b, key, wc, size,
-				EBLOB_COPY_RECORD, 0, &rctl);
+				EBLOB_COPY_RECORD, 0, &rctl, defrag_generation);
 		if (err != 0)
 			goto err_out_cleanup_wc;
 	}
 
-	pthread_mutex_unlock(&b->lock);
-
 	/*
 	 * We are committing the record,
 	 * so `BLOB_DISK_CTL_UNCOMMITTED` should be removed from record's flags.
@@ -2234,8 +3161,7 @@ static int eblob_write_commit_prepare(struct eblob_backend *b, struct eblob_key
 
 err_out_cleanup_wc:
 	eblob_write_control_cleanup(wc);
-err_out_unlock:
-	pthread_mutex_unlock(&b->lock);
+err_out_exit:
 	return err;
 }
 
@@ -2263,7 +3189,7 @@ int eblob_write_commit(struct eblob_backend *b, struct eblob_key *key,
 	if (err != 0)
 		goto err_out_exit;
 
-	err = eblob_write_commit_ll(b, key, &wc);
+	err = eblob_write_commit_ll(b, key, &wc, NULL, 0);
 	if (err != 0)
 		goto err_out_cleanup_wc;
 
@@ -2289,14 +3215,11 @@ static int eblob_try_overwritev(struct eblob_backend *b, struct eblob_key *key,
 	uint64_t flags = wc->flags;
 	const size_t size = wc->size;
 
-	pthread_mutex_lock(&b->lock);
-	*defrag_generation = b->defrag_generation;
+	*defrag_generation = __atomic_load_n(&b->defrag_generation, __ATOMIC_ACQUIRE);
 
 	err = eblob_fill_write_control_from_ram(b, key, wc, 1, old);
-	if (err) {
-		pthread_mutex_unlock(&b->lock);
+	if (err)
 		goto err_out_exit;
-	}
 
 	/*
 	 * We can only overwrite keys inplace if data-sort is not processing
@@ -2304,10 +3227,8 @@ static int eblob_try_overwritev(struct eblob_backend *b, struct eblob_key *key,
 	 */
 	if (eblob_binlog_enabled(&wc->bctl->binlog)) {
 		err = -EROFS;
-	}
-	pthread_mutex_unlock(&b->lock);
-	if (err)
 		goto err_out_cleanup_wc;
+	}
 
 	/*
 	 * We can't overwrite old record with new one if they have different
@@ -2338,7 +3259,7 @@ static int eblob_try_overwritev(struct eblob_backend *b, struct eblob_key *key,
 	eblob_stat_inc(b->stat, EBLOB_GST_WRITES_NUMBER);
 	eblob_stat_add(b->stat, EBLOB_GST_WRITES_SIZE, wc->size);
 
-	err = eblob_write_commit_ll(b, key, wc);
+	err = eblob_write_commit_ll(b, key, wc, iov, iovcnt);
 	if (err) {
 		eblob_dump_wc(b, key, wc, "eblob_try_overwrite: ERROR-eblob_write_commit_ll", err);
 		goto err_out_cleanup_wc;
@@ -2369,15 +3290,16 @@ static int eblob_plain_writev_prepare(struct eblob_backend *b, struct eblob_key
 				      struct eblob_write_control *wc, int *prepared)
 {
 	struct eblob_iovec_bounds bounds;
+	size_t defrag_generation;
 	ssize_t err;
 
 	eblob_iovec_get_bounds(&bounds, iov, iovcnt);
 	wc->size = bounds.max;
 
-	pthread_mutex_lock(&b->lock);
+	defrag_generation = __atomic_load_n(&b->defrag_generation, __ATOMIC_ACQUIRE);
 	err = eblob_fill_write_control_from_ram(b, key, wc, 1, NULL);
 	if (err)
-		goto err_out_unlock;
+		goto err_out_exit;
 
 	/*
 	 * plain write is allowed only for uncommitted records
@@ -2428,20 +3350,17 @@ static int eblob_plain_writev_prepare(struct eblob_backend *b, struct eblob_key
 		const uint64_t prepare_disk_size = wc->total_size - hdr_footer_size;
 		err = eblob_write_prepare_disk_ll(b, key, wc,
 				prepare_disk_size,
-				EBLOB_COPY_RECORD, 0, &rctl);
+				EBLOB_COPY_RECORD, 0, &rctl, defrag_generation);
 		if (err != 0)
 			goto err_out_cleanup_wc;
 		*prepared = 1;
 	}
 
-	pthread_mutex_unlock(&b->lock);
-
 	return err;
 
 err_out_cleanup_wc:
 	eblob_write_control_cleanup(wc);
-err_out_unlock:
-	pthread_mutex_unlock(&b->lock);
+err_out_exit:
 	return err;
 }
 
@@ -2467,6 +3386,8 @@ int eblob_plain_writev(struct eblob_backend *b, struct eblob_key *key,
 		goto err_out_exit;
 
 	err = eblob_writev_raw(key, &wc, iov, iovcnt);
+	if (err == 0)
+		err = eblob_write_reap();
 	if (err)
 		goto err_out_cleanup_wc;
 
@@ -2631,7 +3552,7 @@ int eblob_writev_return(struct eblob_backend *b, struct eblob_key *key,
 		goto err_out_cleanup_wc;
 	}
 
-	err = eblob_write_commit_ll(b, key, wc);
+	err = eblob_write_commit_ll(b, key, wc, iov, iovcnt);
 	if (err) {
 		eblob_dump_wc(b, key, wc, "eblob_writev: eblob_write_commit_ll: FAILED", err);
 		goto err_out_cleanup_wc;
@@ -2647,6 +3568,345 @@ err_out_exit:
 	return err;
 }
 
+/* Record of eblob_writev_batch() */
+struct eblob_write_batch_rec {
+	struct eblob_key		key;
+	/* Position of record in batch */
+	size_t				pos;
+	struct eblob_write_control	wc;
+	/* Footer computed from iovecs, it is written together with the data */
+	void				*footer;
+	uint64_t			footer_size;
+};
+
+/* Buffers shared by all bases eblob_writev_batch() writes to */
+struct eblob_write_batch_buf {
+	struct eblob_disk_control	*dcs;
+	struct eblob_cache_batch_entry	*entries;
+	struct iovec			*iov;
+	/* Zeroed gap between data and footer, the largest one of the batch */
+	void				*zeroes;
+};
+
+/* Orders records by key and then by position in batch */
+static int eblob_write_batch_rec_cmp(const void *l, const void *r)
+{
+	const struct eblob_write_batch_rec *lrec = l, *rrec = r;
+	int cmp;
+
+	cmp = eblob_id_cmp(lrec->key.id, rrec->key.id);
+	if (cmp != 0)
+		return cmp;
+	if (lrec->pos < rrec->pos)
+		return -1;
+	return lrec->pos > rrec->pos;
+}
+
+static void eblob_write_batch_fail(struct eblob_write_batch_rec *recs, size_t num, int *errors, int err)
+{
+	size_t i;
+
+	for (i = 0; i < num; ++i)
+		errors[recs[i].pos] = err;
+}
+
+static void eblob_write_batch_abandon(struct eblob_backend *b, struct eblob_write_batch_rec *recs, size_t num)
+{
+	size_t i;
+
+	for (i = 0; i < num; ++i)
+		eblob_write_abandon_disk(b, &recs[i].key, &recs[i].wc);
+}
+
+/*
+ * Writes head of @recs to the last base: records are taken while base has
+ * room for them according to @records_in_blob and @blob_size, but at least
+ * one is taken, as eblob_write_pick_base() does for single write. Index
+ * entries are appended with one write, headers, data and footers are written
+ * with one pwritev(2) and synced by one group commit.
+ *
+ * Returns number of records that have been processed, their results are
+ * stored to @errors, or negative error if base could not be picked.
+ */
+static ssize_t eblob_writev_batch_base(struct eblob_backend *b, const struct eblob_write_batch *batch,
+		struct eblob_write_batch_rec *recs, size_t num, int *errors, struct eblob_write_batch_buf *buf)
+{
+	static const size_t hdr_size = sizeof(struct eblob_disk_control);
+	struct eblob_base_ctl *ctl;
+	uint64_t data_size = 0, data_offset, index_offset, records, room;
+	size_t i, j, n, m = 0, k = 0;
+	int err;
+
+	pthread_mutex_lock(&b->lock);
+	err = eblob_write_pick_base(b, &ctl);
+	if (err) {
+		pthread_mutex_unlock(&b->lock);
+		return err;
+	}
+	eblob_bctl_hold(ctl);
+	pthread_mutex_unlock(&b->lock);
+
+	/* Reserve space for records at once, see eblob_write_prepare_disk_ll() */
+	pthread_mutex_lock(&ctl->lock);
+
+	data_offset = __atomic_load_n(&ctl->data_ctl.offset, __ATOMIC_RELAXED);
+	records = __atomic_load_n(&ctl->index_ctl.size, __ATOMIC_RELAXED) / hdr_size;
+	room = data_offset < b->cfg.blob_size ? b->cfg.blob_size - data_offset : 0;
+	for (n = 0; n < num; ++n) {
+		if (n > 0 && (records + n >= b->cfg.records_in_blob || data_size + recs[n].wc.total_size > room))
+			break;
+		data_size += recs[n].wc.total_size;
+	}
+
+	data_offset = __atomic_fetch_add(&ctl->data_ctl.offset, data_size, __ATOMIC_RELAXED);
+	index_offset = __atomic_fetch_add(&ctl->index_ctl.size, n * hdr_size, __ATOMIC_RELAXED);
+
+	for (i = 0; i < n; ++i) {
+		const struct eblob_write_batch *w = &batch[recs[i].pos];
+		struct eblob_write_control *wc = &recs[i].wc;
+		const uint64_t gap = wc->total_size - hdr_size - wc->size - recs[i].footer_size;
+
+		wc->bctl = ctl;
+		wc->index = ctl->index;
+		wc->data_fd = ctl->data_ctl.fd;
+		wc->index_fd = ctl->index_ctl.fd;
+		wc->ctl_data_offset = data_offset;
+		wc->ctl_index_offset = index_offset + i * hdr_size;
+		wc->data_offset = wc->ctl_data_offset + hdr_size;
+		data_offset += wc->total_size;
+
+		eblob_wc_to_dc(&recs[i].key, wc, &buf->dcs[i]);
+
+		/* Record is laid out as header, data, zeroed gap and footer */
+		buf->iov[k].iov_base = &buf->dcs[i];
+		buf->iov[k++].iov_len = hdr_size;
+		for (j = 0; j < w->iovcnt; ++j) {
+			buf->iov[k].iov_base = w->iov[j].base;
+			buf->iov[k++].iov_len = w->iov[j].size;
+		}
+		if (gap) {
+			buf->iov[k].iov_base = buf->zeroes;
+			buf->iov[k++].iov_len = gap;
+		}
+		if (recs[i].footer_size) {
+			buf->iov[k].iov_base = recs[i].footer;
+			buf->iov[k++].iov_len = recs[i].footer_size;
+		}
+	}
+
+	err = __eblob_write_ll(ctl->index_ctl.fd, buf->dcs, n * hdr_size, index_offset);
+	if (err) {
+		__atomic_fetch_sub(&ctl->data_ctl.offset, data_size, __ATOMIC_RELAXED);
+		__atomic_fetch_sub(&ctl->index_ctl.size, n * hdr_size, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&ctl->lock);
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: index write failed: fd: %d, "
+				"offset: %" PRIu64 ", records: %zu: %d\n",
+				ctl->index, __func__, ctl->index_ctl.fd, index_offset, n, err);
+		goto err_out_fail;
+	}
+
+	pthread_mutex_unlock(&ctl->lock);
+
+	if (!b->cfg.sync) {
+		err = eblob_group_commit(b, ctl, EBLOB_GROUP_COMMIT_INDEX);
+		if (err) {
+			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: index sync failed: fd: %d: %d\n",
+					ctl->index, __func__, ctl->index_ctl.fd, err);
+			goto err_out_abandon;
+		}
+	}
+
+	err = __eblob_writev_ll(ctl->data_ctl.fd, buf->iov, k, recs[0].wc.ctl_data_offset);
+	if (err) {
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: data write failed: fd: %d, "
+				"offset: %" PRIu64 ", size: %" PRIu64 ": %d\n",
+				ctl->index, __func__, ctl->data_ctl.fd, recs[0].wc.ctl_data_offset, data_size, err);
+		goto err_out_abandon;
+	}
+
+	if (!b->cfg.sync) {
+		err = eblob_group_commit(b, ctl, EBLOB_GROUP_COMMIT_DATA);
+		if (err) {
+			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: data sync failed: fd: %d: %d\n",
+					ctl->index, __func__, ctl->data_ctl.fd, err);
+			goto err_out_abandon;
+		}
+	}
+
+	for (i = 0; i < n; ++i) {
+		eblob_write_account_disk(b, &recs[i].wc);
+
+		buf->entries[m].key = &recs[i].key;
+		eblob_wc_to_rctl(&recs[i].wc, &buf->entries[m++].rctl);
+	}
+
+	eblob_cache_insert_batch(b, buf->entries, m);
+	for (i = 0; i < m; ++i) {
+		errors[recs[i].pos] = buf->entries[i].err;
+		if (buf->entries[i].err)
+			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: %s: %s: eblob_cache_insert_batch: %d\n",
+					eblob_dump_id(buf->entries[i].key->id), __func__, buf->entries[i].err);
+	}
+
+	eblob_bctl_release(ctl);
+	return n;
+
+err_out_abandon:
+	eblob_write_batch_abandon(b, recs, n);
+err_out_fail:
+	eblob_write_batch_fail(recs, n, errors, err);
+	eblob_bctl_release(ctl);
+	return n;
+}
+
+int eblob_writev_batch(struct eblob_backend *b, const struct eblob_write_batch *batch,
+		size_t num, int *errors)
+{
+	FORMATTED(HANDY_TIMER_SCOPE, ("eblob.%u.disk.write.batch", b->cfg.stat_id));
+
+	static const size_t hdr_size = sizeof(struct eblob_disk_control);
+	struct eblob_write_batch_rec *recs = NULL;
+	struct eblob_write_batch_buf buf = { .dcs = NULL, };
+	char *footers = NULL;
+	uint64_t data_size = 0, pad_size = 0, footers_size = 0;
+	size_t i, j, n = 0, bulk = 0, iovcnt = 0;
+	ssize_t done;
+	int err = 0;
+
+	if (b == NULL || batch == NULL || errors == NULL)
+		return -EINVAL;
+
+	recs = malloc(num * sizeof(struct eblob_write_batch_rec));
+	if (recs == NULL && num != 0) {
+		for (i = 0; i < num; ++i)
+			errors[i] = -ENOMEM;
+		return -ENOMEM;
+	}
+
+	/* Positive error means that record is not written yet */
+	for (i = 0; i < num; ++i) {
+		errors[i] = 1;
+		recs[i].key = batch[i].key;
+		recs[i].pos = i;
+	}
+	qsort(recs, num, sizeof(struct eblob_write_batch_rec), eblob_write_batch_rec_cmp);
+
+	/*
+	 * Pick records that can be written in bulk and move them to the head
+	 * of @recs keeping them sorted by key.
+	 */
+	for (i = 0; i < num; i = j) {
+		const struct eblob_write_batch *w = &batch[recs[i].pos];
+		struct eblob_write_control *wc;
+		struct eblob_iovec_bounds bounds;
+		struct eblob_ram_control rctl;
+		int disk;
+
+		for (j = i + 1; j < num; ++j)
+			if (eblob_id_cmp(recs[j].key.id, recs[i].key.id) != 0)
+				break;
+
+		/* Writes of the same key must be applied in order */
+		if (j - i > 1)
+			continue;
+
+		if (w->iov == NULL || check_writev_return_flags(w->flags, w->iovcnt) != 0)
+			continue;
+		if (w->flags & BLOB_DISK_CTL_APPEND)
+			continue;
+
+		eblob_iovec_get_bounds(&bounds, w->iov, w->iovcnt);
+		if (bounds.min != 0 || bounds.max == 0 || bounds.contiguous == 0)
+			continue;
+
+		/* Existing record may be overwritten inplace or may need to be copied */
+		if (eblob_cache_lookup(b, &recs[i].key, &rctl, &disk) != -ENOENT)
+			continue;
+
+		recs[n] = recs[i];
+		wc = &recs[n].wc;
+		memset(wc, 0, sizeof(struct eblob_write_control));
+		wc->size = wc->total_data_size = bounds.max;
+		wc->flags = eblob_validate_ctl_flags(b, w->flags);
+		wc->total_size = eblob_calculate_size(b, &recs[n].key, 0, wc->size);
+		recs[n].footer_size = eblob_get_footer_size(b, wc);
+
+		data_size += wc->total_size;
+		footers_size += recs[n].footer_size;
+		if (pad_size < wc->total_size - hdr_size - wc->size - recs[n].footer_size)
+			pad_size = wc->total_size - hdr_size - wc->size - recs[n].footer_size;
+		iovcnt += w->iovcnt + 3;
+		++n;
+	}
+
+	if (n == 0)
+		goto err_out_write_one_by_one;
+
+	err = eblob_check_free_space(b, data_size);
+	if (err)
+		goto err_out_fail;
+
+	buf.dcs = malloc(n * sizeof(struct eblob_disk_control));
+	buf.entries = malloc(n * sizeof(struct eblob_cache_batch_entry));
+	buf.iov = malloc(iovcnt * sizeof(struct iovec));
+	if (pad_size)
+		buf.zeroes = calloc(1, pad_size);
+	if (footers_size)
+		footers = malloc(footers_size);
+	if (buf.dcs == NULL || buf.entries == NULL || buf.iov == NULL ||
+			(pad_size && buf.zeroes == NULL) || (footers_size && footers == NULL)) {
+		err = -ENOMEM;
+		goto err_out_fail;
+	}
+
+	/* Data of bulk records is in memory, so footers are calculated before anything is written */
+	for (i = 0, j = 0; i < n; ++i) {
+		const struct eblob_write_batch *w = &batch[recs[i].pos];
+
+		recs[i].footer = footers + j;
+		j += recs[i].footer_size;
+
+		err = eblob_calculate_footer_iov(b, &recs[i].key, &recs[i].wc, w->iov, w->iovcnt, recs[i].footer);
+		if (err) {
+			eblob_dump_wc(b, &recs[i].key, &recs[i].wc, "eblob_writev_batch: eblob_calculate_footer_iov: FAILED", err);
+			goto err_out_fail;
+		}
+	}
+
+	/* Records go to the last base until it is full, then to the next one */
+	for (bulk = 0; bulk < n; bulk += done) {
+		done = eblob_writev_batch_base(b, batch, recs + bulk, n - bulk, errors, &buf);
+		if (done < 0) {
+			err = done;
+			eblob_write_batch_fail(recs + bulk, n - bulk, errors, err);
+			break;
+		}
+	}
+	err = 0;
+	goto err_out_write_one_by_one;
+
+err_out_fail:
+	eblob_write_batch_fail(recs, n, errors, err);
+err_out_write_one_by_one:
+	for (i = 0; i < num; ++i) {
+		struct eblob_key key = batch[i].key;
+
+		if (errors[i] > 0)
+			errors[i] = eblob_writev(b, &key, batch[i].iov, batch[i].iovcnt, batch[i].flags);
+	}
+
+	eblob_log(b->cfg.log, EBLOB_LOG_NOTICE, "blob: %s: records: %zu, written in bulk: %zu: %d\n",
+			__func__, num, bulk, err);
+
+	free(footers);
+	free(buf.zeroes);
+	free(buf.iov);
+	free(buf.entries);
+	free(buf.dcs);
+	free(recs);
+	return 0;
+}
+
 /**
  * eblob_remove() - remove entry from backend
  */
@@ -2656,19 +3916,13 @@ int eblob_remove(struct eblob_backend *b, struct eblob_key *key)
 	struct eblob_ram_control ctl;
 	int err, disk;
 
-
-	pthread_mutex_lock(&b->lock);
-	err = eblob_cache_lookup(b, key, &ctl, &disk);
+	err = eblob_cache_lookup_hold(b, key, &ctl, &disk);
 	if (err) {
-		pthread_mutex_unlock(&b->lock);
-		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: %s: %s: eblob_cache_lookup: %d.\n",
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: %s: %s: eblob_cache_lookup_hold: %d.\n",
 				eblob_dump_id(key->id), __func__, err);
 		goto err_out_exit;
 	}
 
-	eblob_bctl_hold(ctl.bctl);
-	pthread_mutex_unlock(&b->lock);
-
 	if ((err = eblob_mark_entry_removed_purge(b, key, &ctl)) != 0) {
 		eblob_log(b->cfg.log, EBLOB_LOG_ERROR,
 				"%s: %s: eblob_mark_entry_removed_purge: %d\n",
@@ -2712,9 +3966,7 @@ static int _eblob_read_ll(struct eblob_backend *b, struct eblob_key *key,
 
 	memset(wc, 0, sizeof(struct eblob_write_control));
 
-	pthread_mutex_lock(&b->lock);
 	err = eblob_fill_write_control_from_ram(b, key, wc, 0, NULL);
-	pthread_mutex_unlock(&b->lock);
 	if (err < 0) {
 		eblob_log(b->cfg.log, EBLOB_LOG_ERROR,
 				"blob: %s: %s: eblob_fill_write_control_from_ram: %d.\n",
@@ -3166,6 +4418,9 @@ int eblob_inspect(struct eblob_backend *b) {
 
 void eblob_cleanup(struct eblob_backend *b)
 {
+	/* Complete queued asynchronous requests while backend is still fully functional */
+	eblob_async_destroy(b);
+
 	eblob_event_set(&b->exit_event);
 
 	if (!(b->cfg.blob_flags & EBLOB_DISABLE_THREADS)) {
@@ -3175,12 +4430,15 @@ void eblob_cleanup(struct eblob_backend *b)
 		pthread_join(b->inspect_tid, NULL);
 	}
 
+	eblob_group_commit_destroy(b);
+
 	eblob_json_stat_destroy(b);
 
 	eblob_bases_cleanup(b);
 
-	eblob_hash_destroy(&b->hash);
-	eblob_l2hash_destroy(&b->l2hash);
+	eblob_locator_destroy(b);
+
+	eblob_cache_destroy(b);
 
 	free(b->base_dir);
 	free(b->cfg.file);
@@ -3229,6 +4487,16 @@ static int eblob_lock_blob(struct eblob_backend *b)
 	return 0;
 }
 
+#if defined(__x86_64__) || defined(__aarch64__)
+/*
+ * New fields of struct eblob_config are taken from its reserved tail, so
+ * config passed by binaries built against older headers keeps its layout.
+ */
+_Static_assert(sizeof(struct eblob_config) == 248, "eblob_config size changed");
+_Static_assert(offsetof(struct eblob_config, blob_size_limit) == 64, "eblob_config layout changed");
+_Static_assert(offsetof(struct eblob_config, cache_shards) == 104, "eblob_config layout changed");
+#endif
+
 struct eblob_backend *eblob_init(struct eblob_config *c)
 {
 	struct eblob_backend *b;
@@ -3237,6 +4505,12 @@ struct eblob_backend *eblob_init(struct eblob_config *c)
 
 	eblob_log(c->log, EBLOB_LOG_INFO, "blob: start\n");
 
+	if ((c->blob_flags & EBLOB_L2HASH) && (c->blob_flags & EBLOB_FLATHASH)) {
+		eblob_log(c->log, EBLOB_LOG_ERROR, "blob: l2hash and flathash can not be used together\n");
+		err = -EINVAL;
+		goto err_out_exit;
+	}
+
 	b = calloc(1, sizeof(struct eblob_backend));
 	if (!b) {
 		err = -ENOMEM;
@@ -3264,6 +4538,12 @@ struct eblob_backend *eblob_init(struct eblob_config *c)
 		c->index_block_size = EBLOB_INDEX_DEFAULT_BLOCK_SIZE;
 	if (!c->index_block_bloom_length)
 		c->index_block_bloom_length = EBLOB_INDEX_DEFAULT_BLOCK_BLOOM_LENGTH;
+	if (!c->bloom_false_positive_ppm)
+		c->bloom_false_positive_ppm = EBLOB_DEFAULT_BLOOM_FALSE_POSITIVE_PPM;
+	if (!c->io_threads)
+		c->io_threads = EBLOB_DEFAULT_IO_THREADS;
+	if (!c->datasort_threads)
+		c->datasort_threads = EBLOB_DEFAULT_DATASORT_THREADS;
 	if (!c->blob_size)
 		c->blob_size = EBLOB_BLOB_DEFAULT_BLOB_SIZE;
 	if (!c->records_in_blob)
@@ -3330,22 +4610,22 @@ struct eblob_backend *eblob_init(struct eblob_config *c)
 	INIT_LIST_HEAD(&b->bases);
 	b->max_index = -1;
 
-	err = eblob_l2hash_init(&b->l2hash);
+	err = eblob_cache_init(b);
 	if (err) {
-		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: l2hash initialization failed: %s %d.\n", strerror(-err), err);
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: cache initialization failed: %s %d.\n", strerror(-err), err);
 		goto err_out_lock_destroy;
 	}
 
-	err = eblob_hash_init(&b->hash, sizeof(struct eblob_ram_control));
+	err = eblob_locator_init(b);
 	if (err) {
-		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: hash initialization failed: %s %d.\n", strerror(-err), err);
-		goto err_out_l2hash_destroy;
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: locator initialization failed: %s %d.\n", strerror(-err), err);
+		goto err_out_cache_destroy;
 	}
 
 	err = eblob_load_data(b);
 	if (err) {
 		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: index iteration failed: %d.\n", err);
-		goto err_out_hash_destroy;
+		goto err_out_locator_destroy;
 	}
 	eblob_stat_summary_update(b);
 
@@ -3373,11 +4653,19 @@ struct eblob_backend *eblob_init(struct eblob_config *c)
 	if (err != 0)
 		goto err_out_inspect_lock_destroy;
 
+	err = eblob_group_commit_init(b);
+	if (err != 0)
+		goto err_out_json_stat_destroy;
+
+	err = eblob_async_init(b);
+	if (err != 0)
+		goto err_out_group_commit_destroy;
+
 	if (!(b->cfg.blob_flags & EBLOB_DISABLE_THREADS)) {
 		err = pthread_create(&b->sync_tid, NULL, eblob_sync_thread, b);
 		if (err) {
 			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: eblob sync thread creation failed: %d.\n", err);
-			goto err_out_json_stat_destroy;
+			goto err_out_async_destroy;
 		}
 
 		err = pthread_create(&b->defrag_tid, NULL, eblob_defrag_thread, b);
@@ -3411,6 +4699,10 @@ err_out_join_defrag:
 err_out_join_sync:
 	eblob_event_set(&b->exit_event);
 	pthread_join(b->sync_tid, NULL);
+err_out_async_destroy:
+	eblob_async_destroy(b);
+err_out_group_commit_destroy:
+	eblob_group_commit_destroy(b);
 err_out_json_stat_destroy:
 	eblob_json_stat_destroy(b);
 err_out_inspect_lock_destroy:
@@ -3425,10 +4717,10 @@ err_out_exit_event_destroy:
 	eblob_event_destroy(&b->exit_event);
 err_out_cleanup:
 	eblob_bases_cleanup(b);
-err_out_l2hash_destroy:
-	eblob_l2hash_destroy(&b->l2hash);
-err_out_hash_destroy:
-	eblob_hash_destroy(&b->hash);
+err_out_locator_destroy:
+	eblob_locator_destroy(b);
+err_out_cache_destroy:
+	eblob_cache_destroy(b);
 err_out_lock_destroy:
 	pthread_mutex_destroy(&b->lock);
 err_out_lockf:
@@ -3574,10 +4866,10 @@ static void eblob_mark_entry_corrupted(struct eblob_backend *b, struct eblob_key
 	eblob_stat_inc(b->stat_summary, EBLOB_LST_RECORDS_CORRUPTED);
 	eblob_stat_add(b->stat_summary, EBLOB_LST_CORRUPTED_SIZE, record_size);
 
-	if (!b->cfg.sync) {
-		eblob_fdatasync(wc->index_fd);
-		eblob_fdatasync(wc->data_fd);
-	}
+	if (!b->cfg.sync && eblob_group_commit(b, bctl, EBLOB_GROUP_COMMIT_DATA | EBLOB_GROUP_COMMIT_INDEX))
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: i%d: failed to sync corrupted record mark: offset: %"
+		                                       PRIu64 "\n",
+		          wc->index, wc->ctl_index_offset);
 
 err_out_release_bctl:
 	if (!wc->bctl)
@@ -3586,7 +4878,8 @@ err_out:
 	return;
 }
 
-int eblob_verify_checksum(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc) {
+static int eblob_verify_checksum_ll(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+		void *buffer, size_t buffer_size, const char *record) {
 	if (b->cfg.blob_flags & EBLOB_NO_FOOTER ||
 	    wc->flags & (BLOB_DISK_CTL_NOCSUM | BLOB_DISK_CTL_REMOVE | BLOB_DISK_CTL_UNCOMMITTED))
 		return 0;
@@ -3608,9 +4901,9 @@ int eblob_verify_checksum(struct eblob_backend *b, struct eblob_key *key, struct
 	HANDY_TIMER_SCOPE(("eblob.%u.verify_checksum", b->cfg.stat_id));
 
 	if (wc->flags & BLOB_DISK_CTL_CHUNKED_CSUM)
-		err = eblob_verify_mmhash(b, key, wc);
+		err = eblob_verify_mmhash(b, key, wc, buffer, buffer_size, record);
 	else
-		err = eblob_verify_sha512(b, key, wc);
+		err = eblob_verify_sha512(b, key, wc, record);
 
 	if (err == -EILSEQ)
 		eblob_mark_entry_corrupted(b, key, wc);
@@ -3622,6 +4915,20 @@ int eblob_verify_checksum(struct eblob_backend *b, struct eblob_key *key, struct
 	return err;
 }
 
+int eblob_verify_checksum_buffer(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+		void *buffer, size_t buffer_size) {
+	return eblob_verify_checksum_ll(b, key, wc, buffer, buffer_size, NULL);
+}
+
+int eblob_verify_checksum_record(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+		const char *record) {
+	return eblob_verify_checksum_ll(b, key, wc, NULL, 0, record);
+}
+
+int eblob_verify_checksum(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc) {
+	return eblob_verify_checksum_buffer(b, key, wc, NULL, 0);
+}
+
 int eblob_set_name(const char *format, ...) {
 	char name[16 + 1];
 	memset(name, 0, sizeof(name));
@@ -20,22 +20,33 @@
 
 #ifndef __EBLOB_BLOB_H
 #define __EBLOB_BLOB_H
+#include "async.h"
 #include "datasort.h"
 #include "eblob/blob.h"
 #include "hash.h"
 #include "l2hash.h"
+#include "flathash.h"
+#include "group_commit.h"
 #include "list.h"
+#include "locator.h"
 #include "stat.h"
+#include "uring.h"
 
 #include <sys/statvfs.h>
+#include <sys/uio.h>
 
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdint.h>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -83,12 +94,55 @@ extern "C" {
 #define EBLOB_DEFAULT_DEFRAG_SPLAY		(3)
 #define EBLOB_DEFAULT_DEFRAG_MIN_TIMEOUT	(60)
 #define EBLOB_DEFAULT_PERIODIC_THREAD_TIMEOUT	(15)
+#define EBLOB_DEFAULT_CACHE_SHARDS		(16)
+#define EBLOB_DEFAULT_IO_THREADS		(4)
+#define EBLOB_DEFAULT_DATASORT_THREADS		(2)
+/* Shard is selected by first two bytes of the key */
+#define EBLOB_MAX_CACHE_SHARDS			(1 << 16)
+
+/*
+ * Initial load collects records of unsorted bases and puts them to ram index
+ * in batches of at most EBLOB_CACHE_BULK_MAX records.
+ */
+#define EBLOB_CACHE_BULK_MIN			(1 << 10)
+#define EBLOB_CACHE_BULK_MAX			(1 << 18)
+
+/* Size of blob window read at once by data-order iteration */
+#define EBLOB_ITERATE_DATA_WINDOW		(4 << 20)
+/*
+ * Iterator prefetches blob parts needed by records of index batch at most
+ * this many bytes per batch, parts closer than PREFETCH_GAP are merged.
+ */
+#define EBLOB_ITERATE_PREFETCH_MAX		(64 << 20)
+#define EBLOB_ITERATE_PREFETCH_GAP		(64 << 10)
+/*
+ * Checksums are verified by iteration with VERIFY_CHECKSUM in a separate
+ * stage, each of its workers reads records through buffer of this size.
+ * It holds several checksum chunks, so they are read and hashed at once.
+ */
+#define EBLOB_ITERATE_VERIFY_BUFFER		(4 << 20)
 
 /* Size of one entry in cache */
 static const size_t EBLOB_HASH_ENTRY_SIZE = sizeof(struct eblob_ram_control)
 	+ sizeof(struct eblob_hash_entry);
 /* Approx. size of l2hash entry (considering there wasn't a collision) */
 static const size_t EBLOB_L2HASH_ENTRY_SIZE = sizeof(struct eblob_l2hash_entry);
+/* Approx. size of flathash entry (slab entry plus one slot) */
+static const size_t EBLOB_FLATHASH_ENTRY_SIZE = sizeof(struct eblob_flathash_entry)
+	+ sizeof(struct eblob_flathash_slot);
+
+/*
+ * One partition of in-memory cache.
+ * Shards cover contiguous key ranges, shard with bigger number holds bigger keys.
+ */
+struct eblob_cache_shard {
+	/* In memory cache, hash.root_lock protects the whole shard */
+	struct eblob_hash	hash;
+	/* Level two hash table */
+	struct eblob_l2hash	l2hash;
+	/* Open-addressing hash table */
+	struct eblob_flathash	flathash;
+};
 
 struct eblob_file_ctl {
 	int			fd;
@@ -102,6 +156,8 @@ struct eblob_file_ctl {
  * FIXME: By default we have around 128 bits per key, which is kinda too much
  */
 #define EBLOB_INDEX_DEFAULT_BLOCK_BLOOM_LENGTH		(EBLOB_INDEX_DEFAULT_BLOCK_SIZE * 128)
+/* Target false positive rate of blocked bloom filter: 0.1% */
+#define EBLOB_DEFAULT_BLOOM_FALSE_POSITIVE_PPM		1000
 
 /*
  * Sync written data to disk
@@ -133,6 +189,7 @@ struct eblob_base_ctl {
 
 	int			index;
 
+	/* Also serializes space reservation and header commit of new records */
 	pthread_mutex_t		lock;
 	pthread_cond_t		critness_wait;
 
@@ -152,9 +209,26 @@ struct eblob_base_ctl {
 	uint64_t		bloom_size;
 	/* Number of hash functions */
 	uint8_t			bloom_func_num;
+	/* Number of cache lines in blocked bloom filter, zero if classic one is used */
+	uint64_t		bloom_blocks;
 
 	/* Array of index blocks */
 	struct eblob_index_block	*index_blocks;
+	/*
+	 * Read-only mapping of sorted index, lookups search in it directly.
+	 * Lives as long as @index_blocks.
+	 */
+	struct eblob_disk_control	*index_map;
+	uint64_t		index_map_size;
+	/*
+	 * Mapping of .index.meta file @index_blocks and @bloom point to,
+	 * NULL if they were built from sorted index and are allocated.
+	 */
+	void			*meta_map;
+	uint64_t		meta_map_size;
+	/* Payload checksum of .index.meta file that describes this base, 0 if there is none */
+	uint64_t		meta_csum;
+	/* Protects @index_blocks, @bloom and @index_map */
 	pthread_rwlock_t	index_blocks_lock;
 
 	/* Number of bctl users inside a critical section */
@@ -312,12 +386,80 @@ inline static int eblob_bloom_ll(struct eblob_base_ctl *bctl, const struct eblob
 	}
 }
 
+/*
+ * Blocked bloom filter: all bits of the key are in a single cache line, one
+ * bit in each 64-bit word of it, so lookup costs at most one cache miss.
+ * Line and bits are taken from key words, that are already well distributed
+ * for sha512 keys, and spread by multiplication with per-word salts.
+ */
+#define EBLOB_BLOOM_BLOCK_SIZE		64
+#define EBLOB_BLOOM_BLOCK_WORDS		(EBLOB_BLOOM_BLOCK_SIZE / sizeof(uint64_t))
+
+static const uint32_t eblob_bloom_salt[EBLOB_BLOOM_BLOCK_WORDS] __attribute__ ((aligned(32))) = {
+	0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+	0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+__attribute_always_inline__
+inline static uint64_t *__eblob_bloom_block_calc(const struct eblob_base_ctl *bctl, const struct eblob_key *key,
+		uint32_t *hash)
+{
+	uint64_t w[EBLOB_ID_SIZE / sizeof(uint64_t)], x, y;
+
+	memcpy(w, key->id, sizeof(w));
+	x = (w[0] ^ w[2] ^ w[4] ^ w[6]) * 0x9e3779b97f4a7c15ULL;
+	y = (w[1] ^ w[3] ^ w[5] ^ w[7]) * 0x9e3779b97f4a7c15ULL;
+
+	*hash = y >> 32;
+	/* Maps high 32 bits of @x to [0, bloom_blocks) without division */
+	return (uint64_t *)bctl->bloom + EBLOB_BLOOM_BLOCK_WORDS * (((x >> 32) * bctl->bloom_blocks) >> 32);
+}
+
+__attribute_always_inline__
+inline static int __eblob_bloom_block_get(const struct eblob_base_ctl *bctl, const struct eblob_key *key)
+{
+	uint32_t hash;
+	const uint64_t *block = __eblob_bloom_block_calc(bctl, key, &hash);
+
+#ifdef __AVX2__
+	const __m256i salt = _mm256_load_si256((const __m256i *)eblob_bloom_salt);
+	const __m256i bits = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32((int)hash), salt), 26);
+	const __m256i one = _mm256_set1_epi64x(1);
+	const __m256i lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(bits)));
+	const __m256i hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(bits, 1)));
+
+	return _mm256_testc_si256(_mm256_load_si256((const __m256i *)block), lo) &&
+		_mm256_testc_si256(_mm256_load_si256((const __m256i *)block + 1), hi);
+#else
+	uint64_t missing = 0;
+	unsigned int i;
+
+	for (i = 0; i < EBLOB_BLOOM_BLOCK_WORDS; ++i)
+		missing |= ~block[i] & (1ULL << ((uint32_t)(hash * eblob_bloom_salt[i]) >> 26));
+
+	return missing == 0;
+#endif
+}
+
+__attribute_always_inline__
+inline static void __eblob_bloom_block_set(struct eblob_base_ctl *bctl, const struct eblob_key *key)
+{
+	uint32_t hash;
+	uint64_t *block = __eblob_bloom_block_calc(bctl, key, &hash);
+	unsigned int i;
+
+	for (i = 0; i < EBLOB_BLOOM_BLOCK_WORDS; ++i)
+		block[i] |= 1ULL << ((uint32_t)(hash * eblob_bloom_salt[i]) >> 26);
+}
+
 /*!
  * Returns non-null if \a key is present in \a bctl bloom fileter
  */
 __attribute_always_inline__
 inline static int eblob_bloom_get(struct eblob_base_ctl *bctl, const struct eblob_key *key)
 {
+	if (bctl->bloom_blocks)
+		return __eblob_bloom_block_get(bctl, key);
 	return eblob_bloom_ll(bctl, key, EBLOB_BLOOM_CMD_GET);
 }
 
@@ -327,7 +469,10 @@ inline static int eblob_bloom_get(struct eblob_base_ctl *bctl, const struct eblo
 __attribute_always_inline__
 inline static void eblob_bloom_set(struct eblob_base_ctl *bctl, const struct eblob_key *key)
 {
-	eblob_bloom_ll(bctl, key, EBLOB_BLOOM_CMD_SET);
+	if (bctl->bloom_blocks)
+		__eblob_bloom_block_set(bctl, key);
+	else
+		eblob_bloom_ll(bctl, key, EBLOB_BLOOM_CMD_SET);
 }
 
 /*
@@ -410,15 +555,18 @@ struct json_stat_cache;
 struct eblob_backend {
 	struct eblob_config	cfg;
 
+	/* Protects list of bases and selection of the base new records go to */
 	pthread_mutex_t		lock;
 
 	struct list_head	bases;
 	int			max_index;
 
-	/* In memory cache */
-	struct eblob_hash	hash;
-	/* Level two hash table */
-	struct eblob_l2hash	l2hash;
+	/* In memory cache partitioned by high bits of the key */
+	struct eblob_cache_shard	*cache_shards;
+	/* Number of key bits used to select a shard */
+	unsigned int		cache_shards_bits;
+	/* Grace periods for lockless cache readers */
+	struct eblob_epoch	cache_epoch;
 
 	/* Threads exit event */
 	struct eblob_event	exit_event;
@@ -433,6 +581,15 @@ struct eblob_backend {
 	pthread_t		periodic_tid;
 	pthread_t		inspect_tid;
 
+	/* Batches syncs of concurrent writers when @cfg.sync == 0 */
+	struct eblob_group_commit	group_commit;
+
+	/* I/O threads that process eblob_*_async() requests */
+	struct eblob_async	async;
+
+	/* Maps keys of sorted bases to bases that hold them, used with EBLOB_KEY_LOCATOR */
+	struct eblob_locator	locator;
+
 	/*
 	 * Last time when data.stat file was updated. Data statistics is being updated by periodic thread
 	 * once per second, but it is only dumped into data.stat file once per @cfg.periodic_timeout
@@ -468,6 +625,9 @@ struct eblob_backend {
 	struct json_stat_cache *json_stat;
 	/* generation counter that is incremented by defrag/data-sort
 	 * it is used for determining that blob has been defraged
+	 * NB! It is incremented when cache is locked for the swap and again
+	 * before swapped bctls are unlocked, so lookups that are done without
+	 * @lock can check it after holding bctl or after a miss
 	 */
 	size_t		defrag_generation;
 
@@ -482,11 +642,44 @@ int eblob_add_new_base(struct eblob_backend *b);
 int eblob_load_data(struct eblob_backend *b);
 void eblob_bases_cleanup(struct eblob_backend *b);
 
+int eblob_cache_init(struct eblob_backend *b);
+void eblob_cache_destroy(struct eblob_backend *b);
+int eblob_cache_lock_all(struct eblob_backend *b);
+void eblob_cache_unlock_all(struct eblob_backend *b);
+int eblob_cache_empty(struct eblob_backend *b);
 int eblob_cache_lookup(struct eblob_backend *b, struct eblob_key *key, struct eblob_ram_control *res, int *diskp);
 int eblob_cache_remove(struct eblob_backend *b, struct eblob_key *key);
 int eblob_cache_remove_nolock(struct eblob_backend *b, struct eblob_key *key);
+
+/*
+ * Returns cache shard responsible for key @id.
+ * High bits of the key are used, so shards are ordered the same way as keys.
+ */
+static inline struct eblob_cache_shard *eblob_cache_shard(struct eblob_backend *b,
+		const unsigned char *id)
+{
+	const unsigned int prefix = ((unsigned int)id[0] << 8) | id[1];
+
+	return &b->cache_shards[prefix >> (16 - b->cache_shards_bits)];
+}
+
 int eblob_cache_insert(struct eblob_backend *b, struct eblob_key *key,
 		struct eblob_ram_control *ctl);
+
+/* Entry of eblob_cache_insert_batch() */
+struct eblob_cache_batch_entry {
+	struct eblob_key		*key;
+	struct eblob_ram_control	rctl;
+	/* Result of insertion of this entry */
+	int				err;
+};
+
+/*
+ * Inserts @num entries taking lock of each shard once per run of entries
+ * that belong to it, so entries sorted by key take every lock only once.
+ */
+void eblob_cache_insert_batch(struct eblob_backend *b, struct eblob_cache_batch_entry *entries,
+		size_t num);
 int eblob_disk_index_lookup(struct eblob_backend *b, struct eblob_key *key,
 		struct eblob_ram_control *rctl);
 
@@ -517,7 +710,10 @@ int eblob_generate_sorted_index(struct eblob_backend *b, struct eblob_base_ctl *
 int eblob_index_blocks_destroy(struct eblob_base_ctl *bctl);
 
 int eblob_index_blocks_fill(struct eblob_base_ctl *bctl);
+/* Saves current counters of sorted base to its .index.meta file */
+void eblob_index_meta_sync(struct eblob_base_ctl *bctl);
 int __eblob_write_ll(int fd, const void *data, size_t size, off_t offset);
+int __eblob_writev_ll(int fd, struct iovec *iov, int iovcnt, off_t offset);
 int __eblob_read_ll(int fd, void *data, size_t size, off_t offset);
 
 struct eblob_disk_search_stat {
@@ -543,14 +739,24 @@ ssize_t eblob_get_actual_size(int fd);
 int eblob_key_sort(const void *key1, const void *key2);
 int eblob_disk_control_sort(const void *d1, const void *d2);
 int eblob_disk_control_sort_with_flags(const void *d1, const void *d2);
+int eblob_disk_control_radix_sort(struct eblob_disk_control *dcs, uint64_t num,
+		int (*cmp)(const void *, const void *), unsigned int threads);
 
 int eblob_copy_data(int fd_in, uint64_t off_in, int fd_out, uint64_t off_out, ssize_t len);
 int eblob_splice_data(int fd_in, uint64_t off_in, int fd_out, uint64_t off_out, ssize_t len);
 
 int eblob_preallocate(int fd, off_t offset, off_t size);
 int eblob_pagecache_hint(int fd, uint64_t flag);
+/* Starts asynchronous read of @size bytes of @fd at @offset into pagecache */
+int eblob_pagecache_prefetch(int fd, uint64_t offset, uint64_t size);
 
 int eblob_mark_index_removed(int fd, uint64_t offset);
+/* eblob_verify_checksum() that reads record through @buffer of @buffer_size bytes */
+int eblob_verify_checksum_buffer(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+		void *buffer, size_t buffer_size);
+/* eblob_verify_checksum() of record which whole image of @wc->total_size bytes is at @record */
+int eblob_verify_checksum_record(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+		const char *record);
 void eblob_base_wait(struct eblob_base_ctl *bctl);
 void eblob_base_wait_locked(struct eblob_base_ctl *bctl);
 
@@ -559,6 +765,16 @@ void eblob_bctl_release(struct eblob_base_ctl *bctl);
 
 int eblob_mutex_init(pthread_mutex_t *mutex);
 int eblob_cond_init(pthread_cond_t *cond);
+int eblob_parallel(unsigned int threads, unsigned int num,
+		int (*func)(void *priv, unsigned int item), void *priv);
+
+/* Number of threads that load bases on startup and iterate bases in background */
+static inline unsigned int eblob_worker_threads(struct eblob_backend *b)
+{
+	if (b->cfg.blob_flags & EBLOB_DISABLE_THREADS)
+		return 1;
+	return b->cfg.io_threads;
+}
 
 struct eblob_base_ctl *eblob_base_ctl_new(struct eblob_backend *b, int index,
 		const char *name, int name_len);
@@ -260,8 +260,11 @@ int datasort_cleanup_stale(struct eblob_log *log, char *base, char *dir)
 	eblob_log(log, EBLOB_LOG_INFO, "stale datasort dir found: %s\n", dir);
 
 	/* Glob all chunks in this directory */
-	snprintf(datasort_dir, PATH_MAX, "%s/%s", base, dir);
-	snprintf(datasort_chunks, PATH_MAX, "%s/chunk.*", datasort_dir);
+	if (snprintf(datasort_dir, PATH_MAX, "%s/%s", base, dir) >= PATH_MAX ||
+	    snprintf(datasort_chunks, PATH_MAX, "%s/chunk.*", datasort_dir) >= PATH_MAX) {
+		eblob_log(log, EBLOB_LOG_ERROR, "path is too long: %s/%s\n", base, dir);
+		return -ENAMETOOLONG;
+	}
 
 	err = glob(datasort_chunks, 0, NULL, &datasort_glob);
 	if (err != 0) {
@@ -382,6 +385,30 @@ err:
 	return NULL;
 }
 
+/*
+ * Creates chunk that indexes records left in place in base with data
+ * descriptor @fd
+ */
+static struct datasort_chunk *datasort_add_base_chunk(struct datasort_cfg *dcfg, int fd)
+{
+	struct datasort_chunk *chunk;
+
+	assert(dcfg);
+	assert(fd >= 0);
+
+	chunk = calloc(1, sizeof(*chunk));
+	if (chunk == NULL) {
+		EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, errno, "defrag: calloc");
+		return NULL;
+	}
+	chunk->fd = fd;
+	chunk->in_base = 1;
+
+	EBLOB_WARNX(dcfg->log, EBLOB_LOG_INFO, "defrag: added new in-base chunk: fd: %d", fd);
+
+	return chunk;
+}
+
 /*
  * Recursively destroys all initialized fields of one chunk
  */
@@ -399,6 +426,13 @@ static void datasort_destroy_chunk(struct datasort_cfg *dcfg, struct datasort_ch
 	assert(dcfg != NULL);
 	assert(chunk != NULL);
 
+	/* Base and its descriptor are not owned by chunk */
+	if (chunk->in_base) {
+		EBLOB_WARNX(dcfg->log, EBLOB_LOG_NOTICE, "defrag: destroying in-base chunk: fd: %d", chunk->fd);
+		_datasort_destroy_chunk(chunk);
+		return;
+	}
+
 	EBLOB_WARNX(dcfg->log, EBLOB_LOG_NOTICE, "defrag: destroying chunk: %s, fd: %d", chunk->path, chunk->fd);
 
 	if (chunk->path != NULL) {
@@ -433,13 +467,45 @@ static void datasort_destroy_chunks(struct datasort_cfg *dcfg, struct list_head
 	EBLOB_WARNX(dcfg->log, EBLOB_LOG_NOTICE, "defrag: destroyed list of chunks");
 }
 
+/*
+ * datasort_io_throttle() - accounts @size bytes copied by datasort and sleeps
+ * if needed, so copies of all threads stay under @io_limit bytes per second.
+ */
+static void datasort_io_throttle(struct datasort_cfg *dcfg, uint64_t size)
+{
+	struct timespec ts;
+	uint64_t now, delay;
+
+	if (dcfg->io_limit == 0 || size == 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	pthread_mutex_lock(&dcfg->lock);
+	if (dcfg->io_next < now)
+		dcfg->io_next = now;
+	delay = dcfg->io_next - now;
+	dcfg->io_next += (double)size * 1000000000 / dcfg->io_limit;
+	pthread_mutex_unlock(&dcfg->lock);
+
+	if (delay == 0)
+		return;
+
+	ts.tv_sec = delay / 1000000000;
+	ts.tv_nsec = delay % 1000000000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
 /*
  * Split data in ~chunk_size byte pieces.
  *
  * If size of current chunk + new entry >= chunk_size:
  * - start new one, add it to linked list, make it current
  * Then
- * - copy new entry to current chunk
+ * - copy new entry to current chunk, or only add it to chunk's index if
+ *   records are gathered from bases by merge
  */
 static int datasort_split_iterator(struct eblob_disk_control *dc,
 		struct eblob_ram_control *rctl __attribute_unused__,
@@ -470,8 +536,10 @@ static int datasort_split_iterator(struct eblob_disk_control *dc,
 	 */
 	if (c == NULL || (dcfg->chunk_size > 0 && c->offset + dc->disk_size >= dcfg->chunk_size)
 			|| (dcfg->chunk_limit > 0 && c->count >= dcfg->chunk_limit)) {
-		/* TODO: here we can plug sort for speedup */
-		c = datasort_add_chunk(dcfg, dcfg->chunks_dir);
+		if (dcfg->gather)
+			c = datasort_add_base_chunk(dcfg, fd);
+		else
+			c = datasort_add_chunk(dcfg, dcfg->chunks_dir);
 		if (c == NULL) {
 			err = -EIO;
 			EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err, "defrag: datasort_add_chunk: FAILED");
@@ -492,8 +560,9 @@ static int datasort_split_iterator(struct eblob_disk_control *dc,
 			", size: %" PRIu64 ", flags: %s",
 			eblob_dump_id(dc->key.id), c->fd, c->offset, dc->disk_size, eblob_dump_dctl_flags(dc->flags));
 
-	/* Rewrite position */
-	dc->position = c->offset;
+	/* Rewrite position unless record stays in base */
+	if (!c->in_base)
+		dc->position = c->offset;
 
 	/* Extend in-memory index if needed */
 	c->index = datasort_reallocf((void **)&c->index, sizeof(struct eblob_disk_control),
@@ -506,6 +575,12 @@ static int datasort_split_iterator(struct eblob_disk_control *dc,
 	}
 	c->index[c->count] = *dc;
 
+	if (c->in_base) {
+		c->offset += dc->disk_size;
+		c->count++;
+		return 0;
+	}
+
 	/* Write header */
 	err = __eblob_write_ll(c->fd, dc, hdr_size, c->offset);
 	if (err) {
@@ -526,6 +601,8 @@ static int datasort_split_iterator(struct eblob_disk_control *dc,
 
 	c->offset += dc->disk_size - hdr_size;
 	c->count++;
+
+	datasort_io_throttle(dcfg, dc->disk_size);
 	return 0;
 
 err:
@@ -578,6 +655,11 @@ static int datasort_split(struct datasort_cfg *dcfg)
 		ictl.base = dcfg->bctl[n];
 		ictl.log = dcfg->b->cfg.log;
 		ictl.flags = EBLOB_ITERATE_FLAGS_ALL | EBLOB_ITERATE_FLAGS_READONLY;
+		/* Data is read by split only if it is copied to chunk files */
+		if (!dcfg->gather)
+			ictl.flags |= EBLOB_ITERATE_FLAGS_PREFETCH_DATA;
+		/* Every thread fills its own chunks */
+		ictl.thread_num = eblob_worker_threads(dcfg->b);
 		ictl.iterator_cb.iterator = datasort_split_iterator;
 		ictl.iterator_cb.iterator_init = datasort_split_iterator_init;
 		ictl.iterator_cb.iterator_free = datasort_split_iterator_free;
@@ -662,7 +744,8 @@ err:
  * - Destroy unsorted chunk
  * - Return sorted chunk
  *
- * TODO: sort step can be merged into split step for speedup
+ * Used only if chunks are stored in files (@chunks_dir is configured),
+ * otherwise only index of in-base chunk is sorted.
  */
 static struct datasort_chunk *datasort_sort_chunk(struct datasort_cfg *dcfg,
 		struct datasort_chunk *unsorted_chunk)
@@ -670,7 +753,6 @@ static struct datasort_chunk *datasort_sort_chunk(struct datasort_cfg *dcfg,
 	ssize_t err;
 	uint64_t i, offset;
 	struct datasort_chunk *sorted_chunk;
-	const ssize_t hdr_size = sizeof(struct eblob_disk_control);
 
 	assert(dcfg != NULL);
 	assert(dcfg->dir != NULL);
@@ -703,7 +785,13 @@ static struct datasort_chunk *datasort_sort_chunk(struct datasort_cfg *dcfg,
 	unsorted_chunk->index = NULL;
 
 	/* Sort index */
-	qsort(sorted_chunk->index, sorted_chunk->count, hdr_size, eblob_disk_control_sort);
+	err = eblob_disk_control_radix_sort(sorted_chunk->index, sorted_chunk->count,
+			eblob_disk_control_sort, 1);
+	if (err) {
+		EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err,
+				"defrag: eblob_disk_control_radix_sort: count: %" PRIu64, sorted_chunk->count);
+		goto err_destroy_chunk;
+	}
 
 	/* Preallocate space for sorted chunk */
 	err = eblob_preallocate(sorted_chunk->fd, 0, sorted_chunk->offset);
@@ -725,6 +813,8 @@ static struct datasort_chunk *datasort_sort_chunk(struct datasort_cfg *dcfg,
 			goto err_destroy_chunk;
 		}
 		offset += dc->disk_size;
+
+		datasort_io_throttle(dcfg, dc->disk_size);
 	}
 	assert(offset == unsorted_chunk->offset);
 
@@ -744,10 +834,62 @@ err:
 	return NULL;
 }
 
-/* Sort all chunks from unsorted list and move them to sorted one */
+/* Unsorted chunks shared by sort threads */
+struct datasort_sort_ctl {
+	struct datasort_cfg		*dcfg;
+	/* Chunk is destroyed and its pointer is reset once it is sorted */
+	struct datasort_chunk		**unsorted;
+	struct datasort_chunk		**sorted;
+};
+
+/* Sorts one chunk, called by eblob_parallel() */
+static int datasort_sort_one(void *priv, unsigned int item)
+{
+	struct datasort_sort_ctl *ctl = priv;
+	struct datasort_cfg *dcfg = ctl->dcfg;
+	struct datasort_chunk *chunk = ctl->unsorted[item];
+	int err;
+
+	if (eblob_event_get(&dcfg->b->exit_event)) {
+		EBLOB_WARNX(dcfg->log, EBLOB_LOG_ERROR, "defrag: exit requested - aborting sort");
+		return -EINTR;
+	}
+
+	/* Records stay in base, merge copies them in order of sorted index */
+	if (chunk->in_base) {
+		err = eblob_disk_control_radix_sort(chunk->index, chunk->count,
+				eblob_disk_control_sort, 1);
+		if (err) {
+			EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err,
+					"defrag: eblob_disk_control_radix_sort: count: %" PRIu64, chunk->count);
+			return err;
+		}
+		ctl->sorted[item] = chunk;
+		ctl->unsorted[item] = NULL;
+		return 0;
+	}
+
+	ctl->sorted[item] = datasort_sort_chunk(dcfg, ctl->unsorted[item]);
+	if (ctl->sorted[item] == NULL) {
+		EBLOB_WARNX(dcfg->log, EBLOB_LOG_ERROR, "defrag: datasort_sort_chunk: FAILED");
+		return -EIO;
+	}
+
+	datasort_destroy_chunk(dcfg, ctl->unsorted[item]);
+	ctl->unsorted[item] = NULL;
+	return 0;
+}
+
+/*
+ * Sort all chunks from unsorted list by up to @sort_threads threads and move
+ * them to sorted one, sorted chunks keep order of unsorted ones.
+ */
 static int datasort_sort(struct datasort_cfg *dcfg)
 {
-	struct datasort_chunk *chunk, *sorted_chunk, *tmp;
+	struct datasort_chunk *chunk, *tmp;
+	struct datasort_sort_ctl ctl = { .dcfg = dcfg };
+	unsigned int i, num = 0;
+	int err;
 
 	assert(dcfg != NULL);
 	assert(list_empty(&dcfg->sorted_chunks) == 1);
@@ -768,63 +910,216 @@ static int datasort_sort(struct datasort_cfg *dcfg)
 		return 0;
 	}
 
-	/* Base is not sorted - sort it */
-	EBLOB_WARNX(dcfg->log, EBLOB_LOG_INFO, "defrag: sort: start");
+	list_for_each_entry(chunk, &dcfg->unsorted_chunks, list)
+		num++;
+
+	ctl.unsorted = calloc(num, sizeof(struct datasort_chunk *));
+	ctl.sorted = calloc(num, sizeof(struct datasort_chunk *));
+	if (ctl.unsorted == NULL || ctl.sorted == NULL) {
+		err = -ENOMEM;
+		EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err, "defrag: calloc: %u chunks", num);
+		goto err_free;
+	}
+
+	/* Chunks are owned by sort threads until sort is finished */
+	i = 0;
 	list_for_each_entry_safe(chunk, tmp, &dcfg->unsorted_chunks, list) {
-		sorted_chunk = datasort_sort_chunk(dcfg, chunk);
-		if (sorted_chunk == NULL) {
-			EBLOB_WARNX(dcfg->log, EBLOB_LOG_ERROR, "defrag: datasort_sort_chunk: FAILED");
-			goto err;
-		}
-		list_add_tail(&sorted_chunk->list, &dcfg->sorted_chunks);
 		list_del(&chunk->list);
-		datasort_destroy_chunk(dcfg, chunk);
+		ctl.unsorted[i++] = chunk;
+	}
 
-		if (eblob_event_get(&dcfg->b->exit_event)) {
-			EBLOB_WARNX(dcfg->log, EBLOB_LOG_ERROR, "defrag: exit requested - aborting sort");
-			goto err;
-		}
+	/* Base is not sorted - sort it */
+	EBLOB_WARNX(dcfg->log, EBLOB_LOG_INFO, "defrag: sort: start: chunks: %u, threads: %u",
+			num, dcfg->sort_threads);
+	err = eblob_parallel(dcfg->sort_threads, num, datasort_sort_one, &ctl);
+
+	for (i = 0; i < num; ++i) {
+		if (ctl.sorted[i] != NULL)
+			list_add_tail(&ctl.sorted[i]->list, &dcfg->sorted_chunks);
+		if (ctl.unsorted[i] != NULL)
+			list_add_tail(&ctl.unsorted[i]->list, &dcfg->unsorted_chunks);
 	}
+	if (err)
+		goto err_free;
+
+	free(ctl.unsorted);
+	free(ctl.sorted);
 	EBLOB_WARNX(dcfg->log, EBLOB_LOG_INFO, "defrag: sort: completed");
 	return 0;
 
-err:
+err_free:
+	free(ctl.unsorted);
+	free(ctl.sorted);
 	datasort_destroy_chunks(dcfg, &dcfg->sorted_chunks);
 	datasort_destroy_chunks(dcfg, &dcfg->unsorted_chunks);
-	return -EIO;
+	return err;
 }
 
-/**
- * datasort_merge_get_smallest() - find chunk with smallest key across all
- * sorted chunks
+/*
+ * Loser tree over cursors (merge_count) of sorted chunks used by n-way merge.
  *
- * O(n) complexity with n - number of chunks.
- * Can be speeded up by using heap-based structure for index in chunks.
+ * Leaves are chunks, inner node keeps index of chunk that lost the match
+ * played in it, node 0 keeps the overall winner. Replacing the winner costs
+ * log(n) comparisons on the path from its leaf to the root.
  */
-static struct datasort_chunk *datasort_merge_get_smallest(struct datasort_cfg *dcfg)
+struct datasort_merge_tree {
+	struct datasort_chunk		**chunks;
+	uint64_t			*nodes;
+	uint64_t			num;
+};
+
+/*
+ * Returns nonzero if head of chunk @a goes before head of chunk @b.
+ * Exhausted chunks go after everything, ties are broken by chunk order so
+ * records with equal keys are merged in the same order as sorted chunks.
+ */
+static int datasort_merge_less(const struct datasort_merge_tree *t, uint64_t a, uint64_t b)
 {
-	struct datasort_chunk *smallest_chunk = NULL, *chunk;
-	struct eblob_disk_control *smallest_dc = NULL, *dc;
+	const struct datasort_chunk *ca = t->chunks[a], *cb = t->chunks[b];
+	const int a_eof = ca->merge_count >= ca->count;
+	const int b_eof = cb->merge_count >= cb->count;
+	int cmp;
+
+	if (a_eof || b_eof) {
+		if (a_eof && b_eof)
+			return a < b;
+		return b_eof;
+	}
 
-	assert(dcfg != NULL);
+	cmp = eblob_disk_control_sort(&ca->index[ca->merge_count], &cb->index[cb->merge_count]);
+	if (cmp != 0)
+		return cmp < 0;
+	return a < b;
+}
+
+static void datasort_merge_tree_destroy(struct datasort_merge_tree *t)
+{
+	free(t->chunks);
+	free(t->nodes);
+}
+
+/*
+ * datasort_merge_tree_init() - builds tree over all sorted chunks by playing
+ * matches bottom-up, leaf of chunk i is node num + i.
+ */
+static int datasort_merge_tree_init(struct datasort_cfg *dcfg, struct datasort_merge_tree *t)
+{
+	struct datasort_chunk *chunk;
+	uint64_t *winners = NULL, i;
+	int err = -ENOMEM;
+
+	memset(t, 0, sizeof(*t));
 
+	list_for_each_entry(chunk, &dcfg->sorted_chunks, list)
+		t->num++;
+	assert(t->num > 0);
+
+	t->chunks = calloc(t->num, sizeof(*t->chunks));
+	t->nodes = calloc(t->num, sizeof(*t->nodes));
+	winners = calloc(2 * t->num, sizeof(*winners));
+	if (t->chunks == NULL || t->nodes == NULL || winners == NULL)
+		goto err_out_free;
+
+	i = 0;
 	list_for_each_entry(chunk, &dcfg->sorted_chunks, list) {
-		assert(chunk->merge_count <= chunk->count);
+		t->chunks[i] = chunk;
+		winners[t->num + i] = i;
+		++i;
+	}
 
-		if (chunk->merge_count >= chunk->count)
-			continue;
+	for (i = t->num - 1; i > 0; --i) {
+		const uint64_t l = winners[2 * i], r = winners[2 * i + 1];
+
+		if (datasort_merge_less(t, r, l)) {
+			winners[i] = r;
+			t->nodes[i] = l;
+		} else {
+			winners[i] = l;
+			t->nodes[i] = r;
+		}
+	}
+	t->nodes[0] = winners[1];
+
+	free(winners);
+	return 0;
+
+err_out_free:
+	free(winners);
+	datasort_merge_tree_destroy(t);
+	return err;
+}
+
+/**
+ * datasort_merge_tree_next() - takes smallest record across all sorted chunks
+ * and advances cursor of its chunk.
+ * Returns chunk of that record or NULL if all chunks are merged.
+ */
+static struct datasort_chunk *datasort_merge_tree_next(struct datasort_merge_tree *t)
+{
+	uint64_t winner = t->nodes[0], node, tmp;
+	struct datasort_chunk *chunk = t->chunks[winner];
+
+	assert(chunk->merge_count <= chunk->count);
+	if (chunk->merge_count >= chunk->count)
+		return NULL;
+
+	chunk->merge_count++;
 
-		/* Shortcut */
-		dc = &chunk->index[chunk->merge_count];
-		if (smallest_dc == NULL || eblob_disk_control_sort(smallest_dc, dc) > 0) {
-			smallest_chunk = chunk;
-			smallest_dc = dc;
+	/* Replay matches on the path from winner's leaf to the root */
+	for (node = (t->num + winner) / 2; node > 0; node /= 2) {
+		if (datasort_merge_less(t, t->nodes[node], winner)) {
+			tmp = t->nodes[node];
+			t->nodes[node] = winner;
+			winner = tmp;
 		}
 	}
-	if (smallest_chunk != NULL)
-		smallest_chunk->merge_count++;
+	t->nodes[0] = winner;
 
-	return smallest_chunk;
+	return chunk;
+}
+
+/**
+ * datasort_merge_copy_run() - copies run of @count records, that lie one
+ * after another starting at @from_offset of @from_chunk, to the end of
+ * @to_chunk by single splice and rewrites positions in their headers.
+ * Headers of the run with already rewritten positions are taken from the
+ * tail of @to_chunk index.
+ */
+static int datasort_merge_copy_run(struct datasort_cfg *dcfg,
+		struct datasort_chunk *from_chunk, struct datasort_chunk *to_chunk,
+		uint64_t from_offset, uint64_t to_offset, uint64_t size, uint64_t count)
+{
+	const ssize_t hdr_size = sizeof(struct eblob_disk_control);
+	struct eblob_disk_control *dc;
+	uint64_t i;
+	int err;
+
+	assert(from_chunk->in_base || from_offset + size <= from_chunk->offset);
+	assert(count <= to_chunk->count);
+
+	err = eblob_splice_data(from_chunk->fd, from_offset, to_chunk->fd, to_offset, size);
+	if (err) {
+		EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err,
+				"eblob_splice_data: FAILED, fd_in: %d, off_in: %" PRIu64 ", "
+				"fd_out: %d, off_out: %" PRIu64 ", size: %" PRIu64,
+				from_chunk->fd, from_offset, to_chunk->fd, to_offset, size);
+		return err;
+	}
+
+	for (i = to_chunk->count - count; i < to_chunk->count; ++i) {
+		dc = &to_chunk->index[i];
+
+		err = __eblob_write_ll(to_chunk->fd, dc, hdr_size, dc->position);
+		if (err) {
+			EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err,
+					"__eblob_write_ll: %s, fd: %d, offset: %" PRIu64,
+					to_chunk->path, to_chunk->fd, dc->position);
+			return err;
+		}
+	}
+
+	datasort_io_throttle(dcfg, size);
+	return 0;
 }
 
 /**
@@ -845,14 +1140,16 @@ static inline uint64_t datasort_merge_index_size(struct list_head *lst)
 
 /**
  * sort_merge() - n-way merge of sorted chunks
- * - While we can find non-EOF chunk with smallest key
- * - Copy first entry from it
- * - Repeat
+ * - Take record with smallest key across all chunks from loser tree
+ * - While records come from the same chunk one after another collect them
+ *   into a run
+ * - Copy each run by single splice and rewrite positions in its headers
  */
 static struct datasort_chunk *datasort_merge(struct datasort_cfg *dcfg)
 {
-	struct datasort_chunk *chunk = NULL, *merged_chunk = NULL;
-	uint64_t total_items = 0;
+	struct datasort_chunk *chunk = NULL, *merged_chunk = NULL, *run_chunk = NULL;
+	struct datasort_merge_tree tree;
+	uint64_t total_items = 0, run_offset = 0, run_size = 0, run_count = 0;
 	int err = 0;
 
 	assert(dcfg != NULL);
@@ -880,31 +1177,49 @@ static struct datasort_chunk *datasort_merge(struct datasort_cfg *dcfg)
 		goto err;
 	}
 
-	while ((chunk = datasort_merge_get_smallest(dcfg)) != NULL) {
-		struct eblob_disk_control *dc;
-		uint64_t total_count, current_count;
+	err = datasort_merge_tree_init(dcfg, &tree);
+	if (err) {
+		EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err, "defrag: datasort_merge_tree_init: FAILED");
+		goto err;
+	}
 
-		/* Shortcut */
-		total_count = merged_chunk->count;
-		current_count = chunk->merge_count - 1;
-		dc = &chunk->index[current_count];
+	while ((chunk = datasort_merge_tree_next(&tree)) != NULL) {
+		struct eblob_disk_control *dc = &chunk->index[chunk->merge_count - 1];
 
-		err = datasort_copy_record(dcfg, chunk, merged_chunk, dc, merged_chunk->offset);
-		if (err != 0) {
-			EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err,
-					"defrag: datasort_copy_record: FAILED");
-			goto err;
+		/* Record does not continue current run - flush it */
+		if (run_count != 0 && (chunk != run_chunk || dc->position != run_offset + run_size)) {
+			err = datasort_merge_copy_run(dcfg, run_chunk, merged_chunk, run_offset,
+					merged_chunk->offset - run_size, run_size, run_count);
+			if (err != 0)
+				goto err_destroy_tree;
+			run_count = 0;
+		}
+
+		if (run_count == 0) {
+			run_chunk = chunk;
+			run_offset = dc->position;
+			run_size = 0;
 		}
+		run_size += dc->disk_size;
+		run_count++;
 
 		/* Rewrite on-disk position */
 		dc->position = merged_chunk->offset;
 
 		/* Save merged chunk */
-		merged_chunk->index[total_count] = *dc;
+		merged_chunk->index[merged_chunk->count] = *dc;
 		merged_chunk->offset += dc->disk_size;
 		merged_chunk->count++;
 	}
+
+	if (run_count != 0) {
+		err = datasort_merge_copy_run(dcfg, run_chunk, merged_chunk, run_offset,
+				merged_chunk->offset - run_size, run_size, run_count);
+		if (err != 0)
+			goto err_destroy_tree;
+	}
 	assert(total_items == merged_chunk->count);
+	datasort_merge_tree_destroy(&tree);
 
 	EBLOB_WARNX(dcfg->log, EBLOB_LOG_INFO,
 			"defrag: merge: stop: fd: %d, count: %" PRIu64 ", size: %" PRIu64 ", path: %s",
@@ -913,6 +1228,8 @@ static struct datasort_chunk *datasort_merge(struct datasort_cfg *dcfg)
 	datasort_destroy_chunks(dcfg, &dcfg->sorted_chunks);
 	return merged_chunk;
 
+err_destroy_tree:
+	datasort_merge_tree_destroy(&tree);
 err:
 	EBLOB_WARNX(dcfg->log, EBLOB_LOG_ERROR, "merge: FAILED");
 	if (merged_chunk)
@@ -1031,7 +1348,11 @@ static int datasort_swap_memory(struct datasort_cfg *dcfg)
 		EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err, "defrag: datasort_base_get_path: FAILED");
 		goto err_free_base;
 	}
-	snprintf(tmp_index_path, PATH_MAX, "%s.index.sorted.tmp", data_path);
+	if (snprintf(tmp_index_path, PATH_MAX, "%s.index.sorted.tmp", data_path) >= PATH_MAX) {
+		err = -ENAMETOOLONG;
+		EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err, "defrag: tmp index path is too long: %s", data_path);
+		goto err_free_base;
+	}
 
 	/*
 	 * Init index map
@@ -1098,11 +1419,12 @@ static int datasort_swap_memory(struct datasort_cfg *dcfg)
 	}
 
 	/* Protect l2hash/hash from accessing stale fds */
-	if ((err = pthread_rwlock_wrlock(&dcfg->b->hash.root_lock)) != 0) {
-		err = -err;
-		EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err, "defrag: pthread_mutex_lock");
+	if ((err = eblob_cache_lock_all(dcfg->b)) != 0) {
+		EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err, "defrag: eblob_cache_lock_all");
 		goto err_free_base;
 	}
+	/* Lookups that started before the swap repeat their misses */
+	__atomic_add_fetch(&dcfg->b->defrag_generation, 1, __ATOMIC_RELEASE);
 
 	/*
 	 * Flush hash
@@ -1139,12 +1461,16 @@ static int datasort_swap_memory(struct datasort_cfg *dcfg)
 	 * TODO: Here we purposely leak unsorted bctl - we don't have any control
 	 * over it and it can still be used anywhere in code.
 	 */
-	list_replace(&unsorted_bctl->base_entry, &sorted_bctl->base_entry);
+	list_replace_release(&unsorted_bctl->base_entry, &sorted_bctl->base_entry);
 	for (n = 1; n < dcfg->bctl_cnt; ++n)
 		__list_del(dcfg->bctl[n]->base_entry.prev, dcfg->bctl[n]->base_entry.next);
 
 	/* Unlock hash */
-	pthread_rwlock_unlock(&dcfg->b->hash.root_lock);
+	eblob_cache_unlock_all(dcfg->b);
+
+	/* Keys of merged bases are located in sorted one now */
+	for (n = 1; n < dcfg->bctl_cnt; ++n)
+		eblob_locator_remove_base(dcfg->b, dcfg->bctl[n]);
 
 	/* Save pointer to sorted_bctl for datasort_swap_disk() */
 	dcfg->sorted_bctl = sorted_bctl;
@@ -1189,9 +1515,13 @@ static int datasort_swap_disk(struct datasort_cfg *dcfg)
 	EBLOB_WARNX(dcfg->log, EBLOB_LOG_INFO, "defrag: data swap start: data: %s -> %s\n",
 			dcfg->result->path, data_path);
 
-	snprintf(mark_path, PATH_MAX, "%s" EBLOB_DATASORT_SORTED_MARK_SUFFIX, data_path);
-	snprintf(sorted_index_path, PATH_MAX, "%s.index.sorted", data_path);
-	snprintf(tmp_index_path, PATH_MAX, "%s.tmp", sorted_index_path);
+	if (snprintf(mark_path, PATH_MAX, "%s" EBLOB_DATASORT_SORTED_MARK_SUFFIX, data_path) >= PATH_MAX ||
+	    snprintf(sorted_index_path, PATH_MAX, "%s.index.sorted", data_path) >= PATH_MAX ||
+	    snprintf(tmp_index_path, PATH_MAX, "%s.tmp", sorted_index_path) >= PATH_MAX) {
+		err = -ENAMETOOLONG;
+		EBLOB_WARNC(dcfg->log, EBLOB_LOG_ERROR, -err, "defrag: index paths are too long: %s", data_path);
+		goto err;
+	}
 
 	/*
 	 * Remove old base.
@@ -1313,6 +1643,12 @@ static void datasort_cleanup(struct datasort_cfg *dcfg)
  *  - Apply binlog ontop of sorted base
  *  - Replace original base(s) with sorted one
  *  - Unlock now-sorted base
+ *
+ * If chunks_dir is not configured chunks are never written: split only
+ * builds their indexes, sort sorts indexes and merge copies records from
+ * original base(s) straight into sorted base, so data is rewritten once.
+ * Otherwise chunks are written to files in chunks_dir, which moves most of
+ * datasort I/O to that directory.
  */
 int eblob_generate_sorted_data(struct datasort_cfg *dcfg)
 {
@@ -1335,6 +1671,11 @@ int eblob_generate_sorted_data(struct datasort_cfg *dcfg)
 		dcfg->chunk_size = EBLOB_DATASORT_DEFAULTS_CHUNK_SIZE;
 	if (dcfg->chunk_limit == 0)
 		dcfg->chunk_limit = EBLOB_DATASORT_DEFAULTS_CHUNK_LIMIT;
+	if (dcfg->sort_threads == 0)
+		dcfg->sort_threads = (dcfg->b->cfg.blob_flags & EBLOB_DISABLE_THREADS) ?
+			1 : dcfg->b->cfg.datasort_threads;
+	if (dcfg->io_limit == 0)
+		dcfg->io_limit = dcfg->b->cfg.datasort_io_limit;
 
 	err = pthread_mutex_init(&dcfg->lock, NULL);
 	if (err) {
@@ -1391,6 +1732,8 @@ int eblob_generate_sorted_data(struct datasort_cfg *dcfg)
 			err = -ENOMEM;
 			goto err_rmdir;
 		}
+		/* Records are copied from bases straight into sorted blob */
+		dcfg->gather = 1;
 	}
 
 	/*
@@ -1485,7 +1828,7 @@ int eblob_generate_sorted_data(struct datasort_cfg *dcfg)
 
 	/* Increase defrag_generation in order to interrupted operation could relookup keys.
 	 */
-	dcfg->b->defrag_generation += 1;
+	__atomic_add_fetch(&dcfg->b->defrag_generation, 1, __ATOMIC_RELEASE);
 
 	/* restore original io priority */
 	if ((ioprio != -1) && (eblob_ioprio_set(ioprio) == -1))
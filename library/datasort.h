@@ -57,6 +57,11 @@ struct datasort_chunk {
 	uint64_t			index_size;
 	/* Set to 1 if chunk came from sorted bctl */
 	uint8_t				already_sorted;
+	/*
+	 * Set to 1 if chunk has no file of its own: @fd is data descriptor of
+	 * base and index keeps positions of records in it
+	 */
+	uint8_t				in_base;
 	/* Chunk maybe in sorted or unsorted list */
 	struct list_head		list;
 };
@@ -73,7 +78,13 @@ struct datasort_cfg {
 	uint64_t			chunk_size;
 	/* Limit on number of records in one chunk */
 	uint64_t			chunk_limit;
-	/* Lock used by blob iterator */
+	/* Number of chunks sorted concurrently */
+	unsigned int			sort_threads;
+	/* Limit on copied bytes per second, 0 means unlimited */
+	uint64_t			io_limit;
+	/* Time in ns (CLOCK_MONOTONIC) when limit allows next copy */
+	uint64_t			io_next;
+	/* Lock used by blob iterator and by I/O throttling */
 	pthread_mutex_t			lock;
 	/* Splitter chunks */
 	struct list_head		unsorted_chunks;
@@ -85,6 +96,12 @@ struct datasort_cfg {
 	char				*dir;
 	/* Chunks directory - if not defined, then chunks are stored in dir */
 	char				*chunks_dir;
+	/*
+	 * Set if split only builds index of chunks and merge copies records
+	 * from bases straight into sorted blob, used when chunks_dir is not
+	 * configured
+	 */
+	int				gather;
 	/* Pointer to backend */
 	struct eblob_backend		*b;
 	/* Logging */
@@ -197,6 +197,7 @@ int eblob_defrag(struct eblob_backend *b)
 
 			/* Remove base files */
 			eblob_base_remove(bctl);
+			eblob_locator_remove_base(b, bctl);
 
 			/* Wait until bctl is unused */
 			eblob_base_wait_locked(bctl);
@@ -0,0 +1,138 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "features.h"
+
+#include "epoch.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Called on thread exit for each registered reader record */
+static void eblob_epoch_reader_destroy(void *data)
+{
+	struct eblob_epoch_reader *r = data;
+	struct eblob_epoch *e = r->owner;
+
+	pthread_mutex_lock(&e->lock);
+	list_del(&r->list);
+	pthread_mutex_unlock(&e->lock);
+
+	free(r);
+}
+
+int eblob_epoch_init(struct eblob_epoch *e)
+{
+	int err;
+
+	memset(e, 0, sizeof(*e));
+	e->epoch = 1;
+	INIT_LIST_HEAD(&e->readers);
+
+	err = pthread_mutex_init(&e->lock, NULL);
+	if (err) {
+		err = -err;
+		goto err_out_exit;
+	}
+
+	err = pthread_key_create(&e->key, eblob_epoch_reader_destroy);
+	if (err) {
+		err = -err;
+		goto err_out_mutex_destroy;
+	}
+
+	return 0;
+
+err_out_mutex_destroy:
+	pthread_mutex_destroy(&e->lock);
+err_out_exit:
+	return err;
+}
+
+/*
+ * NB! There must be no readers inside read-side section.
+ * Records of still running threads are freed here, since after
+ * pthread_key_delete() their destructors will not be called.
+ */
+void eblob_epoch_destroy(struct eblob_epoch *e)
+{
+	struct eblob_epoch_reader *r, *tmp;
+
+	pthread_key_delete(e->key);
+
+	list_for_each_entry_safe(r, tmp, &e->readers, list) {
+		list_del(&r->list);
+		free(r);
+	}
+
+	pthread_mutex_destroy(&e->lock);
+}
+
+struct eblob_epoch_reader *eblob_epoch_reader_register(struct eblob_epoch *e)
+{
+	struct eblob_epoch_reader *r;
+	void *mem;
+
+	if (posix_memalign(&mem, sizeof(*r), sizeof(*r)) != 0)
+		return NULL;
+	r = mem;
+
+	memset(r, 0, sizeof(*r));
+	r->owner = e;
+
+	if (pthread_setspecific(e->key, r) != 0) {
+		free(r);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&e->lock);
+	list_add_tail(&r->list, &e->readers);
+	pthread_mutex_unlock(&e->lock);
+
+	return r;
+}
+
+void eblob_epoch_synchronize(struct eblob_epoch *e)
+{
+	struct eblob_epoch_reader *r;
+	uint64_t target, epoch;
+
+	pthread_mutex_lock(&e->lock);
+
+	/*
+	 * Readers that enter after this point see new epoch and, thanks to
+	 * the fence in eblob_epoch_enter(), already unpublished data is
+	 * invisible to them. Wait only for those who entered earlier.
+	 */
+	target = __atomic_add_fetch(&e->epoch, 1, __ATOMIC_SEQ_CST);
+
+	list_for_each_entry(r, &e->readers, list) {
+		for (;;) {
+			epoch = __atomic_load_n(&r->epoch, __ATOMIC_ACQUIRE);
+			if (epoch == 0 || epoch >= target)
+				break;
+			sched_yield();
+		}
+	}
+
+	pthread_mutex_unlock(&e->lock);
+}
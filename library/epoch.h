@@ -0,0 +1,106 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Epoch-based grace periods for lockless readers.
+ *
+ * Reader announces the epoch it has entered in its own per-thread record, so
+ * entering and leaving read-side section does not write to any shared cache
+ * line. Writer that has unpublished some memory calls eblob_epoch_synchronize()
+ * which waits until every reader that could see that memory has left.
+ */
+
+#ifndef __EBLOB_EPOCH_H
+#define __EBLOB_EPOCH_H
+
+#include "eblob/blob.h"
+
+#include "list.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct eblob_epoch;
+
+/* Per-thread reader record */
+struct eblob_epoch_reader {
+	/* Epoch reader has entered, 0 when reader is outside of read-side section */
+	uint64_t		epoch;
+	/* Entry in eblob_epoch::readers */
+	struct list_head	list;
+	/* Owner, used on thread exit */
+	struct eblob_epoch	*owner;
+} __attribute__ ((aligned (64)));
+
+struct eblob_epoch {
+	/* Current epoch, starts from 1 */
+	uint64_t		epoch;
+	/* Key for per-thread reader records */
+	pthread_key_t		key;
+	/* Protects list of readers and serializes synchronize */
+	pthread_mutex_t		lock;
+	struct list_head	readers;
+};
+
+int eblob_epoch_init(struct eblob_epoch *e);
+void eblob_epoch_destroy(struct eblob_epoch *e);
+
+/* Registers calling thread as a reader, slow path of eblob_epoch_enter() */
+struct eblob_epoch_reader *eblob_epoch_reader_register(struct eblob_epoch *e);
+
+/* Waits until all readers that have entered before the call leave */
+void eblob_epoch_synchronize(struct eblob_epoch *e);
+
+/*
+ * Enters read-side section.
+ * Returns NULL if reader record can not be allocated.
+ */
+static inline struct eblob_epoch_reader *eblob_epoch_enter(struct eblob_epoch *e)
+{
+	struct eblob_epoch_reader *r;
+
+	r = (struct eblob_epoch_reader *)pthread_getspecific(e->key);
+	if (r == NULL) {
+		r = eblob_epoch_reader_register(e);
+		if (r == NULL)
+			return NULL;
+	}
+
+	__atomic_store_n(&r->epoch, __atomic_load_n(&e->epoch, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	/* Announcement must be visible before any read of protected data */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	return r;
+}
+
+/* Leaves read-side section */
+static inline void eblob_epoch_exit(struct eblob_epoch_reader *r)
+{
+	__atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EBLOB_EPOCH_H */
@@ -0,0 +1,499 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Flat in-memory index: Robin Hood open-addressing table over 64bit key
+ * prefixes with ram controls stored in slab chunks.
+ *
+ * Keys are already SHA512 so their first 8 bytes are good enough both as a
+ * tag and as a source of bucket index. Full key is compared only on tag match,
+ * so lookup usually costs one or two cache lines of the table and one line of
+ * the slab.
+ */
+
+#include "features.h"
+
+#include "eblob/blob.h"
+#include "flathash.h"
+#include "blob.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Prefix is mixed before it is used as bucket index, so that keys which are
+ * not real hashes (e.g. sequential ids) do not end up in one cluster.
+ */
+static inline uint64_t eblob_flathash_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static inline uint64_t eblob_flathash_prefix(const struct eblob_key *key)
+{
+	uint64_t prefix;
+
+	memcpy(&prefix, key->id, sizeof(prefix));
+	return prefix;
+}
+
+static inline struct eblob_flathash_entry *eblob_flathash_entry(const struct eblob_flathash_chunks *chunks,
+		uint32_t idx)
+{
+	return &chunks->chunk[idx >> EBLOB_FLATHASH_CHUNK_SHIFT][idx & (EBLOB_FLATHASH_CHUNK_SIZE - 1)];
+}
+
+/*
+ * Writer side of sequence counter: lockless readers that overlap with
+ * section between begin and end will retry.
+ * Frozen table already has odd counter, so nothing is done then.
+ */
+static inline void eblob_flathash_write_begin(struct eblob_flathash *fh)
+{
+	if (fh->frozen)
+		return;
+	__atomic_store_n(&fh->seq, fh->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void eblob_flathash_write_end(struct eblob_flathash *fh)
+{
+	if (fh->frozen)
+		return;
+	__atomic_store_n(&fh->seq, fh->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Frees memory that was unpublished from @fh.
+ * Waits for grace period if there can be lockless readers.
+ */
+static void eblob_flathash_retire(struct eblob_flathash *fh, void *ptr)
+{
+	if (fh->epoch != NULL)
+		eblob_epoch_synchronize(fh->epoch);
+	free(ptr);
+}
+
+/* Makes room for one more chunk in directory */
+static int eblob_flathash_chunks_grow(struct eblob_flathash *fh)
+{
+	struct eblob_flathash_chunks *chunks, *old = fh->chunks;
+	uint32_t size = old ? old->size * 2 : 16;
+
+	chunks = malloc(sizeof(*chunks) + size * sizeof(chunks->chunk[0]));
+	if (chunks == NULL)
+		return -ENOMEM;
+
+	chunks->size = size;
+	chunks->num = 0;
+	if (old != NULL) {
+		chunks->num = old->num;
+		memcpy(chunks->chunk, old->chunk, old->num * sizeof(old->chunk[0]));
+	}
+
+	__atomic_store_n(&fh->chunks, chunks, __ATOMIC_RELEASE);
+	if (old != NULL)
+		eblob_flathash_retire(fh, old);
+	return 0;
+}
+
+/*
+ * Allocates entry in slab, reusing previously freed ones first.
+ * Returns index of entry or -ENOMEM.
+ */
+static int64_t eblob_flathash_entry_alloc(struct eblob_flathash *fh)
+{
+	if (fh->free_num > 0)
+		return fh->free[--fh->free_num];
+
+	if (fh->used == UINT32_MAX - 1)
+		return -ENOMEM;
+
+	if ((fh->used >> EBLOB_FLATHASH_CHUNK_SHIFT) >= fh->chunks->num) {
+		struct eblob_flathash_entry *chunk;
+
+		if (fh->chunks->num == fh->chunks->size && eblob_flathash_chunks_grow(fh) != 0)
+			return -ENOMEM;
+
+		chunk = malloc(EBLOB_FLATHASH_CHUNK_SIZE * sizeof(*chunk));
+		if (chunk == NULL)
+			return -ENOMEM;
+		fh->chunks->chunk[fh->chunks->num] = chunk;
+		/* Chunk pointer must be visible before readers can see new num */
+		__atomic_store_n(&fh->chunks->num, fh->chunks->num + 1, __ATOMIC_RELEASE);
+	}
+
+	return fh->used++;
+}
+
+/* Makes sure there is room in free stack for one more index */
+static int eblob_flathash_free_reserve(struct eblob_flathash *fh)
+{
+	if (fh->free_num == fh->free_size) {
+		uint32_t size = fh->free_size ? fh->free_size * 2 : EBLOB_FLATHASH_MIN_SLOTS;
+		uint32_t *free_stack;
+
+		free_stack = realloc(fh->free, size * sizeof(*free_stack));
+		if (free_stack == NULL)
+			return -ENOMEM;
+		fh->free = free_stack;
+		fh->free_size = size;
+	}
+	return 0;
+}
+
+/*
+ * Puts @slot into table using Robin Hood displacement.
+ * Caller guarantees that there is at least one empty slot.
+ */
+static void eblob_flathash_slot_insert(struct eblob_flathash_table *t, struct eblob_flathash_slot slot)
+{
+	uint64_t pos = eblob_flathash_mix(slot.prefix) & t->mask;
+
+	slot.dib = 0;
+	for (;;) {
+		struct eblob_flathash_slot *s = &t->slots[pos];
+
+		if (s->entry == 0) {
+			*s = slot;
+			return;
+		}
+
+		/* Steal slot from the "richer" entry and carry it further */
+		if (s->dib < slot.dib) {
+			struct eblob_flathash_slot tmp = *s;
+			*s = slot;
+			slot = tmp;
+		}
+
+		pos = (pos + 1) & t->mask;
+		slot.dib++;
+	}
+}
+
+/*
+ * Rebuilds table with @nslots slots.
+ * New table is filled privately and then published, so lockless readers
+ * are not disturbed: both tables have the same content.
+ */
+static int eblob_flathash_resize(struct eblob_flathash *fh, uint64_t nslots)
+{
+	struct eblob_flathash_table *t, *old = fh->table;
+	uint64_t i;
+
+	t = calloc(1, sizeof(*t) + nslots * sizeof(t->slots[0]));
+	if (t == NULL)
+		return -ENOMEM;
+	t->mask = nslots - 1;
+
+	for (i = 0; old != NULL && i <= old->mask; ++i) {
+		if (old->slots[i].entry != 0)
+			eblob_flathash_slot_insert(t, old->slots[i]);
+	}
+
+	__atomic_store_n(&fh->table, t, __ATOMIC_RELEASE);
+	if (old != NULL)
+		eblob_flathash_retire(fh, old);
+	return 0;
+}
+
+/*
+ * Returns position of slot that holds @key in @t and stores slab index of
+ * the entry in @idx. Returns -ENOENT if there is no such key or -EAGAIN if
+ * probing has been confused by concurrent writer.
+ *
+ * Works both under lock and in lockless mode, in the latter case all
+ * results must be validated by sequence counter.
+ */
+static int64_t eblob_flathash_find(const struct eblob_flathash_table *t,
+		const struct eblob_flathash_chunks *chunks, const struct eblob_key *key, uint32_t *idx)
+{
+	const uint64_t prefix = eblob_flathash_prefix(key);
+	uint64_t pos = eblob_flathash_mix(prefix) & t->mask;
+	const uint32_t nchunks = __atomic_load_n(&chunks->num, __ATOMIC_ACQUIRE);
+	uint64_t dib;
+
+	for (dib = 0; dib <= t->mask; ++dib, pos = (pos + 1) & t->mask) {
+		const struct eblob_flathash_slot *s = &t->slots[pos];
+		const uint32_t entry = s->entry;
+
+		/*
+		 * Robin Hood invariant: if we are already further from home
+		 * than the entry in this slot, key is not in the table.
+		 */
+		if (entry == 0 || s->dib < dib)
+			return -ENOENT;
+
+		if (s->prefix != prefix)
+			continue;
+
+		/* Entry allocated after our snapshot of chunk directory */
+		if (((entry - 1) >> EBLOB_FLATHASH_CHUNK_SHIFT) >= nchunks)
+			return -EAGAIN;
+
+		if (eblob_id_cmp(eblob_flathash_entry(chunks, entry - 1)->key.id, key->id) == 0) {
+			*idx = entry - 1;
+			return pos;
+		}
+	}
+
+	return -EAGAIN;
+}
+
+int eblob_flathash_init(struct eblob_flathash *fh, struct eblob_epoch *epoch)
+{
+	int err;
+
+	if (fh == NULL)
+		return -EINVAL;
+
+	memset(fh, 0, sizeof(*fh));
+
+	err = eblob_flathash_chunks_grow(fh);
+	if (err)
+		goto err_out_exit;
+
+	err = eblob_flathash_resize(fh, EBLOB_FLATHASH_MIN_SLOTS);
+	if (err)
+		goto err_out_free_chunks;
+
+	fh->epoch = epoch;
+	return 0;
+
+err_out_free_chunks:
+	free(fh->chunks);
+	fh->chunks = NULL;
+err_out_exit:
+	return err;
+}
+
+void eblob_flathash_destroy(struct eblob_flathash *fh)
+{
+	uint32_t i;
+
+	if (fh == NULL)
+		return;
+
+	for (i = 0; fh->chunks != NULL && i < fh->chunks->num; ++i)
+		free(fh->chunks->chunk[i]);
+	free(fh->chunks);
+	free(fh->table);
+	free(fh->free);
+	memset(fh, 0, sizeof(*fh));
+}
+
+int eblob_flathash_lookup(struct eblob_flathash *fh, const struct eblob_key *key, struct eblob_ram_control *rctl)
+{
+	uint32_t idx;
+	int64_t pos;
+
+	if (fh == NULL || key == NULL || rctl == NULL)
+		return -EINVAL;
+
+	pos = eblob_flathash_find(fh->table, fh->chunks, key, &idx);
+	if (pos < 0)
+		return pos;
+
+	*rctl = eblob_flathash_entry(fh->chunks, idx)->rctl;
+	return 0;
+}
+
+/**
+ * eblob_flathash_lookup_lockless() - looks up @key without taking any lock.
+ * Reader retries if it has overlapped with a writer.
+ * Returns -EAGAIN if reader can not be registered in epoch or if table is
+ * being modified right now (or is frozen), caller should fall back to locked
+ * lookup then: it will wait for the writer to release the lock.
+ */
+int eblob_flathash_lookup_lockless(struct eblob_flathash *fh, const struct eblob_key *key,
+		struct eblob_ram_control *rctl)
+{
+	const struct eblob_flathash_chunks *chunks;
+	const struct eblob_flathash_table *t;
+	struct eblob_epoch_reader *reader;
+	struct eblob_ram_control res;
+	uint64_t seq;
+	uint32_t idx;
+	int64_t pos;
+
+	if (fh == NULL || key == NULL || rctl == NULL || fh->epoch == NULL)
+		return -EINVAL;
+
+	reader = eblob_epoch_enter(fh->epoch);
+	if (reader == NULL)
+		return -EAGAIN;
+
+	for (;;) {
+		seq = __atomic_load_n(&fh->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			pos = -EAGAIN;
+			break;
+		}
+
+		t = __atomic_load_n(&fh->table, __ATOMIC_ACQUIRE);
+		chunks = __atomic_load_n(&fh->chunks, __ATOMIC_ACQUIRE);
+
+		pos = eblob_flathash_find(t, chunks, key, &idx);
+		if (pos >= 0)
+			res = eblob_flathash_entry(chunks, idx)->rctl;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&fh->seq, __ATOMIC_RELAXED) == seq && pos != -EAGAIN)
+			break;
+	}
+
+	eblob_epoch_exit(reader);
+
+	if (pos < 0)
+		return pos;
+
+	*rctl = res;
+	return 0;
+}
+
+int eblob_flathash_remove(struct eblob_flathash *fh, const struct eblob_key *key)
+{
+	struct eblob_flathash_table *t;
+	uint64_t next;
+	uint32_t idx;
+	int64_t pos;
+	int err;
+
+	if (fh == NULL || key == NULL)
+		return -EINVAL;
+
+	t = fh->table;
+	pos = eblob_flathash_find(t, fh->chunks, key, &idx);
+	if (pos < 0)
+		return pos;
+
+	err = eblob_flathash_free_reserve(fh);
+	if (err != 0)
+		return err;
+
+	eblob_flathash_write_begin(fh);
+
+	fh->free[fh->free_num++] = idx;
+
+	/* Backward shift deletion: pull following displaced slots one step closer */
+	next = (pos + 1) & t->mask;
+	while (t->slots[next].entry != 0 && t->slots[next].dib > 0) {
+		t->slots[pos] = t->slots[next];
+		t->slots[pos].dib--;
+		pos = next;
+		next = (next + 1) & t->mask;
+	}
+	memset(&t->slots[pos], 0, sizeof(t->slots[pos]));
+
+	fh->count--;
+
+	eblob_flathash_write_end(fh);
+	return 0;
+}
+
+/**
+ * eblob_flathash_freeze() - opens one write section for all following changes.
+ * Used when the whole in-memory index is locked for a series of changes that
+ * must look atomic, e.g. entries of a base are flushed while it is replaced by
+ * sorted one: lockless reader must not see the table in between.
+ * Caller should hold the same lock as for other modifications until thaw.
+ */
+void eblob_flathash_freeze(struct eblob_flathash *fh)
+{
+	eblob_flathash_write_begin(fh);
+	fh->frozen = 1;
+}
+
+void eblob_flathash_thaw(struct eblob_flathash *fh)
+{
+	fh->frozen = 0;
+	eblob_flathash_write_end(fh);
+}
+
+int eblob_flathash_reserve(struct eblob_flathash *fh, uint64_t num)
+{
+	uint64_t nslots;
+
+	if (fh == NULL)
+		return -EINVAL;
+
+	nslots = fh->table->mask + 1;
+	while ((fh->count + num) * EBLOB_FLATHASH_LOAD_DEN > nslots * EBLOB_FLATHASH_LOAD_NUM)
+		nslots *= 2;
+
+	if (nslots == fh->table->mask + 1)
+		return 0;
+	return eblob_flathash_resize(fh, nslots);
+}
+
+int eblob_flathash_upsert(struct eblob_flathash *fh, const struct eblob_key *key,
+		const struct eblob_ram_control *rctl, int *replaced)
+{
+	struct eblob_flathash_slot slot;
+	struct eblob_flathash_entry *e;
+	int64_t pos, new_idx;
+	uint32_t idx;
+	int err;
+
+	if (fh == NULL || key == NULL || rctl == NULL || replaced == NULL)
+		return -EINVAL;
+
+	*replaced = 0;
+
+	pos = eblob_flathash_find(fh->table, fh->chunks, key, &idx);
+	if (pos >= 0) {
+		eblob_flathash_write_begin(fh);
+		eblob_flathash_entry(fh->chunks, idx)->rctl = *rctl;
+		eblob_flathash_write_end(fh);
+		*replaced = 1;
+		return 0;
+	}
+
+	if ((fh->count + 1) * EBLOB_FLATHASH_LOAD_DEN > (fh->table->mask + 1) * EBLOB_FLATHASH_LOAD_NUM) {
+		err = eblob_flathash_resize(fh, (fh->table->mask + 1) * 2);
+		if (err != 0)
+			return err;
+	}
+
+	new_idx = eblob_flathash_entry_alloc(fh);
+	if (new_idx < 0)
+		return new_idx;
+
+	eblob_flathash_write_begin(fh);
+
+	e = eblob_flathash_entry(fh->chunks, new_idx);
+	e->key = *key;
+	e->rctl = *rctl;
+
+	slot.prefix = eblob_flathash_prefix(key);
+	slot.entry = new_idx + 1;
+	slot.dib = 0;
+	eblob_flathash_slot_insert(fh->table, slot);
+
+	fh->count++;
+
+	eblob_flathash_write_end(fh);
+	return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EBLOB_FLATHASH_H
+#define __EBLOB_FLATHASH_H
+
+#include "eblob/blob.h"
+#include "epoch.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Initial number of slots in table, must be power of two */
+#define EBLOB_FLATHASH_MIN_SLOTS	(1 << 10)
+/* Table grows when number of entries exceeds slots * 7 / 8 */
+#define EBLOB_FLATHASH_LOAD_NUM		7
+#define EBLOB_FLATHASH_LOAD_DEN		8
+/* Number of entries in one slab chunk, must be power of two */
+#define EBLOB_FLATHASH_CHUNK_SHIFT	14
+#define EBLOB_FLATHASH_CHUNK_SIZE	(1 << EBLOB_FLATHASH_CHUNK_SHIFT)
+
+/*
+ * Entry of slab: full key and ram control.
+ * Entries live in fixed-size chunks so their addresses are stable.
+ */
+struct eblob_flathash_entry {
+	struct eblob_key		key;
+	struct eblob_ram_control	rctl;
+};
+
+/*
+ * One slot of open-addressing table.
+ * Slot keeps 64bit prefix of the key so most of probes never touch the slab.
+ */
+struct eblob_flathash_slot {
+	/* First 8 bytes of key */
+	uint64_t			prefix;
+	/* Index of entry in slab plus one, 0 means slot is empty */
+	uint32_t			entry;
+	/* Distance from initial bucket (Robin Hood probe length) */
+	uint32_t			dib;
+};
+
+/* Table of slots, replaced as a whole on resize */
+struct eblob_flathash_table {
+	uint64_t			mask;
+	struct eblob_flathash_slot	slots[];
+};
+
+/* Directory of slab chunks, replaced as a whole when it grows */
+struct eblob_flathash_chunks {
+	uint32_t			num;
+	uint32_t			size;
+	struct eblob_flathash_entry	*chunk[];
+};
+
+/*
+ * In-memory index implemented as Robin Hood open-addressing hash table
+ * with slab storage for ram controls. Used when EBLOB_FLATHASH is set.
+ *
+ * Modifications must be serialized by caller. Lookups either run under the
+ * same lock (eblob_flathash_lookup()) or without any lock at all
+ * (eblob_flathash_lookup_lockless()): writer bumps @seq around every change
+ * so lockless reader can detect it raced with one and retry, and memory that
+ * is given back to allocator (old table, old chunk directory) is freed only
+ * after epoch grace period. Slab chunks are never freed while table lives, so
+ * reader may see stale but always valid entries.
+ * eblob_flathash_freeze() keeps @seq odd for a whole series of changes, so
+ * lockless readers fall back to the caller's lock until the table is thawed.
+ */
+struct eblob_flathash {
+	struct eblob_flathash_table	*table;
+	/* Number of used slots (== number of live entries) */
+	uint64_t			count;
+	/* Odd while writer modifies table or entries */
+	uint64_t			seq;
+	/* Non-zero between eblob_flathash_freeze() and eblob_flathash_thaw() */
+	int				frozen;
+	struct eblob_flathash_chunks	*chunks;
+	/* Number of ever allocated entries in slab */
+	uint32_t			used;
+	/* Stack of freed entry indexes for reuse */
+	uint32_t			*free;
+	uint32_t			free_num;
+	uint32_t			free_size;
+	/* Grace periods for lockless readers, may be NULL if there are none */
+	struct eblob_epoch		*epoch;
+};
+
+/* Constructor and destructor */
+int eblob_flathash_init(struct eblob_flathash *fh, struct eblob_epoch *epoch);
+void eblob_flathash_destroy(struct eblob_flathash *fh);
+
+/* Public API */
+int eblob_flathash_lookup(struct eblob_flathash *fh, const struct eblob_key *key, struct eblob_ram_control *rctl);
+int eblob_flathash_lookup_lockless(struct eblob_flathash *fh, const struct eblob_key *key,
+		struct eblob_ram_control *rctl);
+int eblob_flathash_remove(struct eblob_flathash *fh, const struct eblob_key *key);
+int eblob_flathash_upsert(struct eblob_flathash *fh, const struct eblob_key *key,
+		const struct eblob_ram_control *rctl, int *replaced);
+/* Makes lockless lookups fall back to locked ones until table is thawed */
+void eblob_flathash_freeze(struct eblob_flathash *fh);
+void eblob_flathash_thaw(struct eblob_flathash *fh);
+/* Grows table in advance so @num more entries can be added without resize */
+int eblob_flathash_reserve(struct eblob_flathash *fh, uint64_t num);
+
+static inline int eblob_flathash_empty(struct eblob_flathash *fh)
+{
+	return (fh == NULL) || (fh->count == 0);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EBLOB_FLATHASH_H */
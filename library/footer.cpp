@@ -20,6 +20,8 @@
 
 #include "footer.h"
 
+#include <algorithm>
+
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
@@ -29,36 +31,239 @@
 
 #include "measure_points.h"
 
+/* Checksum of a chunk is MurmurHash64A chained over its pieces of this size */
+static const size_t mmhash_piece_size = 4096;
+/* Number of chunks read from disk at once and hashed simultaneously */
+static const size_t mmhash_read_chunks = 4;
 /*
- * mmhash_file() - computes MurmurHash64A of bytes range read from @fd with @offset and @count.
- *
- * Results:
- * Returns negative error value or zero on success.
- * @result - computed MurmurHash64A.
+ * Large records are read and hashed by several threads, each of them takes at least this many bytes.
+ * Hashing of 64 MiB takes tens of milliseconds, so creation of threads costs less than 0.1% of it,
+ * while smaller records are hashed by calling thread and do not create threads on every write or verify.
  */
-static inline int mmhash_file(int fd, off_t offset, size_t count, uint64_t &result) {
-	static const size_t buffer_size = 4096;
-	char buffer[buffer_size];
-	size_t read_size = buffer_size;
-	int err = 0;
-	result = 0;
+static const uint64_t mmhash_thread_min_size = 64ULL << 20;
+
+/*
+ * mmhash_chunk() - computes checksum of chunk of @size bytes at @data.
+ */
+static inline uint64_t mmhash_chunk(const char *data, size_t size) {
+	uint64_t result = 0;
+
+	for (size_t pos = 0; pos < size; pos += mmhash_piece_size)
+		result = MurmurHash64A(data + pos, std::min(mmhash_piece_size, size - pos), result);
+
+	return result;
+}
+
+/*
+ * mmhash_lanes() - computes checksums of @lanes whole chunks at @data, result is the same as of mmhash_chunk().
+ * Hash of a chunk is one long chain of multiplications, so chains of several chunks are interleaved
+ * to be computed by cpu in parallel instead of waiting for each multiplication in turn.
+ */
+template <size_t lanes>
+static void mmhash_lanes(const char *data, uint64_t *checksums) {
+	static const uint64_t m = 0xc6a4a7935bd1e995LLU;
+	static const int r = 47;
+	static const size_t pieces = EBLOB_CSUM_CHUNK_SIZE / mmhash_piece_size;
+	static const size_t words = mmhash_piece_size / sizeof(uint64_t);
+	uint64_t h[lanes];
+
+	for (size_t l = 0; l < lanes; ++l)
+		h[l] = 0;
+
+	for (size_t p = 0; p < pieces; ++p) {
+		const char *piece = data + p * mmhash_piece_size;
+
+		for (size_t l = 0; l < lanes; ++l)
+			h[l] ^= mmhash_piece_size * m;
+
+		for (size_t w = 0; w < words; ++w) {
+			for (size_t l = 0; l < lanes; ++l) {
+				uint64_t k;
+				memcpy(&k, piece + l * EBLOB_CSUM_CHUNK_SIZE + w * sizeof(k), sizeof(k));
+
+				k *= m;
+				k ^= k >> r;
+				k *= m;
+
+				h[l] ^= k;
+				h[l] *= m;
+			}
+		}
+
+		for (size_t l = 0; l < lanes; ++l) {
+			h[l] ^= h[l] >> r;
+			h[l] *= m;
+			h[l] ^= h[l] >> r;
+		}
+	}
 
-	while (count) {
-		if (count < buffer_size)
-			read_size = count;
+	for (size_t l = 0; l < lanes; ++l)
+		checksums[l] = h[l];
+}
 
-		err = __eblob_read_ll(fd, buffer, read_size, offset);
+/*
+ * mmhash_buffer() - computes checksums of consecutive chunks of @size bytes at @data,
+ * only the last chunk can be partial.
+ */
+static void mmhash_buffer(const char *data, size_t size, uint64_t *checksums) {
+	const size_t whole = size / EBLOB_CSUM_CHUNK_SIZE;
+	size_t i = 0;
+
+	for (; i + 4 <= whole; i += 4)
+		mmhash_lanes<4>(data + i * EBLOB_CSUM_CHUNK_SIZE, checksums + i);
+	for (; i + 2 <= whole; i += 2)
+		mmhash_lanes<2>(data + i * EBLOB_CSUM_CHUNK_SIZE, checksums + i);
+	for (; i < whole; ++i)
+		checksums[i] = mmhash_chunk(data + i * EBLOB_CSUM_CHUNK_SIZE, EBLOB_CSUM_CHUNK_SIZE);
+
+	if (size % EBLOB_CSUM_CHUNK_SIZE)
+		checksums[i] = mmhash_chunk(data + i * EBLOB_CSUM_CHUNK_SIZE, size % EBLOB_CSUM_CHUNK_SIZE);
+}
+
+struct mmhash_file_ctl {
+	int fd;
+	uint64_t offset, count;
+	uint64_t *checksums;
+	/* Data is read and hashed by groups of chunks of this size */
+	uint64_t group_size;
+	uint64_t groups, next_group;
+};
+
+/*
+ * mmhash_file_groups() - reads groups of chunks not taken by other threads yet via @buffer and hashes them.
+ */
+static int mmhash_file_groups(struct mmhash_file_ctl *ctl, char *buffer) {
+	uint64_t group;
+
+	while ((group = __atomic_fetch_add(&ctl->next_group, 1, __ATOMIC_RELAXED)) < ctl->groups) {
+		const uint64_t pos = group * ctl->group_size;
+		const size_t size = std::min(ctl->group_size, ctl->count - pos);
+
+		int err = __eblob_read_ll(ctl->fd, buffer, size, ctl->offset + pos);
 		if (err)
-			break;
+			return err;
 
-		result = MurmurHash64A(buffer, read_size, result);
-		count -= read_size;
-		offset += read_size;
+		mmhash_buffer(buffer, size, ctl->checksums + pos / EBLOB_CSUM_CHUNK_SIZE);
 	}
 
+	return 0;
+}
+
+/*
+ * mmhash_file_worker() - one of threads hashing file, each of them reads data via its own buffer.
+ */
+static int mmhash_file_worker(void *priv, unsigned int) {
+	auto ctl = static_cast<struct mmhash_file_ctl *>(priv);
+	const size_t size = std::min(ctl->group_size, ctl->count);
+	void *buffer;
+
+	/* page aligned buffer lets kernel copy data faster */
+	if (posix_memalign(&buffer, mmhash_piece_size, size) != 0)
+		return -ENOMEM;
+
+	int err = mmhash_file_groups(ctl, static_cast<char *>(buffer));
+	free(buffer);
 	return err;
 }
 
+/*
+ * mmhash_file() - computes checksums of consecutive chunks of bytes range read from @fd with @offset and @count.
+ * Each read takes several chunks at once. Data is read via @buffer of @buffer_size bytes if it holds at least
+ * one chunk, otherwise records of at least two mmhash_thread_min_size are read and hashed by several threads.
+ *
+ * Results:
+ * Returns negative error value or zero on success.
+ * @checksums - computed MurmurHash64A of chunks.
+ */
+static int mmhash_file(struct eblob_backend *b, int fd, uint64_t offset, uint64_t count, uint64_t *checksums,
+                       char *buffer, size_t buffer_size) {
+	struct mmhash_file_ctl ctl;
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.fd = fd;
+	ctl.offset = offset;
+	ctl.count = count;
+	ctl.checksums = checksums;
+
+	if (buffer != NULL && buffer_size >= EBLOB_CSUM_CHUNK_SIZE) {
+		ctl.group_size = buffer_size - buffer_size % EBLOB_CSUM_CHUNK_SIZE;
+		ctl.groups = (count + ctl.group_size - 1) / ctl.group_size;
+		return mmhash_file_groups(&ctl, buffer);
+	}
+
+	ctl.group_size = mmhash_read_chunks * EBLOB_CSUM_CHUNK_SIZE;
+	ctl.groups = (count + ctl.group_size - 1) / ctl.group_size;
+
+	const unsigned int threads = std::min<uint64_t>(eblob_worker_threads(b), count / mmhash_thread_min_size);
+	if (threads > 1)
+		return eblob_parallel(threads, threads, mmhash_file_worker, &ctl);
+	return mmhash_file_worker(&ctl, 0);
+}
+
+/*
+ * mmhash_iov() - computes checksums of consecutive chunks of @size bytes laid out in @iov one after another.
+ * Chunks that lie within one iovec are hashed straight from it, pieces of chunks that cross boundaries
+ * of iovecs are gathered into small buffer.
+ */
+static void mmhash_iov(const struct eblob_iovec *iov, uint64_t size, uint64_t *checksums) {
+	char piece[mmhash_piece_size];
+	uint64_t pos = 0, iov_pos = 0;
+
+	while (pos < size) {
+		while (iov_pos == iov->size) {
+			++iov;
+			iov_pos = 0;
+		}
+
+		const char *data = static_cast<const char *>(iov->base) + iov_pos;
+		const uint64_t in_iov = std::min(iov->size - iov_pos, size - pos);
+
+		/* whole chunks or the rest of the record are in the iovec */
+		if (in_iov >= EBLOB_CSUM_CHUNK_SIZE || in_iov == size - pos) {
+			const uint64_t len = (in_iov == size - pos) ? in_iov : in_iov - in_iov % EBLOB_CSUM_CHUNK_SIZE;
+
+			mmhash_buffer(data, len, checksums + pos / EBLOB_CSUM_CHUNK_SIZE);
+			pos += len;
+			iov_pos += len;
+			continue;
+		}
+
+		/* chunk crosses end of the iovec */
+		const uint64_t chunk_end = std::min(pos + EBLOB_CSUM_CHUNK_SIZE, size);
+		uint64_t result = 0;
+
+		while (pos < chunk_end) {
+			const size_t len = std::min<uint64_t>(mmhash_piece_size, chunk_end - pos);
+
+			if (iov->size - iov_pos >= len) {
+				result = MurmurHash64A(static_cast<const char *>(iov->base) + iov_pos, len, result);
+				iov_pos += len;
+			} else {
+				for (size_t copied = 0; copied < len;) {
+					while (iov_pos == iov->size) {
+						++iov;
+						iov_pos = 0;
+					}
+
+					const size_t part = std::min<uint64_t>(len - copied, iov->size - iov_pos);
+					memcpy(piece + copied, static_cast<const char *>(iov->base) + iov_pos, part);
+					copied += part;
+					iov_pos += part;
+				}
+				result = MurmurHash64A(piece, len, result);
+			}
+			pos += len;
+
+			if (pos < chunk_end && iov_pos == iov->size) {
+				++iov;
+				iov_pos = 0;
+			}
+		}
+
+		checksums[(pos - 1) / EBLOB_CSUM_CHUNK_SIZE] = result;
+	}
+}
+
 /*
  * chunked_footer_offset() - calculates chunked footer offset within record pointed by @wc.
  *
@@ -93,10 +298,13 @@ static inline uint64_t chunked_footer_offset(const struct eblob_write_control *w
  * @footers - calculated MurmurHash64A of chunks
  * @footers_offset - offset of record's footer with corresponding checksums.
  * @footers_offset can be used for reading and verifying on-disk checksums or for writing calculated checksums
+ * Data is taken from @record if it holds whole record, otherwise it is read via @buffer of @buffer_size bytes
+ * or via buffers of its own, see mmhash_file().
  */
 static int eblob_chunked_mmhash(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
                                 const uint64_t offset, const uint64_t size,
-                                std::vector<uint64_t> &checksums, uint64_t &checksums_offset) {
+                                std::vector<uint64_t> &checksums, uint64_t &checksums_offset,
+                                char *buffer = NULL, size_t buffer_size = 0, const char *record = NULL) {
 	int err = 0;
 	const uint64_t first_chunk = offset / EBLOB_CSUM_CHUNK_SIZE;
 
@@ -121,29 +329,90 @@ static int eblob_chunked_mmhash(struct eblob_backend *b, struct eblob_key *key,
 		return -ENOMEM;
 	}
 
-	/* checksumming of the entry is disabled, so skip calculation of checksums */
-	if (wc->flags & BLOB_DISK_CTL_NOCSUM)
+	/* checksumming of the entry is disabled or nothing is touched, so skip calculation of checksums */
+	if ((wc->flags & BLOB_DISK_CTL_NOCSUM) || checksums.empty())
 		return 0;
 
-	uint64_t chunk_offset = data_offset + first_chunk * EBLOB_CSUM_CHUNK_SIZE;
-	uint64_t chunk_size = EBLOB_CSUM_CHUNK_SIZE;
-	for (auto it = checksums.begin(); it != checksums.end() ; ++it, chunk_offset += chunk_size) {
-		chunk_size = EBLOB_MIN(chunk_size, (offset_max - chunk_offset));
+	/* part of the record covered by chunks, the last chunk can be partial */
+	const uint64_t chunks_offset = data_offset + first_chunk * EBLOB_CSUM_CHUNK_SIZE;
+	const uint64_t chunks_end = EBLOB_MIN(data_offset + last_chunk * EBLOB_CSUM_CHUNK_SIZE, offset_max);
+	if (chunks_end <= chunks_offset ||
+	    (chunks_end - chunks_offset - 1) / EBLOB_CSUM_CHUNK_SIZE + 1 != checksums.size()) {
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: %s: chunks are out of record: "
+		          "chunks_offset: %" PRIu64 ", chunks_end: %" PRIu64 ", chunks: %zu\n",
+		          wc->index, eblob_dump_id(key->id), __func__, chunks_offset, chunks_end, checksums.size());
+		checksums.clear();
+		return -EINVAL;
+	}
 
-		err = mmhash_file(wc->data_fd, chunk_offset, chunk_size, *it);
-		if (err) {
-			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: mmhash_file failed: "
-			          "fd: %d, chunk_offset: %" PRIu64 ", chunk_size: %" PRIu64 ", err: %d\n",
-			          wc->index, eblob_dump_id(key->id), wc->data_fd, chunk_offset, chunk_size, err);
-			break;
-		}
+	if (record != NULL) {
+		mmhash_buffer(record + (chunks_offset - wc->ctl_data_offset), chunks_end - chunks_offset, checksums.data());
+		return 0;
 	}
 
-	if (err)
+	err = mmhash_file(b, wc->data_fd, chunks_offset, chunks_end - chunks_offset, checksums.data(),
+	                  buffer, buffer_size);
+	if (err) {
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: mmhash_file failed: "
+		          "fd: %d, chunks_offset: %" PRIu64 ", chunks_size: %" PRIu64 ", err: %d\n",
+		          wc->index, eblob_dump_id(key->id), wc->data_fd, chunks_offset, chunks_end - chunks_offset, err);
 		checksums.clear();
+	}
+
 	return err;
 }
 
+/*
+ * eblob_iov_holds_record() - checks whether @iov contains all data of record pointed by @wc
+ * one after another, so checksums can be calculated without reading data back from disk.
+ */
+static bool eblob_iov_holds_record(const struct eblob_write_control *wc,
+                                   const struct eblob_iovec *iov, uint16_t iovcnt) {
+	uint64_t size = 0;
+
+	/* data of extended records is shifted by hacks of eblob_writev_raw() */
+	if (wc->flags & BLOB_DISK_CTL_EXTHDR)
+		return false;
+
+	if (wc->data_offset != wc->ctl_data_offset + sizeof(struct eblob_disk_control))
+		return false;
+
+	for (uint16_t i = 0; i < iovcnt; ++i) {
+		if (iov[i].offset != size)
+			return false;
+		size += iov[i].size;
+	}
+
+	return size == wc->total_data_size;
+}
+
+/*
+ * eblob_chunked_mmhash_iov() - the same as eblob_chunked_mmhash() of whole record, but takes record's data from @iov.
+ * @iov must hold whole record, see eblob_iov_holds_record().
+ */
+static int eblob_chunked_mmhash_iov(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+                                    const struct eblob_iovec *iov,
+                                    std::vector<uint64_t> &checksums, uint64_t &checksums_offset) {
+	const uint64_t size = wc->total_data_size;
+
+	checksums_offset = wc->ctl_data_offset + chunked_footer_offset(wc);
+
+	try {
+		checksums.resize((size + EBLOB_CSUM_CHUNK_SIZE - 1) / EBLOB_CSUM_CHUNK_SIZE, 0);
+	} catch (const std::exception &e) {
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: %s: failed to allocate checksums: %s\n",
+		          wc->index, eblob_dump_id(key->id), __func__, e.what());
+		return -ENOMEM;
+	}
+
+	/* checksumming of the entry is disabled, so skip calculation of checksums */
+	if (wc->flags & BLOB_DISK_CTL_NOCSUM)
+		return 0;
+
+	mmhash_iov(iov, size, checksums.data());
+	return 0;
+}
+
 uint64_t eblob_calculate_footer_size(struct eblob_backend *b, uint64_t data_size) {
 	if (b->cfg.blob_flags & EBLOB_NO_FOOTER ||
 	    data_size == 0)
@@ -163,7 +432,8 @@ uint64_t eblob_get_footer_size(const struct eblob_backend *b, const struct eblob
 		return sizeof(struct eblob_disk_footer);
 }
 
-int eblob_verify_sha512(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc) {
+int eblob_verify_sha512(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+                        const char *record) {
 	struct eblob_disk_footer f;
 	unsigned char csum[EBLOB_ID_SIZE];
 	int err = 0;
@@ -179,6 +449,12 @@ int eblob_verify_sha512(struct eblob_backend *b, struct eblob_key *key, struct e
 		return -EINVAL;
 	}
 
+	if (record != NULL) {
+		memcpy(&f, record + wc->total_size - sizeof(f), sizeof(f));
+		sha512_buffer(record + hdr_size, wc->total_data_size, csum);
+		goto compare;
+	}
+
 	err = __eblob_read_ll(wc->data_fd, &f, sizeof(f), off);
 	if (err) {
 		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: %s: failed to read footer: "
@@ -197,6 +473,7 @@ int eblob_verify_sha512(struct eblob_backend *b, struct eblob_key *key, struct e
 		return err;
 	}
 
+compare:
 	if (memcmp(csum, f.csum, sizeof(csum))) {
 		err = -EILSEQ;
 		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: %s: checksum mismatch: err: %d\n",
@@ -211,7 +488,8 @@ int eblob_verify_sha512(struct eblob_backend *b, struct eblob_key *key, struct e
 }
 
 
-int eblob_verify_mmhash(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc) {
+int eblob_verify_mmhash(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+                        void *buffer, size_t buffer_size, const char *record) {
 	int err = 0;
 	uint64_t footers_offset = 0,
 	         footers_size = 0;
@@ -228,7 +506,8 @@ int eblob_verify_mmhash(struct eblob_backend *b, struct eblob_key *key, struct e
 
 	std::vector<uint64_t> calc_footers, check_footers;
 
-	err = eblob_chunked_mmhash(b, key, wc, wc->offset, wc->size, calc_footers, footers_offset);
+	err = eblob_chunked_mmhash(b, key, wc, wc->offset, wc->size, calc_footers, footers_offset,
+	                           static_cast<char *>(buffer), buffer_size, record);
 	if (err) {
 		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: %s: eblob_chunked_mmhash: failed: fd: %d, size: %" PRIu64
 		          ", offset: %" PRIu64 "\n",
@@ -239,7 +518,10 @@ int eblob_verify_mmhash(struct eblob_backend *b, struct eblob_key *key, struct e
 	footers_size = calc_footers.size() * sizeof(calc_footers.front());
 
 	check_footers.resize(calc_footers.size(), 0);
-	err = __eblob_read_ll(wc->data_fd, check_footers.data(), footers_size, footers_offset);
+	if (record != NULL)
+		memcpy(check_footers.data(), record + (footers_offset - wc->ctl_data_offset), footers_size);
+	else
+		err = __eblob_read_ll(wc->data_fd, check_footers.data(), footers_size, footers_offset);
 	if (err) {
 		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: %s: failed to read footer: fd: %d, size: %" PRIu64
 		          ", offset: %" PRIu64 "\n",
@@ -260,7 +542,51 @@ int eblob_verify_mmhash(struct eblob_backend *b, struct eblob_key *key, struct e
 	return 0;
 }
 
+int eblob_calculate_footer_iov(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+                               const struct eblob_iovec *iov, uint16_t iovcnt, void *footer) {
+	const uint64_t footer_size = eblob_get_footer_size(b, wc);
+	if (footer_size == 0)
+		return 0;
+
+	/*
+	 * checksums are laid out by chunks of data, so data must start right after the header;
+	 * extended header shifts data only for appends and record that is not placed yet is not one
+	 */
+	struct eblob_write_control placed = *wc;
+	placed.ctl_data_offset = 0;
+	placed.data_offset = sizeof(struct eblob_disk_control);
+	placed.flags &= ~BLOB_DISK_CTL_EXTHDR;
+	if ((wc->flags & BLOB_DISK_CTL_APPEND) || !(wc->flags & BLOB_DISK_CTL_CHUNKED_CSUM) ||
+	    !eblob_iov_holds_record(&placed, iov, iovcnt))
+		return -EINVAL;
+
+	std::vector<uint64_t> checksums;
+	uint64_t checksums_offset;
+	int err = eblob_chunked_mmhash_iov(b, key, &placed, iov, checksums, checksums_offset);
+	if (err)
+		return err;
+
+	/* chunked MurmurHash64A is followed by final MurmurHash64A of them */
+	const size_t checksums_size = checksums.size() * sizeof(checksums.front());
+	if (checksums_size + sizeof(uint64_t) != footer_size) {
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: %s: %s: checksums do not fit footer: "
+		          "checksums: %zu, footer size: %" PRIu64 "\n",
+		          eblob_dump_id(key->id), __func__, checksums.size(), footer_size);
+		return -EINVAL;
+	}
+
+	const uint64_t final_checksum = MurmurHash64A(checksums.data(), checksums_size, 0);
+	memcpy(footer, checksums.data(), checksums_size);
+	memcpy(static_cast<char *>(footer) + checksums_size, &final_checksum, sizeof(final_checksum));
+	return 0;
+}
+
 int eblob_commit_footer(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc) {
+	return eblob_commit_footer_iov(b, key, wc, NULL, 0);
+}
+
+int eblob_commit_footer_iov(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+                            const struct eblob_iovec *iov, uint16_t iovcnt) {
 	/*
 	 * skip footer committing if eblob is configured with EBLOB_NO_FOOTER flag or
 	 * the record should not be checksummed
@@ -274,8 +600,17 @@ int eblob_commit_footer(struct eblob_backend *b, struct eblob_key *key, struct e
 	std::vector<uint64_t> checksums;
 	uint64_t checksums_offset;
 
-	/* calculates chunked MurmurHash64A of whole record's data */
-	err = eblob_chunked_mmhash(b, key, wc, 0, wc->total_data_size, checksums, checksums_offset);
+	/*
+	 * calculates chunked MurmurHash64A of whole record's data, from memory if it is all there,
+	 * while the data is still being written. Otherwise data is read back once its writes are completed.
+	 */
+	if (iov != NULL && eblob_iov_holds_record(wc, iov, iovcnt)) {
+		err = eblob_chunked_mmhash_iov(b, key, wc, iov, checksums, checksums_offset);
+	} else {
+		err = eblob_write_reap();
+		if (!err)
+			err = eblob_chunked_mmhash(b, key, wc, 0, wc->total_data_size, checksums, checksums_offset);
+	}
 	if (err)
 		return err;
 
@@ -285,33 +620,37 @@ int eblob_commit_footer(struct eblob_backend *b, struct eblob_key *key, struct e
 	/* final MurmurHash64A of previously calculated chunked MurmurHash64A */
 	const uint64_t final_checksum = MurmurHash64A(checksums.data(), checksums_size, 0);
 
-	/* writes chunked MurmurHash64A to footer */
-	err = __eblob_write_ll(wc->data_fd, checksums.data(), checksums_size, checksums_offset);
+	/* writes chunked MurmurHash64A and final MurmurHash64A to footer, waits for record's data as well */
+	struct eblob_io_op ops[2];
+	ops[0].fd = wc->data_fd;
+	ops[0].buf = checksums.data();
+	ops[0].size = checksums_size;
+	ops[0].offset = checksums_offset;
+	ops[1].fd = wc->data_fd;
+	ops[1].buf = &final_checksum;
+	ops[1].size = sizeof(final_checksum);
+	ops[1].offset = checksums_offset + checksums_size;
+
+	err = eblob_write_chain(ops, 2);
 	if (err) {
-		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: %s: failed to write checksums: "
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: %s: failed to write data or checksums: "
 		          "fd: %d, size: %" PRIu64 ", offset: %" PRIu64 ": %d\n",
 		          wc->index, eblob_dump_id(key->id), __func__,
-		          wc->data_fd, checksums_size, checksums_offset, err);
-		return err;
-	}
-
-	checksums_offset += checksums_size;
-
-	/* writes final MurmurHash64A to footer */
-	err = __eblob_write_ll(wc->data_fd, &final_checksum, sizeof(final_checksum), checksums_offset);
-	if (err) {
-		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: %s: failed to write final checksums: "
-		          "fd: %d, size: %zu, offset: %" PRIu64 ": %d\n",
-		          wc->index, eblob_dump_id(key->id), __func__,
-		          wc->data_fd, sizeof(final_checksum), checksums_offset, err);
+		          wc->data_fd, checksums_size + sizeof(final_checksum), checksums_offset, err);
 		return err;
 	}
 
 	eblob_log(b->cfg.log, EBLOB_LOG_INFO, "blob i%d: %s: %s: checksums have been updated, final checksum: %" PRIx64 "\n",
 	          wc->index, eblob_dump_id(key->id), __func__, final_checksum);
 
-	if (!b->cfg.sync)
-		fsync(wc->data_fd);
+	if (!b->cfg.sync) {
+		err = eblob_group_commit(b, wc->bctl, EBLOB_GROUP_COMMIT_DATA);
+		if (err) {
+			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob i%d: %s: %s: failed to sync data: fd: %d: %d\n",
+			          wc->index, eblob_dump_id(key->id), __func__, wc->data_fd, err);
+			return err;
+		}
+	}
 
 	return 0;
 }
@@ -60,21 +60,45 @@ uint64_t eblob_get_footer_size(const struct eblob_backend *b, const struct eblob
  */
 int eblob_commit_footer(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc);
 
+/*
+ * eblob_commit_footer_iov() - the same as eblob_commit_footer(), but if @iov written to the record
+ * holds all its data, checksums are calculated from @iov instead of reading the data back from disk.
+ *
+ * Returns negative error value or zero on success
+ */
+int eblob_commit_footer_iov(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+                            const struct eblob_iovec *iov, uint16_t iovcnt);
+
+/*
+ * eblob_calculate_footer_iov() - computes footer of record pointed by @wc from @iov that holds all its data,
+ * so footer can be written together with the data instead of being committed by eblob_commit_footer().
+ * Footer of eblob_get_footer_size() bytes is put to @footer, it goes to the very end of the record.
+ * Only offsets of @iov and sizes and flags of @wc are used, the record does not need to be placed yet.
+ *
+ * Returns negative error value or zero on success
+ */
+int eblob_calculate_footer_iov(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+                               const struct eblob_iovec *iov, uint16_t iovcnt, void *footer);
+
 /*
  * eblob_verify_sha512() - verifies checksum of enty pointed by @wc by comparing sha512 of whole record's data with
- * footer.
+ * footer. If @record is not NULL, it holds whole record (@wc->total_size bytes) and nothing is read from disk.
  *
  * Returns negative error value or zero on success.
  */
-int eblob_verify_sha512(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc);
+int eblob_verify_sha512(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+                        const char *record);
 
 /*
  * eblob_verify_mmhash() - verifies checksum of entry pointed by @wc by comparing MurmurHash64A of record's data chunks
  * with footer. It will checks only chunks that intersect @wc->offset and @wc->size.
+ * If @record is not NULL, it holds whole record (@wc->total_size bytes) and nothing is read from disk.
+ * Otherwise data is read via @buffer of @buffer_size bytes if it can hold a chunk, or buffers are allocated.
  *
  * Returns negative error value or zero on success.
  */
-int eblob_verify_mmhash(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc);
+int eblob_verify_mmhash(struct eblob_backend *b, struct eblob_key *key, struct eblob_write_control *wc,
+                        void *buffer, size_t buffer_size, const char *record);
 
 #ifdef __cplusplus
 }
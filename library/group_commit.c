@@ -0,0 +1,213 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "features.h"
+
+#include "blob.h"
+#include "group_commit.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* Request of one writer, lives on its stack until @done is set */
+struct eblob_group_commit_request {
+	struct list_head	list;
+	struct eblob_base_ctl	*bctl;
+	int			flags;
+	int			err;
+	/* Set by flusher under eblob_group_commit::lock */
+	int			done;
+};
+
+static int eblob_group_commit_sync(struct eblob_base_ctl *bctl, int flags)
+{
+	int err = 0, ret;
+
+	if (flags & EBLOB_GROUP_COMMIT_DATA) {
+		ret = eblob_fdatasync(bctl->data_ctl.fd);
+		if (ret)
+			err = ret;
+	}
+
+	if (flags & EBLOB_GROUP_COMMIT_INDEX) {
+		ret = eblob_fdatasync(bctl->index_ctl.fd);
+		if (ret && !err)
+			err = ret;
+	}
+
+	return err;
+}
+
+/*
+ * Syncs every base mentioned in @round once and moves served requests to @synced.
+ * Requesters are sleeping, so requests can be modified without lock except @done.
+ */
+static void eblob_group_commit_round(struct list_head *round, struct list_head *synced)
+{
+	struct eblob_group_commit_request *r, *other, *tmp;
+	struct eblob_base_ctl *bctl;
+	int flags, err;
+
+	while (!list_empty(round)) {
+		r = list_first_entry(round, struct eblob_group_commit_request, list);
+		bctl = r->bctl;
+
+		flags = 0;
+		list_for_each_entry(other, round, list) {
+			if (other->bctl == bctl)
+				flags |= other->flags;
+		}
+
+		err = eblob_group_commit_sync(bctl, flags);
+
+		list_for_each_entry_safe(other, tmp, round, list) {
+			if (other->bctl == bctl) {
+				other->err = err;
+				list_move_tail(&other->list, synced);
+			}
+		}
+	}
+}
+
+/**
+ * eblob_group_commit_thread() - flusher thread.
+ * Serves requests in rounds: everything that has been queued while previous
+ * round was syncing goes to the next one.
+ */
+static void *eblob_group_commit_thread(void *data)
+{
+	struct eblob_backend *b = data;
+	struct eblob_group_commit *gc = &b->group_commit;
+	struct eblob_group_commit_request *r, *tmp;
+	LIST_HEAD(round);
+	LIST_HEAD(synced);
+
+	eblob_set_name("commit_%u", b->cfg.stat_id);
+
+	pthread_mutex_lock(&gc->lock);
+	for (;;) {
+		while (list_empty(&gc->requests) && !gc->need_exit)
+			pthread_cond_wait(&gc->queued, &gc->lock);
+
+		if (list_empty(&gc->requests))
+			break;
+
+		list_splice_init(&gc->requests, &round);
+		pthread_mutex_unlock(&gc->lock);
+
+		eblob_group_commit_round(&round, &synced);
+
+		pthread_mutex_lock(&gc->lock);
+		/* Requester may return as soon as lock is dropped, so unlink before marking it done */
+		list_for_each_entry_safe(r, tmp, &synced, list) {
+			list_del(&r->list);
+			r->done = 1;
+		}
+		pthread_cond_broadcast(&gc->completed);
+	}
+	pthread_mutex_unlock(&gc->lock);
+
+	return NULL;
+}
+
+int eblob_group_commit_init(struct eblob_backend *b)
+{
+	struct eblob_group_commit *gc = &b->group_commit;
+	int err;
+
+	memset(gc, 0, sizeof(*gc));
+	INIT_LIST_HEAD(&gc->requests);
+
+	err = eblob_mutex_init(&gc->lock);
+	if (err != 0)
+		goto err_out_exit;
+
+	err = eblob_cond_init(&gc->queued);
+	if (err != 0)
+		goto err_out_mutex_destroy;
+
+	err = eblob_cond_init(&gc->completed);
+	if (err != 0)
+		goto err_out_queued_destroy;
+
+	/* Nothing to group if writes are not synced or there is nobody to do it in background */
+	if (b->cfg.sync || (b->cfg.blob_flags & EBLOB_DISABLE_THREADS))
+		return 0;
+
+	err = pthread_create(&gc->tid, NULL, eblob_group_commit_thread, b);
+	if (err) {
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: eblob group commit thread creation failed: %d.\n", err);
+		err = -err;
+		goto err_out_completed_destroy;
+	}
+	gc->running = 1;
+
+	return 0;
+
+err_out_completed_destroy:
+	pthread_cond_destroy(&gc->completed);
+err_out_queued_destroy:
+	pthread_cond_destroy(&gc->queued);
+err_out_mutex_destroy:
+	pthread_mutex_destroy(&gc->lock);
+err_out_exit:
+	return err;
+}
+
+void eblob_group_commit_destroy(struct eblob_backend *b)
+{
+	struct eblob_group_commit *gc = &b->group_commit;
+
+	if (gc->running) {
+		pthread_mutex_lock(&gc->lock);
+		gc->need_exit = 1;
+		pthread_cond_signal(&gc->queued);
+		pthread_mutex_unlock(&gc->lock);
+
+		pthread_join(gc->tid, NULL);
+		gc->running = 0;
+	}
+
+	pthread_cond_destroy(&gc->completed);
+	pthread_cond_destroy(&gc->queued);
+	pthread_mutex_destroy(&gc->lock);
+}
+
+int eblob_group_commit(struct eblob_backend *b, struct eblob_base_ctl *bctl, int flags)
+{
+	struct eblob_group_commit *gc = &b->group_commit;
+	struct eblob_group_commit_request req;
+
+	if (!gc->running)
+		return eblob_group_commit_sync(bctl, flags);
+
+	memset(&req, 0, sizeof(req));
+	req.bctl = bctl;
+	req.flags = flags;
+
+	pthread_mutex_lock(&gc->lock);
+	list_add_tail(&req.list, &gc->requests);
+	pthread_cond_signal(&gc->queued);
+	while (!req.done)
+		pthread_cond_wait(&gc->completed, &gc->lock);
+	pthread_mutex_unlock(&gc->lock);
+
+	return req.err;
+}
@@ -0,0 +1,83 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Group commit of synchronous writes (cfg.sync == 0).
+ *
+ * Instead of syncing base files by itself every writer queues a request and
+ * sleeps. Single flusher thread takes everything that has been queued so far,
+ * syncs each involved file of each involved base only once and wakes all
+ * requesters up. Since requests queued while flusher syncs are served by the
+ * next round, writer returns only after the file has been synced after its
+ * own write, so "returned means durable" still holds.
+ */
+
+#ifndef __EBLOB_GROUP_COMMIT_H
+#define __EBLOB_GROUP_COMMIT_H
+
+#include "list.h"
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Files of base that should be synced */
+#define EBLOB_GROUP_COMMIT_DATA		(1<<0)
+#define EBLOB_GROUP_COMMIT_INDEX	(1<<1)
+
+struct eblob_backend;
+struct eblob_base_ctl;
+
+struct eblob_group_commit {
+	/* Protects @requests, @need_exit and completion of requests */
+	pthread_mutex_t		lock;
+	/* Signalled when request is queued or flusher should exit */
+	pthread_cond_t		queued;
+	/* Broadcasted when flusher has completed a round of requests */
+	pthread_cond_t		completed;
+	/* Requests that are waiting for the next round */
+	struct list_head	requests;
+	int			need_exit;
+	/* Set when flusher thread is running, otherwise callers sync by themselves */
+	int			running;
+	pthread_t		tid;
+};
+
+/*
+ * Initializes group commit and starts flusher thread
+ * if backend does synchronous writes and threads are allowed.
+ */
+int eblob_group_commit_init(struct eblob_backend *b);
+/* Stops flusher thread, there must be no requests in flight */
+void eblob_group_commit_destroy(struct eblob_backend *b);
+
+/*
+ * Syncs files of @bctl selected by @flags.
+ * Returns after all data written to them before the call is on disk.
+ */
+int eblob_group_commit(struct eblob_backend *b, struct eblob_base_ctl *bctl, int flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EBLOB_GROUP_COMMIT_H */
@@ -48,6 +48,7 @@
 #include <unistd.h>
 
 #include "blob.h"
+#include "murmurhash.h"
 
 #include "measure_points.h"
 
@@ -83,6 +84,244 @@ int eblob_disk_control_sort_with_flags(const void *d1, const void *d2)
 	return cmp;
 }
 
+/* Key prefix of header and its position in array being sorted */
+struct eblob_radix_item {
+	uint64_t		prefix;
+	uint64_t		pos;
+};
+
+/* Arrays shorter than this are sorted by qsort(3) */
+#define EBLOB_RADIX_SORT_MIN	256
+/* Buckets and runs of equal prefixes shorter than this are sorted by insertion sort */
+#define EBLOB_RADIX_BUCKET_MIN	32
+
+/* Headers and buckets by first byte of key shared by threads of radix sort */
+struct eblob_radix_sort_ctl {
+	const struct eblob_disk_control	*dcs;
+	/* Items are scattered to buckets in @items, @tmp is scratch space */
+	struct eblob_radix_item		*items;
+	struct eblob_radix_item		*tmp;
+	/* Bucket i is [starts[i], starts[i + 1]) */
+	uint64_t			starts[257];
+	int				(*cmp)(const void *, const void *);
+};
+
+/* First 64 bits of key as big-endian number, so numbers compare as keys */
+static inline uint64_t eblob_radix_prefix(const struct eblob_disk_control *dc)
+{
+	uint64_t prefix = 0;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(prefix); ++i)
+		prefix = (prefix << 8) | dc->key.id[i];
+	return prefix;
+}
+
+static inline int eblob_radix_item_cmp(const struct eblob_disk_control *dcs,
+		const struct eblob_radix_item *i1, const struct eblob_radix_item *i2,
+		int (*cmp)(const void *, const void *))
+{
+	if (i1->prefix != i2->prefix)
+		return i1->prefix < i2->prefix ? -1 : 1;
+	return cmp(&dcs[i1->pos], &dcs[i2->pos]);
+}
+
+/*
+ * Insertion sort of @num items by prefix and then by @cmp applied to their
+ * headers, keeps order of equal items.
+ */
+static void eblob_radix_insertion_sort(const struct eblob_disk_control *dcs,
+		struct eblob_radix_item *items, uint64_t num, int (*cmp)(const void *, const void *))
+{
+	struct eblob_radix_item tmp;
+	uint64_t i, j;
+
+	for (i = 1; i < num; ++i) {
+		tmp = items[i];
+		for (j = i; j > 0 && eblob_radix_item_cmp(dcs, &items[j - 1], &tmp, cmp) > 0; --j)
+			items[j] = items[j - 1];
+		items[j] = tmp;
+	}
+}
+
+/*
+ * Merge sort of @num items by prefix and then by @cmp applied to their
+ * headers, keeps order of equal items. @tmp is scratch space of @num items.
+ * Pieces of EBLOB_RADIX_BUCKET_MIN items are sorted by insertion sort first.
+ */
+static void eblob_radix_merge_sort(const struct eblob_disk_control *dcs,
+		struct eblob_radix_item *items, struct eblob_radix_item *tmp, uint64_t num,
+		int (*cmp)(const void *, const void *))
+{
+	struct eblob_radix_item *src = items, *dst = tmp, *swap;
+	uint64_t width, start, mid, end, i, j, k;
+
+	for (start = 0; start < num; start += EBLOB_RADIX_BUCKET_MIN)
+		eblob_radix_insertion_sort(dcs, items + start, EBLOB_MIN(num - start, EBLOB_RADIX_BUCKET_MIN), cmp);
+
+	for (width = EBLOB_RADIX_BUCKET_MIN; width < num; width *= 2) {
+		for (start = 0; start < num; start += 2 * width) {
+			mid = EBLOB_MIN(start + width, num);
+			end = EBLOB_MIN(start + 2 * width, num);
+
+			/* Item of the first piece goes first if items are equal */
+			for (i = start, j = mid, k = start; k < end; ++k) {
+				if (j == end || (i < mid && eblob_radix_item_cmp(dcs, &src[i], &src[j], cmp) <= 0))
+					dst[k] = src[i++];
+				else
+					dst[k] = src[j++];
+			}
+		}
+
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if (src != items)
+		memcpy(items, src, num * sizeof(struct eblob_radix_item));
+}
+
+/*
+ * Sorts one bucket of items with equal first byte of key: LSD radix sort by
+ * remaining 7 bytes of prefix, then runs of equal prefixes are ordered by @cmp
+ * with merge sort, so even many duplicates of a key are sorted in O(k log k).
+ * Called by eblob_parallel().
+ */
+static int eblob_radix_sort_bucket(void *priv, unsigned int bucket)
+{
+	static const unsigned int digits = sizeof(uint64_t) - 1;
+	struct eblob_radix_sort_ctl *ctl = priv;
+	const uint64_t start = ctl->starts[bucket];
+	const uint64_t num = ctl->starts[bucket + 1] - start;
+	struct eblob_radix_item *items = ctl->items + start, *tmp = ctl->tmp + start, *swap;
+	uint64_t counts[digits][256];
+	uint64_t i, j, next, sum;
+	unsigned int d, shift;
+
+	if (num < EBLOB_RADIX_BUCKET_MIN) {
+		eblob_radix_insertion_sort(ctl->dcs, items, num, ctl->cmp);
+		return 0;
+	}
+
+	/* Histograms of all digits are built in one pass */
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < num; ++i)
+		for (d = 0; d < digits; ++d)
+			counts[d][(items[i].prefix >> (d * 8)) & 0xff]++;
+
+	for (d = 0; d < digits; ++d) {
+		shift = d * 8;
+
+		/* All items have the same digit - pass would not move anything */
+		if (counts[d][(items[0].prefix >> shift) & 0xff] == num)
+			continue;
+
+		for (j = 0, sum = 0; j < 256; ++j) {
+			next = sum + counts[d][j];
+			counts[d][j] = sum;
+			sum = next;
+		}
+
+		for (i = 0; i < num; ++i)
+			tmp[counts[d][(items[i].prefix >> shift) & 0xff]++] = items[i];
+
+		swap = items;
+		items = tmp;
+		tmp = swap;
+	}
+
+	/* Result must stay in @ctl->items */
+	if (items != ctl->items + start)
+		memcpy(ctl->items + start, items, num * sizeof(struct eblob_radix_item));
+	items = ctl->items + start;
+	tmp = ctl->tmp + start;
+
+	for (j = 0, i = 1; i <= num; ++i) {
+		if (i < num && items[i].prefix == items[j].prefix)
+			continue;
+		if (i - j > 1)
+			eblob_radix_merge_sort(ctl->dcs, items + j, tmp + j, i - j, ctl->cmp);
+		j = i;
+	}
+
+	return 0;
+}
+
+/**
+ * eblob_disk_control_radix_sort() - sorts @num headers in the same order as
+ * qsort(3) with @cmp, which must order headers by key first.
+ *
+ * Pairs of 64-bit key prefix and position are scattered to 256 buckets by
+ * first byte of key. Buckets are sorted by up to @threads threads with LSD
+ * radix sort, pairs with equal prefixes are ordered by @cmp. Then headers
+ * are permuted in place. Headers that are equal for @cmp keep their order.
+ * Returns 0 or -ENOMEM.
+ */
+int eblob_disk_control_radix_sort(struct eblob_disk_control *dcs, uint64_t num,
+		int (*cmp)(const void *, const void *), unsigned int threads)
+{
+	struct eblob_radix_sort_ctl ctl;
+	struct eblob_radix_item *items, *buf;
+	struct eblob_disk_control dc;
+	uint64_t counts[256] = { 0 };
+	uint64_t i, j, next;
+	unsigned int b;
+
+	if (num < EBLOB_RADIX_SORT_MIN) {
+		qsort(dcs, num, sizeof(struct eblob_disk_control), cmp);
+		return 0;
+	}
+
+	buf = malloc(2 * num * sizeof(struct eblob_radix_item));
+	if (buf == NULL)
+		return -ENOMEM;
+	items = buf + num;
+
+	for (i = 0; i < num; ++i) {
+		buf[i].prefix = eblob_radix_prefix(&dcs[i]);
+		buf[i].pos = i;
+		counts[buf[i].prefix >> 56]++;
+	}
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.dcs = dcs;
+	ctl.items = items;
+	ctl.tmp = buf;
+	ctl.cmp = cmp;
+	for (b = 0; b < 256; ++b)
+		ctl.starts[b + 1] = ctl.starts[b] + counts[b];
+
+	/* Scatter to buckets, each bucket gets its share of scratch space */
+	for (b = 0; b < 256; ++b)
+		counts[b] = ctl.starts[b];
+	for (i = 0; i < num; ++i)
+		items[counts[buf[i].prefix >> 56]++] = buf[i];
+
+	eblob_parallel(threads, 256, eblob_radix_sort_bucket, &ctl);
+
+	/*
+	 * Header at @pos of item i goes to position i: follow cycles of this
+	 * permutation, placed items are marked by pointing to themselves.
+	 */
+	for (i = 0; i < num; ++i) {
+		if (items[i].pos == i)
+			continue;
+
+		dc = dcs[i];
+		for (j = i; items[j].pos != i; j = next) {
+			next = items[j].pos;
+			dcs[j] = dcs[next];
+			items[j].pos = j;
+		}
+		dcs[j] = dc;
+		items[j].pos = j;
+	}
+
+	free(buf);
+	return 0;
+}
+
 static int eblob_key_range_cmp(const void *k1, const void *k2)
 {
 	const struct eblob_key *key = k1;
@@ -131,12 +370,24 @@ static int eblob_find_non_removed_callback(struct eblob_disk_control *sorted,
 int eblob_index_blocks_destroy(struct eblob_base_ctl *bctl)
 {
 	pthread_rwlock_wrlock(&bctl->index_blocks_lock);
-	/* Free data */
-	free(bctl->index_blocks);
-	free(bctl->bloom);
+	/* Free data, bloom and index blocks are not allocated if they were loaded from .index.meta */
+	if (bctl->meta_map != NULL) {
+		munmap(bctl->meta_map, bctl->meta_map_size);
+	} else {
+		free(bctl->index_blocks);
+		free(bctl->bloom);
+	}
+	if (bctl->index_map != NULL)
+		munmap(bctl->index_map, bctl->index_map_size);
 	/* Allow subsequent destroys */
 	bctl->index_blocks = NULL;
 	bctl->bloom = NULL;
+	bctl->bloom_blocks = 0;
+	bctl->index_map = NULL;
+	bctl->index_map_size = 0;
+	bctl->meta_map = NULL;
+	bctl->meta_map_size = 0;
+	bctl->meta_csum = 0;
 	/* Nullify stats */
 	eblob_stat_set(bctl->stat, EBLOB_LST_BLOOM_SIZE, 0);
 	eblob_stat_set(bctl->stat, EBLOB_LST_INDEX_BLOCKS_SIZE, 0);
@@ -188,7 +439,7 @@ static uint64_t eblob_bloom_size(const struct eblob_base_ctl *bctl)
 	uint64_t bloom_size = 0;
 
 	/* Number of record in base */
-	bloom_size += bctl->index_ctl.size / sizeof(struct eblob_disk_control);
+	bloom_size += bctl->index_map_size / sizeof(struct eblob_disk_control);
 	/* Number of index blocks in base */
 	bloom_size /= bctl->back->cfg.index_block_size;
 	/* Add one for tiny bases */
@@ -215,7 +466,7 @@ static uint8_t eblob_bloom_func_num(const struct eblob_base_ctl *bctl)
 	uint8_t func_num = 0;
 
 	bits_per_key = 8 * bctl->bloom_size /
-		(bctl->index_ctl.size / sizeof(struct eblob_disk_control));
+		(bctl->index_map_size / sizeof(struct eblob_disk_control));
 	func_num = bits_per_key * 0.69;
 	if (func_num == 0)
 		return 1;
@@ -224,51 +475,564 @@ static uint8_t eblob_bloom_func_num(const struct eblob_base_ctl *bctl)
 	return func_num;
 }
 
-int eblob_index_blocks_fill(struct eblob_base_ctl *bctl)
+/*
+ * False positive rate (in ppm) of blocked bloom filter for number of bits per
+ * key starting from EBLOB_BLOOM_BLOCK_MIN_BITS. Number of keys that fall into
+ * one cache line is taken Poisson distributed.
+ */
+#define EBLOB_BLOOM_BLOCK_MIN_BITS	4
+static const uint32_t eblob_bloom_block_fpr[] = {
+	319128, 171952, 92927, 51399, 29311, 17262, 10490, 6566, 4223, 2785,
+	1879, 1295, 909, 650, 472, 348, 260, 197, 151, 117,
+	91, 72, 58, 46, 37, 31, 25, 21, 17, 15,
+	12, 10, 9, 8, 7, 6, 5,
+};
+
+/*!
+ * Calculates number of cache lines in blocked bloom filter needed to reach
+ * configured false positive rate.
+ */
+static uint64_t eblob_bloom_blocks(const struct eblob_base_ctl *bctl)
+{
+	const uint64_t records = bctl->index_map_size / sizeof(struct eblob_disk_control);
+	const size_t max = sizeof(eblob_bloom_block_fpr) / sizeof(eblob_bloom_block_fpr[0]) - 1;
+	uint64_t blocks;
+	size_t i = 0;
+
+	while (i < max && eblob_bloom_block_fpr[i] > bctl->back->cfg.bloom_false_positive_ppm)
+		++i;
+
+	blocks = howmany(records * (EBLOB_BLOOM_BLOCK_MIN_BITS + i), EBLOB_BLOOM_BLOCK_SIZE * 8);
+	if (blocks == 0)
+		blocks = 1;
+	/* Block is selected by 32 bits of hash */
+	if (blocks > UINT32_MAX)
+		blocks = UINT32_MAX;
+
+	return blocks;
+}
+
+/*!
+ * Sets size and number of hash functions of bloom filter according to config
+ */
+static void eblob_bloom_layout(struct eblob_base_ctl *bctl)
+{
+	if (bctl->back->cfg.blob_flags & EBLOB_BLOCKED_BLOOM) {
+		bctl->bloom_blocks = eblob_bloom_blocks(bctl);
+		bctl->bloom_size = bctl->bloom_blocks * EBLOB_BLOOM_BLOCK_SIZE;
+		bctl->bloom_func_num = EBLOB_BLOOM_BLOCK_WORDS;
+	} else {
+		bctl->bloom_blocks = 0;
+		bctl->bloom_size = eblob_bloom_size(bctl);
+		/* Calculate needed number of hash functions */
+		bctl->bloom_func_num = eblob_bloom_func_num(bctl);
+	}
+}
+
+static int eblob_bloom_alloc(struct eblob_base_ctl *bctl)
+{
+	void *bloom;
+
+	eblob_bloom_layout(bctl);
+
+	if (bctl->bloom_blocks) {
+		if (posix_memalign(&bloom, EBLOB_BLOOM_BLOCK_SIZE, bctl->bloom_size) != 0)
+			return -ENOMEM;
+		memset(bloom, 0, bctl->bloom_size);
+	} else {
+		bloom = calloc(1, bctl->bloom_size);
+		if (bloom == NULL)
+			return -ENOMEM;
+	}
+
+	bctl->bloom = bloom;
+	return 0;
+}
+
+/*
+ * .index.meta file keeps bloom filter, index blocks and counters of sorted
+ * base, so they do not have to be rebuilt from sorted index on startup.
+ *
+ * File consists of header, array of index blocks, bloom filter and, if key
+ * locator is used, array of eblob_locator_hash() of live keys, all aligned
+ * to EBLOB_BLOOM_BLOCK_SIZE. The last one lets locator be filled without
+ * reading whole sorted index. File is valid only for sorted index
+ * with the same inode, size and mtime (generation). Sorted index is changed
+ * in place by removes, so header is rewritten with fresh counters and
+ * generation on clean shutdown, after crash file is just rebuilt.
+ */
+#define EBLOB_INDEX_META_MAGIC		0x4154454d58444e49ULL	/* "INDXMETA" */
+#define EBLOB_INDEX_META_VERSION	2
+/* MurmurHash64A() takes int length, so payload is hashed by chunks */
+#define EBLOB_INDEX_META_CSUM_CHUNK	(1UL << 30)
+
+struct eblob_index_meta {
+	uint64_t	magic;
+	uint64_t	version;
+	/* Generation of sorted index */
+	uint64_t	index_ino;
+	uint64_t	index_size;
+	uint64_t	index_mtime_sec;
+	uint64_t	index_mtime_nsec;
+	/* Layout */
+	uint64_t	index_block_size;
+	uint64_t	block_count;
+	uint64_t	blocks_offset;
+	uint64_t	bloom_size;
+	uint64_t	bloom_blocks;
+	uint64_t	bloom_func_num;
+	uint64_t	bloom_offset;
+	/* Zero offset means there are no locator hashes */
+	uint64_t	locator_offset;
+	uint64_t	locator_count;
+	uint64_t	payload_csum;
+	/* Counters */
+	int64_t		removed;
+	int64_t		removed_size;
+	int64_t		uncommitted;
+	int64_t		uncommitted_size;
+	int64_t		corrupted;
+	int64_t		corrupted_size;
+	int64_t		index_corrupted;
+	/* Checksum of all fields above */
+	uint64_t	header_csum;
+};
+
+static inline uint64_t eblob_index_meta_align(uint64_t offset)
+{
+	return howmany(offset, EBLOB_BLOOM_BLOCK_SIZE) * EBLOB_BLOOM_BLOCK_SIZE;
+}
+
+/* Returns size of file described by @meta */
+static inline uint64_t eblob_index_meta_size(const struct eblob_index_meta *meta)
+{
+	if (meta->locator_offset)
+		return meta->locator_offset + meta->locator_count * sizeof(uint64_t);
+	return meta->bloom_offset + meta->bloom_size;
+}
+
+static int eblob_index_meta_path(const struct eblob_base_ctl *bctl, char *path, size_t size)
+{
+	if (snprintf(path, size, "%s-0.%d.index.meta", bctl->back->cfg.file, bctl->index) >= (int)size)
+		return -ENAMETOOLONG;
+	return 0;
+}
+
+static uint64_t eblob_index_meta_header_csum(const struct eblob_index_meta *meta)
+{
+	return MurmurHash64A(meta, offsetof(struct eblob_index_meta, header_csum), EBLOB_INDEX_META_MAGIC);
+}
+
+static uint64_t eblob_index_meta_payload_csum(const char *data, uint64_t size)
+{
+	uint64_t csum = EBLOB_INDEX_META_MAGIC, len;
+
+	for (; size; data += len, size -= len) {
+		len = size < EBLOB_INDEX_META_CSUM_CHUNK ? size : EBLOB_INDEX_META_CSUM_CHUNK;
+		csum = MurmurHash64A(data, len, csum);
+	}
+
+	/* Zero means there is no meta */
+	return csum ? csum : 1;
+}
+
+/* Puts generation of sorted index and current counters of @bctl to @meta */
+static int eblob_index_meta_fill_header(struct eblob_base_ctl *bctl, struct eblob_index_meta *meta)
+{
+	struct stat st;
+
+	if (fstat(bctl->index_ctl.fd, &st) == -1)
+		return -errno;
+
+	meta->index_ino = st.st_ino;
+	meta->index_size = st.st_size;
+	meta->index_mtime_sec = st.st_mtim.tv_sec;
+	meta->index_mtime_nsec = st.st_mtim.tv_nsec;
+
+	meta->removed = eblob_stat_get(bctl->stat, EBLOB_LST_RECORDS_REMOVED);
+	meta->removed_size = eblob_stat_get(bctl->stat, EBLOB_LST_REMOVED_SIZE);
+	meta->uncommitted = eblob_stat_get(bctl->stat, EBLOB_LST_RECORDS_UNCOMMITTED);
+	meta->uncommitted_size = eblob_stat_get(bctl->stat, EBLOB_LST_UNCOMMITTED_SIZE);
+	meta->corrupted = eblob_stat_get(bctl->stat, EBLOB_LST_RECORDS_CORRUPTED);
+	meta->corrupted_size = eblob_stat_get(bctl->stat, EBLOB_LST_CORRUPTED_SIZE);
+	meta->index_corrupted = eblob_stat_get(bctl->stat, EBLOB_LST_INDEX_CORRUPTED_ENTRIES);
+
+	meta->header_csum = eblob_index_meta_header_csum(meta);
+	return 0;
+}
+
+/* Syncs directory of bases, so renamed .index.meta file survives crash */
+static int eblob_index_meta_sync_dir(struct eblob_base_ctl *bctl)
+{
+	int fd, err;
+
+	fd = open(bctl->back->base_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return -errno;
+
+	err = eblob_fsync(fd);
+	close(fd);
+	return err;
+}
+
+/*!
+ * Writes bloom filter and index blocks just built for @bctl to its .index.meta file.
+ * File is written aside and renamed, so readers never see partially written one.
+ */
+static int eblob_index_meta_write(struct eblob_base_ctl *bctl)
+{
+	struct eblob_index_meta meta;
+	char path[PATH_MAX], tmp_path[PATH_MAX];
+	const uint64_t block_count = eblob_stat_get(bctl->stat, EBLOB_LST_INDEX_BLOCKS_SIZE) /
+		sizeof(struct eblob_index_block);
+	const uint64_t records = bctl->index_map_size / sizeof(struct eblob_disk_control);
+	const int with_locator = !!(bctl->back->cfg.blob_flags & EBLOB_KEY_LOCATOR);
+	uint64_t *hashes, i;
+	char *payload;
+	int fd, err;
+
+	memset(&meta, 0, sizeof(meta));
+	meta.magic = EBLOB_INDEX_META_MAGIC;
+	meta.version = EBLOB_INDEX_META_VERSION;
+	meta.index_block_size = bctl->back->cfg.index_block_size;
+	meta.block_count = block_count;
+	meta.blocks_offset = eblob_index_meta_align(sizeof(meta));
+	meta.bloom_size = bctl->bloom_size;
+	meta.bloom_blocks = bctl->bloom_blocks;
+	meta.bloom_func_num = bctl->bloom_func_num;
+	meta.bloom_offset = eblob_index_meta_align(meta.blocks_offset +
+			block_count * sizeof(struct eblob_index_block));
+	if (with_locator)
+		meta.locator_offset = eblob_index_meta_align(meta.bloom_offset + meta.bloom_size);
+
+	/* Payload is built in memory to checksum it in one pass, room is reserved for hashes of all keys */
+	payload = calloc(1, meta.bloom_offset + meta.bloom_size - meta.blocks_offset +
+			(with_locator ? meta.locator_offset - meta.bloom_offset - meta.bloom_size +
+			 records * sizeof(uint64_t) : 0));
+	if (payload == NULL) {
+		err = -ENOMEM;
+		goto err_out_exit;
+	}
+	memcpy(payload, bctl->index_blocks, block_count * sizeof(struct eblob_index_block));
+	memcpy(payload + meta.bloom_offset - meta.blocks_offset, bctl->bloom, bctl->bloom_size);
+
+	if (with_locator) {
+		hashes = (uint64_t *)(payload + meta.locator_offset - meta.blocks_offset);
+		for (i = 0; i < records; ++i) {
+			if (bctl->index_map[i].flags & eblob_bswap64(BLOB_DISK_CTL_REMOVE))
+				continue;
+			hashes[meta.locator_count++] = eblob_locator_hash(&bctl->index_map[i].key);
+		}
+	}
+
+	meta.payload_csum = eblob_index_meta_payload_csum(payload,
+			eblob_index_meta_size(&meta) - meta.blocks_offset);
+
+	err = eblob_index_meta_fill_header(bctl, &meta);
+	if (err)
+		goto err_out_free;
+
+	err = eblob_index_meta_path(bctl, path, sizeof(path));
+	if (err)
+		goto err_out_free;
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path)) {
+		err = -ENAMETOOLONG;
+		goto err_out_free;
+	}
+
+	fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		err = -errno;
+		goto err_out_free;
+	}
+
+	err = __eblob_write_ll(fd, &meta, sizeof(meta), 0);
+	if (err)
+		goto err_out_unlink;
+
+	err = __eblob_write_ll(fd, payload, eblob_index_meta_size(&meta) - meta.blocks_offset,
+			meta.blocks_offset);
+	if (err)
+		goto err_out_unlink;
+
+	/* File must be on disk before it replaces the old one, or crash may leave empty file */
+	err = eblob_fsync(fd);
+	if (err)
+		goto err_out_unlink;
+
+	if (rename(tmp_path, path) == -1) {
+		err = -errno;
+		goto err_out_unlink;
+	}
+
+	close(fd);
+	free(payload);
+	bctl->meta_csum = meta.payload_csum;
+
+	return eblob_index_meta_sync_dir(bctl);
+
+err_out_unlink:
+	unlink(tmp_path);
+	close(fd);
+err_out_free:
+	free(payload);
+err_out_exit:
+	return err;
+}
+
+/*!
+ * Maps .index.meta file of @bctl and points bloom filter and index blocks to it.
+ * Points @hashes to @hashes_num locator hashes of its keys if locator is used.
+ * Returns error if there is no file or it does not match sorted index or config,
+ * caller has to build them from sorted index then.
+ */
+static int eblob_index_meta_load(struct eblob_base_ctl *bctl, const uint64_t **hashes, uint64_t *hashes_num)
+{
+	struct eblob_index_meta meta;
+	char path[PATH_MAX];
+	struct stat st, index_st;
+	const uint64_t records = bctl->index_ctl.size / sizeof(struct eblob_disk_control);
+	char *map;
+	int fd, err;
+
+	err = eblob_index_meta_path(bctl, path, sizeof(path));
+	if (err)
+		goto err_out_exit;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		err = -errno;
+		goto err_out_exit;
+	}
+
+	if (fstat(fd, &st) == -1 || fstat(bctl->index_ctl.fd, &index_st) == -1) {
+		err = -errno;
+		goto err_out_close;
+	}
+
+	err = __eblob_read_ll(fd, &meta, sizeof(meta), 0);
+	if (err)
+		goto err_out_close;
+
+	/* Check that file is intact and describes current sorted index */
+	err = -EINVAL;
+	if (meta.magic != EBLOB_INDEX_META_MAGIC || meta.version != EBLOB_INDEX_META_VERSION ||
+			meta.header_csum != eblob_index_meta_header_csum(&meta))
+		goto err_out_close;
+
+	err = -ESTALE;
+	if (meta.index_ino != (uint64_t)index_st.st_ino ||
+			meta.index_size != (uint64_t)index_st.st_size ||
+			meta.index_size != bctl->index_ctl.size ||
+			meta.index_mtime_sec != (uint64_t)index_st.st_mtim.tv_sec ||
+			meta.index_mtime_nsec != (uint64_t)index_st.st_mtim.tv_nsec)
+		goto err_out_close;
+
+	/* Check that config has not been changed since file was written */
+	eblob_bloom_layout(bctl);
+	if (meta.index_block_size != bctl->back->cfg.index_block_size ||
+			meta.block_count != howmany(records, bctl->back->cfg.index_block_size) ||
+			meta.bloom_size != bctl->bloom_size ||
+			meta.bloom_blocks != bctl->bloom_blocks ||
+			meta.bloom_func_num != bctl->bloom_func_num ||
+			meta.blocks_offset != eblob_index_meta_align(sizeof(meta)) ||
+			meta.bloom_offset != eblob_index_meta_align(meta.blocks_offset +
+				meta.block_count * sizeof(struct eblob_index_block)) ||
+			(meta.locator_offset && meta.locator_offset !=
+				eblob_index_meta_align(meta.bloom_offset + meta.bloom_size)) ||
+			(!meta.locator_offset && (bctl->back->cfg.blob_flags & EBLOB_KEY_LOCATOR)) ||
+			meta.locator_count > records ||
+			(uint64_t)st.st_size != eblob_index_meta_size(&meta))
+		goto err_out_close;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		err = -errno;
+		goto err_out_close;
+	}
+
+	err = -EILSEQ;
+	if (meta.payload_csum != eblob_index_meta_payload_csum(map + meta.blocks_offset,
+				st.st_size - meta.blocks_offset))
+		goto err_out_unmap;
+
+	close(fd);
+
+	bctl->meta_map = map;
+	bctl->meta_map_size = st.st_size;
+	bctl->meta_csum = meta.payload_csum;
+	bctl->index_blocks = (struct eblob_index_block *)(map + meta.blocks_offset);
+	bctl->bloom = (unsigned char *)map + meta.bloom_offset;
+	*hashes = (const uint64_t *)(map + meta.locator_offset);
+	*hashes_num = meta.locator_count;
+
+	eblob_stat_set(bctl->stat, EBLOB_LST_BLOOM_SIZE, bctl->bloom_size);
+	eblob_stat_set(bctl->stat, EBLOB_LST_INDEX_BLOCKS_SIZE,
+			meta.block_count * sizeof(struct eblob_index_block));
+	eblob_stat_set(bctl->stat, EBLOB_LST_RECORDS_REMOVED, meta.removed);
+	eblob_stat_set(bctl->stat, EBLOB_LST_REMOVED_SIZE, meta.removed_size);
+	eblob_stat_set(bctl->stat, EBLOB_LST_RECORDS_UNCOMMITTED, meta.uncommitted);
+	eblob_stat_set(bctl->stat, EBLOB_LST_UNCOMMITTED_SIZE, meta.uncommitted_size);
+	eblob_stat_set(bctl->stat, EBLOB_LST_RECORDS_CORRUPTED, meta.corrupted);
+	eblob_stat_set(bctl->stat, EBLOB_LST_CORRUPTED_SIZE, meta.corrupted_size);
+	eblob_stat_set(bctl->stat, EBLOB_LST_INDEX_CORRUPTED_ENTRIES, meta.index_corrupted);
+	return 0;
+
+err_out_unmap:
+	munmap(map, st.st_size);
+err_out_close:
+	close(fd);
+err_out_exit:
+	return err;
+}
+
+void eblob_index_meta_sync(struct eblob_base_ctl *bctl)
+{
+	struct eblob_index_meta meta;
+	char path[PATH_MAX];
+	int fd, err;
+
+	if (!(bctl->back->cfg.blob_flags & EBLOB_INDEX_META))
+		return;
+	if (bctl->meta_csum == 0 || bctl->index_ctl.fd < 0 || !bctl->index_ctl.sorted)
+		return;
+
+	err = eblob_index_meta_path(bctl, path, sizeof(path));
+	if (err)
+		goto err_out_exit;
+
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd == -1) {
+		err = -errno;
+		goto err_out_exit;
+	}
+
+	err = __eblob_read_ll(fd, &meta, sizeof(meta), 0);
+	if (err)
+		goto err_out_close;
+
+	/* File could have been replaced by the one of newer base with the same index */
+	err = -ESTALE;
+	if (meta.magic != EBLOB_INDEX_META_MAGIC || meta.version != EBLOB_INDEX_META_VERSION ||
+			meta.header_csum != eblob_index_meta_header_csum(&meta) ||
+			meta.payload_csum != bctl->meta_csum)
+		goto err_out_close;
+
+	err = eblob_index_meta_fill_header(bctl, &meta);
+	if (err)
+		goto err_out_close;
+
+	err = __eblob_write_ll(fd, &meta, sizeof(meta), 0);
+
+err_out_close:
+	close(fd);
+err_out_exit:
+	if (err && err != -ENOENT)
+		EBLOB_WARNC(bctl->back->cfg.log, EBLOB_LOG_ERROR, -err,
+				"index: meta: index: %d: failed to update %s", bctl->index, path);
+}
+
+/* Counters of removed, uncommitted and corrupted records of sorted index kept in base stats */
+struct eblob_index_counters {
+	int64_t			removed, removed_size;
+	int64_t			uncommitted, uncommitted_size;
+	int64_t			corrupted, corrupted_size;
+};
+
+/* Adds (@sign is 1) or subtracts (@sign is -1) record @dc of sorted index to @c */
+static void eblob_index_counters_account(struct eblob_index_counters *c,
+		const struct eblob_disk_control *dc, int64_t sign)
+{
+	/* size of the place occupied by the record in the index and the blob */
+	const int64_t size = sign * (int64_t)(dc->disk_size + sizeof(struct eblob_disk_control));
+
+	if (dc->flags & eblob_bswap64(BLOB_DISK_CTL_REMOVE)) {
+		c->removed += sign;
+		c->removed_size += size;
+		return;
+	}
+	if (dc->flags & eblob_bswap64(BLOB_DISK_CTL_UNCOMMITTED)) {
+		c->uncommitted += sign;
+		c->uncommitted_size += size;
+	}
+	if (dc->flags & eblob_bswap64(BLOB_DISK_CTL_CORRUPTED)) {
+		c->corrupted += sign;
+		c->corrupted_size += size;
+	}
+}
+
+static void eblob_index_counters_set_stat(struct eblob_base_ctl *bctl, const struct eblob_index_counters *c)
+{
+	eblob_stat_set(bctl->stat, EBLOB_LST_RECORDS_REMOVED, c->removed);
+	eblob_stat_set(bctl->stat, EBLOB_LST_REMOVED_SIZE, c->removed_size);
+	eblob_stat_set(bctl->stat, EBLOB_LST_RECORDS_UNCOMMITTED, c->uncommitted);
+	eblob_stat_set(bctl->stat, EBLOB_LST_UNCOMMITTED_SIZE, c->uncommitted_size);
+	eblob_stat_set(bctl->stat, EBLOB_LST_RECORDS_CORRUPTED, c->corrupted);
+	eblob_stat_set(bctl->stat, EBLOB_LST_CORRUPTED_SIZE, c->corrupted_size);
+}
+
+/* Maps sorted index @fd of @size bytes once, both filling and following lookups read it from memory */
+static int eblob_index_map(struct eblob_base_ctl *bctl, int fd, uint64_t size)
+{
+	void *map;
+
+	if (size == 0)
+		return 0;
+
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		EBLOB_WARNC(bctl->back->cfg.log, EBLOB_LOG_ERROR, errno,
+				"index: mmap: index: %d, size: %" PRIu64, bctl->index, size);
+		return -errno;
+	}
+	bctl->index_map = map;
+	bctl->index_map_size = size;
+	return 0;
+}
+
+/*!
+ * Builds bloom filter and index blocks of @bctl from its mapped sorted index
+ * and puts counters of its records to @counters. Stats of @bctl other than
+ * sizes of bloom filter and blocks are not touched, neither is @bctl->index_ctl,
+ * so they can be built before sorted index is installed.
+ */
+static int eblob_index_blocks_build(struct eblob_base_ctl *bctl, struct eblob_index_counters *counters)
 {
 	struct eblob_index_block *block = NULL;
 	struct eblob_disk_control dc, prev;
+	const uint64_t size = bctl->index_map_size;
 	uint64_t block_count, block_id = 0, err_count = 0, offset = 0, prev_offset = 0;
-	int64_t removed = 0, removed_size = 0;
-	int64_t uncommitted = 0, uncommitted_size = 0;
-	int64_t corrupted = 0, corrupted_size = 0;
 	unsigned int i;
 	int err = 0;
 	int prev_filled = 0;
 
+	memset(counters, 0, sizeof(*counters));
+
 	/* Allocate bloom filter */
-	bctl->bloom_size = eblob_bloom_size(bctl);
+	err = eblob_bloom_alloc(bctl);
+	if (err)
+		goto err_out_drop_tree;
 	EBLOB_WARNX(bctl->back->cfg.log, EBLOB_LOG_NOTICE,
-			"index: bloom filter size: %" PRIu64, bctl->bloom_size);
-
-	/* Calculate needed number of hash functions */
-	bctl->bloom_func_num = eblob_bloom_func_num(bctl);
-
-	bctl->bloom = calloc(1, bctl->bloom_size);
-	if (bctl->bloom == NULL) {
-		err = -ENOMEM;
-		goto err_out_exit;
-	}
+			"index: bloom filter size: %" PRIu64 ", blocks: %" PRIu64,
+			bctl->bloom_size, bctl->bloom_blocks);
 	eblob_stat_set(bctl->stat, EBLOB_LST_BLOOM_SIZE, bctl->bloom_size);
 
 	/* Pre-allcate all index blocks */
-	block_count = howmany(bctl->index_ctl.size / sizeof(struct eblob_disk_control),
+	block_count = howmany(size / sizeof(struct eblob_disk_control),
 			bctl->back->cfg.index_block_size);
 	bctl->index_blocks = calloc(block_count, sizeof(struct eblob_index_block));
 	if (bctl->index_blocks == NULL) {
 		err = -ENOMEM;
-		goto err_out_exit;
+		goto err_out_drop_tree;
 	}
 	eblob_stat_set(bctl->stat, EBLOB_LST_INDEX_BLOCKS_SIZE,
 			block_count * sizeof(struct eblob_index_block));
 
-	while (offset < bctl->index_ctl.size) {
+	while (offset < size) {
 		block = &bctl->index_blocks[block_id++];
 		block->start_offset = offset;
-		for (i = 0; i < bctl->back->cfg.index_block_size && offset < bctl->index_ctl.size; ++i) {
-			err = __eblob_read_ll(bctl->index_ctl.fd, &dc, sizeof(struct eblob_disk_control), offset);
-			if (err)
-				goto err_out_drop_tree;
+		for (i = 0; i < bctl->back->cfg.index_block_size && offset < size; ++i) {
+			dc = bctl->index_map[offset / sizeof(struct eblob_disk_control)];
 
 			/* Check record for validity */
 			err = eblob_check_record(bctl, &dc);
@@ -340,21 +1104,9 @@ int eblob_index_blocks_fill(struct eblob_base_ctl *bctl)
 			if (i == 0)
 				block->start_key = dc.key;
 
-			if (dc.flags & eblob_bswap64(BLOB_DISK_CTL_REMOVE)) {
-				removed++;
-				/* size of the place occupied by the record in the index and the blob */
-				removed_size += dc.disk_size + sizeof(struct eblob_disk_control);
-			} else {
-				if (dc.flags & eblob_bswap64(BLOB_DISK_CTL_UNCOMMITTED)) {
-					uncommitted++;
-					uncommitted_size += dc.disk_size + sizeof(struct eblob_disk_control);
-				}
-				if (dc.flags & eblob_bswap64(BLOB_DISK_CTL_CORRUPTED)) {
-					++corrupted;
-					corrupted_size += dc.disk_size + sizeof(struct eblob_disk_control);
-				}
+			eblob_index_counters_account(counters, &dc, 1);
+			if (!(dc.flags & eblob_bswap64(BLOB_DISK_CTL_REMOVE)))
 				eblob_bloom_set(bctl, &dc.key);
-			}
 
 			offset += sizeof(struct eblob_disk_control);
 		}
@@ -362,20 +1114,62 @@ int eblob_index_blocks_fill(struct eblob_base_ctl *bctl)
 		block->end_offset = offset;
 		block->end_key = dc.key;
 	}
-	eblob_stat_set(bctl->stat, EBLOB_LST_RECORDS_REMOVED, removed);
-	eblob_stat_set(bctl->stat, EBLOB_LST_REMOVED_SIZE, removed_size);
-	eblob_stat_set(bctl->stat, EBLOB_LST_RECORDS_UNCOMMITTED, uncommitted);
-	eblob_stat_set(bctl->stat, EBLOB_LST_UNCOMMITTED_SIZE, uncommitted_size);
-	eblob_stat_set(bctl->stat, EBLOB_LST_RECORDS_CORRUPTED, corrupted);
-	eblob_stat_set(bctl->stat, EBLOB_LST_CORRUPTED_SIZE, corrupted_size);
 	return 0;
 
 err_out_drop_tree:
 	eblob_index_blocks_destroy(bctl);
-err_out_exit:
 	return err;
 }
 
+/* Writes .index.meta of @bctl, base is usable without it, meta will be rebuilt on next startup */
+static void eblob_index_meta_write_warn(struct eblob_base_ctl *bctl)
+{
+	int err;
+
+	if (!(bctl->back->cfg.blob_flags & EBLOB_INDEX_META))
+		return;
+
+	err = eblob_index_meta_write(bctl);
+	if (err)
+		EBLOB_WARNC(bctl->back->cfg.log, EBLOB_LOG_ERROR, -err,
+				"index: meta: index: %d: failed to write", bctl->index);
+}
+
+int eblob_index_blocks_fill(struct eblob_base_ctl *bctl)
+{
+	struct eblob_index_counters counters;
+	const uint64_t *hashes;
+	uint64_t hashes_num;
+	int err;
+
+	err = eblob_index_map(bctl, bctl->index_ctl.fd, bctl->index_ctl.size);
+	if (err)
+		return err;
+
+	if (bctl->back->cfg.blob_flags & EBLOB_INDEX_META) {
+		err = eblob_index_meta_load(bctl, &hashes, &hashes_num);
+		if (err == 0) {
+			EBLOB_WARNX(bctl->back->cfg.log, EBLOB_LOG_NOTICE,
+					"index: meta: index: %d: loaded bloom filter size: %" PRIu64 ", blocks: %" PRIu64,
+					bctl->index, bctl->bloom_size, bctl->bloom_blocks);
+			/* Sorted index is not read at all */
+			eblob_locator_add_base(bctl->back, bctl, hashes, hashes_num);
+			return 0;
+		}
+		EBLOB_WARNC(bctl->back->cfg.log, EBLOB_LOG_NOTICE, -err,
+				"index: meta: index: %d: rebuilding from sorted index", bctl->index);
+	}
+
+	err = eblob_index_blocks_build(bctl, &counters);
+	if (err)
+		return err;
+	eblob_index_counters_set_stat(bctl, &counters);
+
+	eblob_index_meta_write_warn(bctl);
+	eblob_locator_add_base(bctl->back, bctl, NULL, 0);
+	return 0;
+}
+
 
 static int eblob_find_on_disk(struct eblob_backend *b,
 		struct eblob_base_ctl *bctl, struct eblob_disk_control *dc, uint64_t *hdr_offset,
@@ -384,187 +1178,79 @@ static int eblob_find_on_disk(struct eblob_backend *b,
 {
 	FORMATTED(HANDY_TIMER_SCOPE, ("eblob.%u.disk.lookup.one", b->cfg.stat_id));
 
-	struct eblob_disk_control *sorted, *end, *sorted_orig, *found = NULL;
-	struct eblob_disk_control *hdr_block, *search_start, *search_end;
+	struct eblob_disk_control *index, *sorted, *found = NULL;
 	struct eblob_index_block *block;
-	size_t num;
-	ssize_t hdr_block_size;
-	uint64_t hdr_block_offset, saved_hdr_block_offset;
+	uint64_t total, start, num, pos, i;
 	const size_t hdr_size = sizeof(struct eblob_disk_control);
-	int read_err, err = -ENOENT;
+	int err = -ENOENT;
 
 	st->search_on_disk++;
 
+	/* Mapping can not be unmapped while we are holding the lock */
 	pthread_rwlock_rdlock(&bctl->index_blocks_lock);
 	block = eblob_index_blocks_search_nolock(bctl, dc, st);
-	if (block) {
-		assert((bctl->index_ctl.size - block->start_offset) / hdr_size > 0);
-		assert((bctl->index_ctl.size - block->start_offset) % hdr_size == 0);
+	if (!block)
+		goto err_out_unlock;
 
-		num = (bctl->index_ctl.size - block->start_offset) / hdr_size;
+	index = bctl->index_map;
+	total = bctl->index_map_size / hdr_size;
+	start = block->start_offset / hdr_size;
 
-		if (num > b->cfg.index_block_size)
-			num = b->cfg.index_block_size;
+	assert(start < total);
 
-		/*
-		 * We do not use @block->end_offset here, since it points to
-		 * the start offset of the *next* record, which potentially
-		 * can be outside of the index, i.e. be equal to the size of
-		 * the index.
-		 */
-		hdr_block_size = num * hdr_size;
-		saved_hdr_block_offset = hdr_block_offset = block->start_offset;
-	} else {
-		pthread_rwlock_unlock(&bctl->index_blocks_lock);
-		goto err_out_exit;
-	}
-	pthread_rwlock_unlock(&bctl->index_blocks_lock);
+	/*
+	 * We do not use @block->end_offset here, since it points to
+	 * the start offset of the *next* record, which potentially
+	 * can be outside of the index, i.e. be equal to the size of
+	 * the index.
+	 */
+	num = total - start;
+	if (num > b->cfg.index_block_size)
+		num = b->cfg.index_block_size;
 
 	st->bsearch_reached++;
 
-	hdr_block = malloc(hdr_block_size);
-	if (!hdr_block) {
-		err = -ENOMEM;
-		goto err_out_exit;
-	}
-
-	read_err = __eblob_read_ll(bctl->index_ctl.fd, hdr_block, hdr_block_size, hdr_block_offset);
-	if (read_err < 0) {
-		err = read_err;
-		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "%s: index: %d, position: %" PRIu64 ", block_size: %zu, blob_size: %zd, num: %zu, FAILED: %s: %d.\n",
-			  eblob_dump_id(dc->key.id),
-			  bctl->index_ctl.fd, hdr_block_offset, hdr_block_size, bctl->index_ctl.size, num, strerror(-err), err);
-		goto err_out_free_index;
-	}
+	sorted = bsearch(dc, index + start, num, hdr_size, eblob_disk_control_sort);
 
-	search_start = hdr_block;
-	search_end = search_start + (num - 1);
+	eblob_log(b->cfg.log, EBLOB_LOG_SPAM, "%s: position: %" PRIu64 ", index_size: %" PRIu64 ", num: %" PRIu64
+			", bsearch range: start: %s, end: %s\n",
+			eblob_dump_id(dc->key.id), block->start_offset, bctl->index_map_size, num,
+			eblob_dump_id(index[start].key.id), eblob_dump_id(index[start + num - 1].key.id));
 
-	sorted_orig = bsearch(dc, search_start, num, sizeof(struct eblob_disk_control), eblob_disk_control_sort);
-
-	eblob_log(b->cfg.log, EBLOB_LOG_SPAM, "%s: position: %" PRIu64 ", block_size: %zu, index_size: %zd, num: %zu\n",
-			eblob_dump_id(dc->key.id),
-			hdr_block_offset, hdr_block_size, bctl->index_ctl.size, num);
-
-	eblob_log(b->cfg.log, EBLOB_LOG_SPAM, "%s: bsearch range: start: %s, end: %s, num: %zd\n",
-			eblob_dump_id(dc->key.id),
-			eblob_dump_id(search_start->key.id),
-			eblob_dump_id(search_end->key.id), num);
-
-	if (!sorted_orig)
-		goto err_out_free_index;
+	if (!sorted)
+		goto err_out_unlock;
 
 	st->bsearch_found++;
 
 	/*
 	 * Sorted index may contain range of keys with the same key.
 	 * Some keys in that range may be marked as removed.
-	 * Do forward linear search (reading block by block) in range of keys,
-	 * until reached range's end or found existing key.
+	 * Do forward linear search in range of keys, until reached range's
+	 * end or found existing key, then the same backward.
 	 */
-	sorted = sorted_orig;
-	end = search_end;
-	while (eblob_disk_control_sort(sorted, dc) == 0) {
-		if (callback(sorted, dc)) {
-			found = sorted;
+	pos = sorted - index;
+	for (i = pos; i < total && eblob_disk_control_sort(&index[i], dc) == 0; ++i) {
+		if (callback(&index[i], dc)) {
+			found = &index[i];
 			break;
 		}
 		st->additional_reads++;
-
-		if (++sorted > end) {
-			/* read next block of headers */
-			hdr_block_offset += hdr_block_size;
-			if (hdr_block_offset >= bctl->index_ctl.size)
-				break;
-
-			num = (bctl->index_ctl.size - hdr_block_offset) / hdr_size;
-
-			if (num > b->cfg.index_block_size)
-				num = b->cfg.index_block_size;
-
-			hdr_block_size = num * hdr_size;
-			sorted = hdr_block;
-			end = sorted + (num - 1);
-
-			read_err = __eblob_read_ll(bctl->index_ctl.fd, hdr_block, hdr_block_size, hdr_block_offset);
-			if (read_err < 0) {
-				err = read_err;
-				eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "%s: index: %d, position: %" PRIu64 ", block_size: %zu, blob_size: %zd, num: %zu, FAILED: %s: %d.\n",
-					  eblob_dump_id(dc->key.id),
-					  bctl->index_ctl.fd, hdr_block_offset, hdr_block_size, bctl->index_ctl.size, num, strerror(-err), err);
-				break;
-			}
-		}
 	}
 
-	if (found) {
-		err = 0;
-		memcpy(dc, found, hdr_size);
-		*hdr_offset = hdr_block_offset + ((void *)found - (void *)hdr_block);
-		goto err_out_free_index;
-	}
-
-	/* Do the same thing as in previous loop, only switching to backward linear search */
-	hdr_block_offset = saved_hdr_block_offset + hdr_block_size;
-	/* set invalid value to 'sorted' var to force initial reading of hdr_block at saved_hdr_block_offset */
-	sorted = hdr_block - 1;
-	while (1) {
-	    if (sorted >= hdr_block) {
+	for (i = pos; !found && i > 0 && eblob_disk_control_sort(&index[i - 1], dc) == 0; --i) {
 		st->additional_reads++;
-
-		if (eblob_disk_control_sort(sorted, dc))
-			break;
-
-		if (callback(sorted, dc)) {
-			found = sorted;
-			break;
-		}
-		sorted--;
-	    } else {
-		/* read next block of headers */
-		if (!hdr_block_offset)
-			break;
-
-		if (hdr_block_offset < (uint64_t)hdr_block_size) {
-			hdr_block_size = hdr_block_offset;
-			num = hdr_block_size / hdr_size;
-			hdr_block_offset = 0;
-		} else {
-			hdr_block_offset -= hdr_block_size;
-		}
-
-		read_err = __eblob_read_ll(bctl->index_ctl.fd, hdr_block, hdr_block_size, hdr_block_offset);
-		if (read_err < 0) {
-			err = read_err;
-			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "%s: index: %d, position: %" PRIu64 ", block_size: %zu, blob_size: %zd, num: %zu, FAILED: %s: %d.\n",
-				  eblob_dump_id(dc->key.id),
-				  bctl->index_ctl.fd, hdr_block_offset, hdr_block_size, bctl->index_ctl.size, num, strerror(-err), err);
-			break;
-		}
-
-		/*
-		 * if it is first and initial block read, then begin searching record starting
-		 * from record preceded to founded by bsearch record (sorted_orig),
-		 * otherwise starting from last block record
-		 */
-		if (hdr_block_offset == saved_hdr_block_offset) {
-			sorted = sorted_orig - 1;
-		} else {
-			sorted = hdr_block + (num - 1);
-		}
-	    }
+		if (callback(&index[i - 1], dc))
+			found = &index[i - 1];
 	}
 
 	if (found) {
 		err = 0;
 		memcpy(dc, found, hdr_size);
-		*hdr_offset = hdr_block_offset + ((void *)found - (void *)hdr_block);
-		goto err_out_free_index;
+		*hdr_offset = (found - index) * hdr_size;
 	}
 
-err_out_free_index:
-	free(hdr_block);
-err_out_exit:
+err_out_unlock:
+	pthread_rwlock_unlock(&bctl->index_blocks_lock);
 	return err;
 }
 
@@ -596,46 +1282,67 @@ static int indexsort_binlog_start(struct eblob_backend *b, struct eblob_base_ctl
 }
 
 /*
- * Applies binlog of bctl to sorted index \a sorted
+ * Applies binlog of bctl to sorted index \a sorted starting after entry \a it,
+ * which is set to the last applied entry. Binlog is appended under bctl->lock,
+ * so it must be held by the caller.
+ * If \a fd is not negative, entries removed by this call are also marked in
+ * sorted index already written to \a fd and accounted in \a counters.
  */
-static int indexsort_binlog_apply(struct eblob_base_ctl *bctl, void *sorted_index, ssize_t index_size) {
-	const struct eblob_binlog_entry *it = NULL;
+static int indexsort_binlog_apply(struct eblob_base_ctl *bctl, void *sorted_index, ssize_t index_size,
+		const struct eblob_binlog_entry **it, int fd, struct eblob_index_counters *counters) {
 	const struct eblob_binlog_cfg * const bcfg = &bctl->binlog;
+	const struct eblob_binlog_entry *next;
 	static const size_t hdr_size = sizeof(struct eblob_disk_control);
 	struct eblob_disk_control *dc;
 	int err = 0;
 
 	/* Iterates throw binlog keys */
-	while ((it = eblob_binlog_iterate(bcfg, it)) != NULL) {
+	while ((next = eblob_binlog_iterate(bcfg, *it)) != NULL) {
 		/* Bsearch index offset of key at sorted index */
-		const uint64_t index = sorted_index_bsearch_raw(&it->key,
+		const uint64_t index = sorted_index_bsearch_raw(&next->key,
 				sorted_index,
 				index_size / sizeof(struct eblob_disk_control));
 
+		*it = next;
+
 		/* It is sanity check. In common case binlog shouldn't have nonexistent keys.
 		 * If it has, print log and continue with skipping this key.
 		 */
 		if (index == -1ULL) {
 			EBLOB_WARNX(bctl->back->cfg.log, EBLOB_LOG_ERROR, "%s: skipped",
-						eblob_dump_id(it->key.id));
+						eblob_dump_id(next->key.id));
 			continue;
 		}
 
 		dc = sorted_index + index * hdr_size;
 
 		/* Mark entry removed in both index and data file */
-		while (((void*)dc < sorted_index + index_size) && (eblob_id_cmp(it->key.id, dc->key.id) == 0)) {
+		while (((void*)dc < sorted_index + index_size) && (eblob_id_cmp(next->key.id, dc->key.id) == 0)) {
 			EBLOB_WARNX(bctl->back->cfg.log, EBLOB_LOG_DEBUG, "%s: indexsort: removing: dc: flags: %s, data_size: %" PRIu64,
 			            eblob_dump_id(dc->key.id), eblob_dump_dctl_flags(dc->flags), dc->data_size);
+
+			if (fd >= 0 && !(dc->flags & BLOB_DISK_CTL_REMOVE)) {
+				eblob_index_counters_account(counters, dc, -1);
+				dc->flags |= BLOB_DISK_CTL_REMOVE;
+				eblob_index_counters_account(counters, dc, 1);
+
+				err = eblob_mark_index_removed(fd, (void *)dc - sorted_index);
+				if (err != 0) {
+					EBLOB_WARNX(bctl->back->cfg.log, EBLOB_LOG_ERROR,
+							"%s: indexsort: eblob_mark_index_removed: FAILED: sorted index, fd: %d, err: %d",
+							eblob_dump_id(next->key.id), fd, err);
+					goto err_out_exit;
+				}
+			}
 			dc->flags |= BLOB_DISK_CTL_REMOVE;
 
 			EBLOB_WARNX(bctl->back->cfg.log, EBLOB_LOG_DEBUG, "%s: indexsort: removing: fd: %d, offset: %" PRIu64,
-			            eblob_dump_id(it->key.id), bctl->data_ctl.fd, dc->position);
+			            eblob_dump_id(next->key.id), bctl->data_ctl.fd, dc->position);
 			err = eblob_mark_index_removed(bctl->data_ctl.fd, dc->position);
 			if (err != 0) {
 				EBLOB_WARNX(bctl->back->cfg.log, EBLOB_LOG_ERROR,
 						"%s: indexsort: eblob_mark_index_removed: FAILED: data, fd: %d, err: %d",
-						eblob_dump_id(it->key.id), bctl->data_ctl.fd, err);
+						eblob_dump_id(next->key.id), bctl->data_ctl.fd, err);
 				goto err_out_exit;
 			}
 			dc += 1;
@@ -658,12 +1365,7 @@ static int indexsort_flush_cache(struct eblob_backend *b, void *sorted_index, ui
 	/*
 	 * Check whether cache is empty
 	 */
-	if (b->cfg.blob_flags & EBLOB_L2HASH) {
-		err = eblob_l2hash_empty(&b->l2hash);
-	} else {
-		err = eblob_hash_empty(&b->hash);
-	}
-	if (err) {
+	if (eblob_cache_empty(b)) {
 		/*
 		 * There is nothing we can flush - cache is empty.
 		 * Skip iterating over indexes, this should speed up initial eblob load.
@@ -693,6 +1395,8 @@ static int indexsort_flush_cache(struct eblob_backend *b, void *sorted_index, ui
 }
 
 int eblob_generate_sorted_index(struct eblob_backend *b, struct eblob_base_ctl *bctl) {
+	const struct eblob_binlog_entry *binlog_it = NULL, *delta_it;
+	struct eblob_index_counters counters;
 	int fd, old_fd, err, len;
 	char *file, *dst_file;
 	ssize_t index_size;
@@ -777,8 +1481,55 @@ int eblob_generate_sorted_index(struct eblob_backend *b, struct eblob_base_ctl *
 		goto err_out_stop_binlog;
 	}
 
-	qsort(sorted_index, index_size / sizeof(struct eblob_disk_control), sizeof(struct eblob_disk_control),
-			eblob_disk_control_sort_with_flags);
+	err = eblob_disk_control_radix_sort(sorted_index, index_size / sizeof(struct eblob_disk_control),
+			eblob_disk_control_sort_with_flags, eblob_worker_threads(b));
+	if (err) {
+		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: radix sort: index: %d, size: %llu",
+				bctl->index, (unsigned long long)index_size);
+		goto err_out_stop_binlog;
+	}
+
+	/*
+	 * Apply removes captured so far and build sorted index with its blocks and
+	 * bloom without blocking other bases and the hash: only removes of this base
+	 * wait for the first pass, since binlog is appended under bctl->lock.
+	 */
+	pthread_mutex_lock(&bctl->lock);
+	err = indexsort_binlog_apply(bctl, sorted_index, index_size, &binlog_it, -1, NULL);
+	pthread_mutex_unlock(&bctl->lock);
+	if (err != 0) {
+		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: indexsort_binlog_apply: index: %d: FAILED",
+			    bctl->index);
+		goto err_out_stop_binlog;
+	}
+
+	err = __eblob_write_ll(fd, sorted_index, index_size, 0);
+	if (err) {
+		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: write after binlog apply: index: %d, size: %llu: %s",
+			    bctl->index, (unsigned long long)index_size, file);
+		goto err_out_stop_binlog;
+	}
+
+	err = fsync(fd);
+	if (err == -1) {
+		err = -errno;
+		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: fsync after binlog apply: index: %d, size: %llu: %s",
+			    bctl->index, (unsigned long long)index_size, file);
+		goto err_out_stop_binlog;
+	}
+
+	/*
+	 * Index blocks and bloom are not used until base is marked sorted,
+	 * removes made after this point are applied to the mapped file below.
+	 */
+	err = eblob_index_map(bctl, fd, index_size);
+	if (err == 0)
+		err = eblob_index_blocks_build(bctl, &counters);
+	if (err) {
+		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: eblob_index_blocks_build: index: %d: FAILED",
+				bctl->index);
+		goto err_out_drop_blocks;
+	}
 
 	/* Lock backend */
 	pthread_mutex_lock(&b->lock);
@@ -788,30 +1539,24 @@ int eblob_generate_sorted_index(struct eblob_backend *b, struct eblob_base_ctl *
 	old_fd = bctl->index_ctl.fd;
 
 	/* Lock hash - prevent using old offsets with new sorted index */
-	if ((err = pthread_rwlock_wrlock(&b->hash.root_lock)) != 0) {
-		err = -err;
-		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: pthread_rwlock_wrlock: index: %d: FAILED",
+	if ((err = eblob_cache_lock_all(b)) != 0) {
+		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: eblob_cache_lock_all: index: %d: FAILED",
 				bctl->index);
 		goto err_unlock_bctl;
 	}
+	/* Lookups that started before the swap repeat their misses */
+	__atomic_add_fetch(&b->defrag_generation, 1, __ATOMIC_RELEASE);
 
-	/* Apply binlog */
-	err = indexsort_binlog_apply(bctl, sorted_index, index_size);
+	/* Apply removes made since the first pass */
+	delta_it = binlog_it;
+	err = indexsort_binlog_apply(bctl, sorted_index, index_size, &binlog_it, fd, &counters);
 	if (err != 0) {
 		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: indexsort_binlog_apply: index: %d: FAILED",
 			    bctl->index);
 		goto err_unlock_hash;
 	}
 
-	err = __eblob_write_ll(fd, sorted_index, index_size, 0);
-	if (err) {
-		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: write after binlog apply: index: %d, size: %llu: %s",
-			    bctl->index, (unsigned long long)index_size, file);
-		goto err_unlock_hash;
-	}
-
-	err = fsync(fd);
-	if (err == -1) {
+	if (binlog_it != delta_it && fsync(fd) == -1) {
 		err = -errno;
 		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: fsync after binlog apply: index: %d, size: %llu: %s",
 			    bctl->index, (unsigned long long)index_size, file);
@@ -833,13 +1578,7 @@ int eblob_generate_sorted_index(struct eblob_backend *b, struct eblob_base_ctl *
 	bctl->index_ctl.fd = fd;
 	bctl->index_ctl.offset = 0;
 	bctl->index_ctl.size = index_size;
-
-	err = eblob_index_blocks_fill(bctl);
-	if (err) {
-		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err, "defrag: indexsort: eblob_index_blocks_fill: index: %d: FAILED",
-				bctl->index);
-		goto err_unlock_hash;
-	}
+	eblob_index_counters_set_stat(bctl, &counters);
 
 	rename(file, dst_file);
 
@@ -851,11 +1590,18 @@ int eblob_generate_sorted_index(struct eblob_backend *b, struct eblob_base_ctl *
 		goto err_unlock_hash;
 	}
 
+	/*
+	 * Keys of the base are already dropped from the hash, so locator must
+	 * know them before the hash is unlocked. This does not fail the sort:
+	 * on error locator is marked broken and lookups check all bases.
+	 */
+	eblob_locator_add_base(b, bctl, NULL, 0);
+
 	bctl->index_ctl.sorted = 1;
-	b->defrag_generation += 1;
+	__atomic_add_fetch(&b->defrag_generation, 1, __ATOMIC_RELEASE);
 
 	/* Unlock */
-	pthread_rwlock_unlock(&b->hash.root_lock);
+	eblob_cache_unlock_all(b);
 	pthread_mutex_unlock(&bctl->lock);
 	pthread_mutex_unlock(&b->lock);
 
@@ -864,6 +1610,9 @@ int eblob_generate_sorted_index(struct eblob_backend *b, struct eblob_base_ctl *
 	unlink(file);
 	close(old_fd);
 
+	/* Header of meta is taken from the installed index, so it is written after the swap */
+	eblob_index_meta_write_warn(bctl);
+
 	eblob_log(b->cfg.log, EBLOB_LOG_INFO, "defrag: indexsort: generated sorted: index: %d, "
 			"index-size: %llu, data-size: %" PRIu64 ", file: %s\n",
 			bctl->index, (unsigned long long)index_size, bctl->data_ctl.offset, dst_file);
@@ -875,11 +1624,13 @@ int eblob_generate_sorted_index(struct eblob_backend *b, struct eblob_base_ctl *
 	return 0;
 
 err_unlock_hash:
-	pthread_rwlock_unlock(&b->hash.root_lock);
+	eblob_cache_unlock_all(b);
 err_unlock_bctl:
 	bctl->index_ctl.fd = old_fd;
 	pthread_mutex_unlock(&bctl->lock);
 	pthread_mutex_unlock(&b->lock);
+err_out_drop_blocks:
+	eblob_index_blocks_destroy(bctl);
 err_out_stop_binlog:
 	eblob_binlog_stop(&bctl->binlog);
 err_out_free_index:
@@ -922,11 +1673,29 @@ int eblob_disk_index_lookup(struct eblob_backend *b, struct eblob_key *key,
 	static const int max_tries = 10;
 	int err = -ENOENT, tries = 0;
 	uint64_t hdr_offset = 0;
+	unsigned int bases[EBLOB_LOCATOR_MAX_BASES];
+	int bases_num, i;
 
 	eblob_log(b->cfg.log, EBLOB_LOG_DEBUG, "blob: %s: index: disk.\n", eblob_dump_id(key->id));
 
+	/* Key is not in any sorted base, there is no need to check them */
+	bases_num = eblob_locator_lookup(b, key, bases);
+	if (bases_num == 0)
+		goto err_out_exit;
+
 again:
-	list_for_each_entry_reverse(bctl, &b->bases, base_entry) {
+	/* Bases are added and replaced under @b->lock, lookup walks them without it */
+	list_for_each_entry_reverse_acquire(bctl, &b->bases, base_entry) {
+		/* Skip bases that do not hold the key according to locator */
+		if (bases_num > 0) {
+			for (i = 0; i < bases_num; ++i) {
+				if (bases[i] == (bctl->index & EBLOB_LOCATOR_BASE_MASK))
+					break;
+			}
+			if (i == bases_num)
+				continue;
+		}
+
 		/* Count number of loops before break */
 		++st.loops;
 		/* Protect against datasort */
@@ -982,6 +1751,7 @@ again:
 		break;
 	}
 
+err_out_exit:
 	eblob_log(b->cfg.log, EBLOB_LOG_NOTICE, "blob: %s: stat: %s\n", eblob_dump_id(key->id),
 	          eblob_dump_search_stat(&st, err));
 
@@ -76,11 +76,16 @@ static void eblob_stat_config_json(struct eblob_backend *b, rapidjson::Value &st
 	stat.AddMember("defrag_timeout", b->cfg.defrag_timeout, allocator);
 	stat.AddMember("index_block_size", b->cfg.index_block_size, allocator);
 	stat.AddMember("index_block_bloom_length", b->cfg.index_block_bloom_length, allocator);
+	stat.AddMember("bloom_false_positive_ppm", b->cfg.bloom_false_positive_ppm, allocator);
 	stat.AddMember("blob_size_limit", b->cfg.blob_size_limit, allocator);
 	stat.AddMember("defrag_time", b->cfg.defrag_time, allocator);
 	stat.AddMember("defrag_splay", b->cfg.defrag_splay, allocator);
 	stat.AddMember("bg_ioprio_class", b->cfg.bg_ioprio_class, allocator);
 	stat.AddMember("bg_ioprio_data", b->cfg.bg_ioprio_data, allocator);
+	stat.AddMember("cache_shards", b->cfg.cache_shards, allocator);
+	stat.AddMember("io_threads", b->cfg.io_threads, allocator);
+	stat.AddMember("datasort_threads", b->cfg.datasort_threads, allocator);
+	stat.AddMember("datasort_io_limit", b->cfg.datasort_io_limit, allocator);
 	auto ioprio_class = ioprio_class_string(b->cfg.bg_ioprio_class);
 	stat.AddMember("string_bg_ioprio_class", rapidjson::Value(ioprio_class, allocator), allocator);
 }
@@ -87,6 +87,32 @@ static inline void list_add_tail(struct list_head *new_node, struct list_head *h
 	__list_add(new_node, head->prev, head);
 }
 
+/*
+ * Insert a new entry between two known consecutive entries so that
+ * lockless readers never see it half-linked: new entry is initialized
+ * first and then published by release stores.
+ * Readers should walk the list with list_for_each_entry_reverse_acquire().
+ */
+static inline void __list_add_release(struct list_head *new_node,
+			      struct list_head *prev,
+			      struct list_head *next)
+{
+	new_node->next = next;
+	new_node->prev = prev;
+	__atomic_store_n(&prev->next, new_node, __ATOMIC_RELEASE);
+	__atomic_store_n(&next->prev, new_node, __ATOMIC_RELEASE);
+}
+
+/**
+ * list_add_tail_release - add a new entry visible to lockless readers
+ * @new_node: new entry to be added
+ * @head: list head to add it before
+ */
+static inline void list_add_tail_release(struct list_head *new_node, struct list_head *head)
+{
+	__list_add_release(new_node, head->prev, head);
+}
+
 /*
  * Delete a list entry by making the prev/next entries
  * point to each other.
@@ -128,6 +154,20 @@ static inline void list_replace(struct list_head *old,
 	new_node->prev->next = new_node;
 }
 
+/**
+ * list_replace_release - replace old entry by new one visible to lockless readers
+ * @old : the element to be replaced, it is left intact for readers standing on it
+ * @new_node : the new element to insert
+ */
+static inline void list_replace_release(struct list_head *old,
+				struct list_head *new_node)
+{
+	new_node->next = old->next;
+	new_node->prev = old->prev;
+	__atomic_store_n(&new_node->prev->next, new_node, __ATOMIC_RELEASE);
+	__atomic_store_n(&new_node->next->prev, new_node, __ATOMIC_RELEASE);
+}
+
 static inline void list_replace_init(struct list_head *old,
 					struct list_head *new_node)
 {
@@ -336,6 +376,18 @@ static inline void list_splice_init(struct list_head *list,
 	     prefetch(pos->member.prev), &pos->member != (head); 	\
 	     pos = list_entry(pos->member.prev, typeof(*pos), member))
 
+/**
+ * list_for_each_entry_reverse_acquire - iterate backwards over list of given type
+ * that is modified concurrently by list_add_tail_release() and list_replace_release().
+ * @pos:	the type * to use as a loop cursor.
+ * @head:	the head for your list.
+ * @member:	the name of the list_struct within the struct.
+ */
+#define list_for_each_entry_reverse_acquire(pos, head, member)		\
+	for (pos = list_entry(__atomic_load_n(&(head)->prev, __ATOMIC_ACQUIRE), typeof(*pos), member); \
+	     &pos->member != (head);					\
+	     pos = list_entry(__atomic_load_n(&pos->member.prev, __ATOMIC_ACQUIRE), typeof(*pos), member))
+
 /**
  * list_prepare_entry - prepare a pos entry for use in list_for_each_entry_continue
  * @pos:	the type * to use as a start point
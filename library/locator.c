@@ -0,0 +1,297 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "features.h"
+
+#include "blob.h"
+#include "locator.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+uint64_t eblob_locator_hash(const struct eblob_key *key)
+{
+	uint64_t h = 0, w;
+	unsigned int i;
+
+	for (i = 0; i < EBLOB_ID_SIZE; i += sizeof(w)) {
+		memcpy(&w, key->id + i, sizeof(w));
+		h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 32;
+	}
+
+	h >>= EBLOB_LOCATOR_BASE_BITS;
+	return h ? h : 1;
+}
+
+/*
+ * Puts @slot to @slots unless it is already there.
+ * Returns 1 if slot was inserted and 0 if it was found.
+ */
+static int eblob_locator_insert(uint64_t *slots, uint64_t mask, uint64_t slot)
+{
+	uint64_t i = (slot >> EBLOB_LOCATOR_BASE_BITS) & mask;
+
+	while (slots[i] != 0) {
+		if (slots[i] == slot)
+			return 0;
+		i = (i + 1) & mask;
+	}
+
+	slots[i] = slot;
+	return 1;
+}
+
+/*
+ * Moves entries to new table of @size slots, entries of base @drop
+ * are thrown away if it is not negative.
+ */
+static int eblob_locator_rehash(struct eblob_backend *b, uint64_t size, int64_t drop)
+{
+	struct eblob_locator *l = &b->locator;
+	uint64_t *slots, i;
+
+	slots = calloc(size, sizeof(uint64_t));
+	if (slots == NULL)
+		return -ENOMEM;
+
+	for (i = 0; l->slots && i <= l->mask; ++i) {
+		if (l->slots[i] == 0)
+			continue;
+		if ((int64_t)(l->slots[i] & EBLOB_LOCATOR_BASE_MASK) == drop)
+			continue;
+		eblob_locator_insert(slots, size - 1, l->slots[i]);
+	}
+
+	if (drop >= 0) {
+		l->num -= l->counts[drop];
+		l->counts[drop] = 0;
+	}
+
+	free(l->slots);
+	l->slots = slots;
+	l->mask = size - 1;
+	eblob_stat_set(b->stat, EBLOB_GST_LOCATOR_SIZE, size * sizeof(uint64_t));
+	return 0;
+}
+
+int eblob_locator_init(struct eblob_backend *b)
+{
+	struct eblob_locator *l = &b->locator;
+	int err;
+
+	memset(l, 0, sizeof(*l));
+
+	if (!(b->cfg.blob_flags & EBLOB_KEY_LOCATOR))
+		return 0;
+
+	err = pthread_rwlock_init(&l->lock, NULL);
+	if (err != 0) {
+		err = -err;
+		goto err_out_exit;
+	}
+
+	l->counts = calloc(EBLOB_LOCATOR_BASE_MASK + 1, sizeof(uint32_t));
+	if (l->counts == NULL) {
+		err = -ENOMEM;
+		goto err_out_lock_destroy;
+	}
+
+	l->owners = calloc(EBLOB_LOCATOR_BASE_MASK + 1, sizeof(int));
+	if (l->owners == NULL) {
+		err = -ENOMEM;
+		goto err_out_free_counts;
+	}
+
+	err = eblob_locator_rehash(b, EBLOB_LOCATOR_MIN_SLOTS, -1);
+	if (err != 0)
+		goto err_out_free_owners;
+
+	l->enabled = 1;
+	return 0;
+
+err_out_free_owners:
+	free(l->owners);
+err_out_free_counts:
+	free(l->counts);
+err_out_lock_destroy:
+	pthread_rwlock_destroy(&l->lock);
+err_out_exit:
+	return err;
+}
+
+void eblob_locator_destroy(struct eblob_backend *b)
+{
+	struct eblob_locator *l = &b->locator;
+
+	if (!l->enabled)
+		return;
+
+	free(l->slots);
+	free(l->counts);
+	free(l->owners);
+	pthread_rwlock_destroy(&l->lock);
+	l->enabled = 0;
+}
+
+void eblob_locator_add_base(struct eblob_backend *b, struct eblob_base_ctl *bctl,
+		const uint64_t *hashes, uint64_t num)
+{
+	struct eblob_locator *l = &b->locator;
+	const uint64_t base = bctl->index & EBLOB_LOCATOR_BASE_MASK;
+	const uint64_t records = hashes ? num : bctl->index_map_size / sizeof(struct eblob_disk_control);
+	uint64_t size, i, hash, dropped = 0;
+	int64_t drop = -1;
+	int err;
+
+	if (!l->enabled)
+		return;
+
+	pthread_rwlock_wrlock(&l->lock);
+	if (l->broken)
+		goto err_out_unlock;
+
+	/*
+	 * Old entries of re-sorted base are dropped. Entries of another live base
+	 * with the same low bits of index can not be told apart from them, so
+	 * nothing is dropped then and both bases are checked on lookup.
+	 */
+	if (l->counts[base] == 0) {
+		l->owners[base] = bctl->index;
+	} else if (l->owners[base] == bctl->index) {
+		drop = base;
+		dropped = l->counts[base];
+	} else if (l->owners[base] != EBLOB_LOCATOR_SHARED) {
+		EBLOB_WARNX(b->cfg.log, EBLOB_LOG_NOTICE,
+				"locator: index: %d: shares entries with base: %d",
+				bctl->index, l->owners[base]);
+		l->owners[base] = EBLOB_LOCATOR_SHARED;
+	}
+
+	/* Reserve space for all records at once */
+	size = l->mask + 1;
+	while ((l->num - dropped + records) * EBLOB_LOCATOR_LOAD_DEN > size * EBLOB_LOCATOR_LOAD_NUM)
+		size *= 2;
+
+	if (drop >= 0 || size != l->mask + 1) {
+		err = eblob_locator_rehash(b, size, drop);
+		if (err != 0) {
+			l->broken = 1;
+			EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err,
+					"locator: index: %d: failed to add base, all bases will be scanned on lookup",
+					bctl->index);
+			goto err_out_unlock;
+		}
+	}
+
+	for (i = 0; i < records; ++i) {
+		if (hashes) {
+			hash = hashes[i];
+		} else {
+			const struct eblob_disk_control *dc = &bctl->index_map[i];
+
+			if (dc->flags & eblob_bswap64(BLOB_DISK_CTL_REMOVE))
+				continue;
+			hash = eblob_locator_hash(&dc->key);
+		}
+
+		if (eblob_locator_insert(l->slots, l->mask, (hash << EBLOB_LOCATOR_BASE_BITS) | base)) {
+			l->counts[base]++;
+			l->num++;
+		}
+	}
+
+	EBLOB_WARNX(b->cfg.log, EBLOB_LOG_NOTICE,
+			"locator: index: %d: entries: %" PRIu32 ", total: %" PRIu64 ", slots: %" PRIu64,
+			bctl->index, l->counts[base], l->num, l->mask + 1);
+
+err_out_unlock:
+	pthread_rwlock_unlock(&l->lock);
+}
+
+void eblob_locator_remove_base(struct eblob_backend *b, struct eblob_base_ctl *bctl)
+{
+	struct eblob_locator *l = &b->locator;
+	const uint64_t base = bctl->index & EBLOB_LOCATOR_BASE_MASK;
+	int err;
+
+	if (!l->enabled)
+		return;
+
+	pthread_rwlock_wrlock(&l->lock);
+	if (l->broken || l->counts[base] == 0)
+		goto err_out_unlock;
+
+	/* Stale entries only make lookup check extra bases, so they are left on failure */
+	if (l->owners[base] != bctl->index) {
+		EBLOB_WARNX(b->cfg.log, EBLOB_LOG_NOTICE,
+				"locator: index: %d: entries are shared with other bases, keeping them",
+				bctl->index);
+		goto err_out_unlock;
+	}
+
+	err = eblob_locator_rehash(b, l->mask + 1, base);
+	if (err != 0) {
+		EBLOB_WARNC(b->cfg.log, EBLOB_LOG_ERROR, -err,
+				"locator: index: %d: failed to remove base, keeping its entries", bctl->index);
+		goto err_out_unlock;
+	}
+
+	EBLOB_WARNX(b->cfg.log, EBLOB_LOG_NOTICE, "locator: index: %d: removed, total: %" PRIu64,
+			bctl->index, l->num);
+
+err_out_unlock:
+	pthread_rwlock_unlock(&l->lock);
+}
+
+int eblob_locator_lookup(struct eblob_backend *b, const struct eblob_key *key, unsigned int *bases)
+{
+	struct eblob_locator *l = &b->locator;
+	uint64_t hash, i, slot;
+	int num = 0;
+
+	if (!l->enabled)
+		return -ENOTSUP;
+
+	hash = eblob_locator_hash(key);
+
+	pthread_rwlock_rdlock(&l->lock);
+	if (l->broken) {
+		num = -ENOTSUP;
+		goto err_out_unlock;
+	}
+
+	for (i = hash & l->mask; (slot = l->slots[i]) != 0; i = (i + 1) & l->mask) {
+		if ((slot >> EBLOB_LOCATOR_BASE_BITS) != hash)
+			continue;
+
+		if (num == EBLOB_LOCATOR_MAX_BASES) {
+			num = -E2BIG;
+			break;
+		}
+		bases[num++] = slot & EBLOB_LOCATOR_BASE_MASK;
+	}
+
+err_out_unlock:
+	pthread_rwlock_unlock(&l->lock);
+	return num;
+}
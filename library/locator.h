@@ -0,0 +1,114 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Backend-wide key locator for sorted bases.
+ *
+ * Maps 48bit hash of every live key of every sorted base to the base index,
+ * so disk lookup checks only bases that may hold the key and answers miss
+ * without touching any of them. Used when EBLOB_KEY_LOCATOR is set.
+ *
+ * Locator never gives false negatives, but it may return extra bases:
+ * on hash collision, on collision of 16 low bits of base index and for keys
+ * removed after base was added (they are dropped when base is re-sorted).
+ * Entries of live bases whose indexes collide in 16 low bits can not be told
+ * apart, so they are never dropped: all such bases are checked on lookup.
+ */
+
+#ifndef __EBLOB_LOCATOR_H
+#define __EBLOB_LOCATOR_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct eblob_backend;
+struct eblob_base_ctl;
+struct eblob_key;
+
+/* Initial number of slots in table, must be power of two */
+#define EBLOB_LOCATOR_MIN_SLOTS		(1 << 10)
+/* Table grows when number of entries exceeds slots * 3 / 4 */
+#define EBLOB_LOCATOR_LOAD_NUM		3
+#define EBLOB_LOCATOR_LOAD_DEN		4
+/* Low bits of slot keep base index, the rest is key hash */
+#define EBLOB_LOCATOR_BASE_BITS		16
+#define EBLOB_LOCATOR_BASE_MASK		((1ULL << EBLOB_LOCATOR_BASE_BITS) - 1)
+/* Lookup falls back to scan of all bases if key is found in more bases than this */
+#define EBLOB_LOCATOR_MAX_BASES		8
+/* Owner of low bits of base index that hold entries of several bases */
+#define EBLOB_LOCATOR_SHARED		(-1)
+
+struct eblob_locator {
+	/* Protects everything below: lookups take it for read, modifications for write */
+	pthread_rwlock_t	lock;
+	/* Set when locator is used */
+	int			enabled;
+	/* Set when base could not be added, locator does not answer lookups then */
+	int			broken;
+	/* Open-addressing table, slot is (hash << BASE_BITS) | base, 0 means empty */
+	uint64_t		*slots;
+	uint64_t		mask;
+	uint64_t		num;
+	/* Number of entries per base (by low bits of base index) */
+	uint32_t		*counts;
+	/*
+	 * Index of the base that entries counted in @counts belong to,
+	 * EBLOB_LOCATOR_SHARED if there are entries of several bases
+	 */
+	int			*owners;
+};
+
+int eblob_locator_init(struct eblob_backend *b);
+void eblob_locator_destroy(struct eblob_backend *b);
+
+/* Mixes all words of the key, returns nonzero hash that fits into slot */
+uint64_t eblob_locator_hash(const struct eblob_key *key);
+
+/*
+ * Replaces entries of @bctl by its live keys, must be called after index
+ * blocks of @bctl are filled and before its keys are dropped from ram.
+ * Keys are taken from index map of @bctl if @hashes is NULL, otherwise
+ * @hashes is array of @num eblob_locator_hash() of them (see .index.meta).
+ * On failure locator is marked broken and lookups scan all bases.
+ */
+void eblob_locator_add_base(struct eblob_backend *b, struct eblob_base_ctl *bctl,
+		const uint64_t *hashes, uint64_t num);
+
+/*
+ * Drops entries of @bctl that is removed or merged into another base.
+ * Entries shared with another base are left in place.
+ */
+void eblob_locator_remove_base(struct eblob_backend *b, struct eblob_base_ctl *bctl);
+
+/*
+ * Puts to @bases low bits of indexes of bases that may hold @key.
+ * Returns number of bases or negative error if all bases have to be checked.
+ */
+int eblob_locator_lookup(struct eblob_backend *b, const struct eblob_key *key, unsigned int *bases);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EBLOB_LOCATOR_H */
@@ -402,6 +402,7 @@ static struct eblob_base_ctl *eblob_get_base_ctl(struct eblob_backend *b,
 	char index_str[] = ".index"; /* sizeof() == 7, i.e. including null-byte */
 	char sorted_str[] = ".sorted";
 	char tmp_str[] = ".tmp";
+	char meta_str[] = ".index.meta";
 	int err = 0, flen, index;
 	int want_free = 0;
 	int tmp_len;
@@ -425,6 +426,12 @@ static struct eblob_base_ctl *eblob_get_base_ctl(struct eblob_backend *b,
 		goto err_out_exit;
 	}
 
+	p = strstr(name, meta_str);
+	if (p && ((int)(p - name) == name_len - (int)sizeof(meta_str) + 1)) {
+		/* skip meta of sorted indexes */
+		goto err_out_exit;
+	}
+
 	flen = name_len + 128;
 	format = malloc(flen);
 	if (!format) {
@@ -462,7 +469,9 @@ static struct eblob_base_ctl *eblob_get_base_ctl(struct eblob_backend *b,
 	return ctl;
 
 err_out_free_ctl:
+	eblob_stat_destroy(ctl->stat);
 	pthread_mutex_destroy(&ctl->lock);
+	pthread_cond_destroy(&ctl->critness_wait);
 	pthread_rwlock_destroy(&ctl->index_blocks_lock);
 	free(ctl);
 err_out_free_format:
@@ -479,16 +488,17 @@ static void eblob_add_new_base_ctl(struct eblob_backend *b, struct eblob_base_ct
 	struct eblob_base_ctl *tmp;
 	int added = 0;
 
+	/* Bases are walked by eblob_disk_index_lookup() without lock */
 	list_for_each_entry(tmp, &b->bases, base_entry) {
 		if (ctl->index < tmp->index) {
-			list_add_tail(&ctl->base_entry, &tmp->base_entry);
+			list_add_tail_release(&ctl->base_entry, &tmp->base_entry);
 			added = 1;
 			break;
 		}
 	}
 
 	if (!added)
-		list_add_tail(&ctl->base_entry, &b->bases);
+		list_add_tail_release(&ctl->base_entry, &b->bases);
 
 	if (ctl->index > b->max_index)
 		b->max_index = ctl->index;
@@ -501,22 +511,83 @@ void eblob_bases_cleanup(struct eblob_backend *b)
 	list_for_each_entry_safe(ctl, tmp, &b->bases, base_entry) {
 		list_del_init(&ctl->base_entry);
 
+		eblob_index_meta_sync(ctl);
 		eblob_base_ctl_cleanup(ctl);
 		free(ctl);
 	}
 }
 
+/* Names of files found on startup and bases opened from them by loader threads */
+struct eblob_scan_base_ctl {
+	struct eblob_backend	*b;
+	const char		*dir_base;
+	const char		*base;
+	char			**names;
+	struct eblob_base_ctl	**bctls;
+};
+
+static int eblob_scan_base_open(void *priv, unsigned int i)
+{
+	struct eblob_scan_base_ctl *s = priv;
+	int err = 0;
+
+	/*
+	 * FIXME: Error detection that is based on errno of
+	 * chain of functions is error prone - it would be
+	 * better if eblob_get_base_ctl() could explicitly
+	 * propagate an error through return value
+	 */
+	s->bctls[i] = eblob_get_base_ctl(s->b, s->dir_base, s->base, s->names[i], strlen(s->names[i]), &err);
+	if (!s->bctls[i] && err != 0 && err != -EINVAL)
+		return err;
+
+	return 0;
+}
+
+static int eblob_scan_base_sort(void *priv, unsigned int i)
+{
+	struct eblob_scan_base_ctl *s = priv;
+
+	eblob_generate_sorted_index(s->b, s->bctls[i]);
+	return 0;
+}
+
+/*
+ * Removes .index.meta.tmp file @name in @dir_base left by eblob_index_meta_write()
+ * interrupted before rename, it will be written again after index is sorted.
+ */
+static void eblob_index_meta_unlink_stale(struct eblob_log *log, const char *dir_base, const char *name)
+{
+	char path[PATH_MAX];
+
+	if (snprintf(path, sizeof(path), "%s/%s", dir_base, name) >= (int)sizeof(path)) {
+		EBLOB_WARNC(log, EBLOB_LOG_ERROR, ENAMETOOLONG, "index: meta: %s/%s", dir_base, name);
+		return;
+	}
+
+	if (unlink(path) == -1) {
+		EBLOB_WARNC(log, EBLOB_LOG_ERROR, errno, "index: meta: failed to remove stale %s", path);
+		return;
+	}
+
+	EBLOB_WARNX(log, EBLOB_LOG_INFO, "index: meta: removed stale %s", path);
+}
+
 static int eblob_scan_base(struct eblob_backend *b)
 {
+	struct eblob_scan_base_ctl s;
 	struct eblob_base_ctl *bctl;
 	int base_len, err;
 	DIR *dir;
 	struct dirent64 *d;
 	const char *base;
-	char *dir_base, *tmp;
-	char datasort_dir_pattern[NAME_MAX];
+	char *dir_base, *tmp, **names;
+	char datasort_dir_pattern[NAME_MAX], meta_tmp_pattern[NAME_MAX];
+	unsigned int i, names_num = 0, names_size = 0, num;
 	int d_len;
 
+	memset(&s, 0, sizeof(s));
+
 	base = eblob_get_base(b->cfg.file);
 	base_len = strlen(base);
 
@@ -538,6 +609,8 @@ static int eblob_scan_base(struct eblob_backend *b)
 
 	/* Pattern for data-sort directories */
 	snprintf(datasort_dir_pattern, NAME_MAX, "%s-*.datasort.*", base);
+	/* Pattern for .index.meta files left unfinished by eblob_index_meta_write() */
+	snprintf(meta_tmp_pattern, NAME_MAX, "%s-0.*.index.meta.tmp", base);
 
 	while ((d = readdir64(dir)) != NULL) {
 		if (d->d_name[0] == '.' && d->d_name[1] == '\0')
@@ -552,30 +625,62 @@ static int eblob_scan_base(struct eblob_backend *b)
 		if (d->d_type == DT_DIR)
 			continue;
 
+		if (fnmatch(meta_tmp_pattern, d->d_name, 0) == 0) {
+			eblob_index_meta_unlink_stale(b->cfg.log, dir_base, d->d_name);
+			continue;
+		}
+
 		d_len = _D_EXACT_NAMLEN(d);
 
 		if (d_len < base_len)
 			continue;
 
 		if (!strncmp(d->d_name, base, base_len)) {
-			/*
-			 * FIXME: Error detection that is based on errno of
-			 * chain of functions is error prone - it would be
-			 * better if eblob_get_base_ctl() could explicitly
-			 * propagate an error through return value
-			 */
-			bctl = eblob_get_base_ctl(b, dir_base, base, d->d_name, d_len, &err);
-			if (!bctl) {
-				if (err != 0 && err != -EINVAL)
-					goto err_out_bases_cleanup;
-				continue;
+			if (names_num == names_size) {
+				names_size = names_size ? names_size * 2 : 64;
+				names = realloc(s.names, names_size * sizeof(char *));
+				if (names == NULL) {
+					err = -ENOMEM;
+					goto err_out_free_names;
+				}
+				s.names = names;
 			}
 
-
-			eblob_add_new_base_ctl(b, bctl);
+			s.names[names_num] = strndup(d->d_name, d_len);
+			if (s.names[names_num] == NULL) {
+				err = -ENOMEM;
+				goto err_out_free_names;
+			}
+			names_num++;
 		}
 	}
 
+	s.bctls = calloc(names_num + 1, sizeof(struct eblob_base_ctl *));
+	if (s.bctls == NULL) {
+		err = -ENOMEM;
+		goto err_out_free_names;
+	}
+
+	s.b = b;
+	s.dir_base = dir_base;
+	s.base = base;
+
+	/*
+	 * Bases are opened (and their indexes are sorted and loaded) by pool of
+	 * loader threads. They are added to the list only after all of them are
+	 * opened, list keeps them ordered by index, so resulting list does not
+	 * depend on the order bases were opened in.
+	 */
+	err = eblob_parallel(eblob_worker_threads(b), names_num, eblob_scan_base_open, &s);
+
+	for (i = 0; i < names_num; ++i) {
+		if (s.bctls[i])
+			eblob_add_new_base_ctl(b, s.bctls[i]);
+	}
+
+	if (err)
+		goto err_out_bases_cleanup;
+
 	/*
 	 * Run over all bases and sort all indexes except the last one.
 	 * There is another similar code at eblob_base_ctl_open() - we generate
@@ -588,24 +693,30 @@ static int eblob_scan_base(struct eblob_backend *b)
 	 *
 	 * This loop fixes that - we ALWAYS generate sorted index for all but the last blob at the start.
 	 */
+	num = 0;
 	list_for_each_entry(bctl, &b->bases, base_entry) {
 		/* do not process last entry, it can be used for writing */
 		if (list_is_last(&bctl->base_entry, &b->bases))
 			break;
 
 		/* Sort only nonempty and unsorted indexes */
-		if (bctl->index_ctl.size && !bctl->index_ctl.sorted) {
-			eblob_generate_sorted_index(b, bctl);
-		}
+		if (bctl->index_ctl.size && !bctl->index_ctl.sorted)
+			s.bctls[num++] = bctl;
 	}
 
-	closedir(dir);
-	free(dir_base);
+	eblob_parallel(eblob_worker_threads(b), num, eblob_scan_base_sort, &s);
 
-	return 0;
+	err = 0;
+	goto err_out_free_bctls;
 
 err_out_bases_cleanup:
 	eblob_bases_cleanup(b);
+err_out_free_bctls:
+	free(s.bctls);
+err_out_free_names:
+	for (i = 0; i < names_num; ++i)
+		free(s.names[i]);
+	free(s.names);
 	closedir(dir);
 err_out_free:
 	free(dir_base);
@@ -614,61 +725,279 @@ err_out_exit:
 }
 
 /**
- * eblob_cache_insert() - inserts or updates ram control in hash.
+ * eblob_cache_init() - allocates and initializes shards of in-memory cache.
+ * Number of shards is taken from config and rounded up to power of two.
  */
-int eblob_cache_insert(struct eblob_backend *b, struct eblob_key *key,
-		struct eblob_ram_control *ctl)
+int eblob_cache_init(struct eblob_backend *b)
 {
-	size_t entry_size;
-	int replaced;
+	unsigned int i, shards, bits = 0;
 	int err;
 
-	if (b == NULL || key == NULL || ctl == NULL || ctl->bctl == NULL)
-		return -EINVAL;
-
-	pthread_rwlock_wrlock(&b->hash.root_lock);
+	shards = b->cfg.cache_shards;
+	if (shards == 0)
+		shards = EBLOB_DEFAULT_CACHE_SHARDS;
+	if (shards > EBLOB_MAX_CACHE_SHARDS)
+		shards = EBLOB_MAX_CACHE_SHARDS;
+	while ((1U << bits) < shards)
+		bits++;
+	shards = 1U << bits;
 
-	/* Do not accept bctls invalidated by data-sort */
-	if (ctl->bctl->index_ctl.fd < 0) {
-		err = -EAGAIN;
+	err = eblob_epoch_init(&b->cache_epoch);
+	if (err) {
+		eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: epoch initialization failed: %s %d.\n",
+				strerror(-err), err);
 		goto err_out_exit;
 	}
 
-	if (b->cfg.blob_flags & EBLOB_L2HASH) {
-		err = eblob_l2hash_upsert(&b->l2hash, key, ctl, &replaced);
-		entry_size = EBLOB_L2HASH_ENTRY_SIZE;
-	} else {
-		err = eblob_hash_replace_nolock(&b->hash, key, ctl, &replaced);
-		entry_size = EBLOB_HASH_ENTRY_SIZE;
+	b->cache_shards = calloc(shards, sizeof(struct eblob_cache_shard));
+	if (b->cache_shards == NULL) {
+		err = -ENOMEM;
+		goto err_out_epoch_destroy;
+	}
+	b->cache_shards_bits = bits;
+	b->cfg.cache_shards = shards;
+
+	for (i = 0; i < shards; ++i) {
+		struct eblob_cache_shard *shard = &b->cache_shards[i];
+
+		err = eblob_l2hash_init(&shard->l2hash);
+		if (err) {
+			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: l2hash initialization failed: %s %d.\n",
+					strerror(-err), err);
+			goto err_out_destroy;
+		}
+
+		err = eblob_hash_init(&shard->hash, sizeof(struct eblob_ram_control));
+		if (err) {
+			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: hash initialization failed: %s %d.\n",
+					strerror(-err), err);
+			goto err_out_l2hash_destroy;
+		}
+
+		err = eblob_flathash_init(&shard->flathash, &b->cache_epoch);
+		if (err) {
+			eblob_log(b->cfg.log, EBLOB_LOG_ERROR, "blob: flathash initialization failed: %s %d.\n",
+					strerror(-err), err);
+			goto err_out_hash_destroy;
+		}
+	}
+
+	return 0;
+
+err_out_hash_destroy:
+	eblob_hash_destroy(&b->cache_shards[i].hash);
+err_out_l2hash_destroy:
+	eblob_l2hash_destroy(&b->cache_shards[i].l2hash);
+err_out_destroy:
+	while (i-- > 0) {
+		eblob_flathash_destroy(&b->cache_shards[i].flathash);
+		eblob_hash_destroy(&b->cache_shards[i].hash);
+		eblob_l2hash_destroy(&b->cache_shards[i].l2hash);
+	}
+	free(b->cache_shards);
+	b->cache_shards = NULL;
+err_out_epoch_destroy:
+	eblob_epoch_destroy(&b->cache_epoch);
+err_out_exit:
+	return err;
+}
+
+void eblob_cache_destroy(struct eblob_backend *b)
+{
+	unsigned int i;
+
+	if (b->cache_shards == NULL)
+		return;
+
+	for (i = 0; i < (1U << b->cache_shards_bits); ++i) {
+		eblob_flathash_destroy(&b->cache_shards[i].flathash);
+		eblob_hash_destroy(&b->cache_shards[i].hash);
+		eblob_l2hash_destroy(&b->cache_shards[i].l2hash);
+	}
+	free(b->cache_shards);
+	b->cache_shards = NULL;
+
+	eblob_epoch_destroy(&b->cache_epoch);
+}
+
+/**
+ * eblob_cache_lock_all() - write-locks all shards of cache.
+ * Used by data-sort and index-sort to freeze the whole in-memory index.
+ * Shards are always locked in ascending order.
+ * Flathash is also frozen, so lockless lookups wait on shard locks too
+ * instead of seeing entries flushed before the base is replaced.
+ */
+int eblob_cache_lock_all(struct eblob_backend *b)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < (1U << b->cache_shards_bits); ++i) {
+		err = pthread_rwlock_wrlock(&b->cache_shards[i].hash.root_lock);
+		if (err != 0) {
+			while (i-- > 0)
+				pthread_rwlock_unlock(&b->cache_shards[i].hash.root_lock);
+			return -err;
+		}
+	}
+
+	if (b->cfg.blob_flags & EBLOB_FLATHASH) {
+		for (i = 0; i < (1U << b->cache_shards_bits); ++i)
+			eblob_flathash_freeze(&b->cache_shards[i].flathash);
+	}
+	return 0;
+}
+
+void eblob_cache_unlock_all(struct eblob_backend *b)
+{
+	unsigned int i;
+
+	if (b->cfg.blob_flags & EBLOB_FLATHASH) {
+		for (i = 0; i < (1U << b->cache_shards_bits); ++i)
+			eblob_flathash_thaw(&b->cache_shards[i].flathash);
+	}
+
+	i = 1U << b->cache_shards_bits;
+	while (i-- > 0)
+		pthread_rwlock_unlock(&b->cache_shards[i].hash.root_lock);
+}
+
+/**
+ * eblob_cache_empty() - returns non-zero if there are no entries in any shard.
+ * Caller should hold all shards locked.
+ */
+int eblob_cache_empty(struct eblob_backend *b)
+{
+	unsigned int i;
+
+	for (i = 0; i < (1U << b->cache_shards_bits); ++i) {
+		struct eblob_cache_shard *shard = &b->cache_shards[i];
+		int empty;
+
+		if (b->cfg.blob_flags & EBLOB_L2HASH)
+			empty = eblob_l2hash_empty(&shard->l2hash);
+		else if (b->cfg.blob_flags & EBLOB_FLATHASH)
+			empty = eblob_flathash_empty(&shard->flathash);
+		else
+			empty = eblob_hash_empty(&shard->hash);
+
+		if (!empty)
+			return 0;
 	}
+	return 1;
+}
+
+/* Returns size of one entry of in-memory index engine used by @b */
+static size_t eblob_cache_entry_size(struct eblob_backend *b)
+{
+	if (b->cfg.blob_flags & EBLOB_L2HASH)
+		return EBLOB_L2HASH_ENTRY_SIZE;
+	else if (b->cfg.blob_flags & EBLOB_FLATHASH)
+		return EBLOB_FLATHASH_ENTRY_SIZE;
+	else
+		return EBLOB_HASH_ENTRY_SIZE;
+}
+
+/*
+ * Inserts or updates ram control in @shard without touching counters.
+ * Caller should hold lock of the shard.
+ */
+static int eblob_cache_upsert_nolock(struct eblob_backend *b, struct eblob_cache_shard *shard,
+		struct eblob_key *key, struct eblob_ram_control *ctl, int *replaced)
+{
+	/* Do not accept bctls invalidated by data-sort */
+	if (ctl->bctl->index_ctl.fd < 0)
+		return -EAGAIN;
+
+	if (b->cfg.blob_flags & EBLOB_L2HASH)
+		return eblob_l2hash_upsert(&shard->l2hash, key, ctl, replaced);
+	else if (b->cfg.blob_flags & EBLOB_FLATHASH)
+		return eblob_flathash_upsert(&shard->flathash, key, ctl, replaced);
+	else
+		return eblob_hash_replace_nolock(&shard->hash, key, ctl, replaced);
+}
+
+/*
+ * Inserts or updates ram control in @shard.
+ * Caller should hold lock of the shard.
+ */
+static int eblob_cache_insert_nolock(struct eblob_backend *b, struct eblob_cache_shard *shard,
+		struct eblob_key *key, struct eblob_ram_control *ctl)
+{
+	int replaced;
+	int err;
+
+	err = eblob_cache_upsert_nolock(b, shard, key, ctl, &replaced);
 
 	/* Bump counters only if entry was added and not replaced */
 	if (err == 0 && replaced == 0) {
-		eblob_stat_add(b->stat, EBLOB_GST_CACHED, entry_size);
+		eblob_stat_add(b->stat, EBLOB_GST_CACHED, eblob_cache_entry_size(b));
 		FORMATTED(HANDY_COUNTER_INCREMENT, ("eblob.%u.cache.size", b->cfg.stat_id), 1);
 	}
 
-err_out_exit:
-	pthread_rwlock_unlock(&b->hash.root_lock);
+	return err;
+}
+
+/**
+ * eblob_cache_insert() - inserts or updates ram control in hash.
+ */
+int eblob_cache_insert(struct eblob_backend *b, struct eblob_key *key,
+		struct eblob_ram_control *ctl)
+{
+	struct eblob_cache_shard *shard;
+	int err;
+
+	if (b == NULL || key == NULL || ctl == NULL || ctl->bctl == NULL)
+		return -EINVAL;
+
+	shard = eblob_cache_shard(b, key->id);
+	pthread_rwlock_wrlock(&shard->hash.root_lock);
+	err = eblob_cache_insert_nolock(b, shard, key, ctl);
+	pthread_rwlock_unlock(&shard->hash.root_lock);
 
 	return err;
 }
 
+void eblob_cache_insert_batch(struct eblob_backend *b, struct eblob_cache_batch_entry *entries,
+		size_t num)
+{
+	struct eblob_cache_shard *shard = NULL, *next;
+	size_t i;
+
+	for (i = 0; i < num; ++i) {
+		next = eblob_cache_shard(b, entries[i].key->id);
+		if (next != shard) {
+			if (shard != NULL)
+				pthread_rwlock_unlock(&shard->hash.root_lock);
+			shard = next;
+			pthread_rwlock_wrlock(&shard->hash.root_lock);
+		}
+
+		entries[i].err = eblob_cache_insert_nolock(b, shard, entries[i].key, &entries[i].rctl);
+	}
+
+	if (shard != NULL)
+		pthread_rwlock_unlock(&shard->hash.root_lock);
+}
+
+/*
+ * Removes key from cache.
+ * Caller should hold lock of the key's shard (or all shards).
+ */
 int eblob_cache_remove_nolock(struct eblob_backend *b, struct eblob_key *key)
 {
-	size_t entry_size;
+	struct eblob_cache_shard *shard = eblob_cache_shard(b, key->id);
 	int err;
 
-	if (b->cfg.blob_flags & EBLOB_L2HASH) {
-		err = eblob_l2hash_remove(&b->l2hash, key);
-		entry_size = EBLOB_L2HASH_ENTRY_SIZE;
-	} else {
-		err = eblob_hash_remove_nolock(&b->hash, key);
-		entry_size = EBLOB_HASH_ENTRY_SIZE;
-	}
+	if (b->cfg.blob_flags & EBLOB_L2HASH)
+		err = eblob_l2hash_remove(&shard->l2hash, key);
+	else if (b->cfg.blob_flags & EBLOB_FLATHASH)
+		err = eblob_flathash_remove(&shard->flathash, key);
+	else
+		err = eblob_hash_remove_nolock(&shard->hash, key);
 
 	if (err == 0) {
-		eblob_stat_sub(b->stat, EBLOB_GST_CACHED, entry_size);
+		eblob_stat_sub(b->stat, EBLOB_GST_CACHED, eblob_cache_entry_size(b));
 		FORMATTED(HANDY_COUNTER_DECREMENT, ("eblob.%u.cache.size", b->cfg.stat_id), 1);
 	}
 
@@ -677,29 +1006,39 @@ int eblob_cache_remove_nolock(struct eblob_backend *b, struct eblob_key *key)
 
 int eblob_cache_remove(struct eblob_backend *b, struct eblob_key *key)
 {
+	struct eblob_cache_shard *shard = eblob_cache_shard(b, key->id);
 	int err;
 
-	pthread_rwlock_wrlock(&b->hash.root_lock);
+	pthread_rwlock_wrlock(&shard->hash.root_lock);
 	err = eblob_cache_remove_nolock(b, key);
-	pthread_rwlock_unlock(&b->hash.root_lock);
+	pthread_rwlock_unlock(&shard->hash.root_lock);
 	return err;
 }
 
 int eblob_cache_lookup(struct eblob_backend *b, struct eblob_key *key,
 		struct eblob_ram_control *res, int *diskp)
 {
+	struct eblob_cache_shard *shard = eblob_cache_shard(b, key->id);
 	int err = 1, disk = 0;
 
 	FORMATTED(HANDY_TIMER_START, ("eblob.%u.cache.lookup", b->cfg.stat_id), (uint64_t)key);
-	pthread_rwlock_rdlock(&b->hash.root_lock);
-	if (b->cfg.blob_flags & EBLOB_L2HASH) {
-		/* If l2hash is enabled - look in it */
-		err = eblob_l2hash_lookup(&b->l2hash, key, res);
-	} else {
-		/* Look in memory cache */
-		err = eblob_hash_lookup_nolock(&b->hash, key, res);
+	/* Flathash can be read without taking shard lock */
+	if (b->cfg.blob_flags & EBLOB_FLATHASH)
+		err = eblob_flathash_lookup_lockless(&shard->flathash, key, res);
+
+	if (err > 0 || err == -EAGAIN) {
+		pthread_rwlock_rdlock(&shard->hash.root_lock);
+		if (b->cfg.blob_flags & EBLOB_L2HASH) {
+			/* If l2hash is enabled - look in it */
+			err = eblob_l2hash_lookup(&shard->l2hash, key, res);
+		} else if (b->cfg.blob_flags & EBLOB_FLATHASH) {
+			err = eblob_flathash_lookup(&shard->flathash, key, res);
+		} else {
+			/* Look in memory cache */
+			err = eblob_hash_lookup_nolock(&shard->hash, key, res);
+		}
+		pthread_rwlock_unlock(&shard->hash.root_lock);
 	}
-	pthread_rwlock_unlock(&b->hash.root_lock);
 	FORMATTED(HANDY_TIMER_STOP, ("eblob.%u.cache.lookup", b->cfg.stat_id), (uint64_t)key);
 
 	if (err == -ENOENT) {
@@ -716,11 +1055,139 @@ err_out_exit:
 	return err;
 }
 
+/* Record of unsorted base collected by initial load */
+struct eblob_cache_bulk_entry {
+	struct eblob_key		key;
+	struct eblob_ram_control	rctl;
+};
+
+/*
+ * Records collected by initial load. They are put to ram index in one shot:
+ * grouped by shard and inserted by loader threads, each shard is locked once
+ * and counters are updated once per flush.
+ */
+struct eblob_cache_bulk {
+	struct eblob_backend		*b;
+	struct eblob_cache_bulk_entry	*entries;
+	uint64_t			num, size;
+	/* Positions of entries grouped by shard, shard i owns order[starts[i]..starts[i + 1]) */
+	uint32_t			*order;
+	uint64_t			*starts;
+	/* Number of entries added (not replaced) to every shard */
+	uint64_t			*added;
+};
+
+static int eblob_cache_bulk_init(struct eblob_backend *b, struct eblob_cache_bulk *bulk)
+{
+	const unsigned int shards = 1U << b->cache_shards_bits;
+
+	memset(bulk, 0, sizeof(struct eblob_cache_bulk));
+	bulk->b = b;
+
+	bulk->starts = calloc(shards + 1, sizeof(uint64_t));
+	bulk->added = calloc(shards, sizeof(uint64_t));
+	if (bulk->starts == NULL || bulk->added == NULL) {
+		free(bulk->starts);
+		free(bulk->added);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void eblob_cache_bulk_destroy(struct eblob_cache_bulk *bulk)
+{
+	free(bulk->entries);
+	free(bulk->order);
+	free(bulk->starts);
+	free(bulk->added);
+}
+
+/* Inserts entries of shard @item taking its lock once */
+static int eblob_cache_bulk_shard(void *priv, unsigned int item)
+{
+	struct eblob_cache_bulk *bulk = priv;
+	struct eblob_backend *b = bulk->b;
+	struct eblob_cache_shard *shard = &b->cache_shards[item];
+	const uint64_t start = bulk->starts[item], end = bulk->starts[item + 1];
+	uint64_t i;
+	int replaced, err = 0;
+
+	bulk->added[item] = 0;
+	if (start == end)
+		return 0;
+
+	pthread_rwlock_wrlock(&shard->hash.root_lock);
+
+	if (b->cfg.blob_flags & EBLOB_FLATHASH) {
+		err = eblob_flathash_reserve(&shard->flathash, end - start);
+		if (err != 0)
+			goto err_out_unlock;
+	}
+
+	/* Entries of the same key go in order of records, so the latest one wins */
+	for (i = start; i < end; ++i) {
+		struct eblob_cache_bulk_entry *e = &bulk->entries[bulk->order[i]];
+
+		err = eblob_cache_upsert_nolock(b, shard, &e->key, &e->rctl, &replaced);
+		if (err != 0)
+			break;
+		if (!replaced)
+			bulk->added[item]++;
+	}
+
+err_out_unlock:
+	pthread_rwlock_unlock(&shard->hash.root_lock);
+	return err;
+}
+
+/* Puts all collected entries to ram index */
+static int eblob_cache_bulk_flush(struct eblob_cache_bulk *bulk)
+{
+	struct eblob_backend *b = bulk->b;
+	const unsigned int shards = 1U << b->cache_shards_bits;
+	uint64_t i, added = 0;
+	unsigned int s;
+	int err;
+
+	if (bulk->num == 0)
+		return 0;
+
+	/* Counting sort by shard, it is stable so records of the same key keep their order */
+	memset(bulk->starts, 0, (shards + 1) * sizeof(uint64_t));
+	for (i = 0; i < bulk->num; ++i)
+		bulk->starts[eblob_cache_shard(b, bulk->entries[i].key.id) - b->cache_shards + 1]++;
+	for (s = 0; s < shards; ++s)
+		bulk->starts[s + 1] += bulk->starts[s];
+	for (i = 0; i < bulk->num; ++i)
+		bulk->order[bulk->starts[eblob_cache_shard(b, bulk->entries[i].key.id) - b->cache_shards]++] = i;
+	/* Each start has been moved to the end of its shard, shift them back */
+	for (s = shards; s > 0; --s)
+		bulk->starts[s] = bulk->starts[s - 1];
+	bulk->starts[0] = 0;
+
+	err = eblob_parallel(eblob_worker_threads(b), shards, eblob_cache_bulk_shard, bulk);
+
+	for (s = 0; s < shards; ++s)
+		added += bulk->added[s];
+	eblob_stat_add(b->stat, EBLOB_GST_CACHED, added * eblob_cache_entry_size(b));
+	FORMATTED(HANDY_COUNTER_INCREMENT, ("eblob.%u.cache.size", b->cfg.stat_id), added);
+
+	eblob_log(b->cfg.log, EBLOB_LOG_INFO, "blob: cache: bulk load: records: %" PRIu64
+			", added: %" PRIu64 ", err: %d\n", bulk->num, added, err);
+
+	bulk->num = 0;
+	return err;
+}
+
 static int eblob_blob_iter(struct eblob_disk_control *dc, struct eblob_ram_control *ctl,
         int fd __attribute_unused__, uint64_t data_offset __attribute_unused__, void *priv,
 		void *thread_priv __attribute_unused__)
 {
-	struct eblob_backend *b = priv;
+	struct eblob_cache_bulk *bulk = priv;
+	struct eblob_backend *b = bulk->b;
+	struct eblob_cache_bulk_entry *e;
+	int err;
 
 	eblob_log(b->cfg.log, EBLOB_LOG_DEBUG, "blob: iter: %s: index: %d, "
 			"data position: %llu (0x%llx), data size: %llu, disk size: %llu, flags: %s\n",
@@ -730,7 +1197,39 @@ static int eblob_blob_iter(struct eblob_disk_control *dc, struct eblob_ram_contr
 			(unsigned long long)dc->data_size, (unsigned long long)dc->disk_size,
 			eblob_dump_dctl_flags(dc->flags));
 
-	return eblob_cache_insert(b, &dc->key, ctl);
+	if (bulk->num == bulk->size) {
+		if (bulk->size == EBLOB_CACHE_BULK_MAX) {
+			err = eblob_cache_bulk_flush(bulk);
+			if (err != 0)
+				return err;
+		} else {
+			const uint64_t size = bulk->size ? bulk->size * 2 : EBLOB_CACHE_BULK_MIN;
+			void *entries, *order;
+
+			entries = realloc(bulk->entries, size * sizeof(struct eblob_cache_bulk_entry));
+			if (entries == NULL)
+				return -ENOMEM;
+			bulk->entries = entries;
+
+			order = realloc(bulk->order, size * sizeof(uint32_t));
+			if (order == NULL)
+				return -ENOMEM;
+			bulk->order = order;
+
+			bulk->size = size;
+		}
+	}
+
+	e = &bulk->entries[bulk->num++];
+	e->key = dc->key;
+	e->rctl = *ctl;
+	return 0;
+}
+
+/* Called when base has been iterated, puts its records to ram index */
+static int eblob_blob_iter_free(struct eblob_iterate_control *ctl, void **thread_priv __attribute_unused__)
+{
+	return eblob_cache_bulk_flush(ctl->priv);
 }
 
 static int eblob_iterate_existing(struct eblob_backend *b, struct eblob_iterate_control *ctl)
@@ -780,6 +1279,7 @@ static int eblob_iterate_existing(struct eblob_backend *b, struct eblob_iterate_
 					pthread_mutex_unlock(&b->lock);
 
 					eblob_base_remove(bctl);
+					eblob_locator_remove_base(b, bctl);
 
 					eblob_log(ctl->log, EBLOB_LOG_INFO, "blob: removing: index: %d, data_fd: %d, index_fd: %d, "
 							"data_size: %llu, data_offset: %llu, have_sort: %d\n",
@@ -828,15 +1328,24 @@ int eblob_iterate(struct eblob_backend *b, struct eblob_iterate_control *ctl)
 int eblob_load_data(struct eblob_backend *b)
 {
 	struct eblob_iterate_control ctl;
+	struct eblob_cache_bulk bulk;
+	int err;
+
+	err = eblob_cache_bulk_init(b, &bulk);
+	if (err != 0)
+		return err;
 
 	memset(&ctl, 0, sizeof(ctl));
 
 	ctl.log = b->cfg.log;
-	ctl.priv = b;
+	ctl.priv = &bulk;
 	ctl.iterator_cb.iterator = eblob_blob_iter;
+	ctl.iterator_cb.iterator_free = eblob_blob_iter_free;
 	ctl.flags = EBLOB_ITERATE_FLAGS_INITIAL_LOAD;
 
-	return eblob_iterate_existing(b, &ctl);
+	err = eblob_iterate_existing(b, &ctl);
+	eblob_cache_bulk_destroy(&bulk);
+	return err;
 }
 
 /**
@@ -962,6 +1471,19 @@ int eblob_pagecache_hint(int fd, uint64_t flag)
 #endif /* HAVE_POSIX_FADVISE */
 }
 
+int eblob_pagecache_prefetch(int fd, uint64_t offset, uint64_t size)
+{
+	if (fd < 0)
+		return -EINVAL;
+	if (size == 0)
+		return 0;
+#ifdef HAVE_POSIX_FADVISE
+	return -posix_fadvise(fd, offset, size, POSIX_FADV_WILLNEED);
+#else /* !HAVE_POSIX_FADVISE */
+	return 0;
+#endif /* HAVE_POSIX_FADVISE */
+}
+
 /**
  * eblob_base_remove() - removes files that belong to one base
  *
@@ -969,18 +1491,21 @@ int eblob_pagecache_hint(int fd, uint64_t flag)
  */
 void eblob_base_remove(struct eblob_base_ctl *bctl)
 {
+	static const char * const suffixes[] = {
+		"",
+		EBLOB_DATASORT_SORTED_MARK_SUFFIX,
+		".index",
+		".index.sorted",
+		".index.meta",
+	};
 	struct eblob_backend *b = bctl->back;
-	char path[PATH_MAX], base_path[PATH_MAX];
-
-	snprintf(base_path, PATH_MAX, "%s-0.%d", b->cfg.file, bctl->index);
-	unlink(base_path);
-
-	snprintf(path, PATH_MAX, "%s" EBLOB_DATASORT_SORTED_MARK_SUFFIX, base_path);
-	unlink(path);
+	char path[PATH_MAX];
+	size_t i;
 
-	snprintf(path, PATH_MAX, "%s.index", base_path);
-	unlink(path);
-
-	snprintf(path, PATH_MAX, "%s.index.sorted", base_path);
-	unlink(path);
+	for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+		/* Such a file can not be created, so there is nothing to remove */
+		if (snprintf(path, sizeof(path), "%s-0.%d%s", b->cfg.file, bctl->index, suffixes[i]) >= (int)sizeof(path))
+			continue;
+		unlink(path);
+	}
 }
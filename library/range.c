@@ -223,21 +223,18 @@ err_out_exit:
 	return err;
 }
 
-int eblob_read_range(struct eblob_range_request *req)
+/*
+ * Walks one cache shard starting from the first key that is not less than
+ * req->start and feeds in-range keys to eblob_range_callback().
+ * Returns positive value if callback asked to stop.
+ */
+static int eblob_read_range_shard(struct eblob_range_request *req, struct eblob_hash *h)
 {
 	struct eblob_backend *b = req->back;
-	struct eblob_hash *h = &b->hash;
 	struct rb_node *n = h->root.rb_node;
 	struct eblob_hash_entry *e = NULL, *t = NULL;
 	int err = -ENOENT, cmp;
 
-	/*
-	 * It's non-trivial to make range requests with l2hash enabled so
-	 * disable it all along
-	 */
-	if (b->cfg.blob_flags & EBLOB_L2HASH)
-		return -ENOTSUP;
-
 	pthread_rwlock_rdlock(&h->root_lock);
 	while (n) {
 		t = rb_entry(n, struct eblob_hash_entry, node);
@@ -321,6 +318,30 @@ int eblob_read_range(struct eblob_range_request *req)
 err_out_unlock:
 	pthread_rwlock_unlock(&h->root_lock);
 
+	return err;
+}
+
+int eblob_read_range(struct eblob_range_request *req)
+{
+	struct eblob_backend *b = req->back;
+	struct eblob_cache_shard *shard, *last;
+	int err;
+
+	/*
+	 * It's non-trivial to make range requests with l2hash enabled so
+	 * disable it all along. Flathash is not ordered at all.
+	 */
+	if (b->cfg.blob_flags & (EBLOB_L2HASH | EBLOB_FLATHASH))
+		return -ENOTSUP;
+
+	/* Shards are ordered by key, so walk them from start's to end's one */
+	last = eblob_cache_shard(b, req->end);
+	for (shard = eblob_cache_shard(b, req->start); shard <= last; ++shard) {
+		err = eblob_read_range_shard(req, &shard->hash);
+		if (err > 0)
+			break;
+	}
+
 	err = eblob_read_range_on_disk(req);
 
 	return err;
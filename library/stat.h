@@ -109,6 +109,11 @@ static const struct eblob_stat_entry eblob_stat_default_global[] = {
 		EBLOB_GST_DATASORT_COMPLETION_STATUS,
 		{0}
 	},
+	{
+		"memory_key_locator",
+		EBLOB_GST_LOCATOR_SIZE,
+		{0}
+	},
 	{
 		"MAX",
 		EBLOB_GST_MAX,
@@ -0,0 +1,398 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "features.h"
+
+#include "blob.h"
+#include "uring.h"
+
+#include <errno.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+/* First error of writes submitted by calling thread and not reaped yet */
+static __thread int eblob_write_err;
+
+/* Writes the rest of @op after @done bytes synchronously, used as a fallback and to finish short writes */
+static void eblob_write_finish(const struct eblob_io_op *op, size_t done)
+{
+	int err;
+
+	if (done >= op->size)
+		return;
+
+	err = __eblob_write_ll(op->fd, (const char *)op->buf + done, op->size - done, op->offset + done);
+	if (err && eblob_write_err == 0)
+		eblob_write_err = err;
+}
+
+#ifdef HAVE_IO_URING
+
+/* Single write in SQE is limited by 32bit length, the rest is written synchronously */
+#define EBLOB_URING_MAX_WRITE		(1UL << 30)
+
+/* Per-thread submission and completion rings */
+struct eblob_uring {
+	int			fd;
+
+	unsigned		*sq_tail;
+	unsigned		*sq_mask;
+	unsigned		*sq_array;
+	struct io_uring_sqe	*sqes;
+
+	unsigned		*cq_head;
+	unsigned		*cq_tail;
+	unsigned		*cq_mask;
+	struct io_uring_cqe	*cqes;
+
+	void			*sq_ring;
+	size_t			sq_ring_size;
+	/* Equals to @sq_ring if kernel maps both rings at once */
+	void			*cq_ring;
+	size_t			cq_ring_size;
+	size_t			sqes_size;
+
+	/* Writes in flight by slot, slot is put to user_data of SQE */
+	struct eblob_io_op	ops[EBLOB_URING_ENTRIES];
+	/* Stack of free slots */
+	unsigned		free[EBLOB_URING_ENTRIES];
+	unsigned		free_num;
+	/* Number of SQEs that are queued but not submitted to kernel yet */
+	unsigned		queued;
+};
+
+static pthread_once_t eblob_uring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t eblob_uring_key;
+/* Set when io_uring turns out to be unusable, all threads fall back to pwrite(2) then */
+static int eblob_uring_disabled;
+
+static void eblob_uring_destroy(struct eblob_uring *r)
+{
+	munmap(r->sqes, r->sqes_size);
+	if (r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_size);
+	munmap(r->sq_ring, r->sq_ring_size);
+	close(r->fd);
+	free(r);
+}
+
+/* Called on thread exit */
+static void eblob_uring_key_destroy(void *data)
+{
+	eblob_uring_destroy(data);
+}
+
+static void eblob_uring_key_init(void)
+{
+	if (pthread_key_create(&eblob_uring_key, eblob_uring_key_destroy) != 0)
+		__atomic_store_n(&eblob_uring_disabled, 1, __ATOMIC_RELAXED);
+}
+
+/* Returns non-zero if ring @fd supports IORING_OP_WRITE */
+static int eblob_uring_write_supported(int fd)
+{
+	struct io_uring_probe *probe;
+	int ret;
+
+	probe = calloc(1, sizeof(*probe) + IORING_OP_LAST * sizeof(probe->ops[0]));
+	if (probe == NULL)
+		return 0;
+
+	ret = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST);
+	ret = (ret == 0 && probe->last_op >= IORING_OP_WRITE &&
+			(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED));
+
+	free(probe);
+	return ret;
+}
+
+static struct eblob_uring *eblob_uring_create(void)
+{
+	struct io_uring_params p;
+	struct eblob_uring *r;
+
+	r = calloc(1, sizeof(*r));
+	if (r == NULL)
+		goto err_out_exit;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, EBLOB_URING_ENTRIES, &p);
+	if (r->fd < 0)
+		goto err_out_free;
+
+	/* Older kernels complete every write with -EINVAL, pwrite(2) is used then */
+	if (!eblob_uring_write_supported(r->fd))
+		goto err_out_close;
+
+	r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_ring_size > r->sq_ring_size)
+			r->sq_ring_size = r->cq_ring_size;
+		r->cq_ring_size = r->sq_ring_size;
+	}
+
+	r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED)
+		goto err_out_close;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_ring = r->sq_ring;
+	} else {
+		r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED)
+			goto err_out_unmap_sq;
+	}
+
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto err_out_unmap_cq;
+
+	r->sq_tail = r->sq_ring + p.sq_off.tail;
+	r->sq_mask = r->sq_ring + p.sq_off.ring_mask;
+	r->sq_array = r->sq_ring + p.sq_off.array;
+	r->cq_head = r->cq_ring + p.cq_off.head;
+	r->cq_tail = r->cq_ring + p.cq_off.tail;
+	r->cq_mask = r->cq_ring + p.cq_off.ring_mask;
+	r->cqes = r->cq_ring + p.cq_off.cqes;
+
+	for (r->free_num = 0; r->free_num < EBLOB_URING_ENTRIES; ++r->free_num)
+		r->free[r->free_num] = r->free_num;
+
+	return r;
+
+err_out_unmap_cq:
+	if (r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_size);
+err_out_unmap_sq:
+	munmap(r->sq_ring, r->sq_ring_size);
+err_out_close:
+	close(r->fd);
+err_out_free:
+	free(r);
+err_out_exit:
+	return NULL;
+}
+
+/* Returns ring of calling thread or NULL if it has not been created */
+static struct eblob_uring *eblob_uring_current(void)
+{
+	pthread_once(&eblob_uring_once, eblob_uring_key_init);
+	return pthread_getspecific(eblob_uring_key);
+}
+
+/* Returns ring of calling thread creating it if needed, NULL if io_uring can not be used */
+static struct eblob_uring *eblob_uring_get(void)
+{
+	struct eblob_uring *r;
+
+	r = eblob_uring_current();
+	if (r != NULL)
+		return r;
+
+	if (__atomic_load_n(&eblob_uring_disabled, __ATOMIC_RELAXED))
+		return NULL;
+
+	r = eblob_uring_create();
+	if (r == NULL) {
+		__atomic_store_n(&eblob_uring_disabled, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	if (pthread_setspecific(eblob_uring_key, r) != 0) {
+		eblob_uring_destroy(r);
+		return NULL;
+	}
+
+	return r;
+}
+
+/*
+ * Ring is broken: writes in flight are written again synchronously, since it
+ * is not known which of them have been completed, and ring is dropped.
+ */
+static void eblob_uring_drop(struct eblob_uring *r)
+{
+	unsigned char busy[EBLOB_URING_ENTRIES];
+	unsigned i;
+
+	memset(busy, 1, sizeof(busy));
+	for (i = 0; i < r->free_num; ++i)
+		busy[r->free[i]] = 0;
+
+	for (i = 0; i < EBLOB_URING_ENTRIES; ++i) {
+		if (busy[i])
+			eblob_write_finish(&r->ops[i], 0);
+	}
+
+	pthread_setspecific(eblob_uring_key, NULL);
+	eblob_uring_destroy(r);
+}
+
+/* Frees slots of completed writes, short and failed ones are finished synchronously */
+static void eblob_uring_complete(struct eblob_uring *r)
+{
+	const unsigned mask = *r->cq_mask;
+	unsigned head = *r->cq_head;
+
+	while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+		const struct io_uring_cqe *cqe = &r->cqes[head & mask];
+		const unsigned slot = cqe->user_data;
+
+		/* Failed write is retried by pwrite(2) which reports real error of it */
+		eblob_write_finish(&r->ops[slot], cqe->res > 0 ? (size_t)cqe->res : 0);
+		r->free[r->free_num++] = slot;
+		++head;
+	}
+
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * Submits queued SQEs to kernel, waits for at least @wait completions and reaps
+ * all completed writes. Returns error only if ring itself has failed.
+ */
+static int eblob_uring_enter(struct eblob_uring *r, unsigned wait)
+{
+	int ret;
+
+	for (;;) {
+		ret = syscall(__NR_io_uring_enter, r->fd, r->queued, wait,
+				wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if (ret >= 0)
+			break;
+		if (errno != EINTR)
+			return -errno;
+	}
+	r->queued -= ret;
+
+	eblob_uring_complete(r);
+	return 0;
+}
+
+/* Puts @op to submission ring, makes room for it by reaping completions if all slots are busy */
+static int eblob_uring_queue(struct eblob_uring *r, const struct eblob_io_op *op)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail, idx, slot;
+	int err;
+
+	while (r->free_num == 0) {
+		err = eblob_uring_enter(r, 1);
+		if (err)
+			return err;
+	}
+
+	slot = r->free[--r->free_num];
+	r->ops[slot] = *op;
+
+	tail = *r->sq_tail;
+	idx = tail & *r->sq_mask;
+	sqe = &r->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = op->fd;
+	sqe->addr = (uintptr_t)op->buf;
+	sqe->len = op->size < EBLOB_URING_MAX_WRITE ? op->size : EBLOB_URING_MAX_WRITE;
+	sqe->off = op->offset;
+	sqe->user_data = slot;
+
+	r->sq_array[idx] = idx;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->queued++;
+	return 0;
+}
+
+void eblob_write_submit(const struct eblob_io_op *ops, int num)
+{
+	struct eblob_uring *r = eblob_uring_get();
+	int i;
+
+	for (i = 0; i < num; ++i) {
+		if (r != NULL && eblob_uring_queue(r, &ops[i]) != 0) {
+			eblob_uring_drop(r);
+			r = NULL;
+		}
+		if (r == NULL)
+			eblob_write_finish(&ops[i], 0);
+	}
+
+	/* Kick queued writes without waiting for them, reap those that have been already completed */
+	if (r != NULL && r->queued && eblob_uring_enter(r, 0) != 0)
+		eblob_uring_drop(r);
+}
+
+int eblob_write_reap(void)
+{
+	struct eblob_uring *r = eblob_uring_current();
+	int err;
+
+	while (r != NULL && r->free_num < EBLOB_URING_ENTRIES) {
+		if (eblob_uring_enter(r, 1) != 0) {
+			eblob_uring_drop(r);
+			break;
+		}
+	}
+
+	err = eblob_write_err;
+	eblob_write_err = 0;
+	return err;
+}
+
+#else /* HAVE_IO_URING */
+
+void eblob_write_submit(const struct eblob_io_op *ops, int num)
+{
+	int i;
+
+	for (i = 0; i < num; ++i)
+		eblob_write_finish(&ops[i], 0);
+}
+
+int eblob_write_reap(void)
+{
+	const int err = eblob_write_err;
+
+	eblob_write_err = 0;
+	return err;
+}
+
+#endif /* HAVE_IO_URING */
+
+int eblob_write_chain(const struct eblob_io_op *ops, int num)
+{
+	eblob_write_submit(ops, num);
+	return eblob_write_reap();
+}
@@ -0,0 +1,81 @@
+/*
+ * 2017+ Copyright (c) Kirill Smorodinnikov <shaitkir@gmail.com>
+ * All rights reserved.
+ *
+ * This file is part of Eblob.
+ *
+ * Eblob is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eblob is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Eblob.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Asynchronous disk writes.
+ *
+ * Writes that belong to one request (record data chunks, checksums, record
+ * header in index and data) are submitted by eblob_write_submit() and keep
+ * going while the caller does something else, e.g. hashes the same data for
+ * the footer. eblob_write_reap() waits for all writes submitted by the
+ * calling thread. When eblob is built with WITH_URING and kernel supports
+ * io_uring, writes are put to per-thread ring with up to EBLOB_URING_ENTRIES
+ * of them in flight at once, completions are reaped whenever ring is entered.
+ * Otherwise, or if ring can not be set up, writes are done synchronously by
+ * eblob_write_submit() with __eblob_write_ll().
+ *
+ * Writes in flight are not ordered against each other, so they must not
+ * overlap. Short writes are finished synchronously when they are reaped.
+ */
+
+#ifndef __EBLOB_URING_H
+#define __EBLOB_URING_H
+
+#include <sys/types.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of writes in flight per thread, further submissions reap completed ones first */
+#define EBLOB_URING_ENTRIES		64
+
+struct eblob_io_op {
+	int		fd;
+	const void	*buf;
+	size_t		size;
+	off_t		offset;
+};
+
+/*
+ * Submits @ops without waiting for them, @ops array itself may be reused at once.
+ * Buffers must stay valid until eblob_write_reap() is called by the same thread.
+ * Errors are reported by eblob_write_reap().
+ */
+void eblob_write_submit(const struct eblob_io_op *ops, int num);
+
+/*
+ * Waits for all writes submitted by calling thread.
+ * Returns zero when every write is completed or negative error of the first failed one.
+ */
+int eblob_write_reap(void);
+
+/*
+ * Writes all @ops and waits for them as well as for writes submitted earlier.
+ * Returns zero when every write is completed or negative error of the first failed one.
+ */
+int eblob_write_chain(const struct eblob_io_op *ops, int num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __EBLOB_URING_H */
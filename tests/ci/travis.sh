@@ -8,3 +8,10 @@ yes | debuild -e CC -e CXX --prepend-path="/usr/local/bin/" -uc -us
 
 # Install packages
 sudo -- dpkg -i ../*.deb
+
+# Build with io_uring disk writes and run tests that write through it
+mkdir -p build-uring
+(cd build-uring && cmake -DWITH_URING=ON .. && make eblob_uring_test eblob_batch_test eblob_stress)
+build-uring/tests/eblob_uring_test
+build-uring/tests/eblob_batch_test
+build-uring/tests/eblob_stress -m0 -f1000 -D0 -I30000 -o2000 -i1000 -l4 -r 1000 -S10 -F87
@@ -12,6 +12,15 @@ $(find . -name eblob_cpp_test)
 # Run unit tests
 $(find . -name eblob_crypto_test)
 $(find . -name eblob_corruption_test)
+$(find . -name eblob_batch_test)
+$(find . -name eblob_async_test)
+$(find . -name eblob_index_meta_test)
+$(find . -name eblob_datasort_test)
+$(find . -name eblob_radix_sort_test)
+$(find . -name eblob_flathash_test)
+$(find . -name eblob_locator_test)
+$(find . -name eblob_iterate_test)
+$(find . -name eblob_uring_test)
 
 # Big and small stress tests
 $(find . -name eblob_stress) -m0 -f1000 -D0 -I300000 -o20000 -i1000 -l4 -r 1000 -S10 -F87
@@ -25,3 +34,17 @@ $(find . -name eblob_stress) -m0 -f1000 -D0 -I300000 -o20000 -i1000 -l4 -r 1000
 # Overwrite-heavy test with many bases and threads
 $(find . -name eblob_stress) -f1000 -D0 -I100000 -i64 -r 40 -S10 -F64 -T32 -l4 -o 0
 $(find . -name eblob_stress) -f1000 -D0 -I100000 -i64 -r 40 -S10 -F2112 -T32 -l4 -o 0
+
+# Blocked bloom filter for sorted bases
+$(find . -name eblob_stress) -m0 -f1000 -D0 -I300000 -o20000 -i1000 -l4 -r 1000 -S10 -F10327
+
+# Open-addressing in-memory index
+$(find . -name eblob_stress) -m0 -f1000 -D0 -I300000 -o20000 -i1000 -l4 -r 1000 -S10 -F6167
+$(find . -name eblob_stress) -f1000 -D0 -I100000 -i64 -r 40 -S10 -F4096 -T32 -l4 -o 0
+
+# Key locator for sorted bases
+$(find . -name eblob_stress) -m0 -f1000 -D0 -I300000 -o20000 -i1000 -l4 -r 1000 -S10 -F18519
+
+# Persistent bloom filters and index blocks
+$(find . -name eblob_stress) -m0 -f1000 -D0 -I300000 -o20000 -i1000 -l4 -r 1000 -S10 -F32855
+$(find . -name eblob_stress) -m0 -f1000 -D0 -I300000 -o20000 -i1000 -l4 -r 1000 -S10 -F49239
@@ -0,0 +1,314 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ASYNC library test
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "library/blob.h"
+#include "library/async.h"
+#include "library/crypto/sha512.h"
+
+#include "eblob/eblob.hpp"
+
+#include "eblob_wrapper.hpp"
+
+/* Config of backend started by test itself */
+static eblob_wrapper::tune_t async_config(uint64_t blob_flags) {
+	return [=](eblob_config &config) {
+		config.blob_flags = blob_flags | EBLOB_NO_FREE_SPACE_CHECK;
+	};
+}
+
+/* Collects results of asynchronous requests by key */
+class completions {
+public:
+	void add(const eblob_key *key, int err, std::string data = std::string()) {
+		std::unique_lock<std::mutex> guard(lock_);
+		results_[std::string((const char *)key->id, EBLOB_ID_SIZE)] = std::make_pair(err, data);
+		cond_.notify_all();
+	}
+
+	void wait(size_t num) {
+		std::unique_lock<std::mutex> guard(lock_);
+		cond_.wait(guard, [&] { return results_.size() >= num; });
+	}
+
+	std::pair<int, std::string> get(const eblob_key &key) {
+		std::unique_lock<std::mutex> guard(lock_);
+		return results_.at(std::string((const char *)key.id, EBLOB_ID_SIZE));
+	}
+
+	void clear() {
+		std::unique_lock<std::mutex> guard(lock_);
+		results_.clear();
+	}
+
+private:
+	std::mutex lock_;
+	std::condition_variable cond_;
+	std::map<std::string, std::pair<int, std::string>> results_;
+};
+
+static void write_complete(eblob_key *key, int err, eblob_write_control *, void *priv) {
+	static_cast<completions *>(priv)->add(key, err);
+}
+
+static void read_complete(eblob_key *key, int err, char *data, uint64_t size, void *priv) {
+	static_cast<completions *>(priv)->add(key, err, err ? std::string() : std::string(data, size));
+	free(data);
+}
+
+static void remove_complete(eblob_key *key, int err, void *priv) {
+	static_cast<completions *>(priv)->add(key, err);
+}
+
+static void test_async(uint64_t blob_flags) {
+	eblob_wrapper wrapper(async_config(blob_flags), false);
+	eblob_backend *b = eblob_init(wrapper.config());
+	BOOST_REQUIRE(b != nullptr);
+
+	static const size_t num = 500;
+	std::vector<std::string> data(num);
+	std::vector<eblob_key> keys(num);
+	completions done;
+
+	for (size_t i = 0; i < num; ++i) {
+		keys[i] = hash("key-" + std::to_string(i));
+		data[i] = "data of " + std::to_string(i);
+
+		eblob_iovec iov[2] = {
+			{&data[i].front(), 5, 0},
+			{&data[i][5], data[i].size() - 5, 5},
+		};
+		BOOST_REQUIRE_EQUAL(eblob_writev_async(b, &keys[i], iov, 2, 0, write_complete, &done), 0);
+	}
+	done.wait(num);
+	for (size_t i = 0; i < num; ++i)
+		BOOST_REQUIRE_EQUAL(done.get(keys[i]).first, 0);
+
+	done.clear();
+	for (size_t i = 0; i < num; ++i)
+		BOOST_REQUIRE_EQUAL(eblob_read_async(b, &keys[i], 5, 0, EBLOB_READ_CSUM, read_complete, &done), 0);
+	done.wait(num);
+	for (size_t i = 0; i < num; ++i) {
+		auto result = done.get(keys[i]);
+		BOOST_REQUIRE_EQUAL(result.first, 0);
+		BOOST_REQUIRE_EQUAL(result.second, data[i].substr(5));
+	}
+
+	done.clear();
+	for (size_t i = 0; i < num; i += 2)
+		BOOST_REQUIRE_EQUAL(eblob_remove_async(b, &keys[i], remove_complete, &done), 0);
+	done.wait(num / 2);
+
+	done.clear();
+	for (size_t i = 0; i < num; ++i)
+		BOOST_REQUIRE_EQUAL(eblob_read_async(b, &keys[i], 0, 0, EBLOB_READ_NOCSUM, read_complete, &done), 0);
+	done.wait(num);
+	for (size_t i = 0; i < num; ++i)
+		BOOST_REQUIRE_EQUAL(done.get(keys[i]).first, (i % 2) ? 0 : -ENOENT);
+
+	/* requests queued right before cleanup must be completed by it */
+	done.clear();
+	for (size_t i = 1; i < num; i += 2)
+		BOOST_REQUIRE_EQUAL(eblob_remove_async(b, &keys[i], remove_complete, &done), 0);
+	eblob_cleanup(b);
+	done.wait(num / 2);
+	for (size_t i = 1; i < num; i += 2)
+		BOOST_REQUIRE_EQUAL(done.get(keys[i]).first, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_io_threads) {
+	test_async(0);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_disabled_threads) {
+	/* requests are processed by caller */
+	test_async(EBLOB_DISABLE_THREADS);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_futures) {
+	eblob_wrapper wrapper(async_config(0), false);
+	ioremap::eblob::eblob blob(wrapper.config());
+
+	auto key = hash("key");
+	blob.write_async(key, "some data").get();
+	blob.write_async(key, " appended", 0, BLOB_DISK_CTL_APPEND).get();
+	BOOST_REQUIRE_EQUAL(blob.read_async(key, 5, 0).get(), "data appended");
+
+	blob.remove_async(key).get();
+	BOOST_REQUIRE_THROW(blob.read_async(key, 0, 0).get(), std::runtime_error);
+	BOOST_REQUIRE_THROW(blob.remove_async(hash("missing")).get(), std::runtime_error);
+}
+
+/* Records results of asynchronous requests in order of their completion */
+class completion_log {
+public:
+	struct entry {
+		std::string	op;
+		int		err;
+		std::string	data;
+		std::thread::id	thread;
+	};
+
+	void add(const char *op, int err, std::string data = std::string()) {
+		std::unique_lock<std::mutex> guard(lock_);
+		entries_.push_back(entry{op, err, std::move(data), std::this_thread::get_id()});
+		cond_.notify_all();
+	}
+
+	std::vector<entry> wait(size_t num) {
+		std::unique_lock<std::mutex> guard(lock_);
+		cond_.wait(guard, [&] { return entries_.size() >= num; });
+		return entries_;
+	}
+
+private:
+	std::mutex lock_;
+	std::condition_variable cond_;
+	std::vector<entry> entries_;
+};
+
+static void log_write_complete(eblob_key *, int err, eblob_write_control *, void *priv) {
+	static_cast<completion_log *>(priv)->add("write", err);
+}
+
+static void log_read_complete(eblob_key *, int err, char *data, uint64_t size, void *priv) {
+	static_cast<completion_log *>(priv)->add("read", err, err ? std::string() : std::string(data, size));
+	free(data);
+}
+
+static void log_remove_complete(eblob_key *, int err, void *priv) {
+	static_cast<completion_log *>(priv)->add("remove", err);
+}
+
+static void test_async_order(uint64_t blob_flags) {
+	eblob_wrapper wrapper(async_config(blob_flags), false);
+	/* with the only I/O thread requests are completed in order of queueing */
+	wrapper.config()->io_threads = 1;
+	eblob_backend *b = eblob_init(wrapper.config());
+	BOOST_REQUIRE(b != nullptr);
+
+	/* all requests fit into queue */
+	static const size_t rounds = EBLOB_ASYNC_QUEUE_PER_THREAD / 6;
+	completion_log log;
+	auto key = hash("key");
+	std::vector<std::string> data(rounds);
+	std::vector<eblob_iovec> too_many_iov(EBLOB_IOVCNT_MAX + 1, eblob_iovec{&data[0].front(), 0, 0});
+
+	for (size_t i = 0; i < rounds; ++i) {
+		data[i] = "data of round " + std::to_string(i);
+		eblob_iovec iov = {&data[i].front(), data[i].size(), 0};
+
+		BOOST_REQUIRE_EQUAL(eblob_writev_async(b, &key, &iov, 1, 0, log_write_complete, &log), 0);
+		BOOST_REQUIRE_EQUAL(eblob_read_async(b, &key, 0, 0, EBLOB_READ_CSUM, log_read_complete, &log), 0);
+		BOOST_REQUIRE_EQUAL(eblob_remove_async(b, &key, log_remove_complete, &log), 0);
+		BOOST_REQUIRE_EQUAL(eblob_read_async(b, &key, 0, 0, EBLOB_READ_NOCSUM, log_read_complete, &log), 0);
+		BOOST_REQUIRE_EQUAL(eblob_remove_async(b, &key, log_remove_complete, &log), 0);
+		/* errors of the request itself are passed to callback and not returned */
+		BOOST_REQUIRE_EQUAL(eblob_writev_async(b, &key, too_many_iov.data(), too_many_iov.size(), 0,
+					log_write_complete, &log), 0);
+	}
+
+	auto entries = log.wait(rounds * 6);
+	BOOST_REQUIRE_EQUAL(entries.size(), rounds * 6);
+	for (size_t i = 0; i < rounds; ++i) {
+		const auto *e = &entries[i * 6];
+		BOOST_REQUIRE_EQUAL(e[0].op, "write");
+		BOOST_REQUIRE_EQUAL(e[0].err, 0);
+		BOOST_REQUIRE_EQUAL(e[1].op, "read");
+		BOOST_REQUIRE_EQUAL(e[1].err, 0);
+		BOOST_REQUIRE_EQUAL(e[1].data, data[i]);
+		BOOST_REQUIRE_EQUAL(e[2].op, "remove");
+		BOOST_REQUIRE_EQUAL(e[2].err, 0);
+		BOOST_REQUIRE_EQUAL(e[3].op, "read");
+		BOOST_REQUIRE_EQUAL(e[3].err, -ENOENT);
+		BOOST_REQUIRE_EQUAL(e[4].op, "remove");
+		BOOST_REQUIRE_EQUAL(e[4].err, -ENOENT);
+		BOOST_REQUIRE_EQUAL(e[5].op, "write");
+		BOOST_REQUIRE_EQUAL(e[5].err, -E2BIG);
+	}
+
+	/* callbacks are called on I/O thread unless threads are disabled */
+	for (const auto &e : entries) {
+		if (blob_flags & EBLOB_DISABLE_THREADS)
+			BOOST_REQUIRE(e.thread == std::this_thread::get_id());
+		else
+			BOOST_REQUIRE(e.thread != std::this_thread::get_id());
+	}
+
+	eblob_cleanup(b);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_order_io_thread) {
+	test_async_order(0);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_order_disabled_threads) {
+	test_async_order(EBLOB_DISABLE_THREADS);
+}
+
+/* Blocks I/O thread in completion until gate is opened */
+struct blocking_completions {
+	std::shared_future<void>	gate;
+	completions			done;
+};
+
+static void blocking_remove_complete(eblob_key *key, int err, void *priv) {
+	auto *ctx = static_cast<blocking_completions *>(priv);
+	ctx->gate.wait();
+	ctx->done.add(key, err);
+}
+
+BOOST_AUTO_TEST_CASE(test_async_queue_full) {
+	eblob_wrapper wrapper(async_config(0), false);
+	static const unsigned int io_threads = 2;
+	static const size_t limit = io_threads * EBLOB_ASYNC_QUEUE_PER_THREAD;
+	wrapper.config()->io_threads = io_threads;
+	eblob_backend *b = eblob_init(wrapper.config());
+	BOOST_REQUIRE(b != nullptr);
+
+	std::promise<void> gate;
+	blocking_completions ctx;
+	ctx.gate = gate.get_future().share();
+
+	/*
+	 * All I/O threads get stuck in completions of their first requests,
+	 * so queue is filled up by the rest and then requests are rejected.
+	 */
+	std::vector<eblob_key> keys;
+	int err = 0;
+	while (keys.size() <= limit + io_threads) {
+		keys.push_back(hash("missing-" + std::to_string(keys.size())));
+		err = eblob_remove_async(b, &keys.back(), blocking_remove_complete, &ctx);
+		if (err) {
+			keys.pop_back();
+			break;
+		}
+	}
+	BOOST_REQUIRE_EQUAL(err, -EAGAIN);
+	BOOST_REQUIRE_GE(keys.size(), limit);
+	BOOST_REQUIRE_LE(keys.size(), limit + io_threads);
+
+	/* rejected request is not completed, accepted ones are */
+	gate.set_value();
+	ctx.done.wait(keys.size());
+	for (const auto &key : keys)
+		BOOST_REQUIRE_EQUAL(ctx.done.get(key).first, -ENOENT);
+
+	/* queue accepts requests again once it is drained */
+	ctx.done.clear();
+	keys.resize(1);
+	BOOST_REQUIRE_EQUAL(eblob_remove_async(b, &keys[0], blocking_remove_complete, &ctx), 0);
+	ctx.done.wait(1);
+	BOOST_REQUIRE_EQUAL(ctx.done.get(keys[0]).first, -ENOENT);
+
+	eblob_cleanup(b);
+}
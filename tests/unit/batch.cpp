@@ -0,0 +1,157 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE BATCH library test
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <map>
+#include <vector>
+
+#include "library/blob.h"
+#include "library/footer.h"
+#include "library/crypto/sha512.h"
+
+#include "eblob/eblob.hpp"
+
+#include "eblob_wrapper.hpp"
+
+static void batch_config(eblob_config &config) {
+	config.blob_flags = EBLOB_DISABLE_THREADS | EBLOB_NO_FREE_SPACE_CHECK;
+}
+
+std::string read(eblob_backend *b, const std::string &key) {
+	auto k = hash(key);
+	char *data = nullptr;
+	uint64_t size = 0;
+
+	BOOST_REQUIRE_EQUAL(eblob_read_data(b, &k, 0, &data, &size), 0);
+	std::string ret(data, size);
+	free(data);
+	return ret;
+}
+
+BOOST_AUTO_TEST_CASE(test_writev_batch) {
+	/* mix of new keys, overwrites, appends and duplicates should end up as if they were written one by one */
+	eblob_wrapper wrapper(batch_config);
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	std::string existing = "existing data";
+	auto existing_key = hash("existing");
+	BOOST_REQUIRE_EQUAL(eblob_write(wrapper.get(), &existing_key, &existing.front(), 0, existing.size(), 0), 0);
+
+	struct record {
+		std::string key;
+		std::vector<std::string> parts;
+		uint64_t flags;
+	};
+	std::vector<record> records;
+	for (int i = 0; i < 300; ++i)
+		records.push_back({"key-" + std::to_string(i), {"data of ", std::to_string(i)}, 0});
+	records.push_back({"existing", {" appended"}, BLOB_DISK_CTL_APPEND});
+	records.push_back({"key-7", {"rewritten"}, 0});
+	records.push_back({"key-8", {"also rewritten"}, 0});
+	records.push_back({"key-8", {" and appended"}, BLOB_DISK_CTL_APPEND});
+
+	std::vector<std::vector<eblob_iovec>> iovs(records.size());
+	std::vector<eblob_write_batch> batch(records.size());
+	std::map<std::string, std::string> expected;
+	expected["existing"] = existing;
+	for (size_t i = 0; i < records.size(); ++i) {
+		uint64_t offset = 0;
+		for (auto &part : records[i].parts) {
+			iovs[i].push_back({&part.front(), part.size(), offset});
+			offset += part.size();
+		}
+
+		batch[i].key = hash(records[i].key);
+		batch[i].iov = iovs[i].data();
+		batch[i].iovcnt = iovs[i].size();
+		batch[i].flags = records[i].flags;
+
+		auto &value = expected[records[i].key];
+		if (!(records[i].flags & BLOB_DISK_CTL_APPEND))
+			value.clear();
+		for (const auto &part : records[i].parts)
+			value += part;
+	}
+
+	std::vector<int> errors(batch.size(), -1);
+	BOOST_REQUIRE_EQUAL(eblob_writev_batch(wrapper.get(), batch.data(), batch.size(), errors.data()), 0);
+	for (size_t i = 0; i < errors.size(); ++i)
+		BOOST_REQUIRE_EQUAL(errors[i], 0);
+
+	for (const auto &item : expected)
+		BOOST_REQUIRE_EQUAL(read(wrapper.get(), item.first), item.second);
+
+	BOOST_REQUIRE_EQUAL(eblob_stat_get(wrapper.get()->stat_summary, EBLOB_LST_RECORDS_TOTAL) -
+	                    eblob_stat_get(wrapper.get()->stat_summary, EBLOB_LST_RECORDS_REMOVED),
+	                    expected.size());
+
+	/* records written in bulk must be found in index on start */
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	for (const auto &item : expected)
+		BOOST_REQUIRE_EQUAL(read(wrapper.get(), item.first), item.second);
+}
+
+/* Writes @num records of @size bytes by one batch to at least @min_bases, checks they are read back before and after restart */
+static void check_batch_rollover(eblob_wrapper &wrapper, size_t num, size_t size, size_t min_bases) {
+	std::vector<std::string> data;
+	std::vector<eblob_iovec> iovs(num);
+	std::vector<eblob_write_batch> batch(num);
+	for (size_t i = 0; i < num; ++i) {
+		data.push_back(std::string(size, 'a' + i % 26) + std::to_string(i));
+		iovs[i] = eblob_iovec{&data[i].front(), data[i].size(), 0};
+		batch[i] = eblob_write_batch{hash("key-" + std::to_string(i)), &iovs[i], 1, 0};
+	}
+
+	std::vector<int> errors(num, -1);
+	BOOST_REQUIRE_EQUAL(eblob_writev_batch(wrapper.get(), batch.data(), batch.size(), errors.data()), 0);
+	for (size_t i = 0; i < num; ++i)
+		BOOST_REQUIRE_EQUAL(errors[i], 0);
+
+	/* every base is filled up to its limits, last record of base may cross blob_size as single write does */
+	const eblob_config *config = wrapper.config();
+	size_t bases = 0, records = 0;
+	eblob_base_ctl *bctl;
+	list_for_each_entry(bctl, &wrapper.get()->bases, base_entry) {
+		const uint64_t base_records = bctl->index_ctl.size / sizeof(eblob_disk_control);
+		BOOST_REQUIRE(base_records <= config->records_in_blob);
+		BOOST_REQUIRE(bctl->data_ctl.offset < config->blob_size + 2 * size);
+		records += base_records;
+		++bases;
+	}
+	BOOST_REQUIRE_EQUAL(records, num);
+	BOOST_REQUIRE(bases >= min_bases);
+
+	for (int restart = 0; restart < 2; ++restart) {
+		for (size_t i = 0; i < num; ++i)
+			BOOST_REQUIRE(read(wrapper.get(), "key-" + std::to_string(i)) == data[i]);
+
+		wrapper.restart();
+		BOOST_REQUIRE(wrapper.get() != nullptr);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_writev_batch_records_rollover) {
+	/* batch that does not fit into one base by number of records goes to next bases */
+	eblob_wrapper wrapper([](eblob_config &config) {
+		batch_config(config);
+		config.records_in_blob = 100;
+	});
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	check_batch_rollover(wrapper, 350, 100, 4);
+}
+
+BOOST_AUTO_TEST_CASE(test_writev_batch_size_rollover) {
+	/* batch that does not fit into one base by size goes to next bases, records span many checksum chunks */
+	eblob_wrapper wrapper([](eblob_config &config) {
+		batch_config(config);
+		config.blob_size = 8 << 20;
+	});
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	check_batch_rollover(wrapper, 20, 3 * EBLOB_CSUM_CHUNK_SIZE / 2, 4);
+}
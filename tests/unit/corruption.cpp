@@ -8,80 +8,93 @@
 
 #include "library/blob.h"
 #include "library/crypto/sha512.h"
+#include "library/footer.h"
+#include "library/murmurhash.h"
 
 #include "eblob/eblob.hpp"
 
-class eblob_wrapper {
-public:
-	eblob_wrapper()
-	: data_dir_template_("/tmp/eblob-test-XXXXXX")
-	, data_dir_{mkdtemp(&data_dir_template_.front())}
-	, data_path_{data_dir_ + "/data"}
-	, log_path_{data_dir_ + "/log.log"}
-	, logger_{log_path_.c_str(), EBLOB_LOG_DEBUG}
-	, backend_{nullptr} {
-		restart();
-	}
+#include "eblob_wrapper.hpp"
+
+/* Bases of 100 records, sorted ones are indexsorted on startup */
+static void corruption_config(eblob_config &config) {
+	config.blob_flags = EBLOB_L2HASH | EBLOB_DISABLE_THREADS | EBLOB_AUTO_INDEXSORT;
+	config.records_in_blob = 100;
+}
 
-	void restart() {
-		stop();
-		backend_ = [&]() {
-			eblob_config config;
-			memset(&config, 0, sizeof(config));
-			config.blob_flags = EBLOB_L2HASH | EBLOB_DISABLE_THREADS | EBLOB_AUTO_INDEXSORT;
-			config.sync = -2;
-			config.log = logger_.log();
-			config.file = (char *)data_path_.c_str();
-			config.blob_size = EBLOB_BLOB_DEFAULT_BLOB_SIZE;
-			config.records_in_blob = 100 /*EBLOB_BLOB_DEFAULT_RECORDS_IN_BLOB*/;
-			config.defrag_percentage = EBLOB_DEFAULT_DEFRAG_PERCENTAGE;
-			config.defrag_timeout = EBLOB_DEFAULT_DEFRAG_TIMEOUT;
-			config.index_block_size = EBLOB_INDEX_DEFAULT_BLOCK_SIZE;
-			config.index_block_bloom_length = EBLOB_INDEX_DEFAULT_BLOCK_BLOOM_LENGTH;
-			config.blob_size_limit = UINT64_MAX;
-			config.defrag_time = EBLOB_DEFAULT_DEFRAG_TIME;
-			config.defrag_splay = EBLOB_DEFAULT_DEFRAG_SPLAY;
-			config.periodic_timeout = EBLOB_DEFAULT_PERIODIC_THREAD_TIMEOUT;
-			config.stat_id = 12345;
-			config.chunks_dir = nullptr;
-			return eblob_init(&config);
-		}();
+/* Checks that footer of record written from @iov are MurmurHash64A of chunks chained over their 4 KiB pieces */
+static void check_chunked_checksum(eblob_backend *b, const std::string &data, const std::vector<eblob_iovec> &iov,
+                                   uint64_t flags) {
+	auto key = hash("some key");
+	eblob_write_control wc;
+	BOOST_REQUIRE_EQUAL(eblob_writev_return(b, &key, iov.data(), iov.size(), flags, &wc), 0);
+	BOOST_REQUIRE_EQUAL(wc.flags, flags | BLOB_DISK_CTL_CHUNKED_CSUM);
+
+	std::vector<uint64_t> checksums;
+	for (size_t chunk = 0; chunk < data.size(); chunk += EBLOB_CSUM_CHUNK_SIZE) {
+		uint64_t checksum = 0;
+		const size_t chunk_end = std::min(data.size(), chunk + EBLOB_CSUM_CHUNK_SIZE);
+		for (size_t piece = chunk; piece < chunk_end; piece += 4096)
+			checksum = MurmurHash64A(data.data() + piece, std::min<size_t>(4096, chunk_end - piece), checksum);
+		checksums.push_back(checksum);
 	}
+	const uint64_t final_checksum = MurmurHash64A(checksums.data(), checksums.size() * sizeof(uint64_t), 0);
+	checksums.push_back(final_checksum);
 
-	void stop() {
-		if (backend_) {
-			eblob_cleanup(backend_);
-			backend_ = nullptr;
-		}
+	std::vector<uint64_t> footer(checksums.size());
+	BOOST_REQUIRE_EQUAL(__eblob_read_ll(wc.data_fd, footer.data(), footer.size() * sizeof(uint64_t),
+	                                    wc.ctl_data_offset + wc.total_size - footer.size() * sizeof(uint64_t)), 0);
+	BOOST_REQUIRE(footer == checksums);
+
+	BOOST_REQUIRE_EQUAL(eblob_verify_checksum(b, &key, &wc), 0);
+	BOOST_REQUIRE_EQUAL(eblob_read_return(b, &key, EBLOB_READ_CSUM, &wc), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_chunked_checksum) {
+	eblob_wrapper wrapper(corruption_config);
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	std::string data(5 * EBLOB_CSUM_CHUNK_SIZE + 4096 + 3, '\0');
+	uint64_t seed = 1;
+	for (auto &c : data) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		c = seed >> 56;
 	}
 
-	~eblob_wrapper() {
-		stop();
-		boost::filesystem::remove_all(data_dir_);
+	/* checksums are calculated from the only iovec */
+	check_chunked_checksum(wrapper.get(), data, {{(void *)data.data(), data.size(), 0}}, 0);
+
+	/* chunks and their pieces cross boundaries of iovecs, some of iovecs are empty */
+	const std::vector<size_t> bounds = {0, 1000, 1000, 4097, EBLOB_CSUM_CHUNK_SIZE + 5, EBLOB_CSUM_CHUNK_SIZE + 6,
+	                                    4 * EBLOB_CSUM_CHUNK_SIZE - 1, data.size()};
+	std::vector<eblob_iovec> iov;
+	for (size_t i = 1; i < bounds.size(); ++i)
+		iov.push_back({(void *)(data.data() + bounds[i - 1]), bounds[i] - bounds[i - 1], bounds[i - 1]});
+	check_chunked_checksum(wrapper.get(), data, iov, 0);
+
+	/* checksums of data of extended record are read back from disk */
+	check_chunked_checksum(wrapper.get(), data, {{(void *)data.data(), data.size(), 0}}, BLOB_DISK_CTL_EXTHDR);
+}
+
+BOOST_AUTO_TEST_CASE(test_chunked_checksum_threads) {
+	/* record large enough to be hashed by several threads */
+	eblob_wrapper wrapper(corruption_config);
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	std::string data(128 * EBLOB_CSUM_CHUNK_SIZE + 4096 + 3, '\0');
+	uint64_t seed = 1;
+	for (auto &c : data) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		c = seed >> 56;
 	}
 
-	eblob_backend *get() { return backend_; }
-
-private:
-	std::string data_dir_template_;
-	const std::string data_dir_;
-	const std::string data_path_;
-	const std::string log_path_;
-	ioremap::eblob::eblob_logger logger_;
-	eblob_backend *backend_;
-};
-
-eblob_key hash(std::string key) {
-	eblob_key ret;
-	sha512_buffer(key.data(), key.size(), ret.id);
-	return ret;
+	check_chunked_checksum(wrapper.get(), data, {{(void *)data.data(), data.size(), 0}}, BLOB_DISK_CTL_EXTHDR);
 }
 
 BOOST_AUTO_TEST_CASE(test_header_corruption) {
 	/* corrupt record's header in blob and check that record isn't considered as corrupted (since data is correct)
 	 * and read is failed with -EINVAL
 	 */
-	eblob_wrapper wrapper;
+	eblob_wrapper wrapper(corruption_config);
 	BOOST_REQUIRE(wrapper.get() != nullptr);
 
 	BOOST_REQUIRE_EQUAL(eblob_stat_get(wrapper.get()->stat_summary, EBLOB_LST_RECORDS_CORRUPTED), 0);
@@ -132,7 +145,7 @@ BOOST_AUTO_TEST_CASE(test_header_corruption) {
 
 BOOST_AUTO_TEST_CASE(test_data_corruption) {
 	/* corrupt record's data and check that the record is considered as corrupted */
-	eblob_wrapper wrapper;
+	eblob_wrapper wrapper(corruption_config);
 	BOOST_REQUIRE(wrapper.get() != nullptr);
 
 	BOOST_REQUIRE_EQUAL(eblob_stat_get(wrapper.get()->stat_summary, EBLOB_LST_RECORDS_CORRUPTED), 0);
@@ -191,7 +204,7 @@ BOOST_AUTO_TEST_CASE(test_data_corruption) {
 
 BOOST_AUTO_TEST_CASE(test_footer_corruption) {
 	/* corrupt record's footer and check that the record is considered as corrupted */
-	eblob_wrapper wrapper;
+	eblob_wrapper wrapper(corruption_config);
 	BOOST_REQUIRE(wrapper.get() != nullptr);
 
 	BOOST_REQUIRE_EQUAL(eblob_stat_get(wrapper.get()->stat_summary, EBLOB_LST_RECORDS_CORRUPTED), 0);
@@ -244,7 +257,7 @@ BOOST_AUTO_TEST_CASE(test_footer_corruption) {
 }
 
 BOOST_AUTO_TEST_CASE(test_inspection) {
-	eblob_wrapper wrapper;
+	eblob_wrapper wrapper(corruption_config);
 	BOOST_REQUIRE(wrapper.get() != nullptr);
 
 	constexpr char data[] = "some data";
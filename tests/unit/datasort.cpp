@@ -0,0 +1,64 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE DATASORT library test
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <vector>
+
+#include "library/blob.h"
+#include "library/datasort.h"
+#include "library/crypto/sha512.h"
+
+#include "eblob/eblob.hpp"
+
+#include "eblob_wrapper.hpp"
+
+/* Bases of 100 records with @blob_flags */
+static eblob_wrapper::tune_t datasort_config(uint64_t blob_flags) {
+	return [=](eblob_config &config) {
+		config.blob_flags = blob_flags;
+		config.records_in_blob = 100;
+	};
+}
+
+BOOST_AUTO_TEST_CASE(test_datasort_without_chunks_dir) {
+	/* without chunks_dir datasort copies records straight from original bases */
+	eblob_wrapper wrapper(datasort_config(EBLOB_DISABLE_THREADS | EBLOB_INDEX_META));
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	std::vector<eblob_key> keys;
+	std::vector<std::string> values;
+	for (size_t i = 0; i < 350; ++i) {
+		keys.push_back(hash("key-" + std::to_string(i)));
+		values.push_back(std::string(i % 50 + 1, 'a' + i % 26));
+		BOOST_REQUIRE_EQUAL(eblob_write(wrapper.get(), &keys.back(), (void *)values.back().data(),
+		                                0, values.back().size(), 0), 0);
+	}
+	for (size_t i = 0; i < 20; ++i)
+		BOOST_REQUIRE_EQUAL(eblob_remove(wrapper.get(), &keys[i]), 0);
+	for (size_t i = 20; i < 30; ++i) {
+		values[i] = "new-" + values[i];
+		BOOST_REQUIRE_EQUAL(eblob_write(wrapper.get(), &keys[i], (void *)values[i].data(),
+		                                0, values[i].size(), 0), 0);
+	}
+
+	wrapper.get()->want_defrag = EBLOB_DEFRAG_STATE_DATA_SORT;
+	BOOST_REQUIRE_EQUAL(eblob_defrag(wrapper.get()), 0);
+	wrapper.get()->want_defrag = EBLOB_DEFRAG_STATE_NOT_STARTED;
+
+	BOOST_REQUIRE(boost::filesystem::exists(wrapper.path(0, EBLOB_DATASORT_SORTED_MARK_SUFFIX)));
+
+	for (size_t i = 0; i < keys.size(); ++i) {
+		char *data = nullptr;
+		uint64_t size = 0;
+		const int err = eblob_read_data(wrapper.get(), &keys[i], 0, &data, &size);
+		if (i < 20) {
+			BOOST_REQUIRE_EQUAL(err, -ENOENT);
+			continue;
+		}
+		BOOST_REQUIRE_EQUAL(err, 0);
+		BOOST_REQUIRE_EQUAL(std::string(data, size), values[i]);
+		free(data);
+	}
+}
@@ -0,0 +1,101 @@
+/*
+ * Backend of unit tests living in temporary directory.
+ */
+
+#ifndef __EBLOB_TESTS_UNIT_EBLOB_WRAPPER_HPP
+#define __EBLOB_TESTS_UNIT_EBLOB_WRAPPER_HPP
+
+#include <boost/filesystem.hpp>
+
+#include <functional>
+#include <string>
+
+#include "library/blob.h"
+#include "library/crypto/sha512.h"
+
+#include "eblob/eblob.hpp"
+
+class eblob_wrapper {
+public:
+	/* Changes fields of default config that test needs */
+	typedef std::function<void(eblob_config &)> tune_t;
+
+	/*
+	 * Starts backend with default config changed by @tune.
+	 * If @start is false, backend is not started: test passes config() to eblob_init() itself.
+	 */
+	explicit eblob_wrapper(tune_t tune = tune_t(), bool start = true)
+	: data_dir_template_("/tmp/eblob-test-XXXXXX")
+	, data_dir_{mkdtemp(&data_dir_template_.front())}
+	, data_path_{data_dir_ + "/data"}
+	, log_path_{data_dir_ + "/log.log"}
+	, logger_{log_path_.c_str(), EBLOB_LOG_DEBUG}
+	, backend_{nullptr} {
+		memset(&config_, 0, sizeof(config_));
+		config_.sync = -2;
+		config_.log = logger_.log();
+		config_.file = (char *)data_path_.c_str();
+		config_.blob_size = EBLOB_BLOB_DEFAULT_BLOB_SIZE;
+		config_.records_in_blob = EBLOB_BLOB_DEFAULT_RECORDS_IN_BLOB;
+		config_.defrag_percentage = EBLOB_DEFAULT_DEFRAG_PERCENTAGE;
+		config_.defrag_timeout = EBLOB_DEFAULT_DEFRAG_TIMEOUT;
+		config_.index_block_size = EBLOB_INDEX_DEFAULT_BLOCK_SIZE;
+		config_.index_block_bloom_length = EBLOB_INDEX_DEFAULT_BLOCK_BLOOM_LENGTH;
+		config_.blob_size_limit = UINT64_MAX;
+		config_.defrag_time = EBLOB_DEFAULT_DEFRAG_TIME;
+		config_.defrag_splay = EBLOB_DEFAULT_DEFRAG_SPLAY;
+		config_.periodic_timeout = EBLOB_DEFAULT_PERIODIC_THREAD_TIMEOUT;
+		config_.stat_id = 12345;
+		config_.chunks_dir = nullptr;
+		if (tune)
+			tune(config_);
+
+		if (start)
+			restart();
+	}
+
+	~eblob_wrapper() {
+		stop();
+		boost::filesystem::remove_all(data_dir_);
+	}
+
+	void restart() {
+		stop();
+		/* eblob_init() may change config it is given */
+		eblob_config config = config_;
+		backend_ = eblob_init(&config);
+	}
+
+	void stop() {
+		if (backend_) {
+			eblob_cleanup(backend_);
+			backend_ = nullptr;
+		}
+	}
+
+	eblob_backend *get() { return backend_; }
+
+	eblob_config *config() { return &config_; }
+
+	/* Path of file of base @index with @suffix, e.g. ".index" */
+	std::string path(int index, const char *suffix) const {
+		return data_path_ + "-0." + std::to_string(index) + suffix;
+	}
+
+private:
+	std::string data_dir_template_;
+	const std::string data_dir_;
+	const std::string data_path_;
+	const std::string log_path_;
+	ioremap::eblob::eblob_logger logger_;
+	eblob_config config_;
+	eblob_backend *backend_;
+};
+
+static inline eblob_key hash(const std::string &key) {
+	eblob_key ret;
+	sha512_buffer(key.data(), key.size(), ret.id);
+	return ret;
+}
+
+#endif /* __EBLOB_TESTS_UNIT_EBLOB_WRAPPER_HPP */
@@ -0,0 +1,299 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE FLATHASH library test
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+#include "library/blob.h"
+#include "library/epoch.h"
+#include "library/flathash.h"
+
+#include "eblob_wrapper.hpp"
+
+/* Same as eblob_flathash_mix(): home bucket of prefix is mix(prefix) & mask */
+static uint64_t mix(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* Key with given first 8 bytes, the rest of the key is made of @tail */
+static eblob_key make_key(uint64_t key_prefix, const std::string &tail) {
+	eblob_key key = hash(tail);
+	memcpy(key.id, &key_prefix, sizeof(key_prefix));
+	return key;
+}
+
+static eblob_ram_control make_rctl(uint64_t i) {
+	eblob_ram_control rctl;
+	memset(&rctl, 0, sizeof(rctl));
+	rctl.data_offset = i * 2;
+	rctl.index_offset = i * 3;
+	rctl.size = i;
+	return rctl;
+}
+
+/* Flathash with epoch so both locked and lockless lookups can be checked */
+class flathash_wrapper {
+public:
+	flathash_wrapper() {
+		BOOST_REQUIRE_EQUAL(eblob_epoch_init(&epoch_), 0);
+		BOOST_REQUIRE_EQUAL(eblob_flathash_init(&fh_, &epoch_), 0);
+	}
+
+	~flathash_wrapper() {
+		eblob_flathash_destroy(&fh_);
+		eblob_epoch_destroy(&epoch_);
+	}
+
+	eblob_flathash *get() { return &fh_; }
+
+	void insert(const eblob_key &key, uint64_t i) {
+		const eblob_ram_control rctl = make_rctl(i);
+		int replaced = -1;
+		BOOST_REQUIRE_EQUAL(eblob_flathash_upsert(&fh_, &key, &rctl, &replaced), 0);
+		BOOST_REQUIRE_EQUAL(replaced, 0);
+	}
+
+	/* Checks that @key is found by both lookups and has ram control of @i */
+	void check_found(const eblob_key &key, uint64_t i) {
+		eblob_ram_control rctl;
+		BOOST_REQUIRE_EQUAL(eblob_flathash_lookup(&fh_, &key, &rctl), 0);
+		BOOST_REQUIRE_EQUAL(rctl.size, i);
+		BOOST_REQUIRE_EQUAL(rctl.data_offset, i * 2);
+		BOOST_REQUIRE_EQUAL(rctl.index_offset, i * 3);
+
+		memset(&rctl, 0, sizeof(rctl));
+		BOOST_REQUIRE_EQUAL(eblob_flathash_lookup_lockless(&fh_, &key, &rctl), 0);
+		BOOST_REQUIRE_EQUAL(rctl.size, i);
+	}
+
+	void check_missing(const eblob_key &key) {
+		eblob_ram_control rctl;
+		BOOST_REQUIRE_EQUAL(eblob_flathash_lookup(&fh_, &key, &rctl), -ENOENT);
+		BOOST_REQUIRE_EQUAL(eblob_flathash_lookup_lockless(&fh_, &key, &rctl), -ENOENT);
+	}
+
+	/*
+	 * Checks Robin Hood invariants: every slot keeps its distance from home
+	 * bucket, there are no holes in probe sequences and count matches table.
+	 */
+	void check_table() {
+		const eblob_flathash_table *t = fh_.table;
+		uint64_t used = 0;
+
+		for (uint64_t pos = 0; pos <= t->mask; ++pos) {
+			const eblob_flathash_slot &s = t->slots[pos];
+			if (s.entry == 0)
+				continue;
+
+			++used;
+			const uint64_t home = mix(s.prefix) & t->mask;
+			BOOST_REQUIRE_EQUAL(s.dib, (pos - home) & t->mask);
+			/* slot before displaced one can not be empty */
+			if (s.dib > 0) {
+				const eblob_flathash_slot &prev = t->slots[(pos - 1) & t->mask];
+				BOOST_REQUIRE(prev.entry != 0);
+				BOOST_REQUIRE(prev.dib + 1 >= s.dib);
+			}
+		}
+		BOOST_REQUIRE_EQUAL(used, fh_.count);
+	}
+
+private:
+	eblob_epoch epoch_;
+	eblob_flathash fh_;
+};
+
+BOOST_AUTO_TEST_CASE(test_insert_lookup_remove) {
+	/* removed keys disappear and backward shift keeps the rest reachable */
+	flathash_wrapper fh;
+	const size_t num = 800;
+
+	std::vector<eblob_key> keys;
+	for (size_t i = 0; i < num; ++i) {
+		keys.push_back(hash("key-" + std::to_string(i)));
+		fh.insert(keys.back(), i);
+	}
+	/* table has not grown, so entries are displaced */
+	BOOST_REQUIRE_EQUAL(fh.get()->table->mask + 1, EBLOB_FLATHASH_MIN_SLOTS);
+	BOOST_REQUIRE_EQUAL(fh.get()->count, num);
+	fh.check_table();
+
+	for (size_t i = 0; i < num; ++i)
+		fh.check_found(keys[i], i);
+	fh.check_missing(hash("missing"));
+
+	/* upsert of existing key replaces ram control in place */
+	const eblob_ram_control rctl = make_rctl(num);
+	int replaced = 0;
+	BOOST_REQUIRE_EQUAL(eblob_flathash_upsert(fh.get(), &keys[0], &rctl, &replaced), 0);
+	BOOST_REQUIRE_EQUAL(replaced, 1);
+	fh.check_found(keys[0], num);
+	BOOST_REQUIRE_EQUAL(fh.get()->count, num);
+
+	for (size_t i = 0; i < num; i += 2) {
+		BOOST_REQUIRE_EQUAL(eblob_flathash_remove(fh.get(), &keys[i]), 0);
+		fh.check_table();
+	}
+	BOOST_REQUIRE_EQUAL(eblob_flathash_remove(fh.get(), &keys[0]), -ENOENT);
+	BOOST_REQUIRE_EQUAL(fh.get()->count, num / 2);
+
+	for (size_t i = 0; i < num; ++i) {
+		if (i % 2 == 0)
+			fh.check_missing(keys[i]);
+		else
+			fh.check_found(keys[i], i);
+	}
+
+	/* freed slab entries are reused */
+	const uint32_t used = fh.get()->used;
+	for (size_t i = 0; i < num; i += 2)
+		fh.insert(keys[i], i + num);
+	BOOST_REQUIRE_EQUAL(fh.get()->used, used);
+	fh.check_table();
+
+	for (size_t i = 0; i < num; ++i)
+		fh.check_found(keys[i], (i % 2 == 0) ? i + num : i);
+}
+
+BOOST_AUTO_TEST_CASE(test_resize_during_inserts) {
+	/* every key inserted before resize is found after it, slab entries stay in place */
+	flathash_wrapper fh;
+	const size_t num = 3 * EBLOB_FLATHASH_CHUNK_SIZE;
+
+	std::vector<eblob_key> keys;
+	uint64_t slots = fh.get()->table->mask + 1;
+	size_t resizes = 0;
+	const eblob_flathash_entry *first = nullptr;
+
+	for (size_t i = 0; i < num; ++i) {
+		keys.push_back(hash("key-" + std::to_string(i)));
+		fh.insert(keys.back(), i);
+		if (first == nullptr)
+			first = &fh.get()->chunks->chunk[0][0];
+
+		if (fh.get()->table->mask + 1 != slots) {
+			slots = fh.get()->table->mask + 1;
+			++resizes;
+
+			fh.check_table();
+			for (size_t j = 0; j <= i; ++j)
+				fh.check_found(keys[j], j);
+		}
+	}
+	BOOST_REQUIRE(resizes >= 5);
+	BOOST_REQUIRE_EQUAL(fh.get()->count, num);
+	BOOST_REQUIRE(fh.get()->count * EBLOB_FLATHASH_LOAD_DEN <= slots * EBLOB_FLATHASH_LOAD_NUM);
+	BOOST_REQUIRE(fh.get()->chunks->num >= 3);
+	BOOST_REQUIRE_EQUAL(&fh.get()->chunks->chunk[0][0], first);
+
+	for (size_t i = 0; i < num; ++i)
+		fh.check_found(keys[i], i);
+
+	/* reserve grows table in advance, so next inserts do not resize */
+	BOOST_REQUIRE_EQUAL(eblob_flathash_reserve(fh.get(), num), 0);
+	slots = fh.get()->table->mask + 1;
+	for (size_t i = num; i < 2 * num; ++i) {
+		keys.push_back(hash("key-" + std::to_string(i)));
+		fh.insert(keys.back(), i);
+	}
+	BOOST_REQUIRE_EQUAL(fh.get()->table->mask + 1, slots);
+	fh.check_table();
+
+	for (size_t i = 0; i < keys.size(); ++i)
+		fh.check_found(keys[i], i);
+}
+
+BOOST_AUTO_TEST_CASE(test_cluster_wrap_around) {
+	/* cluster that starts in the last bucket continues from the first one */
+	flathash_wrapper fh;
+	const uint64_t mask = fh.get()->table->mask;
+
+	/* prefixes whose home bucket is the last one and one before it */
+	std::vector<uint64_t> last, before_last;
+	for (uint64_t p = 1; last.size() < 4 || before_last.size() < 2; ++p) {
+		const uint64_t home = mix(p) & mask;
+		if (home == mask && last.size() < 4)
+			last.push_back(p);
+		else if (home == mask - 1 && before_last.size() < 2)
+			before_last.push_back(p);
+	}
+
+	/* keys of the cluster, the first two ones share the whole prefix */
+	std::vector<eblob_key> keys = {
+		make_key(last[0], "a"),
+		make_key(last[0], "b"),
+		make_key(before_last[0], "c"),
+		make_key(last[1], "d"),
+		make_key(before_last[1], "e"),
+		make_key(last[2], "f"),
+	};
+	for (size_t i = 0; i < keys.size(); ++i)
+		fh.insert(keys[i], i);
+	fh.check_table();
+
+	/* cluster occupies two last buckets and wraps to the first ones */
+	const eblob_flathash_table *t = fh.get()->table;
+	BOOST_REQUIRE(t->slots[mask - 1].entry != 0);
+	BOOST_REQUIRE(t->slots[mask].entry != 0);
+	for (uint64_t pos = 0; pos < keys.size() - 2; ++pos)
+		BOOST_REQUIRE(t->slots[pos].entry != 0);
+	BOOST_REQUIRE_EQUAL(t->slots[keys.size() - 2].entry, 0);
+
+	for (size_t i = 0; i < keys.size(); ++i)
+		fh.check_found(keys[i], i);
+	/* absent keys of the same buckets, including one with shared prefix */
+	fh.check_missing(make_key(last[0], "x"));
+	fh.check_missing(make_key(last[3], "y"));
+
+	/* removal from the end of table shifts wrapped entries back over the edge */
+	BOOST_REQUIRE_EQUAL(eblob_flathash_remove(fh.get(), &keys[0]), 0);
+	fh.check_table();
+	BOOST_REQUIRE_EQUAL(t->slots[keys.size() - 3].entry, 0);
+	fh.check_missing(keys[0]);
+	for (size_t i = 1; i < keys.size(); ++i)
+		fh.check_found(keys[i], i);
+
+	BOOST_REQUIRE_EQUAL(eblob_flathash_remove(fh.get(), &keys[2]), 0);
+	BOOST_REQUIRE_EQUAL(eblob_flathash_remove(fh.get(), &keys[3]), 0);
+	fh.check_table();
+	for (size_t i : {1, 4, 5})
+		fh.check_found(keys[i], i);
+
+	for (size_t i : {1, 4, 5})
+		BOOST_REQUIRE_EQUAL(eblob_flathash_remove(fh.get(), &keys[i]), 0);
+	fh.check_table();
+	BOOST_REQUIRE(eblob_flathash_empty(fh.get()));
+	for (uint64_t pos = 0; pos <= mask; ++pos)
+		BOOST_REQUIRE_EQUAL(t->slots[pos].entry, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_freeze) {
+	/* lockless lookups of frozen table are sent to locked path until it is thawed */
+	flathash_wrapper fh;
+	const eblob_key first = hash("first"), second = hash("second");
+	eblob_ram_control rctl;
+
+	fh.insert(first, 1);
+	fh.insert(second, 2);
+
+	eblob_flathash_freeze(fh.get());
+	BOOST_REQUIRE_EQUAL(eblob_flathash_lookup_lockless(fh.get(), &first, &rctl), -EAGAIN);
+
+	/* changes of frozen table do not close its write section */
+	BOOST_REQUIRE_EQUAL(eblob_flathash_remove(fh.get(), &first), 0);
+	fh.insert(hash("third"), 3);
+	BOOST_REQUIRE_EQUAL(eblob_flathash_lookup_lockless(fh.get(), &second, &rctl), -EAGAIN);
+	BOOST_REQUIRE_EQUAL(eblob_flathash_lookup(fh.get(), &second, &rctl), 0);
+	BOOST_REQUIRE_EQUAL(rctl.size, 2);
+
+	eblob_flathash_thaw(fh.get());
+	BOOST_REQUIRE_EQUAL(fh.get()->seq % 2, 0);
+	fh.check_missing(first);
+	fh.check_found(second, 2);
+	fh.check_found(hash("third"), 3);
+}
@@ -0,0 +1,174 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE INDEX META library test
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <vector>
+
+#include "library/blob.h"
+#include "library/crypto/sha512.h"
+
+#include "eblob/eblob.hpp"
+
+#include "eblob_wrapper.hpp"
+
+/* Bases of 100 records with .index.meta and @blob_flags */
+static eblob_wrapper::tune_t index_meta_config(uint64_t blob_flags) {
+	return [=](eblob_config &config) {
+		config.blob_flags = blob_flags | EBLOB_INDEX_META;
+		config.records_in_blob = 100;
+	};
+}
+
+/* Checks number of sorted bases and number of them that were loaded from .index.meta */
+static void check_sorted(eblob_backend *b, size_t sorted, size_t loaded) {
+	size_t sorted_num = 0, loaded_num = 0;
+	eblob_base_ctl *bctl;
+
+	list_for_each_entry(bctl, &b->bases, base_entry) {
+		if (!bctl->index_ctl.sorted)
+			continue;
+		++sorted_num;
+		if (bctl->meta_map != nullptr)
+			++loaded_num;
+	}
+	BOOST_REQUIRE_EQUAL(sorted_num, sorted);
+	BOOST_REQUIRE_EQUAL(loaded_num, loaded);
+}
+
+static void check_keys(eblob_backend *b, const std::vector<eblob_key> &keys, size_t removed) {
+	eblob_write_control wc;
+
+	for (size_t i = 0; i < keys.size(); ++i) {
+		auto key = keys[i];
+		BOOST_REQUIRE_EQUAL(eblob_read_return(b, &key, EBLOB_READ_CSUM, &wc), i < removed ? -ENOENT : 0);
+	}
+
+	auto missing = hash("missing");
+	BOOST_REQUIRE_EQUAL(eblob_read_return(b, &missing, EBLOB_READ_NOCSUM, &wc), -ENOENT);
+	BOOST_REQUIRE_EQUAL(eblob_stat_get(b->stat_summary, EBLOB_LST_RECORDS_REMOVED), removed);
+}
+
+static void test_index_meta(uint64_t blob_flags) {
+	eblob_wrapper wrapper(index_meta_config(blob_flags));
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	constexpr char data[] = "some data";
+	std::vector<eblob_key> keys;
+	for (size_t i = 0; i < 350; ++i) {
+		keys.push_back(hash("key-" + std::to_string(i)));
+		BOOST_REQUIRE_EQUAL(eblob_write(wrapper.get(), &keys.back(), (void *)data, 0, sizeof(data), 0), 0);
+	}
+
+	/* closed bases are sorted and their meta is written */
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+	BOOST_REQUIRE(boost::filesystem::exists(wrapper.path(0, ".index.meta")));
+	check_sorted(wrapper.get(), 3, 0);
+	check_keys(wrapper.get(), keys, 0);
+
+	/* meta is used on startup and counters of removes made since it was written are kept */
+	for (size_t i = 0; i < 10; ++i)
+		BOOST_REQUIRE_EQUAL(eblob_remove(wrapper.get(), &keys[i]), 0);
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+	check_sorted(wrapper.get(), 3, 3);
+	check_keys(wrapper.get(), keys, 10);
+
+	/* corrupted meta is rebuilt from sorted index */
+	wrapper.stop();
+	const auto meta_path = wrapper.path(0, ".index.meta");
+	const auto size = boost::filesystem::file_size(meta_path);
+	{
+		FILE *f = fopen(meta_path.c_str(), "r+");
+		BOOST_REQUIRE(f != nullptr);
+		fseek(f, size - 1, SEEK_SET);
+		const int c = fgetc(f);
+		fseek(f, size - 1, SEEK_SET);
+		fputc(c ^ 0xff, f);
+		fclose(f);
+	}
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+	check_sorted(wrapper.get(), 3, 2);
+	check_keys(wrapper.get(), keys, 10);
+
+	/* meta of sorted index changed after it was written (i.e. after crash) is rebuilt */
+	eblob_base_ctl *bctl = list_first_entry(&wrapper.get()->bases, eblob_base_ctl, base_entry);
+	BOOST_REQUIRE_EQUAL(eblob_remove(wrapper.get(), &keys[10]), 0);
+	bctl->meta_csum = 0;
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+	check_sorted(wrapper.get(), 3, 2);
+	check_keys(wrapper.get(), keys, 11);
+
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+	check_sorted(wrapper.get(), 3, 3);
+	check_keys(wrapper.get(), keys, 11);
+
+	/* meta left unfinished by crash before rename is removed on startup and not taken for a base */
+	wrapper.stop();
+	const auto tmp_path = wrapper.path(1, ".index.meta.tmp");
+	{
+		FILE *f = fopen(tmp_path.c_str(), "w");
+		BOOST_REQUIRE(f != nullptr);
+		fputs("garbage", f);
+		fclose(f);
+	}
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+	BOOST_REQUIRE(!boost::filesystem::exists(tmp_path));
+	check_sorted(wrapper.get(), 3, 3);
+	check_keys(wrapper.get(), keys, 11);
+}
+
+BOOST_AUTO_TEST_CASE(test_index_meta_indexsort) {
+	/* bases are sorted when they are closed */
+	test_index_meta(EBLOB_DISABLE_THREADS | EBLOB_AUTO_INDEXSORT);
+}
+
+BOOST_AUTO_TEST_CASE(test_index_meta_parallel_load) {
+	/* bases are sorted and loaded on startup by loader threads */
+	test_index_meta(0);
+}
+
+BOOST_AUTO_TEST_CASE(test_index_meta_locator) {
+	eblob_wrapper wrapper(index_meta_config(EBLOB_KEY_LOCATOR));
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	constexpr char data[] = "some data";
+	std::vector<eblob_key> keys;
+	for (size_t i = 0; i < 350; ++i) {
+		keys.push_back(hash("key-" + std::to_string(i)));
+		BOOST_REQUIRE_EQUAL(eblob_write(wrapper.get(), &keys.back(), (void *)data, 0, sizeof(data), 0), 0);
+	}
+
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+	check_sorted(wrapper.get(), 3, 0);
+	BOOST_REQUIRE_EQUAL(wrapper.get()->locator.num, 300);
+	check_keys(wrapper.get(), keys, 0);
+
+	/*
+	 * Locator is filled from hashes kept in meta without reading sorted
+	 * index, so it still has entries of keys removed after meta was written
+	 */
+	for (size_t i = 0; i < 10; ++i)
+		BOOST_REQUIRE_EQUAL(eblob_remove(wrapper.get(), &keys[i]), 0);
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+	check_sorted(wrapper.get(), 3, 3);
+	BOOST_REQUIRE_EQUAL(wrapper.get()->locator.num, 300);
+	check_keys(wrapper.get(), keys, 10);
+
+	/* rebuilt meta takes hashes of live keys from sorted index */
+	wrapper.stop();
+	boost::filesystem::remove(wrapper.path(0, ".index.meta"));
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+	check_sorted(wrapper.get(), 3, 2);
+	BOOST_REQUIRE_EQUAL(wrapper.get()->locator.num, 290);
+	check_keys(wrapper.get(), keys, 10);
+}
@@ -0,0 +1,308 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE ITERATE library test
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "library/blob.h"
+#include "library/footer.h"
+#include "library/crypto/sha512.h"
+
+#include "eblob/eblob.hpp"
+
+#include "eblob_wrapper.hpp"
+
+/* Bases of 100 records with index blocks of 10 records and @blob_flags */
+static eblob_wrapper::tune_t iterate_config(uint64_t blob_flags = EBLOB_DISABLE_THREADS) {
+	return [=](eblob_config &config) {
+		config.blob_flags = blob_flags;
+		config.records_in_blob = 100;
+		config.index_block_size = 10;
+	};
+}
+
+struct key_less {
+	bool operator()(const eblob_key &lhs, const eblob_key &rhs) const {
+		return eblob_id_cmp(lhs.id, rhs.id) < 0;
+	}
+};
+
+/* Keys seen by all iteration threads, filled by iterator_free in main thread */
+struct iterate_result {
+	std::map<eblob_key, size_t, key_less> keys;
+	size_t threads = 0;
+};
+
+static int iterate_init(eblob_iterate_control *, void **thread_priv) {
+	*thread_priv = new std::vector<eblob_key>;
+	return 0;
+}
+
+static int iterate_callback(eblob_disk_control *dc, eblob_ram_control *, int, uint64_t, void *, void *thread_priv) {
+	static_cast<std::vector<eblob_key> *>(thread_priv)->push_back(dc->key);
+	return 0;
+}
+
+static int iterate_free(eblob_iterate_control *ctl, void **thread_priv) {
+	auto result = static_cast<iterate_result *>(ctl->priv);
+	auto keys = static_cast<std::vector<eblob_key> *>(*thread_priv);
+
+	for (const auto &key : *keys)
+		result->keys[key]++;
+	result->threads++;
+	delete keys;
+	return 0;
+}
+
+static iterate_result iterate(eblob_backend *b, int thread_num, eblob_index_block *range, int range_num,
+		unsigned int flags = 0) {
+	iterate_result result;
+	eblob_iterate_control ctl;
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.b = b;
+	ctl.log = b->cfg.log;
+	ctl.flags = EBLOB_ITERATE_FLAGS_ALL | EBLOB_ITERATE_FLAGS_READONLY | flags;
+	ctl.thread_num = thread_num;
+	ctl.iterator_cb.iterator = iterate_callback;
+	ctl.iterator_cb.iterator_init = iterate_init;
+	ctl.iterator_cb.iterator_free = iterate_free;
+	ctl.priv = &result;
+	ctl.range = range;
+	ctl.range_num = range_num;
+
+	BOOST_REQUIRE_EQUAL(eblob_iterate(b, &ctl), 0);
+	return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_iterate_threads) {
+	eblob_wrapper wrapper(iterate_config());
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	constexpr char data[] = "some data";
+	std::vector<eblob_key> keys;
+	for (size_t i = 0; i < 350; ++i) {
+		keys.push_back(hash("key-" + std::to_string(i)));
+		BOOST_REQUIRE_EQUAL(eblob_write(wrapper.get(), &keys.back(), (void *)data, 0, sizeof(data), 0), 0);
+	}
+	for (size_t i = 0; i < 20; ++i)
+		BOOST_REQUIRE_EQUAL(eblob_remove(wrapper.get(), &keys[i]), 0);
+
+	/* closed bases are sorted on startup, the last one stays unsorted */
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	size_t bases = 0;
+	eblob_base_ctl *bctl;
+	list_for_each_entry(bctl, &wrapper.get()->bases, base_entry)
+		++bases;
+
+	for (int thread_num : {0, 1, 3, 16}) {
+		/* data of records is prefetched and checked by some of runs */
+		const auto result = iterate(wrapper.get(), thread_num, nullptr, 0, (thread_num % 2) ?
+				EBLOB_ITERATE_FLAGS_PREFETCH_DATA | EBLOB_ITERATE_FLAGS_VERIFY_CHECKSUM : 0);
+
+		BOOST_REQUIRE_EQUAL(result.threads, bases * std::max(thread_num, 1));
+		BOOST_REQUIRE_EQUAL(result.keys.size(), keys.size() - 20);
+		for (size_t i = 20; i < keys.size(); ++i) {
+			auto it = result.keys.find(keys[i]);
+			BOOST_REQUIRE(it != result.keys.end());
+			BOOST_REQUIRE_EQUAL(it->second, 1);
+		}
+	}
+
+	/* threads share ranges and do not iterate keys outside of them */
+	std::vector<eblob_key> sorted(keys.begin() + 20, keys.end());
+	std::sort(sorted.begin(), sorted.end(), key_less());
+	eblob_index_block ranges[2];
+	memset(ranges, 0, sizeof(ranges));
+	ranges[0].start_key = sorted[10];
+	ranges[0].end_key = sorted[100];
+	ranges[1].start_key = sorted[200];
+	ranges[1].end_key = sorted[210];
+
+	for (int thread_num : {1, 4}) {
+		const auto result = iterate(wrapper.get(), thread_num, ranges, 2);
+
+		BOOST_REQUIRE_EQUAL(result.keys.size(), 91 + 11);
+		for (const auto &it : result.keys) {
+			BOOST_REQUIRE_EQUAL(it.second, 1);
+			const bool in_first = eblob_id_cmp(it.first.id, sorted[10].id) >= 0 &&
+				eblob_id_cmp(it.first.id, sorted[100].id) <= 0;
+			const bool in_second = eblob_id_cmp(it.first.id, sorted[200].id) >= 0 &&
+				eblob_id_cmp(it.first.id, sorted[210].id) <= 0;
+			BOOST_REQUIRE(in_first || in_second);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_iterate_verify_checksum) {
+	/* checksums are verified by worker threads of verification stage, records span several batches */
+	eblob_wrapper wrapper(iterate_config(0));
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	std::vector<eblob_key> keys;
+	for (size_t i = 0; i < 2500; ++i) {
+		/* some records have several checksum chunks */
+		const std::string data((i % 500) ? 100 + i : 2 * EBLOB_ITERATE_VERIFY_BUFFER + i, 'a' + i % 26);
+		keys.push_back(hash("key-" + std::to_string(i)));
+		BOOST_REQUIRE_EQUAL(eblob_write(wrapper.get(), &keys.back(), (void *)data.data(), 0, data.size(), 0), 0);
+	}
+
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	const std::vector<size_t> corrupted = {3, 500, 1150, 1249, 2499};
+	for (size_t i : corrupted) {
+		eblob_write_control wc;
+		BOOST_REQUIRE_EQUAL(eblob_read_return(wrapper.get(), &keys[i], EBLOB_READ_NOCSUM, &wc), 0);
+		BOOST_REQUIRE_EQUAL(__eblob_write_ll(wc.data_fd, "-", 1, wc.data_offset + wc.total_data_size - 1), 0);
+	}
+
+	for (int thread_num : {1, 3}) {
+		const auto result = iterate(wrapper.get(), thread_num, nullptr, 0, EBLOB_ITERATE_FLAGS_VERIFY_CHECKSUM);
+
+		BOOST_REQUIRE_EQUAL(result.keys.size(), keys.size() - corrupted.size());
+		for (size_t i = 0; i < keys.size(); ++i) {
+			const bool is_corrupted = std::find(corrupted.begin(), corrupted.end(), i) != corrupted.end();
+			BOOST_REQUIRE_EQUAL(result.keys.count(keys[i]), is_corrupted ? 0 : 1);
+		}
+		BOOST_REQUIRE_EQUAL(eblob_stat_get(wrapper.get()->stat_summary, EBLOB_LST_RECORDS_CORRUPTED),
+				corrupted.size());
+	}
+}
+
+/* Data and positions seen by data-order iteration */
+struct data_order_result {
+	std::map<eblob_key, std::string, key_less> data;
+	std::map<eblob_base_ctl *, uint64_t> last_position;
+	size_t unordered = 0;
+};
+
+static void data_order_add(data_order_result *result, eblob_disk_control *dc, eblob_ram_control *rctl,
+		std::string data) {
+	result->data[dc->key] = std::move(data);
+
+	auto it = result->last_position.find(rctl->bctl);
+	if (it != result->last_position.end() && it->second >= dc->position)
+		result->unordered++;
+	result->last_position[rctl->bctl] = dc->position;
+}
+
+static int iterate_data_callback(eblob_disk_control *dc, eblob_ram_control *rctl, const void *data, uint64_t size,
+		void *priv, void *) {
+	BOOST_REQUIRE(size >= dc->data_size);
+	BOOST_REQUIRE(dc->disk_size <= EBLOB_ITERATE_DATA_WINDOW);
+	data_order_add(static_cast<data_order_result *>(priv), dc, rctl,
+			std::string(static_cast<const char *>(data), dc->data_size));
+	return 0;
+}
+
+/* Called by data-order iteration for records that do not fit into its read window */
+static int iterate_data_fd_callback(eblob_disk_control *dc, eblob_ram_control *rctl, int fd, uint64_t offset,
+		void *priv, void *) {
+	std::string data(dc->data_size, '\0');
+
+	BOOST_REQUIRE(dc->disk_size > EBLOB_ITERATE_DATA_WINDOW);
+	BOOST_REQUIRE_EQUAL(__eblob_read_ll(fd, &data.front(), data.size(), offset), 0);
+	data_order_add(static_cast<data_order_result *>(priv), dc, rctl, std::move(data));
+	return 0;
+}
+
+BOOST_AUTO_TEST_CASE(test_iterate_data_order) {
+	eblob_wrapper wrapper(iterate_config());
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	/* one record does not fit into read window */
+	std::vector<eblob_key> keys;
+	std::vector<std::string> values;
+	for (size_t i = 0; i < 250; ++i) {
+		const size_t size = (i == 150) ? EBLOB_ITERATE_DATA_WINDOW + 100 : 100 + i * 37;
+		keys.push_back(hash("key-" + std::to_string(i)));
+		values.emplace_back(size, 'a' + i % 26);
+		BOOST_REQUIRE_EQUAL(eblob_write(wrapper.get(), &keys.back(), (void *)values.back().data(), 0,
+					values.back().size(), 0), 0);
+	}
+	for (size_t i = 0; i < 10; ++i)
+		BOOST_REQUIRE_EQUAL(eblob_remove(wrapper.get(), &keys[i]), 0);
+
+	/* sorted bases have index in key order, the last unsorted one - in data order */
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	data_order_result result;
+	eblob_iterate_control ctl;
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.b = wrapper.get();
+	ctl.log = wrapper.get()->cfg.log;
+	ctl.flags = EBLOB_ITERATE_FLAGS_ALL | EBLOB_ITERATE_FLAGS_READONLY | EBLOB_ITERATE_FLAGS_DATA_ORDER;
+	ctl.iterator_cb.iterator = iterate_data_fd_callback;
+	ctl.iterator_cb.iterator_data = iterate_data_callback;
+	ctl.priv = &result;
+	BOOST_REQUIRE_EQUAL(eblob_iterate(wrapper.get(), &ctl), 0);
+
+	BOOST_REQUIRE_EQUAL(result.unordered, 0);
+	BOOST_REQUIRE_EQUAL(result.data.size(), keys.size() - 10);
+	for (size_t i = 10; i < keys.size(); ++i) {
+		auto it = result.data.find(keys[i]);
+		BOOST_REQUIRE(it != result.data.end());
+		BOOST_REQUIRE(it->second == values[i]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_iterate_data_order_verify_checksum) {
+	/* checksums are verified from read window, records with broken data are skipped */
+	eblob_wrapper wrapper(iterate_config());
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	std::vector<eblob_key> keys;
+	std::vector<std::string> values;
+	for (size_t i = 0; i < 250; ++i) {
+		/* some records have several checksum chunks, one of them does not fit into read window */
+		size_t size = (i % 50) ? 100 + i : 2 * EBLOB_CSUM_CHUNK_SIZE + i;
+		if (i == 120)
+			size = EBLOB_ITERATE_DATA_WINDOW + 100;
+		keys.push_back(hash("key-" + std::to_string(i)));
+		values.emplace_back(size, 'a' + i % 26);
+		BOOST_REQUIRE_EQUAL(eblob_write(wrapper.get(), &keys.back(), (void *)values.back().data(), 0,
+					values.back().size(), 0), 0);
+	}
+
+	wrapper.restart();
+	BOOST_REQUIRE(wrapper.get() != nullptr);
+
+	const std::vector<size_t> corrupted = {3, 50, 120, 150, 249};
+	for (size_t i : corrupted) {
+		eblob_write_control wc;
+		BOOST_REQUIRE_EQUAL(eblob_read_return(wrapper.get(), &keys[i], EBLOB_READ_NOCSUM, &wc), 0);
+		BOOST_REQUIRE_EQUAL(__eblob_write_ll(wc.data_fd, "-", 1, wc.data_offset + wc.total_data_size - 1), 0);
+	}
+
+	data_order_result result;
+	eblob_iterate_control ctl;
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.b = wrapper.get();
+	ctl.log = wrapper.get()->cfg.log;
+	ctl.flags = EBLOB_ITERATE_FLAGS_ALL | EBLOB_ITERATE_FLAGS_READONLY | EBLOB_ITERATE_FLAGS_DATA_ORDER |
+		EBLOB_ITERATE_FLAGS_VERIFY_CHECKSUM;
+	ctl.iterator_cb.iterator = iterate_data_fd_callback;
+	ctl.iterator_cb.iterator_data = iterate_data_callback;
+	ctl.priv = &result;
+	BOOST_REQUIRE_EQUAL(eblob_iterate(wrapper.get(), &ctl), 0);
+
+	BOOST_REQUIRE_EQUAL(result.unordered, 0);
+	BOOST_REQUIRE_EQUAL(result.data.size(), keys.size() - corrupted.size());
+	for (size_t i = 0; i < keys.size(); ++i) {
+		const bool is_corrupted = std::find(corrupted.begin(), corrupted.end(), i) != corrupted.end();
+		auto it = result.data.find(keys[i]);
+		BOOST_REQUIRE_EQUAL(it == result.data.end(), is_corrupted);
+		if (!is_corrupted)
+			BOOST_REQUIRE(it->second == values[i]);
+	}
+	BOOST_REQUIRE_EQUAL(eblob_stat_get(wrapper.get()->stat_summary, EBLOB_LST_RECORDS_CORRUPTED),
+			corrupted.size());
+}
@@ -0,0 +1,234 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE LOCATOR library test
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "library/blob.h"
+#include "library/crypto/sha512.h"
+
+#include "eblob/eblob.hpp"
+
+#include "eblob_wrapper.hpp"
+
+/* Backend with locator and bases of @records_in_blob records */
+static eblob_wrapper::tune_t locator_config(uint64_t records_in_blob = EBLOB_BLOB_DEFAULT_RECORDS_IN_BLOB) {
+	return [=](eblob_config &config) {
+		config.blob_flags = EBLOB_KEY_LOCATOR | EBLOB_NO_FREE_SPACE_CHECK;
+		config.records_in_blob = records_in_blob;
+	};
+}
+
+/* Sorted base that exists only as its index map */
+class fake_base {
+public:
+	explicit fake_base(int index)
+	: bctl_{static_cast<eblob_base_ctl *>(calloc(1, sizeof(eblob_base_ctl))), &free} {
+		BOOST_REQUIRE(bctl_ != nullptr);
+		bctl_->index = index;
+	}
+
+	/* Replaces index of the base by @keys, @removed ones are marked removed */
+	void set(const std::vector<std::string> &keys, const std::vector<std::string> &removed = {}) {
+		index_.clear();
+		for (const auto &key : keys) {
+			eblob_disk_control dc;
+			memset(&dc, 0, sizeof(dc));
+			dc.key = hash(key);
+			if (std::find(removed.begin(), removed.end(), key) != removed.end())
+				dc.flags = eblob_bswap64(BLOB_DISK_CTL_REMOVE);
+			index_.push_back(dc);
+		}
+		bctl_->index_map = index_.data();
+		bctl_->index_map_size = index_.size() * sizeof(eblob_disk_control);
+	}
+
+	eblob_base_ctl *get() { return bctl_.get(); }
+
+private:
+	std::unique_ptr<eblob_base_ctl, decltype(&free)> bctl_;
+	std::vector<eblob_disk_control> index_;
+};
+
+/* Returns low bits of indexes of bases locator returns for @key */
+static std::vector<unsigned int> lookup(eblob_backend *b, const std::string &key) {
+	unsigned int bases[EBLOB_LOCATOR_MAX_BASES];
+	const eblob_key ekey = hash(key);
+	const int num = eblob_locator_lookup(b, &ekey, bases);
+	BOOST_REQUIRE_GE(num, 0);
+	std::vector<unsigned int> ret(bases, bases + num);
+	std::sort(ret.begin(), ret.end());
+	return ret;
+}
+
+using bases = std::vector<unsigned int>;
+
+BOOST_AUTO_TEST_CASE(test_locator_resort_and_remove) {
+	eblob_wrapper wrapper(locator_config());
+	eblob_backend *b = wrapper.get();
+
+	fake_base first(1), second(2);
+	first.set({"a", "b", "c"}, {"c"});
+	second.set({"b", "d"});
+	eblob_locator_add_base(b, first.get(), nullptr, 0);
+	eblob_locator_add_base(b, second.get(), nullptr, 0);
+
+	BOOST_REQUIRE(lookup(b, "a") == bases({1}));
+	BOOST_REQUIRE(lookup(b, "b") == bases({1, 2}));
+	BOOST_REQUIRE(lookup(b, "c") == bases());
+	BOOST_REQUIRE(lookup(b, "d") == bases({2}));
+	BOOST_REQUIRE(lookup(b, "missing") == bases());
+
+	/* re-sorted base replaces its old entries */
+	first.set({"b", "e"});
+	eblob_locator_add_base(b, first.get(), nullptr, 0);
+	BOOST_REQUIRE(lookup(b, "a") == bases());
+	BOOST_REQUIRE(lookup(b, "b") == bases({1, 2}));
+	BOOST_REQUIRE(lookup(b, "e") == bases({1}));
+
+	/* entries of removed base are dropped, others are kept */
+	eblob_locator_remove_base(b, second.get());
+	BOOST_REQUIRE(lookup(b, "b") == bases({1}));
+	BOOST_REQUIRE(lookup(b, "d") == bases());
+	BOOST_REQUIRE(lookup(b, "e") == bases({1}));
+	BOOST_REQUIRE_EQUAL(b->locator.num, 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_locator_aliasing_bases) {
+	eblob_wrapper wrapper(locator_config());
+	eblob_backend *b = wrapper.get();
+
+	/* indexes of these bases are equal in low bits kept by locator */
+	const int index = 5;
+	fake_base first(index), second(index + (1 << EBLOB_LOCATOR_BASE_BITS));
+	first.set({"a", "b"});
+	second.set({"c"});
+	eblob_locator_add_base(b, first.get(), nullptr, 0);
+	eblob_locator_add_base(b, second.get(), nullptr, 0);
+
+	BOOST_REQUIRE(lookup(b, "a") == bases({index}));
+	BOOST_REQUIRE(lookup(b, "c") == bases({index}));
+
+	/* neither re-sort nor removal of one base drops keys of the other one */
+	second.set({"d"});
+	eblob_locator_add_base(b, second.get(), nullptr, 0);
+	BOOST_REQUIRE(lookup(b, "a") == bases({index}));
+	BOOST_REQUIRE(lookup(b, "b") == bases({index}));
+	BOOST_REQUIRE(lookup(b, "d") == bases({index}));
+
+	first.set({"b"});
+	eblob_locator_add_base(b, first.get(), nullptr, 0);
+	BOOST_REQUIRE(lookup(b, "b") == bases({index}));
+	BOOST_REQUIRE(lookup(b, "d") == bases({index}));
+
+	eblob_locator_remove_base(b, first.get());
+	BOOST_REQUIRE(lookup(b, "d") == bases({index}));
+	eblob_locator_remove_base(b, second.get());
+	BOOST_REQUIRE(lookup(b, "b") == bases({index}));
+	BOOST_REQUIRE(lookup(b, "missing") == bases());
+}
+
+BOOST_AUTO_TEST_CASE(test_locator_hashes) {
+	eblob_wrapper wrapper(locator_config());
+	eblob_backend *b = wrapper.get();
+
+	/* base added by hashes of its keys is the same as added by its index */
+	fake_base first(1);
+	std::vector<uint64_t> hashes;
+	for (const auto &key : {"a", "b"}) {
+		const eblob_key ekey = hash(key);
+		hashes.push_back(eblob_locator_hash(&ekey));
+	}
+	eblob_locator_add_base(b, first.get(), hashes.data(), hashes.size());
+	BOOST_REQUIRE(lookup(b, "a") == bases({1}));
+	BOOST_REQUIRE(lookup(b, "b") == bases({1}));
+	BOOST_REQUIRE(lookup(b, "missing") == bases());
+	BOOST_REQUIRE_EQUAL(b->locator.num, 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_locator_index_sort) {
+	/* keys of bases being sorted are found by concurrent reads, writes and removes go on */
+	eblob_wrapper wrapper(locator_config(100));
+	eblob_backend *b = wrapper.get();
+
+	std::vector<eblob_key> keys;
+	std::vector<std::string> values;
+	for (size_t i = 0; i < 1000; ++i) {
+		keys.push_back(hash("key-" + std::to_string(i)));
+		values.emplace_back(i % 50 + 1, 'a' + i % 26);
+		BOOST_REQUIRE_EQUAL(eblob_write(b, &keys.back(), (void *)values.back().data(), 0,
+					values.back().size(), 0), 0);
+	}
+
+	/* keys of the last 100 records are removed by writer, readers check the rest ones */
+	const size_t checked = 900;
+	std::atomic<bool> stop{false};
+	std::atomic<size_t> removed{0};
+	std::atomic<int> failed_reads{0}, failed_writes{0};
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < 3; ++t) {
+		threads.emplace_back([&, t]() {
+			for (size_t i = t; !stop; i = (i + 7) % checked) {
+				char *data = nullptr;
+				uint64_t size = 0;
+				if (eblob_read_data(b, &keys[i], 0, &data, &size) != 0 ||
+				    std::string(data, size) != values[i])
+					++failed_reads;
+				free(data);
+			}
+		});
+	}
+	threads.emplace_back([&]() {
+		for (size_t i = 0; !stop; ++i) {
+			eblob_key key = hash("new-key-" + std::to_string(i));
+			const std::string value = "new-value-" + std::to_string(i);
+			if (eblob_write(b, &key, (void *)value.data(), 0, value.size(), 0) != 0)
+				++failed_writes;
+			if (checked + i < keys.size()) {
+				if (eblob_remove(b, &keys[checked + i]) != 0)
+					++failed_writes;
+				++removed;
+			}
+		}
+	});
+
+	b->want_defrag = EBLOB_DEFRAG_STATE_INDEX_SORT;
+	const int err = eblob_defrag(b);
+	b->want_defrag = EBLOB_DEFRAG_STATE_NOT_STARTED;
+
+	/* let removes of the last keys finish */
+	while (removed < keys.size() - checked)
+		std::this_thread::yield();
+	stop = true;
+	for (auto &t : threads)
+		t.join();
+
+	BOOST_REQUIRE_EQUAL(err, 0);
+	BOOST_REQUIRE_EQUAL(failed_reads, 0);
+	BOOST_REQUIRE_EQUAL(failed_writes, 0);
+
+	size_t sorted = 0;
+	eblob_base_ctl *bctl;
+	list_for_each_entry(bctl, &b->bases, base_entry)
+		sorted += bctl->index_ctl.sorted;
+	BOOST_REQUIRE_GE(sorted, 9);
+
+	for (size_t i = 0; i < keys.size(); ++i) {
+		char *data = nullptr;
+		uint64_t size = 0;
+		const int read_err = eblob_read_data(b, &keys[i], 0, &data, &size);
+		if (i >= checked) {
+			BOOST_REQUIRE_EQUAL(read_err, -ENOENT);
+			continue;
+		}
+		BOOST_REQUIRE_EQUAL(read_err, 0);
+		BOOST_REQUIRE_EQUAL(std::string(data, size), values[i]);
+		free(data);
+	}
+}
@@ -0,0 +1,94 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE RADIX SORT library test
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "library/blob.h"
+#include "library/crypto/sha512.h"
+
+#include "eblob_wrapper.hpp"
+
+/* Sorts first @num of @dcs by radix sort and checks result against @cmp */
+static void check_radix_sort(const std::vector<eblob_disk_control> &dcs, size_t num,
+                             int (*cmp)(const void *, const void *), unsigned int threads) {
+	std::vector<eblob_disk_control> sorted(dcs.begin(), dcs.begin() + num);
+	BOOST_REQUIRE_EQUAL(eblob_disk_control_radix_sort(sorted.data(), num, cmp, threads), 0);
+
+	for (size_t i = 1; i < num; ++i)
+		BOOST_REQUIRE(cmp(&sorted[i - 1], &sorted[i]) <= 0);
+
+	/* every header is kept */
+	std::vector<uint64_t> positions;
+	for (const auto &dc : sorted)
+		positions.push_back(dc.position);
+	std::sort(positions.begin(), positions.end());
+	for (size_t i = 0; i < num; ++i)
+		BOOST_REQUIRE_EQUAL(positions[i], i);
+
+	/* headers equal for comparator keep their order (short arrays are sorted by qsort) */
+	for (size_t i = 1; num > 1000 && i < num; ++i) {
+		if (cmp(&sorted[i - 1], &sorted[i]) == 0)
+			BOOST_REQUIRE(sorted[i - 1].position < sorted[i].position);
+	}
+}
+
+/* Checks radix sort of all of @dcs and of its prefixes of @nums headers */
+static void check_radix_sort_all(const std::vector<eblob_disk_control> &dcs, const std::vector<size_t> &nums) {
+	for (auto cmp : {eblob_disk_control_sort, eblob_disk_control_sort_with_flags}) {
+		for (size_t num : nums) {
+			check_radix_sort(dcs, num, cmp, 1);
+			check_radix_sort(dcs, num, cmp, 4);
+		}
+	}
+}
+
+/* Headers of @num keys given by @key_of, every 5th one is removed */
+template <typename KeyOf>
+static std::vector<eblob_disk_control> make_headers(size_t num, KeyOf key_of) {
+	std::vector<eblob_disk_control> dcs(num);
+	for (size_t i = 0; i < dcs.size(); ++i) {
+		memset(&dcs[i], 0, sizeof(dcs[i]));
+		dcs[i].key = key_of(i);
+		dcs[i].flags = (i % 5 == 0) ? BLOB_DISK_CTL_REMOVE : 0;
+		dcs[i].position = i;
+	}
+	return dcs;
+}
+
+BOOST_AUTO_TEST_CASE(test_disk_control_radix_sort) {
+	/* radix sort orders headers as qsort does, including equal prefixes, keys and flags */
+	const auto dcs = make_headers(20000, [](size_t i) {
+		eblob_key key = hash("key-" + std::to_string(i % 12000));
+		if (i % 7 == 0)
+			key.id[EBLOB_ID_SIZE - 1] ^= 1;
+		if (i % 11 == 0)
+			memset(key.id, 0, 8);
+		return key;
+	});
+
+	check_radix_sort_all(dcs, {0, 100, 5000, dcs.size()});
+}
+
+BOOST_AUTO_TEST_CASE(test_disk_control_radix_sort_duplicates) {
+	/* many duplicates of a few keys are sorted in O(n log n) and keep their order */
+	const auto dcs = make_headers(200000, [](size_t i) {
+		return hash("key-" + std::to_string(i % 3));
+	});
+
+	check_radix_sort_all(dcs, {300, 5000, dcs.size()});
+}
+
+BOOST_AUTO_TEST_CASE(test_disk_control_radix_sort_shared_prefix) {
+	/* keys that share their first 8 bytes are ordered by the rest of the key */
+	const auto dcs = make_headers(200000, [](size_t i) {
+		eblob_key key = hash("key-" + std::to_string(i % 150000));
+		/* a few groups of keys in different buckets, each group has the same prefix */
+		memset(key.id, (i % 4) * 0x40, 8);
+		return key;
+	});
+
+	check_radix_sort_all(dcs, {300, 5000, dcs.size()});
+}
@@ -0,0 +1,186 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE URING library test
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "library/blob.h"
+#include "library/uring.h"
+#include "library/crypto/sha512.h"
+
+#include "eblob/eblob.hpp"
+
+#include "eblob_wrapper.hpp"
+
+class temp_dir {
+public:
+	temp_dir()
+	: template_("/tmp/eblob-test-XXXXXX")
+	, path_{mkdtemp(&template_.front())} {
+	}
+
+	~temp_dir() {
+		boost::filesystem::remove_all(path_);
+	}
+
+	const std::string &path() const { return path_; }
+
+private:
+	std::string template_;
+	const std::string path_;
+};
+
+static std::string read_file(const std::string &path) {
+	std::string ret(boost::filesystem::file_size(path), '\0');
+	const int fd = open(path.c_str(), O_RDONLY);
+	BOOST_REQUIRE(fd >= 0);
+	BOOST_REQUIRE_EQUAL(__eblob_read_ll(fd, &ret.front(), ret.size(), 0), 0);
+	close(fd);
+	return ret;
+}
+
+/* Writes @num chunks of @chunk_size bytes to @path by @calls submissions, checks file contents */
+static void check_submit(const std::string &path, size_t num, size_t chunk_size, size_t calls) {
+	const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	BOOST_REQUIRE(fd >= 0);
+
+	std::string expected;
+	std::vector<std::string> chunks;
+	for (size_t i = 0; i < num; ++i) {
+		chunks.push_back(std::string(chunk_size, 'a' + i % 26));
+		expected += chunks.back();
+	}
+
+	/* chunks are submitted in reverse order, each one goes to its own place */
+	std::vector<eblob_io_op> ops;
+	for (size_t i = num; i-- > 0;)
+		ops.push_back(eblob_io_op{fd, chunks[i].data(), chunk_size, off_t(i * chunk_size)});
+
+	const size_t per_call = (num + calls - 1) / calls;
+	for (size_t pos = 0; pos < num; pos += per_call)
+		eblob_write_submit(ops.data() + pos, std::min(per_call, num - pos));
+	BOOST_REQUIRE_EQUAL(eblob_write_reap(), 0);
+	close(fd);
+
+	BOOST_REQUIRE(read_file(path) == expected);
+}
+
+BOOST_AUTO_TEST_CASE(test_write_submit) {
+	/* more writes than fit into the ring at once, submitted by one and by many calls */
+	temp_dir dir;
+	for (size_t num : {size_t(1), size_t(EBLOB_URING_ENTRIES), size_t(5 * EBLOB_URING_ENTRIES + 3)}) {
+		check_submit(dir.path() + "/file", num, 4096, 1);
+		check_submit(dir.path() + "/file", num, 100, num);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_write_submit_threads) {
+	/* every thread has its own writes in flight */
+	temp_dir dir;
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < 4; ++i) {
+		threads.emplace_back([&dir, i]() {
+			for (size_t j = 0; j < 10; ++j)
+				check_submit(dir.path() + "/file-" + std::to_string(i), 3 * EBLOB_URING_ENTRIES, 512, 7);
+		});
+	}
+	for (auto &t : threads)
+		t.join();
+}
+
+BOOST_AUTO_TEST_CASE(test_write_reap_error) {
+	/* error of a write in flight is returned by reap once, other writes are completed */
+	temp_dir dir;
+	const std::string path = dir.path() + "/file";
+	const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	BOOST_REQUIRE(fd >= 0);
+	const int rdonly = open(path.c_str(), O_RDONLY);
+	BOOST_REQUIRE(rdonly >= 0);
+
+	const std::string data(1024, 'x');
+	std::vector<eblob_io_op> ops;
+	for (size_t i = 0; i < 10; ++i)
+		ops.push_back(eblob_io_op{i == 5 ? rdonly : fd, data.data(), data.size(), off_t(i * data.size())});
+
+	eblob_write_submit(ops.data(), ops.size());
+	BOOST_REQUIRE_EQUAL(eblob_write_reap(), -EBADF);
+	BOOST_REQUIRE_EQUAL(eblob_write_reap(), 0);
+	BOOST_REQUIRE_EQUAL(boost::filesystem::file_size(path), ops.size() * data.size());
+
+	BOOST_REQUIRE_EQUAL(eblob_write_chain(ops.data(), 1), 0);
+	BOOST_REQUIRE_EQUAL(eblob_write_chain(ops.data() + 5, 1), -EBADF);
+
+	close(rdonly);
+	close(fd);
+}
+
+BOOST_AUTO_TEST_CASE(test_writev_many_chunks) {
+	/* record written by more chunks than fit into the ring is read back with checksum verification */
+	eblob_wrapper wrapper([](eblob_config &config) { config.blob_flags = EBLOB_NO_FREE_SPACE_CHECK; });
+	eblob_backend *b = wrapper.get();
+	BOOST_REQUIRE(b != nullptr);
+
+	for (size_t r = 0; r < 20; ++r) {
+		eblob_key key = hash("key-" + std::to_string(r));
+
+		std::vector<std::string> chunks;
+		std::vector<eblob_iovec> iov;
+		std::string expected;
+		for (size_t i = 0; i < EBLOB_IOVCNT_MAX; ++i) {
+			chunks.push_back(std::string(100 + r, 'a' + (i + r) % 26));
+			expected += chunks.back();
+		}
+		for (size_t i = 0, offset = 0; i < chunks.size(); offset += chunks[i].size(), ++i)
+			iov.push_back(eblob_iovec{&chunks[i].front(), chunks[i].size(), offset});
+
+		BOOST_REQUIRE_EQUAL(eblob_writev(b, &key, iov.data(), iov.size(), 0), 0);
+
+		char *data = nullptr;
+		uint64_t size = 0;
+		BOOST_REQUIRE_EQUAL(eblob_read_data(b, &key, 0, &data, &size), 0);
+		BOOST_REQUIRE(std::string(data, size) == expected);
+		free(data);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_writev_overlapping_chunks) {
+	/* overlapping chunks of one record are written in order, the last one wins */
+	eblob_wrapper wrapper([](eblob_config &config) { config.blob_flags = EBLOB_NO_FREE_SPACE_CHECK; });
+	eblob_backend *b = wrapper.get();
+	BOOST_REQUIRE(b != nullptr);
+
+	eblob_key key = hash("key");
+	const size_t num = EBLOB_IOVCNT_MAX - 1, step = 100;
+
+	/* every chunk covers the second half of the previous one */
+	std::vector<std::string> chunks;
+	std::string expected;
+	for (size_t i = 0; i < num; ++i) {
+		chunks.push_back(std::string(2 * step, 'a' + i % 26));
+		expected += chunks.back().substr(0, step);
+	}
+	expected += std::string(step, 'a' + (num - 1) % 26);
+	/* and the last one goes back over the middle of the record */
+	chunks.push_back(std::string(expected.size() / 2, 'Z'));
+	expected.replace(expected.size() / 4, chunks.back().size(), chunks.back());
+
+	std::vector<eblob_iovec> iov;
+	for (size_t i = 0; i < num; ++i)
+		iov.push_back(eblob_iovec{&chunks[i].front(), chunks[i].size(), i * step});
+	iov.push_back(eblob_iovec{&chunks.back().front(), chunks.back().size(), expected.size() / 4});
+
+	BOOST_REQUIRE_EQUAL(eblob_writev(b, &key, iov.data(), iov.size(), 0), 0);
+
+	char *data = nullptr;
+	uint64_t size = 0;
+	BOOST_REQUIRE_EQUAL(eblob_read_data(b, &key, 0, &data, &size), 0);
+	BOOST_REQUIRE(std::string(data, size) == expected);
+	free(data);
+}